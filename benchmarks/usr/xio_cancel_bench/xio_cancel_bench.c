@@ -0,0 +1,437 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "libxio.h"
+
+/*
+ * cancel stress benchmark: the client queues MSGS_NR outstanding requests
+ * on a single loopback connection, the server holds them without
+ * responding, and the client then cancels every CANCEL_EVERY-th request.
+ * measures the cost of issuing the cancels and of the full cancel round
+ * trip (request -> responder lookup -> cancel response).
+ */
+
+#define MSGS_NR			16384
+#define CANCEL_EVERY		10
+#define QUEUE_DEPTH		(MSGS_NR + 1024)
+
+enum bench_phase {
+	PHASE_FILL,
+	PHASE_CANCEL,
+	PHASE_DRAIN,
+	PHASE_DONE
+};
+
+/* benchmark private data - client and server share one context */
+struct bench_data {
+	struct xio_context	*ctx;
+	struct xio_connection	*conn;
+	struct xio_session	*session;
+	struct xio_connection	*srv_conn;
+	enum bench_phase	phase;
+	int			msgs_nr;
+	int			nrecv;		/* requests seen by server */
+	int			ncancel_req;	/* cancel requests at server */
+	int			ncanceled;	/* canceled at client */
+	int			ncancel_failed;
+	int			nrsp;		/* responses at client */
+	int			pad;
+	uint32_t		*idx;		/* request payloads */
+	struct xio_msg		*req;		/* client requests */
+	struct xio_msg		**held;		/* requests held at server */
+	struct xio_msg		*rsp;		/* server responses */
+};
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* req_index								     */
+/*---------------------------------------------------------------------------*/
+static inline int req_index(struct xio_msg *req)
+{
+	return *((uint32_t *)req->in.header.iov_base);
+}
+
+/*---------------------------------------------------------------------------*/
+/* check_phase_done							     */
+/*---------------------------------------------------------------------------*/
+static void check_phase_done(struct bench_data *bd)
+{
+	int ncancels = (bd->msgs_nr + CANCEL_EVERY - 1) / CANCEL_EVERY;
+
+	switch (bd->phase) {
+	case PHASE_FILL:
+		if (bd->nrecv == bd->msgs_nr)
+			xio_context_stop_loop(bd->ctx);
+		break;
+	case PHASE_CANCEL:
+		if (bd->ncanceled + bd->ncancel_failed == ncancels)
+			xio_context_stop_loop(bd->ctx);
+		break;
+	case PHASE_DRAIN:
+		if (bd->nrsp + bd->ncanceled == bd->msgs_nr)
+			xio_context_stop_loop(bd->ctx);
+		break;
+	default:
+		break;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_session_event							     */
+/*---------------------------------------------------------------------------*/
+static int on_session_event(struct xio_session *session,
+			    struct xio_session_event_data *event_data,
+			    void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_NEW_CONNECTION_EVENT:
+		bd->srv_conn = event_data->conn;
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		if (session == bd->session)
+			xio_context_stop_loop(bd->ctx);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "session event: %s. reason: %s\n",
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_new_session							     */
+/*---------------------------------------------------------------------------*/
+static int on_new_session(struct xio_session *session,
+			  struct xio_new_session_req *req,
+			  void *cb_user_context)
+{
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_request - server holds the request until the drain phase		     */
+/*---------------------------------------------------------------------------*/
+static int on_request(struct xio_session *session,
+		      struct xio_msg *req,
+		      int last_in_rxq,
+		      void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	bd->held[req_index(req)] = req;
+	bd->nrecv++;
+	check_phase_done(bd);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_cancel_request - server side					     */
+/*---------------------------------------------------------------------------*/
+static int on_cancel_request(struct xio_session *session,
+			     struct xio_msg *req,
+			     void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	bd->held[req_index(req)] = NULL;
+	bd->ncancel_req++;
+	xio_cancel(req, XIO_E_MSG_CANCELED);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_response - client side						     */
+/*---------------------------------------------------------------------------*/
+static int on_response(struct xio_session *session,
+		       struct xio_msg *rsp,
+		       int last_in_rxq,
+		       void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	xio_release_response(rsp);
+	bd->nrsp++;
+	check_phase_done(bd);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_cancel - client side						     */
+/*---------------------------------------------------------------------------*/
+static int on_cancel(struct xio_session *session,
+		     struct xio_msg *req,
+		     enum xio_status result,
+		     void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	if (result == XIO_E_MSG_CANCELED)
+		bd->ncanceled++;
+	else
+		bd->ncancel_failed++;
+	check_phase_done(bd);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* asynchronous callbacks						     */
+/*---------------------------------------------------------------------------*/
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  on_session_event,
+	.on_new_session			=  on_new_session,
+	.on_msg				=  on_request,
+	.on_cancel_request		=  on_cancel_request,
+};
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  on_session_event,
+	.on_msg				=  on_response,
+	.on_cancel			=  on_cancel,
+};
+
+/*---------------------------------------------------------------------------*/
+/* run_phase								     */
+/*---------------------------------------------------------------------------*/
+static uint64_t run_phase(struct bench_data *bd, enum bench_phase phase)
+{
+	uint64_t start = get_ns();
+
+	bd->phase = phase;
+	check_phase_done(bd);
+	xio_context_run_loop(bd->ctx, XIO_INFINITE);
+
+	return get_ns() - start;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct xio_server		*server;
+	struct xio_session_params	params;
+	struct xio_connection_params	cparams;
+	struct bench_data		bd;
+	char				url[256];
+	uint64_t			issue_ns = 0, start, fill_ns, rtt_ns;
+	int				queue_depth = QUEUE_DEPTH;
+	int				i, ncancels, retval = 1;
+
+	if (argc < 3) {
+		printf("Usage: %s <host> <port> <transport:optional> " \
+		       "<msgs:optional>\n", argv[0]);
+		exit(1);
+	}
+	memset(&bd, 0, sizeof(bd));
+	bd.msgs_nr = (argc > 4) ? atoi(argv[4]) : MSGS_NR;
+	if (bd.msgs_nr < CANCEL_EVERY)
+		bd.msgs_nr = CANCEL_EVERY;
+	if (bd.msgs_nr + 1024 > queue_depth)
+		queue_depth = bd.msgs_nr + 1024;
+	ncancels = (bd.msgs_nr + CANCEL_EVERY - 1) / CANCEL_EVERY;
+
+	sprintf(url, "%s://%s:%s", (argc > 3) ? argv[3] : "tcp",
+		argv[1], argv[2]);
+
+	xio_init();
+
+	/* all requests are outstanding at once */
+	xio_set_opt(NULL, XIO_OPTLEVEL_ACCELIO,
+		    XIO_OPTNAME_SND_QUEUE_DEPTH_MSGS,
+		    &queue_depth, sizeof(int));
+	xio_set_opt(NULL, XIO_OPTLEVEL_ACCELIO,
+		    XIO_OPTNAME_RCV_QUEUE_DEPTH_MSGS,
+		    &queue_depth, sizeof(int));
+
+	bd.idx	= (uint32_t *)calloc(bd.msgs_nr, sizeof(*bd.idx));
+	bd.req	= (struct xio_msg *)calloc(bd.msgs_nr, sizeof(*bd.req));
+	bd.held = (struct xio_msg **)calloc(bd.msgs_nr, sizeof(*bd.held));
+	bd.rsp	= (struct xio_msg *)calloc(bd.msgs_nr, sizeof(*bd.rsp));
+	if (!bd.idx || !bd.req || !bd.held || !bd.rsp) {
+		fprintf(stderr, "failed to allocate messages\n");
+		goto cleanup;
+	}
+
+	bd.ctx = xio_context_create(NULL, 0, -1);
+	if (!bd.ctx) {
+		fprintf(stderr, "context creation failed. %s\n",
+			xio_strerror(xio_errno()));
+		goto cleanup;
+	}
+
+	server = xio_bind(bd.ctx, &server_ops, url, NULL, 0, &bd);
+	if (!server) {
+		fprintf(stderr, "failed to bind %s. %s\n", url,
+			xio_strerror(xio_errno()));
+		goto cleanup_ctx;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.type		= XIO_SESSION_CLIENT;
+	params.ses_ops		= &client_ops;
+	params.user_context	= &bd;
+	params.uri		= url;
+
+	bd.session = xio_session_create(&params);
+	if (!bd.session) {
+		fprintf(stderr, "session creation failed. %s\n",
+			xio_strerror(xio_errno()));
+		goto cleanup_server;
+	}
+
+	memset(&cparams, 0, sizeof(cparams));
+	cparams.session			= bd.session;
+	cparams.ctx			= bd.ctx;
+	cparams.conn_user_context	= &bd;
+
+	bd.conn = xio_connect(&cparams);
+	if (!bd.conn) {
+		fprintf(stderr, "connect failed. %s\n",
+			xio_strerror(xio_errno()));
+		xio_session_destroy(bd.session);
+		goto cleanup_server;
+	}
+
+	for (i = 0; i < bd.msgs_nr; i++) {
+		bd.idx[i] = i;
+		bd.req[i].out.header.iov_base	= &bd.idx[i];
+		bd.req[i].out.header.iov_len	= sizeof(bd.idx[i]);
+		bd.req[i].in.sgl_type		= XIO_SGL_TYPE_IOV;
+		bd.req[i].in.data_iov.max_nents	= XIO_IOVLEN;
+		bd.req[i].out.sgl_type		= XIO_SGL_TYPE_IOV;
+		bd.req[i].out.data_iov.max_nents = XIO_IOVLEN;
+		if (xio_send_request(bd.conn, &bd.req[i]) == -1) {
+			fprintf(stderr, "send request %d failed. %s\n", i,
+				xio_strerror(xio_errno()));
+			goto disconnect;
+		}
+	}
+	fill_ns = run_phase(&bd, PHASE_FILL);
+
+	/* cancel every CANCEL_EVERY-th outstanding request */
+	start = get_ns();
+	bd.phase = PHASE_CANCEL;
+	for (i = 0; i < bd.msgs_nr; i += CANCEL_EVERY) {
+		uint64_t t = get_ns();
+
+		if (xio_cancel_request(bd.conn, &bd.req[i]) == -1)
+			bd.ncancel_failed++;
+		issue_ns += get_ns() - t;
+	}
+	check_phase_done(&bd);
+	xio_context_run_loop(bd.ctx, XIO_INFINITE);
+	rtt_ns = get_ns() - start;
+
+	/* respond to the requests that survived */
+	for (i = 0; i < bd.msgs_nr; i++) {
+		if (!bd.held[i])
+			continue;
+		bd.rsp[i].request = bd.held[i];
+		bd.rsp[i].out.sgl_type		  = XIO_SGL_TYPE_IOV;
+		bd.rsp[i].out.data_iov.max_nents  = XIO_IOVLEN;
+		xio_send_response(&bd.rsp[i]);
+		bd.held[i] = NULL;
+	}
+	run_phase(&bd, PHASE_DRAIN);
+
+	printf("outstanding requests : %d (filled in %.3f ms)\n",
+	       bd.msgs_nr, fill_ns / 1000000.0);
+	printf("cancels issued       : %d (canceled %d, failed %d, " \
+	       "seen by server %d)\n",
+	       ncancels, bd.ncanceled, bd.ncancel_failed, bd.ncancel_req);
+	printf("cancel issue cost    : %.1f ns/cancel\n",
+	       (double)issue_ns / ncancels);
+	printf("cancel round trip    : %.3f ms total, %.1f ns/cancel\n",
+	       rtt_ns / 1000000.0, (double)rtt_ns / ncancels);
+	printf("responses            : %d\n", bd.nrsp);
+	retval = (bd.ncanceled == ncancels &&
+		  bd.nrsp + bd.ncanceled == bd.msgs_nr) ? 0 : 1;
+
+disconnect:
+	bd.phase = PHASE_DONE;
+	xio_disconnect(bd.conn);
+	xio_context_run_loop(bd.ctx, XIO_INFINITE);
+cleanup_server:
+	xio_unbind(server);
+cleanup_ctx:
+	xio_context_destroy(bd.ctx);
+cleanup:
+	free(bd.rsp);
+	free(bd.held);
+	free(bd.req);
+	free(bd.idx);
+
+	xio_shutdown();
+
+	return retval;
+}
+
@@ -0,0 +1,800 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include <sys/hashtable.h>
+#include <sys/resource.h>
+#include <getopt.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_protocol.h"
+#include "xio_mbuf.h"
+#include "xio_task.h"
+#include "xio_hash.h"
+#include "xio_observer.h"
+#include "xio_usr_transport.h"
+#include "xio_transport.h"
+#include "xio_msg_list.h"
+#include "xio_ev_data.h"
+#include "xio_workqueue.h"
+#include "xio_context.h"
+#include "xio_nexus.h"
+#include "xio_sn_hash.h"
+#include "xio_connection.h"
+#include "xio_session.h"
+#include "xio_mempool.h"
+#include "xio_tcp_transport.h"
+#include "xio_perftest_histogram.h"
+
+/*
+ * connection scale: one server and N client sessions, with a single
+ * connection each, in one process over loopback tcp.
+ *
+ * sessions that share a context and a portal uri share the transport
+ * connection (nexus), so every session gets its own destination and
+ * source address in 127.0.0.0/8 - 16M of them - against a server bound
+ * to the wildcard address. the run opens all the connections with a
+ * bounded number of connects in flight per client thread, samples the
+ * process rss, then disconnects them all.
+ *
+ * rss per connection covers both ends. the static part is the size of
+ * the core objects of both ends, as xio_mem_usage prints them; the rest
+ * is task pools, buffers and allocator overhead - mostly the inline
+ * buffers of the primary task pool, which -i trades against the size of
+ * the messages sent inline.
+ *
+ * the run stops opening connections when the fd limit or the system's
+ * free memory would be exceeded, and reports how many it held.
+ */
+
+#define DEF_PORT		2271
+#define DEF_CONNS		10000
+#define DEF_THREADS		1
+#define DEF_WINDOW		64
+#define MAX_THREADS		64
+#define LOOP_SLICE_MS		10
+#define RESERVED_FDS		64
+#define ADDR_HOSTS		254	/* .1 - .254 */
+#define DEF_MIN_FREE_MB		1024
+
+enum conn_state {
+	CONN_IDLE,
+	CONN_CONNECTING,
+	CONN_ESTABLISHED,
+	CONN_CLOSED
+};
+
+enum run_phase {
+	PHASE_INIT,
+	PHASE_CONNECT,
+	PHASE_HOLD,
+	PHASE_TEARDOWN,
+	PHASE_DONE
+};
+
+struct scale_conn {
+	struct scale_thread	*thread;
+	struct xio_session	*session;
+	struct xio_connection	*conn;
+	uint64_t		start_ns;
+	enum conn_state		state;
+	int			idx;
+};
+
+struct scale_thread {
+	struct xio_context	*ctx;
+	struct scale_conn	*conns;
+	struct perf_hist	hist;		/* setup latency, nsecs */
+	pthread_t		thread_id;
+	int			id;
+	int			nr;		/* connections of the thread */
+	int			next;		/* next to connect */
+	int			in_flight;
+	int			established;
+	int			failed;
+	int			closed;
+	int			ready;		/* context created */
+	int			connected;	/* connect phase over */
+	int			torn;		/* teardown phase over */
+};
+
+static struct {
+	const char		*output_file;
+	const char		*label;
+	int			port;
+	int			conns;
+	int			threads;
+	int			window;
+	int			single_stream;
+	int			inline_data;
+	int			min_free_mb;
+	int			pad;
+} params;
+
+static struct scale_thread	threads[MAX_THREADS];
+static struct xio_context	*server_ctx;
+static struct xio_server	*server;
+static pthread_t		server_thread_id;
+static volatile enum run_phase	phase;
+static int			server_sessions;
+static volatile int		mem_low;
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* get_rss - resident bytes of the process				     */
+/*---------------------------------------------------------------------------*/
+static uint64_t get_rss(void)
+{
+	FILE		*fp;
+	unsigned long	size = 0, resident = 0;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return 0;
+	if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+	fclose(fp);
+
+	return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+/*---------------------------------------------------------------------------*/
+/* get_mem_avail - MBytes the system can still give			     */
+/*---------------------------------------------------------------------------*/
+static long get_mem_avail(void)
+{
+	FILE		*fp;
+	char		line[128];
+	long		kb = -1;
+
+	fp = fopen("/proc/meminfo", "r");
+	if (!fp)
+		return -1;
+	while (fgets(line, sizeof(line), fp))
+		if (sscanf(line, "MemAvailable: %ld kB", &kb) == 1)
+			break;
+	fclose(fp);
+
+	return kb < 0 ? -1 : kb / 1024;
+}
+
+/*---------------------------------------------------------------------------*/
+/* conn_addr - the loopback address of a connection			     */
+/*---------------------------------------------------------------------------*/
+static void conn_addr(int idx, char *addr, size_t len)
+{
+	int host = idx % ADDR_HOSTS + 1;
+	int net = idx / ADDR_HOSTS;
+
+	/* 127.0.0.1 stays the server's own */
+	snprintf(addr, len, "127.%d.%d.%d", 1 + net / 256, net % 256, host);
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		server_sessions--;
+		xio_session_destroy(session);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	server_sessions++;
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+};
+
+/*---------------------------------------------------------------------------*/
+/* server_loop								     */
+/*---------------------------------------------------------------------------*/
+static void *server_loop(void *data)
+{
+	xio_context_run_loop(server_ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context);
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+};
+
+/*---------------------------------------------------------------------------*/
+/* thread_connect_next - keep the window of connects in flight		     */
+/*---------------------------------------------------------------------------*/
+static void thread_connect_next(struct scale_thread *thread)
+{
+	struct xio_session_params	sparams;
+	struct xio_connection_params	cparams;
+	struct scale_conn		*sconn;
+	char				addr[32];
+	char				uri[64];
+
+	while (thread->in_flight < params.window && thread->next < thread->nr) {
+		if (!mem_low) {
+			long avail = get_mem_avail();
+
+			if (avail >= 0 && avail < params.min_free_mb)
+				mem_low = 1;
+		}
+		/* hold what is open - the rest is never attempted */
+		if (mem_low) {
+			thread->nr = thread->next;
+			break;
+		}
+		sconn = &thread->conns[thread->next++];
+		conn_addr(sconn->idx, addr, sizeof(addr));
+		sprintf(uri, "tcp://%s:%d", addr, params.port);
+
+		sconn->state	= CONN_CONNECTING;
+		sconn->start_ns	= get_ns();
+
+		memset(&sparams, 0, sizeof(sparams));
+		sparams.type		= XIO_SESSION_CLIENT;
+		sparams.ses_ops		= &client_ops;
+		sparams.user_context	= sconn;
+		sparams.uri		= uri;
+		sconn->session = xio_session_create(&sparams);
+		if (!sconn->session)
+			goto failed;
+
+		memset(&cparams, 0, sizeof(cparams));
+		cparams.session			= sconn->session;
+		cparams.ctx			= thread->ctx;
+		cparams.out_addr		= addr;
+		cparams.conn_user_context	= sconn;
+		sconn->conn = xio_connect(&cparams);
+		if (!sconn->conn) {
+			xio_session_destroy(sconn->session);
+			sconn->session = NULL;
+			goto failed;
+		}
+		thread->in_flight++;
+		continue;
+failed:
+		fprintf(stderr, "connect %s failed. %s\n", uri,
+			xio_strerror(xio_errno()));
+		sconn->state = CONN_CLOSED;
+		thread->failed++;
+		thread->closed++;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct scale_conn	*sconn = (struct scale_conn *)cb_user_context;
+	struct scale_thread	*thread = sconn->thread;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		hist_record(&thread->hist, get_ns() - sconn->start_ns);
+		sconn->state = CONN_ESTABLISHED;
+		thread->established++;
+		thread->in_flight--;
+		thread_connect_next(thread);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_REFUSED_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		if (sconn->state == CONN_CONNECTING) {
+			fprintf(stderr, "connection %d: %s. reason: %s\n",
+				sconn->idx,
+				xio_session_event_str(event_data->event),
+				xio_strerror(event_data->reason));
+			sconn->state = CONN_CLOSED;
+			thread->failed++;
+			thread->in_flight--;
+			thread_connect_next(thread);
+		}
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		sconn->conn = NULL;
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		sconn->session = NULL;
+		sconn->state = CONN_CLOSED;
+		thread->closed++;
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_loop								     */
+/*---------------------------------------------------------------------------*/
+static void *client_loop(void *data)
+{
+	struct scale_thread	*thread = (struct scale_thread *)data;
+	int			i;
+
+	thread->ctx = xio_context_create(NULL, 0, -1);
+	__sync_synchronize();
+	thread->ready = 1;
+	if (!thread->ctx)
+		return NULL;
+
+	while (phase == PHASE_INIT)
+		usleep(1000);
+
+	thread_connect_next(thread);
+
+	/* serve the connections in slices, to follow the phases */
+	while (1) {
+		xio_context_run_loop(thread->ctx, LOOP_SLICE_MS);
+
+		if (!thread->connected &&
+		    thread->established + thread->failed == thread->nr) {
+			__sync_synchronize();
+			thread->connected = 1;
+		}
+		if (phase == PHASE_TEARDOWN && !thread->torn) {
+			for (i = 0; i < thread->nr; i++)
+				if (thread->conns[i].state == CONN_ESTABLISHED)
+					xio_disconnect(thread->conns[i].conn);
+			thread->torn = -1;	/* disconnects issued */
+		}
+		if (thread->torn == -1 && thread->closed == thread->nr) {
+			__sync_synchronize();
+			thread->torn = 1;
+		}
+		if (phase == PHASE_DONE)
+			break;
+	}
+	xio_context_destroy(thread->ctx);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* wait_threads - poll a per thread flag				     */
+/*---------------------------------------------------------------------------*/
+static void wait_threads(size_t flag_offset, int value)
+{
+	int i;
+
+	for (i = 0; i < params.threads; i++)
+		while (*(volatile int *)((char *)&threads[i] + flag_offset) !=
+		       value)
+			usleep(1000);
+}
+
+/*---------------------------------------------------------------------------*/
+/* static_sizes - the core objects of one connection, both ends	     */
+/*---------------------------------------------------------------------------*/
+static uint64_t static_sizes(int print)
+{
+	static const struct {
+		const char	*name;
+		size_t		size;
+	} objs[] = {
+		{ "struct xio_session",		sizeof(struct xio_session) },
+		{ "struct xio_connection",	sizeof(struct xio_connection) },
+		{ "struct xio_nexus",		sizeof(struct xio_nexus) },
+		{ "struct xio_tcp_transport",
+					sizeof(struct xio_tcp_transport) },
+	};
+	uint64_t	total = 0;
+	unsigned int	i;
+
+	for (i = 0; i < sizeof(objs) / sizeof(objs[0]); i++) {
+		if (print)
+			printf("    sizeof(%s) %*s %6zu\n", objs[i].name,
+			       (int)(32 - strlen(objs[i].name)), "",
+			       objs[i].size);
+		total += objs[i].size;
+	}
+
+	return 2 * total;
+}
+
+/*---------------------------------------------------------------------------*/
+/* raise_fd_limit - returns the connections the fd limit allows	     */
+/*---------------------------------------------------------------------------*/
+static int raise_fd_limit(void)
+{
+	struct rlimit	rl;
+	int		fds_per_conn = params.single_stream ? 2 : 4;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl))
+		return params.conns;
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+
+	/* a socket per stream on each end */
+	return (int)((rl.rlim_cur - RESERVED_FDS) / fds_per_conn);
+}
+
+/*---------------------------------------------------------------------------*/
+/* usage								     */
+/*---------------------------------------------------------------------------*/
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s [OPTIONS]\t\tconnection setup rate and footprint\n",
+	       argv0);
+	printf("\n");
+	printf("options:\n");
+	printf("\t-n, --conns=<num> ");
+	printf("\tsessions to open, one connection each (default %d)\n",
+	       DEF_CONNS);
+	printf("\t-t, --threads=<num> ");
+	printf("\tclient threads (default %d)\n", DEF_THREADS);
+	printf("\t-w, --window=<num> ");
+	printf("\tconnects in flight per thread (default %d)\n",
+	       DEF_WINDOW);
+	printf("\t-p, --port=<port> ");
+	printf("\tserver port (default %d)\n", DEF_PORT);
+	printf("\t-s, --single_stream ");
+	printf("\tone tcp socket per connection instead of two\n");
+	printf("\t-i, --inline_data=<bytes> ");
+	printf("\tmaximum inline data - sizes the task pool buffers\n");
+	printf("\t-m, --min_free=<MB> ");
+	printf("\tstop connecting below this free memory (default %d)\n",
+	       DEF_MIN_FREE_MB);
+	printf("\t-o, --output_file=<file> ");
+	printf("\tappend the results as a JSON line\n");
+	printf("\t-l, --label=<text> ");
+	printf("\tlabel of the run in the JSON, e.g. the release\n");
+	printf("\t-h, --help ");
+	printf("\tdisplay this help and exit\n");
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_cmdline							     */
+/*---------------------------------------------------------------------------*/
+static int parse_cmdline(int argc, char **argv)
+{
+	static struct option const long_options[] = {
+		{ .name = "conns",	   .has_arg = 1, .val = 'n'},
+		{ .name = "threads",	   .has_arg = 1, .val = 't'},
+		{ .name = "window",	   .has_arg = 1, .val = 'w'},
+		{ .name = "port",	   .has_arg = 1, .val = 'p'},
+		{ .name = "single_stream", .has_arg = 0, .val = 's'},
+		{ .name = "inline_data",   .has_arg = 1, .val = 'i'},
+		{ .name = "min_free",	   .has_arg = 1, .val = 'm'},
+		{ .name = "output_file",   .has_arg = 1, .val = 'o'},
+		{ .name = "label",	   .has_arg = 1, .val = 'l'},
+		{ .name = "help",	   .has_arg = 0, .val = 'h'},
+		{0, 0, 0, 0},
+	};
+	static char *short_options = "n:t:w:p:si:m:o:l:h";
+	int c;
+
+	params.conns	= DEF_CONNS;
+	params.threads	= DEF_THREADS;
+	params.window	= DEF_WINDOW;
+	params.port	= DEF_PORT;
+	params.inline_data = -1;
+	params.min_free_mb = DEF_MIN_FREE_MB;
+	params.label	= "";
+
+	optind = 0;
+	opterr = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options,
+				long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'n':
+			params.conns = strtol(optarg, NULL, 0);
+			if (params.conns <= 0)
+				goto invalid;
+			break;
+		case 't':
+			params.threads = strtol(optarg, NULL, 0);
+			if (params.threads <= 0 || params.threads > MAX_THREADS)
+				goto invalid;
+			break;
+		case 'w':
+			params.window = strtol(optarg, NULL, 0);
+			if (params.window <= 0)
+				goto invalid;
+			break;
+		case 'p':
+			params.port = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			params.single_stream = 1;
+			break;
+		case 'i':
+			params.inline_data = strtol(optarg, NULL, 0);
+			if (params.inline_data < 0)
+				goto invalid;
+			break;
+		case 'm':
+			params.min_free_mb = strtol(optarg, NULL, 0);
+			if (params.min_free_mb < 0)
+				goto invalid;
+			break;
+		case 'o':
+			params.output_file = optarg;
+			break;
+		case 'l':
+			params.label = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(0);
+		default:
+			goto invalid;
+		}
+	}
+	if (optind < argc)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "invalid command line\n");
+	usage(argv[0]);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct perf_hist	hist;
+	char			uri[64];
+	uint64_t		rss_base, rss_conns, static_sz;
+	uint64_t		t_connect, t_connected, t_teardown, t_torn;
+	double			connects_sec, teardowns_sec, rss_per_conn;
+	double			p50, p99, max;
+	int			i, established = 0, failed = 0, max_conns;
+	int			dual = 0, len;
+	FILE			*fp;
+
+	if (parse_cmdline(argc, argv))
+		return -1;
+
+	max_conns = raise_fd_limit();
+	if (params.conns > max_conns) {
+		fprintf(stderr, "open files limit allows %d connections, " \
+			"capping %d\n", max_conns, params.conns);
+		params.conns = max_conns;
+	}
+	if (params.conns > 254 * 256 * 254) {
+		fprintf(stderr, "too many connections\n");
+		return -1;
+	}
+
+	xio_init();
+
+	if (params.single_stream)
+		xio_set_opt(NULL, XIO_OPTLEVEL_TCP,
+			    XIO_OPTNAME_TCP_DUAL_STREAM, &dual, sizeof(dual));
+	if (params.inline_data >= 0 &&
+	    xio_set_opt(NULL, XIO_OPTLEVEL_ACCELIO,
+			XIO_OPTNAME_MAX_INLINE_DATA,
+			&params.inline_data, sizeof(params.inline_data))) {
+		fprintf(stderr, "invalid inline data size %d. %s\n",
+			params.inline_data, xio_strerror(xio_errno()));
+		goto cleanup;
+	}
+	/* record the value in effect */
+	len = sizeof(params.inline_data);
+	xio_get_opt(NULL, XIO_OPTLEVEL_ACCELIO, XIO_OPTNAME_MAX_INLINE_DATA,
+		    &params.inline_data, &len);
+
+	/* the server */
+	server_ctx = xio_context_create(NULL, 0, -1);
+	if (!server_ctx) {
+		fprintf(stderr, "failed to create context\n");
+		goto cleanup;
+	}
+	sprintf(uri, "tcp://0.0.0.0:%d", params.port);
+	server = xio_bind(server_ctx, &server_ops, uri, NULL, 0, NULL);
+	if (!server) {
+		fprintf(stderr, "failed to bind %s. %s\n", uri,
+			xio_strerror(xio_errno()));
+		goto cleanup;
+	}
+	pthread_create(&server_thread_id, NULL, server_loop, NULL);
+
+	/* the clients - connections are dealt round robin */
+	for (i = 0; i < params.threads; i++) {
+		threads[i].id = i;
+		threads[i].nr = params.conns / params.threads +
+				(i < params.conns % params.threads);
+		threads[i].conns = (struct scale_conn *)calloc(
+				threads[i].nr, sizeof(struct scale_conn));
+		if (!threads[i].conns)
+			goto cleanup;
+		pthread_create(&threads[i].thread_id, NULL, client_loop,
+			       &threads[i]);
+	}
+	for (i = 0; i < params.conns; i++) {
+		struct scale_thread *thread = &threads[i % params.threads];
+		struct scale_conn *sconn = &thread->conns[i / params.threads];
+
+		sconn->thread	= thread;
+		sconn->idx	= i;
+	}
+	wait_threads(offsetof(struct scale_thread, ready), 1);
+	for (i = 0; i < params.threads; i++)
+		if (!threads[i].ctx)
+			goto cleanup;
+
+	rss_base = get_rss();
+
+	printf("connecting %d sessions, %d threads, %d in flight each\n",
+	       params.conns, params.threads, params.window);
+	t_connect = get_ns();
+	phase = PHASE_CONNECT;
+	wait_threads(offsetof(struct scale_thread, connected), 1);
+	t_connected = get_ns();
+
+	phase = PHASE_HOLD;
+	rss_conns = get_rss();
+
+	hist_reset(&hist);
+	for (i = 0; i < params.threads; i++) {
+		established += threads[i].established;
+		failed += threads[i].failed;
+		hist_merge(&hist, &threads[i].hist);
+	}
+
+	t_teardown = get_ns();
+	phase = PHASE_TEARDOWN;
+	wait_threads(offsetof(struct scale_thread, torn), 1);
+	t_torn = get_ns();
+
+	phase = PHASE_DONE;
+	for (i = 0; i < params.threads; i++)
+		pthread_join(threads[i].thread_id, NULL);
+
+	connects_sec	= established * 1e9 / (t_connected - t_connect);
+	teardowns_sec	= established * 1e9 / (t_torn - t_teardown);
+	rss_per_conn	= established ?
+			  (double)(rss_conns - rss_base) / established : 0;
+	p50		= hist_percentile(&hist, 50.0) / 1000.0;
+	p99		= hist_percentile(&hist, 99.0) / 1000.0;
+	max		= hist.max / 1000.0;
+
+	printf("\nstatic sizes, per end:\n");
+	static_sz = static_sizes(1);
+	printf("\n");
+	printf("established            %d (failed %d)\n", established, failed);
+	if (mem_low)
+		printf("  stopped early, free memory below %d MB\n",
+		       params.min_free_mb);
+	printf("connects/sec           %.0f\n", connects_sec);
+	printf("setup latency [usecs]  p50 %.1f  p99 %.1f  max %.1f\n",
+	       p50, p99, max);
+	printf("rss per connection     %.0f bytes, both ends\n", rss_per_conn);
+	printf("  static objects       %" PRIu64 " bytes\n", static_sz);
+	printf("  pools, buffers, rest %.0f bytes\n",
+	       rss_per_conn - static_sz);
+	printf("teardowns/sec          %.0f\n", teardowns_sec);
+
+	/* one line per run - a file collects runs over releases */
+	if (params.output_file) {
+		fp = fopen(params.output_file, "a");
+		if (!fp) {
+			perror("fopen");
+		} else {
+			fprintf(fp, "{\"label\": \"%s\", \"xio_version\": "
+				"\"0x%04x\", \"conns\": %d, \"threads\": %d, "
+				"\"window\": %d, \"dual_stream\": %d, "
+				"\"inline_data\": %d, \"mem_limited\": %d, "
+				"\"established\": %d, \"failed\": %d, "
+				"\"connects_sec\": %.0f, \"setup_p50_us\": %.1f, "
+				"\"setup_p99_us\": %.1f, \"setup_max_us\": %.1f, "
+				"\"rss_per_conn\": %.0f, \"static_per_conn\": %"
+				PRIu64 ", \"teardowns_sec\": %.0f}\n",
+				params.label, XIO_VERSION, params.conns,
+				params.threads, params.window,
+				!params.single_stream, params.inline_data,
+				mem_low, established, failed,
+				connects_sec, p50, p99, max, rss_per_conn,
+				static_sz, teardowns_sec);
+			fclose(fp);
+		}
+	}
+
+cleanup:
+	if (server) {
+		/* the server's sessions follow the client teardown */
+		while (server_sessions)
+			usleep(1000);
+		xio_context_stop_loop(server_ctx);
+		pthread_join(server_thread_id, NULL);
+		xio_unbind(server);
+	}
+	if (server_ctx)
+		xio_context_destroy(server_ctx);
+	for (i = 0; i < params.threads; i++)
+		free(threads[i].conns);
+
+	xio_shutdown();
+
+	return 0;
+}
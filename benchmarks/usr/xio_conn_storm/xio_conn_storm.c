@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxio.h"
+
+/*
+ * connect/teardown storm: every client thread owns a context and, in
+ * each round, opens SESSIONS_NR sessions to the same server, waits for
+ * all of them to be established and then tears them all down. stresses
+ * the session and nexus caches (add/lookup/find/remove) from many
+ * threads at once.
+ */
+
+#define THREADS_NR		4
+#define SESSIONS_NR		64
+#define ROUNDS_NR		20
+
+struct storm_thread {
+	struct xio_context	*ctx;
+	struct xio_session	**sessions;
+	struct xio_connection	**conns;
+	char			*url;
+	pthread_t		thread_id;
+	int			id;
+	int			sessions_nr;
+	int			rounds_nr;
+	int			nestablished;
+	int			nerrors;
+	int			nteardown;
+	uint64_t		setup_ns;
+	uint64_t		teardown_ns;
+	uint64_t		max_setup_ns;
+	uint64_t		max_teardown_ns;
+};
+
+struct storm_server {
+	struct xio_context	*ctx;
+	struct xio_server	*server;
+	pthread_t		thread_id;
+	int			nsessions;
+	volatile int		nteardown;
+};
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct storm_server *srv = (struct storm_server *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		srv->nteardown++;
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	struct storm_server *srv = (struct storm_server *)cb_user_context;
+
+	srv->nsessions++;
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+};
+
+/*---------------------------------------------------------------------------*/
+/* server_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *server_thread(void *data)
+{
+	struct storm_server *srv = (struct storm_server *)data;
+
+	xio_context_run_loop(srv->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct storm_thread *tdata = (struct storm_thread *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		if (++tdata->nestablished + tdata->nerrors ==
+		    tdata->sessions_nr)
+			xio_context_stop_loop(tdata->ctx);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "thread %d: %s. reason: %s\n", tdata->id,
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		if (tdata->nestablished + ++tdata->nerrors ==
+		    tdata->sessions_nr)
+			xio_context_stop_loop(tdata->ctx);
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		if (++tdata->nteardown == tdata->sessions_nr)
+			xio_context_stop_loop(tdata->ctx);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+};
+
+/*---------------------------------------------------------------------------*/
+/* client_round								     */
+/*---------------------------------------------------------------------------*/
+static int client_round(struct storm_thread *tdata)
+{
+	struct xio_session_params	params;
+	struct xio_connection_params	cparams;
+	uint64_t			start, setup, teardown;
+	int				i;
+
+	tdata->nestablished	= 0;
+	tdata->nerrors		= 0;
+	tdata->nteardown	= 0;
+
+	memset(&params, 0, sizeof(params));
+	params.type		= XIO_SESSION_CLIENT;
+	params.ses_ops		= &client_ops;
+	params.user_context	= tdata;
+	params.uri		= tdata->url;
+
+	memset(&cparams, 0, sizeof(cparams));
+	cparams.ctx			= tdata->ctx;
+	cparams.conn_user_context	= tdata;
+
+	start = get_ns();
+	for (i = 0; i < tdata->sessions_nr; i++) {
+		tdata->sessions[i] = xio_session_create(&params);
+		if (!tdata->sessions[i]) {
+			fprintf(stderr, "session creation failed. %s\n",
+				xio_strerror(xio_errno()));
+			return -1;
+		}
+		cparams.session = tdata->sessions[i];
+		tdata->conns[i] = xio_connect(&cparams);
+		if (!tdata->conns[i]) {
+			fprintf(stderr, "connect failed. %s\n",
+				xio_strerror(xio_errno()));
+			return -1;
+		}
+	}
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+	setup = get_ns() - start;
+
+	start = get_ns();
+	for (i = 0; i < tdata->sessions_nr; i++)
+		xio_disconnect(tdata->conns[i]);
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+	teardown = get_ns() - start;
+
+	tdata->setup_ns += setup;
+	tdata->teardown_ns += teardown;
+	if (setup > tdata->max_setup_ns)
+		tdata->max_setup_ns = setup;
+	if (teardown > tdata->max_teardown_ns)
+		tdata->max_teardown_ns = teardown;
+
+	return tdata->nerrors ? -1 : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *client_thread(void *data)
+{
+	struct storm_thread *tdata = (struct storm_thread *)data;
+	int i;
+
+	for (i = 0; i < tdata->rounds_nr; i++) {
+		if (client_round(tdata)) {
+			tdata->rounds_nr = i;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct storm_server	srv;
+	struct storm_thread	*tdata;
+	char			url[256];
+	uint64_t		start, total_ns, setup_ns = 0, teardown_ns = 0;
+	uint64_t		max_setup_ns = 0, max_teardown_ns = 0;
+	int			threads_nr, sessions_nr, rounds_nr;
+	int			i, nsessions = 0, retval = 0;
+
+	if (argc < 3) {
+		printf("Usage: %s <host> <port> <transport:optional> " \
+		       "<threads:optional> <sessions:optional> " \
+		       "<rounds:optional>\n", argv[0]);
+		exit(1);
+	}
+	sprintf(url, "%s://%s:%s", (argc > 3) ? argv[3] : "tcp",
+		argv[1], argv[2]);
+	threads_nr  = (argc > 4) ? atoi(argv[4]) : THREADS_NR;
+	sessions_nr = (argc > 5) ? atoi(argv[5]) : SESSIONS_NR;
+	rounds_nr   = (argc > 6) ? atoi(argv[6]) : ROUNDS_NR;
+	if (threads_nr < 1 || sessions_nr < 1 || rounds_nr < 1) {
+		fprintf(stderr, "invalid arguments\n");
+		exit(1);
+	}
+
+	xio_init();
+
+	memset(&srv, 0, sizeof(srv));
+	srv.ctx = xio_context_create(NULL, 0, -1);
+	srv.server = xio_bind(srv.ctx, &server_ops, url, NULL, 0, &srv);
+	if (!srv.server) {
+		fprintf(stderr, "failed to bind %s. %s\n", url,
+			xio_strerror(xio_errno()));
+		xio_context_destroy(srv.ctx);
+		xio_shutdown();
+		return 1;
+	}
+	pthread_create(&srv.thread_id, NULL, server_thread, &srv);
+
+	tdata = (struct storm_thread *)calloc(threads_nr, sizeof(*tdata));
+	for (i = 0; i < threads_nr; i++) {
+		tdata[i].id		= i;
+		tdata[i].url		= url;
+		tdata[i].sessions_nr	= sessions_nr;
+		tdata[i].rounds_nr	= rounds_nr;
+		tdata[i].sessions = (struct xio_session **)
+				calloc(sessions_nr, sizeof(void *));
+		tdata[i].conns = (struct xio_connection **)
+				calloc(sessions_nr, sizeof(void *));
+		tdata[i].ctx = xio_context_create(NULL, 0, -1);
+	}
+
+	start = get_ns();
+	for (i = 0; i < threads_nr; i++)
+		pthread_create(&tdata[i].thread_id, NULL, client_thread,
+			       &tdata[i]);
+	for (i = 0; i < threads_nr; i++)
+		pthread_join(tdata[i].thread_id, NULL);
+	total_ns = get_ns() - start;
+
+	for (i = 0; i < threads_nr; i++) {
+		if (tdata[i].rounds_nr != rounds_nr)
+			retval = 1;
+		nsessions	+= tdata[i].rounds_nr * sessions_nr;
+		setup_ns	+= tdata[i].setup_ns;
+		teardown_ns	+= tdata[i].teardown_ns;
+		if (tdata[i].max_setup_ns > max_setup_ns)
+			max_setup_ns = tdata[i].max_setup_ns;
+		if (tdata[i].max_teardown_ns > max_teardown_ns)
+			max_teardown_ns = tdata[i].max_teardown_ns;
+	}
+
+	/* let the server side finish its teardowns (up to 5 seconds) */
+	for (i = 0; i < 5000 && srv.nteardown < srv.nsessions; i++)
+		usleep(1000);
+	xio_context_stop_loop(srv.ctx);
+	pthread_join(srv.thread_id, NULL);
+
+	printf("threads %d, sessions/round %d, rounds %d\n",
+	       threads_nr, sessions_nr, rounds_nr);
+	printf("sessions            : %d (server accepted %d)\n",
+	       nsessions, srv.nsessions);
+	printf("total               : %.3f ms, %.0f sessions/sec\n",
+	       total_ns / 1000000.0,
+	       nsessions / (total_ns / 1000000000.0));
+	if (nsessions) {
+		printf("setup    per session: %.1f us (worst round " \
+		       "%.3f ms)\n",
+		       setup_ns / 1000.0 / nsessions,
+		       max_setup_ns / 1000000.0);
+		printf("teardown per session: %.1f us (worst round " \
+		       "%.3f ms)\n",
+		       teardown_ns / 1000.0 / nsessions,
+		       max_teardown_ns / 1000000.0);
+	}
+
+	for (i = 0; i < threads_nr; i++) {
+		xio_context_destroy(tdata[i].ctx);
+		free(tdata[i].sessions);
+		free(tdata[i].conns);
+	}
+	free(tdata);
+
+	xio_unbind(srv.server);
+	xio_context_destroy(srv.ctx);
+
+	xio_shutdown();
+
+	return retval;
+}
+
@@ -0,0 +1,511 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "libxio.h"
+
+/*
+ * fan out benchmark: one context holds the server and CONNS_NR client
+ * sessions over loopback. for 1, 64 and 512 destinations the client sends
+ * the same one way message to every destination, once with a loop of
+ * xio_send_msg (one message per connection) and once with a single
+ * xio_send_msg_multi, keeping WINDOW fan outs in flight. reports the
+ * fan out and message rates of both.
+ */
+
+#define CONNS_NR		512
+#define FANOUTS_NR		2000
+#define MSG_SIZE		256
+#define WINDOW			8
+
+enum fanout_mode {
+	MODE_LOOP,
+	MODE_MULTI
+};
+
+struct fanout_slot {
+	struct xio_msg		*msgs;		/* one, or one per destination */
+	int			pending;	/* completions left */
+	int			pad;
+};
+
+/* benchmark private data - client and server share one context */
+struct bench_data {
+	struct xio_context	*ctx;
+	struct xio_session	**sessions;
+	struct xio_connection	**conns;
+	struct fanout_slot	slots[WINDOW];
+	enum fanout_mode	mode;
+	int			conns_nr;
+	int			fanout;		/* destinations per fan out */
+	int			fanouts_nr;
+	int			issued;
+	int			completed;
+	int			nerrors;
+	int			nestablished;
+	int			nteardown;	/* client sessions */
+	int			srv_nteardown;
+	int			closing;
+	int			pad;
+	uint64_t		nrecv;		/* messages seen by server */
+	uint64_t		nexpected;
+	size_t			msg_size;
+	char			*payload;
+};
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* check_done								     */
+/*---------------------------------------------------------------------------*/
+static void check_done(struct bench_data *bd)
+{
+	if (bd->closing) {
+		if (bd->nteardown == bd->conns_nr &&
+		    bd->srv_nteardown == bd->conns_nr)
+			xio_context_stop_loop(bd->ctx);
+		return;
+	}
+	if (bd->nestablished < bd->conns_nr)
+		return;
+	if (bd->completed == bd->fanouts_nr && bd->nrecv == bd->nexpected)
+		xio_context_stop_loop(bd->ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* issue_fanout								     */
+/*---------------------------------------------------------------------------*/
+static void issue_fanout(struct bench_data *bd, struct fanout_slot *slot)
+{
+	int i;
+
+	bd->issued++;
+	if (bd->mode == MODE_MULTI) {
+		slot->pending = 1;
+		if (xio_send_msg_multi(bd->conns, bd->fanout,
+				       &slot->msgs[0]) == -1) {
+			bd->nerrors++;
+			slot->pending = 0;
+			bd->completed++;
+		}
+		return;
+	}
+	slot->pending = bd->fanout;
+	for (i = 0; i < bd->fanout; i++) {
+		if (xio_send_msg(bd->conns[i], &slot->msgs[i]) == -1) {
+			bd->nerrors++;
+			slot->pending--;
+		}
+	}
+	if (slot->pending == 0)
+		bd->completed++;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_session_event							     */
+/*---------------------------------------------------------------------------*/
+static int on_session_event(struct xio_session *session,
+			    struct xio_session_event_data *event_data,
+			    void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		bd->nteardown++;
+		check_done(bd);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "session event: %s. reason: %s\n",
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_server_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int on_server_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		bd->srv_nteardown++;
+		check_done(bd);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_session_established						     */
+/*---------------------------------------------------------------------------*/
+static int on_session_established(struct xio_session *session,
+				  struct xio_new_session_rsp *rsp,
+				  void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	bd->nestablished++;
+	if (bd->nestablished == bd->conns_nr)
+		xio_context_stop_loop(bd->ctx);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_new_session							     */
+/*---------------------------------------------------------------------------*/
+static int on_new_session(struct xio_session *session,
+			  struct xio_new_session_req *req,
+			  void *cb_user_context)
+{
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_server_msg							     */
+/*---------------------------------------------------------------------------*/
+static int on_server_msg(struct xio_session *session,
+			 struct xio_msg *msg,
+			 int last_in_rxq,
+			 void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	xio_release_msg(msg);
+	bd->nrecv++;
+	check_done(bd);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_ow_msg_send_complete						     */
+/*---------------------------------------------------------------------------*/
+static int on_ow_msg_send_complete(struct xio_session *session,
+				   struct xio_msg *msg,
+				   void *cb_user_context)
+{
+	struct bench_data	*bd = (struct bench_data *)cb_user_context;
+	struct fanout_slot	*slot = (struct fanout_slot *)msg->user_context;
+
+	if (--slot->pending)
+		return 0;
+
+	bd->completed++;
+	if (bd->issued < bd->fanouts_nr)
+		issue_fanout(bd, slot);
+	check_done(bd);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_msg_error								     */
+/*---------------------------------------------------------------------------*/
+static int on_msg_error(struct xio_session *session,
+			enum xio_status error,
+			enum xio_msg_direction direction,
+			struct xio_msg *msg,
+			void *cb_user_context)
+{
+	struct bench_data *bd = (struct bench_data *)cb_user_context;
+
+	bd->nerrors++;
+	if (direction == XIO_MSG_DIRECTION_OUT)
+		on_ow_msg_send_complete(session, msg, cb_user_context);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* asynchronous callbacks						     */
+/*---------------------------------------------------------------------------*/
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  on_server_session_event,
+	.on_new_session			=  on_new_session,
+	.on_msg				=  on_server_msg,
+};
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  on_session_event,
+	.on_session_established		=  on_session_established,
+	.on_ow_msg_send_complete	=  on_ow_msg_send_complete,
+	.on_msg_error			=  on_msg_error,
+};
+
+/*---------------------------------------------------------------------------*/
+/* init_msg								     */
+/*---------------------------------------------------------------------------*/
+static void init_msg(struct bench_data *bd, struct xio_msg *msg,
+		     struct fanout_slot *slot)
+{
+	memset(msg, 0, sizeof(*msg));
+	msg->out.sgl_type		= XIO_SGL_TYPE_IOV;
+	msg->out.data_iov.max_nents	= XIO_IOVLEN;
+	msg->out.data_iov.nents		= 1;
+	msg->out.data_iov.sglist[0].iov_base = bd->payload;
+	msg->out.data_iov.sglist[0].iov_len  = bd->msg_size;
+	msg->in.sgl_type		= XIO_SGL_TYPE_IOV;
+	msg->in.data_iov.max_nents	= XIO_IOVLEN;
+	msg->user_context		= slot;
+}
+
+/*---------------------------------------------------------------------------*/
+/* run_fanout								     */
+/*---------------------------------------------------------------------------*/
+static int run_fanout(struct bench_data *bd, int fanout,
+		      enum fanout_mode mode)
+{
+	uint64_t	start, ns;
+	double		secs;
+	int		i, j, msgs_nr;
+
+	msgs_nr = (mode == MODE_MULTI) ? 1 : fanout;
+	for (i = 0; i < WINDOW; i++) {
+		bd->slots[i].msgs = (struct xio_msg *)
+				calloc(msgs_nr, sizeof(struct xio_msg));
+		if (!bd->slots[i].msgs) {
+			fprintf(stderr, "failed to allocate messages\n");
+			while (i--)
+				free(bd->slots[i].msgs);
+			return -1;
+		}
+		for (j = 0; j < msgs_nr; j++)
+			init_msg(bd, &bd->slots[i].msgs[j], &bd->slots[i]);
+	}
+
+	bd->mode	= mode;
+	bd->fanout	= fanout;
+	bd->issued	= 0;
+	bd->completed	= 0;
+	bd->nerrors	= 0;
+	bd->nrecv	= 0;
+	bd->nexpected	= (uint64_t)bd->fanouts_nr * fanout;
+
+	start = get_ns();
+	for (i = 0; i < WINDOW && bd->issued < bd->fanouts_nr; i++)
+		issue_fanout(bd, &bd->slots[i]);
+	check_done(bd);
+	xio_context_run_loop(bd->ctx, XIO_INFINITE);
+	ns = get_ns() - start;
+	secs = ns / 1000000000.0;
+
+	printf("%7d  %-5s  %9d  %12.0f  %12.0f  %9.1f  %6d\n",
+	       fanout, (mode == MODE_MULTI) ? "multi" : "loop",
+	       bd->fanouts_nr, bd->fanouts_nr / secs,
+	       bd->nexpected / secs, (double)ns / bd->nexpected,
+	       bd->nerrors);
+
+	for (i = 0; i < WINDOW; i++) {
+		free(bd->slots[i].msgs);
+		bd->slots[i].msgs = NULL;
+	}
+
+	return bd->nerrors ? -1 : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	static const int		fanouts[] = {1, 64, 512};
+	struct xio_server		*server;
+	struct xio_session_params	params;
+	struct xio_connection_params	cparams;
+	struct bench_data		bd;
+	char				url[256];
+	int				i, retval = 0;
+
+	if (argc < 3) {
+		printf("Usage: %s <host> <port> <transport:optional> " \
+		       "<msg size:optional> <fanouts:optional> " \
+		       "<tcp mr check:optional>\n", argv[0]);
+		exit(1);
+	}
+	memset(&bd, 0, sizeof(bd));
+	bd.conns_nr	= CONNS_NR;
+	bd.msg_size	= (argc > 4) ? (size_t)atol(argv[4]) : MSG_SIZE;
+	bd.fanouts_nr	= (argc > 5) ? atoi(argv[5]) : FANOUTS_NR;
+	if (bd.fanouts_nr < 1)
+		bd.fanouts_nr = 1;
+
+	sprintf(url, "%s://%s:%s", (argc > 3) ? argv[3] : "tcp",
+		argv[1], argv[2]);
+
+	xio_init();
+
+	/* with mr check the tcp transport copies unregistered data to its
+	 * pool, once per connection for the loop and once for a fan out
+	 */
+	if (argc > 6) {
+		int mr_check = atoi(argv[6]);
+
+		xio_set_opt(NULL, XIO_OPTLEVEL_TCP,
+			    XIO_OPTNAME_TCP_ENABLE_MR_CHECK,
+			    &mr_check, sizeof(int));
+	}
+
+	bd.payload	= (char *)calloc(1, bd.msg_size ? bd.msg_size : 1);
+	bd.sessions	= (struct xio_session **)
+				calloc(bd.conns_nr, sizeof(*bd.sessions));
+	bd.conns	= (struct xio_connection **)
+				calloc(bd.conns_nr, sizeof(*bd.conns));
+	if (!bd.payload || !bd.sessions || !bd.conns) {
+		fprintf(stderr, "failed to allocate\n");
+		retval = 1;
+		goto cleanup;
+	}
+
+	bd.ctx = xio_context_create(NULL, 0, -1);
+	if (!bd.ctx) {
+		fprintf(stderr, "context creation failed. %s\n",
+			xio_strerror(xio_errno()));
+		retval = 1;
+		goto cleanup;
+	}
+
+	server = xio_bind(bd.ctx, &server_ops, url, NULL, 0, &bd);
+	if (!server) {
+		fprintf(stderr, "failed to bind %s. %s\n", url,
+			xio_strerror(xio_errno()));
+		retval = 1;
+		goto cleanup_ctx;
+	}
+
+	for (i = 0; i < bd.conns_nr; i++) {
+		memset(&params, 0, sizeof(params));
+		params.type		= XIO_SESSION_CLIENT;
+		params.ses_ops		= &client_ops;
+		params.user_context	= &bd;
+		params.uri		= url;
+
+		bd.sessions[i] = xio_session_create(&params);
+		if (!bd.sessions[i])
+			break;
+
+		memset(&cparams, 0, sizeof(cparams));
+		cparams.session			= bd.sessions[i];
+		cparams.ctx			= bd.ctx;
+		cparams.conn_user_context	= &bd;
+
+		bd.conns[i] = xio_connect(&cparams);
+		if (!bd.conns[i]) {
+			xio_session_destroy(bd.sessions[i]);
+			break;
+		}
+	}
+	if (i < bd.conns_nr) {
+		fprintf(stderr, "connect %d failed. %s\n", i,
+			xio_strerror(xio_errno()));
+		bd.conns_nr = i;
+		retval = 1;
+		goto disconnect;
+	}
+	xio_context_run_loop(bd.ctx, XIO_INFINITE);
+
+	printf("%d connections, %zd bytes message, %d fan outs, " \
+	       "window %d\n", bd.conns_nr, bd.msg_size, bd.fanouts_nr,
+	       WINDOW);
+	printf("%7s  %-5s  %9s  %12s  %12s  %9s  %6s\n",
+	       "fanout", "mode", "fanouts", "fanouts/s", "msgs/s",
+	       "ns/msg", "errors");
+	for (i = 0; i < (int)(sizeof(fanouts) / sizeof(fanouts[0])); i++) {
+		if (run_fanout(&bd, fanouts[i], MODE_LOOP) ||
+		    run_fanout(&bd, fanouts[i], MODE_MULTI))
+			retval = 1;
+	}
+
+disconnect:
+	bd.closing = 1;
+	for (i = 0; i < bd.conns_nr; i++)
+		xio_disconnect(bd.conns[i]);
+	if (bd.conns_nr) {
+		check_done(&bd);
+		xio_context_run_loop(bd.ctx, XIO_INFINITE);
+	}
+	xio_unbind(server);
+cleanup_ctx:
+	xio_context_destroy(bd.ctx);
+cleanup:
+	free(bd.conns);
+	free(bd.sessions);
+	free(bd.payload);
+
+	xio_shutdown();
+
+	return retval;
+}
@@ -0,0 +1,1159 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "libxio.h"
+#include "xio_perftest_histogram.h"
+
+/*
+ * scaling matrix: a server and a client in one process, over loopback
+ * tcp by default. for every traffic mode, message size, client thread
+ * count and connections per thread, each connection keeps a window of
+ * messages in flight for a fixed time. each cell of the matrix reports
+ * messages and bytes per second, the process cpu and latency percentiles.
+ *
+ * modes:
+ *	rr	requests carry the payload, responses are header only
+ *	ow	one way messages, latency is up to the send completion
+ *	bidi	both sides send requests with the payload and answer the
+ *		other side's, rates count both directions
+ *
+ * every client thread has its own context and sessions, with a single
+ * connection each, to one of the server threads - no redirection.
+ */
+
+#define DEF_TRANSPORT		"tcp"
+#define DEF_HOST		"127.0.0.1"
+#define DEF_PORT		2261
+#define DEF_SIZES		"64:4194304:4"
+#define DEF_THREADS		"1,2,4"
+#define DEF_CONNS		"1,4"
+#define DEF_MODES		"rr,ow,bidi"
+#define DEF_WINDOW		16
+#define DEF_DURATION_MS		1000
+#define WARMUP_MS		200
+#define CONNECT_TIMEOUT_MS	5000
+#define WINDOW_BYTES		(32 * 1024 * 1024)	/* per connection */
+#define MAX_LIST		16
+
+enum bench_mode {
+	MODE_RR,
+	MODE_OW,
+	MODE_BIDI,
+	MODES_NR
+};
+
+static const char *mode_str[MODES_NR] = { "rr", "ow", "bidi" };
+
+static const double percentiles[] = { 50.0, 90.0, 99.0, 99.9, 99.99 };
+#define PERCENTILES_NR		5
+
+struct bench_params {
+	const char		*transport;
+	const char		*host;
+	const char		*output_file;
+	int			json;
+	int			port;
+	int			window;
+	int			duration_ms;
+	uint64_t		min_size;
+	uint64_t		max_size;
+	uint64_t		size_factor;
+	int			threads[MAX_LIST];
+	int			conns[MAX_LIST];
+	enum bench_mode		modes[MODES_NR];
+	int			threads_nr;
+	int			conns_nr;
+	int			modes_nr;
+	int			max_threads;
+	int			pad;
+};
+
+/* the cell that runs */
+struct bench_cell {
+	enum bench_mode		mode;
+	int			threads;
+	int			conns;
+	int			window;
+	uint64_t		size;
+};
+
+struct bench_result {
+	double			msgs_sec;
+	double			gbytes_sec;
+	double			cpu;
+	double			lat_us[PERCENTILES_NR];
+	uint64_t		msgs;
+};
+
+/* a side of the traffic - a client or a server thread */
+struct bench_ep {
+	struct xio_context	*ctx;
+	struct xio_buf		*in_buf;
+	struct xio_buf		*out_buf;
+	struct xio_msg		*free_rsps;	/* via user_context */
+	volatile uint64_t	msgs;		/* by the owner only */
+	volatile uint64_t	bytes;
+	struct perf_hist	hist;		/* nsecs, while measuring */
+	pthread_t		thread_id;
+	int			sessions_up;
+	int			pad;
+};
+
+struct bench_req {
+	struct xio_msg		msg;		/* must be first */
+	uint64_t		start_ns;
+};
+
+/* a connection of either side, its conn_user_context */
+struct bench_conn {
+	struct bench_ep		*ep;
+	struct xio_session	*session;	/* client side */
+	struct xio_connection	*conn;
+	struct bench_req	*reqs;		/* window of own requests */
+	int			outstanding;
+	int			closed;
+};
+
+/*---------------------------------------------------------------------------*/
+/* globals								     */
+/*---------------------------------------------------------------------------*/
+static struct bench_params	params;
+static struct bench_cell	cell;
+static struct bench_ep		*servers;
+static struct xio_server	**servers_bind;
+static volatile int		measuring;
+static volatile int		stopping;
+static volatile int		established;
+static volatile int		failed;
+static struct perf_hist		hist;
+static FILE			*out;
+static int			cells_nr;
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* cpu_ns - user and system time of the whole process			     */
+/*---------------------------------------------------------------------------*/
+static uint64_t cpu_ns(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* ep_init								     */
+/*---------------------------------------------------------------------------*/
+static int ep_init(struct bench_ep *ep)
+{
+	memset(ep, 0, sizeof(*ep));
+	ep->ctx = xio_context_create(NULL, 0, -1);
+	if (!ep->ctx)
+		return -1;
+	ep->in_buf	= xio_alloc(params.max_size);
+	ep->out_buf	= xio_alloc(params.max_size);
+	if (!ep->in_buf || !ep->out_buf)
+		return -1;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* ep_destroy								     */
+/*---------------------------------------------------------------------------*/
+static void ep_destroy(struct bench_ep *ep)
+{
+	struct xio_msg *rsp;
+
+	while (ep->free_rsps) {
+		rsp = ep->free_rsps;
+		ep->free_rsps = (struct xio_msg *)rsp->user_context;
+		free(rsp);
+	}
+	if (ep->in_buf)
+		xio_free(&ep->in_buf);
+	if (ep->out_buf)
+		xio_free(&ep->out_buf);
+	if (ep->ctx)
+		xio_context_destroy(ep->ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* conn_send - one of the connection's own messages			     */
+/*---------------------------------------------------------------------------*/
+static int conn_send(struct bench_conn *bconn, struct bench_req *req)
+{
+	struct xio_iovec_ex	*sglist;
+	int			retval;
+
+	memset(&req->msg, 0, sizeof(req->msg));
+	req->msg.in.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->msg.out.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->msg.in.data_iov.max_nents	= XIO_IOVLEN;
+	req->msg.out.data_iov.max_nents	= XIO_IOVLEN;
+
+	sglist = vmsg_sglist(&req->msg.out);
+	sglist[0].iov_base	= bconn->ep->out_buf->addr;
+	sglist[0].iov_len	= cell.size;
+	sglist[0].mr		= bconn->ep->out_buf->mr;
+	vmsg_sglist_set_nents(&req->msg.out, 1);
+	vmsg_sglist_set_nents(&req->msg.in, 0);
+
+	req->start_ns = get_ns();
+	if (cell.mode == MODE_OW)
+		retval = xio_send_msg(bconn->conn, &req->msg);
+	else
+		retval = xio_send_request(bconn->conn, &req->msg);
+	if (retval) {
+		fprintf(stderr, "send failed. %s\n",
+			xio_strerror(xio_errno()));
+		failed = 1;
+		return -1;
+	}
+	bconn->outstanding++;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* conn_start - fill the window						     */
+/*---------------------------------------------------------------------------*/
+static void conn_start(struct bench_conn *bconn)
+{
+	int i;
+
+	bconn->reqs = (struct bench_req *)calloc(cell.window,
+						 sizeof(*bconn->reqs));
+	if (!bconn->reqs) {
+		failed = 1;
+		return;
+	}
+	for (i = 0; i < cell.window; i++)
+		if (conn_send(bconn, &bconn->reqs[i]))
+			break;
+}
+
+/*---------------------------------------------------------------------------*/
+/* conn_complete - a response or a one way send completion		     */
+/*---------------------------------------------------------------------------*/
+static void conn_complete(struct bench_conn *bconn, struct bench_req *req)
+{
+	struct bench_ep *ep = bconn->ep;
+
+	bconn->outstanding--;
+	ep->msgs++;
+	ep->bytes += cell.size;
+	if (measuring)
+		hist_record(&ep->hist, get_ns() - req->start_ns);
+
+	if (!stopping && !bconn->closed) {
+		conn_send(bconn, req);
+		return;
+	}
+	/* the client side closes once its window drained */
+	if (bconn->session && !bconn->outstanding && !bconn->closed) {
+		bconn->closed = 1;
+		xio_disconnect(bconn->conn);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* conn_respond - header only response to the peer's request		     */
+/*---------------------------------------------------------------------------*/
+static void conn_respond(struct bench_conn *bconn, struct xio_msg *req)
+{
+	struct bench_ep	*ep = bconn->ep;
+	struct xio_msg	*rsp;
+
+	rsp = ep->free_rsps;
+	if (rsp)
+		ep->free_rsps = (struct xio_msg *)rsp->user_context;
+	else
+		rsp = (struct xio_msg *)malloc(sizeof(*rsp));
+	if (!rsp) {
+		failed = 1;
+		return;
+	}
+	memset(rsp, 0, sizeof(*rsp));
+	rsp->request		= req;
+	rsp->in.sgl_type	= XIO_SGL_TYPE_IOV;
+	rsp->out.sgl_type	= XIO_SGL_TYPE_IOV;
+	if (xio_send_response(rsp)) {
+		fprintf(stderr, "send response failed. %s\n",
+			xio_strerror(xio_errno()));
+		rsp->user_context = ep->free_rsps;
+		ep->free_rsps = rsp;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_msg - requests, one way messages and responses of both sides	     */
+/*---------------------------------------------------------------------------*/
+static int on_msg(struct xio_session *session, struct xio_msg *msg,
+		  int last_in_rxq, void *cb_user_context)
+{
+	struct bench_conn *bconn = (struct bench_conn *)cb_user_context;
+
+	switch (msg->type) {
+	case XIO_MSG_TYPE_RSP:
+		xio_release_response(msg);
+		conn_complete(bconn, (struct bench_req *)msg);
+		break;
+	case XIO_MSG_TYPE_ONE_WAY:
+		xio_release_msg(msg);
+		break;
+	default:
+		conn_respond(bconn, msg);
+		break;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_ow_msg_send_complete						     */
+/*---------------------------------------------------------------------------*/
+static int on_ow_msg_send_complete(struct xio_session *session,
+				   struct xio_msg *msg,
+				   void *cb_user_context)
+{
+	conn_complete((struct bench_conn *)cb_user_context,
+		      (struct bench_req *)msg);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_rsp_send_complete							     */
+/*---------------------------------------------------------------------------*/
+static int on_rsp_send_complete(struct xio_session *session,
+				struct xio_msg *rsp,
+				void *cb_user_context)
+{
+	struct bench_ep *ep = ((struct bench_conn *)cb_user_context)->ep;
+
+	rsp->user_context = ep->free_rsps;
+	ep->free_rsps = rsp;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_msg_error - flushed on disconnect					     */
+/*---------------------------------------------------------------------------*/
+static int on_msg_error(struct xio_session *session,
+			enum xio_status error,
+			enum xio_msg_direction direction,
+			struct xio_msg *msg,
+			void *cb_user_context)
+{
+	struct bench_conn *bconn = (struct bench_conn *)cb_user_context;
+
+	if (direction == XIO_MSG_DIRECTION_OUT &&
+	    msg->type == XIO_MSG_TYPE_RSP) {
+		on_rsp_send_complete(session, msg, cb_user_context);
+		return 0;
+	}
+	if (direction == XIO_MSG_DIRECTION_OUT) {
+		bconn->closed = 1;
+		bconn->outstanding--;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* assign_data_in_buf - payloads land in the side's scratch buffer	     */
+/*---------------------------------------------------------------------------*/
+static int assign_data_in_buf(struct xio_msg *msg, void *cb_user_context)
+{
+	struct bench_ep		*ep = ((struct bench_conn *)cb_user_context)->ep;
+	struct xio_iovec_ex	*sglist = vmsg_sglist(&msg->in);
+
+	sglist[0].iov_base	= ep->in_buf->addr;
+	sglist[0].iov_len	= ep->in_buf->length;
+	sglist[0].mr		= ep->in_buf->mr;
+	vmsg_sglist_set_nents(&msg->in, 1);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct bench_conn		*bconn;
+	struct xio_connection_attr	attr;
+
+	switch (event_data->event) {
+	case XIO_SESSION_NEW_CONNECTION_EVENT:
+		/* the connection's callbacks get its own state */
+		bconn = (struct bench_conn *)calloc(1, sizeof(*bconn));
+		if (!bconn) {
+			failed = 1;
+			break;
+		}
+		bconn->ep	= (struct bench_ep *)cb_user_context;
+		bconn->conn	= event_data->conn;
+		memset(&attr, 0, sizeof(attr));
+		attr.user_context = bconn;
+		xio_modify_connection(event_data->conn, &attr,
+				      XIO_CONNECTION_ATTR_USER_CTX);
+		if (cell.mode == MODE_BIDI)
+			conn_start(bconn);
+		break;
+	case XIO_SESSION_CONNECTION_CLOSED_EVENT:
+	case XIO_SESSION_CONNECTION_DISCONNECTED_EVENT:
+		bconn = (struct bench_conn *)event_data->conn_user_context;
+		if (bconn && bconn != cb_user_context)
+			bconn->closed = 1;
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		bconn = (struct bench_conn *)event_data->conn_user_context;
+		xio_connection_destroy(event_data->conn);
+		if (bconn && bconn != cb_user_context) {
+			free(bconn->reqs);
+			free(bconn);
+		}
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+	.on_msg				=  on_msg,
+	.on_msg_send_complete		=  on_rsp_send_complete,
+	.on_ow_msg_send_complete	=  on_ow_msg_send_complete,
+	.on_msg_error			=  on_msg_error,
+	.assign_data_in_buf		=  assign_data_in_buf,
+};
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct bench_conn	*bconn = (struct bench_conn *)cb_user_context;
+	struct bench_ep		*ep = bconn->ep;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		__sync_add_and_fetch(&established, 1);
+		conn_start(bconn);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_REFUSED_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "client: %s. reason: %s\n",
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		failed = 1;
+		bconn->closed = 1;
+		break;
+	case XIO_SESSION_CONNECTION_CLOSED_EVENT:
+	case XIO_SESSION_CONNECTION_DISCONNECTED_EVENT:
+		bconn->closed = 1;
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		if (--ep->sessions_up == 0)
+			xio_context_stop_loop(ep->ctx);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+	.on_msg				=  on_msg,
+	.on_msg_send_complete		=  on_rsp_send_complete,
+	.on_ow_msg_send_complete	=  on_ow_msg_send_complete,
+	.on_msg_error			=  on_msg_error,
+	.assign_data_in_buf		=  assign_data_in_buf,
+};
+
+/*---------------------------------------------------------------------------*/
+/* run_loop_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *run_loop_thread(void *data)
+{
+	struct bench_ep *ep = (struct bench_ep *)data;
+
+	xio_context_run_loop(ep->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_start - a context and a listener per client thread		     */
+/*---------------------------------------------------------------------------*/
+static int server_start(void)
+{
+	char	uri[256];
+	int	i;
+
+	servers = (struct bench_ep *)calloc(params.max_threads,
+					    sizeof(*servers));
+	servers_bind = (struct xio_server **)calloc(params.max_threads,
+						    sizeof(*servers_bind));
+	if (!servers || !servers_bind)
+		return -1;
+
+	for (i = 0; i < params.max_threads; i++) {
+		if (ep_init(&servers[i]))
+			return -1;
+		sprintf(uri, "%s://%s:%d", params.transport, params.host,
+			params.port + i);
+		servers_bind[i] = xio_bind(servers[i].ctx, &server_ops, uri,
+					   NULL, 0, &servers[i]);
+		if (!servers_bind[i]) {
+			fprintf(stderr, "failed to bind %s. %s\n", uri,
+				xio_strerror(xio_errno()));
+			return -1;
+		}
+		pthread_create(&servers[i].thread_id, NULL, run_loop_thread,
+			       &servers[i]);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_stop								     */
+/*---------------------------------------------------------------------------*/
+static void server_stop(void)
+{
+	int i;
+
+	for (i = 0; servers && i < params.max_threads; i++) {
+		if (servers_bind && servers_bind[i]) {
+			xio_context_stop_loop(servers[i].ctx);
+			pthread_join(servers[i].thread_id, NULL);
+			xio_unbind(servers_bind[i]);
+		}
+		ep_destroy(&servers[i]);
+	}
+	free(servers_bind);
+	free(servers);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_connect - the sessions of a client thread, one connection each    */
+/*---------------------------------------------------------------------------*/
+static int client_connect(struct bench_ep *ep, struct bench_conn *bconns,
+			  int id)
+{
+	struct xio_session_params	sparams;
+	struct xio_connection_params	cparams;
+	char				uri[256];
+	int				i;
+
+	/* client thread i talks to server thread i */
+	sprintf(uri, "%s://%s:%d", params.transport, params.host,
+		params.port + id % params.max_threads);
+
+	for (i = 0; i < cell.conns; i++) {
+		bconns[i].ep = ep;
+
+		memset(&sparams, 0, sizeof(sparams));
+		sparams.type		= XIO_SESSION_CLIENT;
+		sparams.ses_ops		= &client_ops;
+		sparams.user_context	= &bconns[i];
+		sparams.uri		= uri;
+		bconns[i].session = xio_session_create(&sparams);
+		if (!bconns[i].session)
+			return -1;
+		ep->sessions_up++;
+
+		memset(&cparams, 0, sizeof(cparams));
+		cparams.session			= bconns[i].session;
+		cparams.ctx			= ep->ctx;
+		cparams.conn_user_context	= &bconns[i];
+		bconns[i].conn = xio_connect(&cparams);
+		if (!bconns[i].conn)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* eps_sum								     */
+/*---------------------------------------------------------------------------*/
+static void eps_sum(struct bench_ep *clients, uint64_t *msgs,
+		    uint64_t *bytes)
+{
+	int i;
+
+	*msgs = 0;
+	*bytes = 0;
+	for (i = 0; i < cell.threads; i++) {
+		*msgs += clients[i].msgs;
+		*bytes += clients[i].bytes;
+	}
+	/* the server's own requests */
+	for (i = 0; cell.mode == MODE_BIDI && i < params.max_threads; i++) {
+		*msgs += servers[i].msgs;
+		*bytes += servers[i].bytes;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* run_cell								     */
+/*---------------------------------------------------------------------------*/
+static int run_cell(struct bench_result *res)
+{
+	struct bench_ep		*clients;
+	struct bench_conn	**bconns;
+	uint64_t		msgs[2], bytes[2];
+	uint64_t		wall[2] = {0}, cpu[2] = {0};
+	uint64_t		deadline;
+	int			i, j;
+
+	measuring	= 0;
+	stopping	= 0;
+	established	= 0;
+	failed		= 0;
+	for (i = 0; i < params.max_threads; i++) {
+		hist_reset(&servers[i].hist);
+		servers[i].msgs = 0;
+		servers[i].bytes = 0;
+	}
+
+	clients = (struct bench_ep *)calloc(cell.threads, sizeof(*clients));
+	bconns = (struct bench_conn **)calloc(cell.threads, sizeof(*bconns));
+	if (!clients || !bconns) {
+		free(clients);
+		free(bconns);
+		return -1;
+	}
+	for (i = 0; i < cell.threads; i++) {
+		bconns[i] = (struct bench_conn *)calloc(cell.conns,
+							sizeof(**bconns));
+		if (!bconns[i] || ep_init(&clients[i]) ||
+		    client_connect(&clients[i], bconns[i], i)) {
+			fprintf(stderr, "client setup failed. %s\n",
+				xio_strerror(xio_errno()));
+			failed = 1;
+			break;
+		}
+	}
+	for (i = 0; i < cell.threads; i++)
+		if (clients[i].sessions_up)
+			pthread_create(&clients[i].thread_id, NULL,
+				       run_loop_thread, &clients[i]);
+
+	deadline = get_ns() + CONNECT_TIMEOUT_MS * 1000000ULL;
+	while (!failed && established < cell.threads * cell.conns) {
+		if (get_ns() > deadline) {
+			fprintf(stderr, "connect timed out\n");
+			failed = 1;
+			break;
+		}
+		usleep(1000);
+	}
+
+	if (!failed) {
+		usleep(WARMUP_MS * 1000);
+		eps_sum(clients, &msgs[0], &bytes[0]);
+		wall[0]	= get_ns();
+		cpu[0]	= cpu_ns();
+		measuring = 1;
+
+		usleep(params.duration_ms * 1000);
+
+		measuring = 0;
+		eps_sum(clients, &msgs[1], &bytes[1]);
+		wall[1]	= get_ns();
+		cpu[1]	= cpu_ns();
+	}
+	stopping = 1;
+
+	/* connections that never came up would not drain - give up */
+	for (i = 0; failed && i < cell.threads; i++)
+		if (clients[i].sessions_up)
+			xio_context_stop_loop(clients[i].ctx);
+	for (i = 0; i < cell.threads; i++)
+		if (clients[i].sessions_up)
+			pthread_join(clients[i].thread_id, NULL);
+	if (failed)
+		return -1;
+
+	hist_reset(&hist);
+	for (i = 0; i < cell.threads; i++)
+		hist_merge(&hist, &clients[i].hist);
+	for (i = 0; i < params.max_threads; i++)
+		hist_merge(&hist, &servers[i].hist);
+
+	res->msgs	= msgs[1] - msgs[0];
+	res->msgs_sec	= res->msgs * 1e9 / (wall[1] - wall[0]);
+	res->gbytes_sec	= (bytes[1] - bytes[0]) / (double)(wall[1] - wall[0]);
+	res->cpu	= 100.0 * (cpu[1] - cpu[0]) / (wall[1] - wall[0]);
+	for (i = 0; i < PERCENTILES_NR; i++)
+		res->lat_us[i] = hist_percentile(&hist, percentiles[i]) /
+				 1000.0;
+
+	for (i = 0; i < cell.threads; i++) {
+		for (j = 0; bconns[i] && j < cell.conns; j++)
+			free(bconns[i][j].reqs);
+		free(bconns[i]);
+		ep_destroy(&clients[i]);
+	}
+	free(bconns);
+	free(clients);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_list - comma separated positive integers			     */
+/*---------------------------------------------------------------------------*/
+static int parse_list(const char *str, int *list)
+{
+	char	*end;
+	int	nr = 0;
+	long	val;
+
+	while (*str) {
+		val = strtol(str, &end, 0);
+		if (end == str || val <= 0 || nr == MAX_LIST)
+			return -1;
+		list[nr++] = (int)val;
+		str = (*end == ',') ? end + 1 : end;
+		if (*end && *end != ',')
+			return -1;
+	}
+
+	return nr ? nr : -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_sizes - min:max[:factor]					     */
+/*---------------------------------------------------------------------------*/
+static int parse_sizes(const char *str)
+{
+	char *end;
+
+	params.min_size = strtoull(str, &end, 0);
+	params.max_size = params.min_size;
+	params.size_factor = 2;
+	if (*end == ':')
+		params.max_size = strtoull(end + 1, &end, 0);
+	if (*end == ':')
+		params.size_factor = strtoull(end + 1, &end, 0);
+
+	if (*end || !params.min_size || params.max_size < params.min_size ||
+	    params.size_factor < 2)
+		return -1;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_modes								     */
+/*---------------------------------------------------------------------------*/
+static int parse_modes(const char *str)
+{
+	const char	*end;
+	size_t		len;
+	int		i;
+
+	params.modes_nr = 0;
+	while (*str) {
+		end = strchr(str, ',');
+		len = end ? (size_t)(end - str) : strlen(str);
+		for (i = 0; i < MODES_NR; i++)
+			if (strlen(mode_str[i]) == len &&
+			    !strncmp(str, mode_str[i], len))
+				break;
+		if (i == MODES_NR || params.modes_nr == MODES_NR)
+			return -1;
+		params.modes[params.modes_nr++] = (enum bench_mode)i;
+		str += len + (end ? 1 : 0);
+	}
+
+	return params.modes_nr ? 0 : -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* usage								     */
+/*---------------------------------------------------------------------------*/
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s [OPTIONS]\t\tscaling matrix over loopback\n", argv0);
+	printf("\n");
+	printf("options:\n");
+	printf("\t-r, --transport=<name> ");
+	printf("\ttransport (default %s)\n", DEF_TRANSPORT);
+	printf("\t-a, --address=<host> ");
+	printf("\tlisten and connect address (default %s)\n", DEF_HOST);
+	printf("\t-p, --port=<port> ");
+	printf("\tfirst port, one per server thread (default %d)\n",
+	       DEF_PORT);
+	printf("\t-s, --sizes=<min:max[:factor]> ");
+	printf("\tmessage sizes (default %s)\n", DEF_SIZES);
+	printf("\t-t, --threads=<list> ");
+	printf("\tclient threads (default %s)\n", DEF_THREADS);
+	printf("\t-c, --conns=<list> ");
+	printf("\tconnections per thread (default %s)\n", DEF_CONNS);
+	printf("\t-m, --modes=<list> ");
+	printf("\trr, ow and bidi (default %s)\n", DEF_MODES);
+	printf("\t-w, --window=<msgs> ");
+	printf("\tmessages in flight per connection (default %d)\n",
+	       DEF_WINDOW);
+	printf("\t-d, --duration=<msecs> ");
+	printf("\tmeasured time per cell (default %d)\n", DEF_DURATION_MS);
+	printf("\t-o, --output_file=<file> ");
+	printf("\twrite the matrix to a file\n");
+	printf("\t-F, --format=<json|csv> ");
+	printf("\tformat of the file (default json)\n");
+	printf("\t-h, --help ");
+	printf("\tdisplay this help and exit\n");
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_cmdline							     */
+/*---------------------------------------------------------------------------*/
+static int parse_cmdline(int argc, char **argv)
+{
+	static struct option const long_options[] = {
+		{ .name = "transport",	 .has_arg = 1, .val = 'r'},
+		{ .name = "address",	 .has_arg = 1, .val = 'a'},
+		{ .name = "port",	 .has_arg = 1, .val = 'p'},
+		{ .name = "sizes",	 .has_arg = 1, .val = 's'},
+		{ .name = "threads",	 .has_arg = 1, .val = 't'},
+		{ .name = "conns",	 .has_arg = 1, .val = 'c'},
+		{ .name = "modes",	 .has_arg = 1, .val = 'm'},
+		{ .name = "window",	 .has_arg = 1, .val = 'w'},
+		{ .name = "duration",	 .has_arg = 1, .val = 'd'},
+		{ .name = "output_file", .has_arg = 1, .val = 'o'},
+		{ .name = "format",	 .has_arg = 1, .val = 'F'},
+		{ .name = "help",	 .has_arg = 0, .val = 'h'},
+		{0, 0, 0, 0},
+	};
+	static char *short_options = "r:a:p:s:t:c:m:w:d:o:F:h";
+	int c, i;
+
+	params.transport	= DEF_TRANSPORT;
+	params.host		= DEF_HOST;
+	params.port		= DEF_PORT;
+	params.window		= DEF_WINDOW;
+	params.duration_ms	= DEF_DURATION_MS;
+	params.json		= 1;
+	parse_sizes(DEF_SIZES);
+	params.threads_nr	= parse_list(DEF_THREADS, params.threads);
+	params.conns_nr		= parse_list(DEF_CONNS, params.conns);
+	parse_modes(DEF_MODES);
+
+	optind = 0;
+	opterr = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options,
+				long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'r':
+			params.transport = optarg;
+			break;
+		case 'a':
+			params.host = optarg;
+			break;
+		case 'p':
+			params.port = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			if (parse_sizes(optarg))
+				goto invalid;
+			break;
+		case 't':
+			params.threads_nr = parse_list(optarg, params.threads);
+			if (params.threads_nr < 0)
+				goto invalid;
+			break;
+		case 'c':
+			params.conns_nr = parse_list(optarg, params.conns);
+			if (params.conns_nr < 0)
+				goto invalid;
+			break;
+		case 'm':
+			if (parse_modes(optarg))
+				goto invalid;
+			break;
+		case 'w':
+			params.window = strtol(optarg, NULL, 0);
+			if (params.window <= 0)
+				goto invalid;
+			break;
+		case 'd':
+			params.duration_ms = strtol(optarg, NULL, 0);
+			if (params.duration_ms <= 0)
+				goto invalid;
+			break;
+		case 'o':
+			params.output_file = optarg;
+			break;
+		case 'F':
+			if (!strcmp(optarg, "csv"))
+				params.json = 0;
+			else if (!strcmp(optarg, "json"))
+				params.json = 1;
+			else
+				goto invalid;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(0);
+		default:
+			goto invalid;
+		}
+	}
+	if (optind < argc)
+		goto invalid;
+
+	for (i = 0; i < params.threads_nr; i++)
+		if (params.threads[i] > params.max_threads)
+			params.max_threads = params.threads[i];
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "invalid command line\n");
+	usage(argv[0]);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* output_open								     */
+/*---------------------------------------------------------------------------*/
+static int output_open(void)
+{
+	if (!params.output_file)
+		return 0;
+
+	out = fopen(params.output_file, "w");
+	if (!out) {
+		perror("fopen");
+		return -1;
+	}
+	if (params.json)
+		fprintf(out, "{\"transport\": \"%s\", \"window\": %d, "
+			"\"duration_ms\": %d, \"cells\": [",
+			params.transport, params.window, params.duration_ms);
+	else
+		fprintf(out, "mode,size,threads,conns,window,msgs_sec,"
+			"gbytes_sec,cpu,p50,p90,p99,p99.9,p99.99\n");
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* output_result							     */
+/*---------------------------------------------------------------------------*/
+static void output_result(struct bench_result *res)
+{
+	int i;
+
+	printf("%-5s %10" PRIu64 " %7d %5d %6d %12.0f %9.3f %6.1f",
+	       mode_str[cell.mode], cell.size, cell.threads, cell.conns,
+	       cell.window, res->msgs_sec, res->gbytes_sec, res->cpu);
+	for (i = 0; i < PERCENTILES_NR; i++)
+		printf(" %9.2f", res->lat_us[i]);
+	printf("\n");
+	fflush(stdout);
+
+	if (!out)
+		return;
+
+	if (params.json) {
+		fprintf(out, "%s\n  {\"mode\": \"%s\", \"size\": %" PRIu64
+			", \"threads\": %d, \"conns\": %d, \"window\": %d, "
+			"\"msgs\": %" PRIu64 ", \"msgs_sec\": %.0f, "
+			"\"gbytes_sec\": %.6f, \"cpu\": %.1f, \"lat_us\": {",
+			cells_nr ? "," : "", mode_str[cell.mode], cell.size,
+			cell.threads, cell.conns, cell.window, res->msgs,
+			res->msgs_sec, res->gbytes_sec, res->cpu);
+		for (i = 0; i < PERCENTILES_NR; i++)
+			fprintf(out, "%s\"p%g\": %.2f", i ? ", " : "",
+				percentiles[i], res->lat_us[i]);
+		fprintf(out, "}}");
+	} else {
+		fprintf(out, "%s,%" PRIu64 ",%d,%d,%d,%.0f,%.6f,%.1f",
+			mode_str[cell.mode], cell.size, cell.threads,
+			cell.conns, cell.window, res->msgs_sec,
+			res->gbytes_sec, res->cpu);
+		for (i = 0; i < PERCENTILES_NR; i++)
+			fprintf(out, ",%.2f", res->lat_us[i]);
+		fprintf(out, "\n");
+	}
+	fflush(out);
+}
+
+/*---------------------------------------------------------------------------*/
+/* output_close								     */
+/*---------------------------------------------------------------------------*/
+static void output_close(void)
+{
+	if (!out)
+		return;
+	if (params.json)
+		fprintf(out, "\n]}\n");
+	fclose(out);
+	out = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct bench_result	res;
+	uint64_t		size;
+	int			m, t, c;
+	int			retval = -1;
+
+	if (parse_cmdline(argc, argv))
+		return -1;
+
+	xio_init();
+
+	if (server_start() || output_open())
+		goto cleanup;
+
+	printf("%-5s %10s %7s %5s %6s %12s %9s %6s %9s %9s %9s %9s %10s\n",
+	       "mode", "size", "threads", "conns", "window", "msgs/sec",
+	       "GB/sec", "cpu%", "p50[us]", "p90[us]", "p99[us]",
+	       "p99.9[us]", "p99.99[us]");
+
+	for (m = 0; m < params.modes_nr; m++) {
+		for (size = params.min_size; size <= params.max_size;
+		     size *= params.size_factor) {
+			for (t = 0; t < params.threads_nr; t++) {
+				for (c = 0; c < params.conns_nr; c++) {
+					cell.mode	= params.modes[m];
+					cell.size	= size;
+					cell.threads	= params.threads[t];
+					cell.conns	= params.conns[c];
+					/* keep under the queued bytes limit */
+					cell.window	= params.window;
+					if ((uint64_t)cell.window * size >
+					    WINDOW_BYTES)
+						cell.window = WINDOW_BYTES /
+							      size;
+					if (!cell.window)
+						cell.window = 1;
+
+					memset(&res, 0, sizeof(res));
+					if (run_cell(&res)) {
+						fprintf(stderr,
+							"cell failed\n");
+						goto cleanup;
+					}
+					output_result(&res);
+					cells_nr++;
+				}
+			}
+		}
+	}
+	retval = 0;
+
+cleanup:
+	output_close();
+	/* a failed cell leaves connections behind, just exit */
+	if (retval)
+		return retval;
+
+	server_stop();
+	xio_shutdown();
+
+	return retval;
+}
@@ -0,0 +1,1018 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include <sys/hashtable.h>
+#include <sys/eventfd.h>
+#include <getopt.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_hash.h"
+#include "xio_sn_hash.h"
+#include "xio_protocol.h"
+#include "xio_mbuf.h"
+#include "xio_task.h"
+#include "xio_observer.h"
+#include "xio_ev_data.h"
+#include "xio_ev_loop.h"
+#include "xio_workqueue.h"
+#include "xio_timers_list.h"
+
+/*
+ * micro benchmarks of the library's internal building blocks, in
+ * isolation. the program links the static library so the internal
+ * symbols are reachable, and wraps the allocator entry points
+ * (-Wl,--wrap) to count the allocations made by the measured code.
+ *
+ * every benchmark is calibrated to run at least --duration msecs and is
+ * then repeated --reps times. ns/op is the median of the repetitions,
+ * allocs/op counts over all of them.
+ */
+
+#define DEF_DURATION_MS		50
+#define DEF_REPS		5
+#define MAX_REPS		64
+#define CALIBRATE_ITERS		1024
+
+#define MEMPOOL_SLAB_SIZE	1024
+#define MEMPOOL_BURST		16
+#define TASKS_NR		4096
+#define TASKS_SLAB_NR		256
+#define TIMERS_RESIDENT		64
+#define HASH_KEYS		1024
+#define MBUF_BUF_SIZE		512
+#define IOV_NR			4
+#define IOV_SEG_SIZE		1024
+#define EV_ADD_DEL_BATCH	256
+
+/*---------------------------------------------------------------------------*/
+/* allocation accounting						     */
+/*---------------------------------------------------------------------------*/
+static uint64_t allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int __real_posix_memalign(void **memptr, size_t alignment, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	__sync_fetch_and_add(&allocs, 1);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+	__sync_fetch_and_add(&allocs, 1);
+	return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	__sync_fetch_and_add(&allocs, 1);
+	return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	__sync_fetch_and_add(&allocs, 1);
+	return __real_posix_memalign(memptr, alignment, size);
+}
+
+/*---------------------------------------------------------------------------*/
+/* benchmark descriptors						     */
+/*---------------------------------------------------------------------------*/
+struct mb_bench {
+	const char	*name;
+	const char	*desc;
+	/* returns the state passed to run and teardown, NULL on error */
+	void		*(*setup)(void);
+	void		(*run)(void *state, uint64_t iters);
+	void		(*teardown)(void *state);
+};
+
+struct mb_result {
+	const char	*name;
+	uint64_t	iters;		/* per repetition */
+	double		ns_op;		/* median */
+	double		ns_op_min;
+	double		allocs_op;
+};
+
+static struct {
+	const char	*filter;
+	const char	*output_file;
+	int		duration_ms;
+	int		reps;
+	int		threads;
+	int		list;
+} params;
+
+/* defeats dead code elimination of results */
+static volatile uint64_t sink;
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* mempool								     */
+/*---------------------------------------------------------------------------*/
+struct mempool_state {
+	struct xio_mempool	*pool;
+	uint64_t		iters;	/* per thread */
+};
+
+static void *mempool_setup(void)
+{
+	struct mempool_state *s;
+
+	s = (struct mempool_state *)calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->pool = xio_mempool_create(-1, XIO_MEMPOOL_FLAG_REGULAR_PAGES_ALLOC);
+	if (!s->pool ||
+	    xio_mempool_add_slab(s->pool, MEMPOOL_SLAB_SIZE, 1024,
+				 1024 * 1024, 1024)) {
+		free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+/* a burst of allocations then frees, as a batch of rx buffers would */
+static void *mempool_worker(void *data)
+{
+	struct mempool_state	*s = (struct mempool_state *)data;
+	struct xio_mempool_obj	obj[MEMPOOL_BURST];
+	uint64_t		i;
+	int			j;
+
+	for (i = 0; i < s->iters; i += MEMPOOL_BURST) {
+		for (j = 0; j < MEMPOOL_BURST; j++)
+			xio_mempool_alloc(s->pool, MEMPOOL_SLAB_SIZE, &obj[j]);
+		for (j = 0; j < MEMPOOL_BURST; j++)
+			xio_mempool_free(&obj[j]);
+	}
+
+	return NULL;
+}
+
+static void mempool_run(void *state, uint64_t iters)
+{
+	struct mempool_state *s = (struct mempool_state *)state;
+
+	s->iters = iters;
+	mempool_worker(s);
+}
+
+static void mempool_mt_run(void *state, uint64_t iters)
+{
+	struct mempool_state	*s = (struct mempool_state *)state;
+	pthread_t		threads[64];
+	int			i, nr = params.threads;
+
+	/* total ops spread over the threads - ns/op is per aggregate op */
+	s->iters = iters / nr;
+	for (i = 0; i < nr; i++)
+		pthread_create(&threads[i], NULL, mempool_worker, s);
+	for (i = 0; i < nr; i++)
+		pthread_join(threads[i], NULL);
+}
+
+static void mempool_teardown(void *state)
+{
+	struct mempool_state *s = (struct mempool_state *)state;
+
+	xio_mempool_destroy(s->pool);
+	free(s);
+}
+
+/*---------------------------------------------------------------------------*/
+/* tasks pool								     */
+/*---------------------------------------------------------------------------*/
+static void *tasks_pool_setup(void)
+{
+	struct xio_tasks_pool_params	tparams;
+	struct xio_tasks_pool		*q;
+	struct xio_task			*tasks[TASKS_NR];
+	int				i;
+
+	memset(&tparams, 0, sizeof(tparams));
+	tparams.start_nr	= TASKS_SLAB_NR;
+	tparams.max_nr		= TASKS_NR;
+	tparams.alloc_nr	= TASKS_SLAB_NR;
+	tparams.node_id		= -1;
+
+	q = xio_tasks_pool_create(&tparams);
+	if (!q)
+		return NULL;
+
+	/* grow to all the slabs up front, so lookup walks a real list */
+	for (i = 0; i < TASKS_NR; i++)
+		tasks[i] = xio_tasks_pool_get(q);
+	for (i = 0; i < TASKS_NR; i++)
+		if (tasks[i])
+			xio_tasks_pool_put(tasks[i]);
+
+	return q;
+}
+
+static void tasks_pool_get_put_run(void *state, uint64_t iters)
+{
+	struct xio_tasks_pool	*q = (struct xio_tasks_pool *)state;
+	struct xio_task		*t;
+	uint64_t		i;
+
+	for (i = 0; i < iters; i++) {
+		t = xio_tasks_pool_get(q);
+		xio_tasks_pool_put(t);
+	}
+}
+
+static void tasks_pool_lookup_run(void *state, uint64_t iters)
+{
+	struct xio_tasks_pool	*q = (struct xio_tasks_pool *)state;
+	uint64_t		i, acc = 0;
+
+	/* stride over all the slabs */
+	for (i = 0; i < iters; i++)
+		acc += (uintptr_t)xio_tasks_pool_lookup(
+				q, (unsigned int)(i * 97) % TASKS_NR);
+	sink = acc;
+}
+
+static void tasks_pool_teardown(void *state)
+{
+	xio_tasks_pool_destroy((struct xio_tasks_pool *)state);
+}
+
+/*---------------------------------------------------------------------------*/
+/* timers list								     */
+/*---------------------------------------------------------------------------*/
+struct timers_state {
+	struct xio_timers_list		list;
+	struct xio_timers_list_entry	entries[TIMERS_RESIDENT + 1];
+};
+
+static void *timers_list_setup(void)
+{
+	struct timers_state	*s;
+	int			i;
+
+	s = (struct timers_state *)calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	xio_timers_list_init(&s->list, NULL);
+
+	/* resident timers spread over a second, as keepalives would be */
+	for (i = 0; i < TIMERS_RESIDENT; i++) {
+		INIT_LIST_HEAD(&s->entries[i].entry);
+		s->entries[i].expires = (i * 7919ULL % TIMERS_RESIDENT) *
+					(XIO_NS_IN_SEC / TIMERS_RESIDENT);
+		xio_timers_list_add(&s->list, &s->entries[i]);
+	}
+	INIT_LIST_HEAD(&s->entries[TIMERS_RESIDENT].entry);
+
+	return s;
+}
+
+static void timers_list_run(void *state, uint64_t iters)
+{
+	struct timers_state		*s = (struct timers_state *)state;
+	struct xio_timers_list_entry	*t = &s->entries[TIMERS_RESIDENT];
+	uint64_t			i;
+
+	for (i = 0; i < iters; i++) {
+		t->expires = (i * 7919ULL % XIO_NS_IN_SEC);
+		xio_timers_list_add(&s->list, t);
+		xio_timers_list_del(&s->list, t);
+	}
+}
+
+static void timers_list_teardown(void *state)
+{
+	struct timers_state *s = (struct timers_state *)state;
+
+	xio_timers_list_close(&s->list);
+	free(s);
+}
+
+/*---------------------------------------------------------------------------*/
+/* HT_* hash tables							     */
+/*---------------------------------------------------------------------------*/
+struct ht_entry {
+	HT_ENTRY(ht_entry, xio_key_int32)	ht;
+	uint32_t				id;
+	uint32_t				pad;
+};
+
+struct ht_state {
+	HT_HEAD(, ht_entry, HASHTABLE_PRIME_SMALL)	head;
+	struct ht_entry				entries[HASH_KEYS];
+};
+
+static void *ht_setup(void)
+{
+	struct ht_state		*s;
+	struct ht_entry		*e;
+	struct xio_key_int32	key;
+	int			i;
+
+	s = (struct ht_state *)calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	HT_INIT(&s->head, xio_int32_hash, xio_int32_cmp, xio_int32_cp);
+	for (i = 0; i < HASH_KEYS; i++) {
+		e = &s->entries[i];
+		e->id = i;
+		key.id = i;
+		HT_INSERT(&s->head, &key, e, ht);
+	}
+
+	return s;
+}
+
+static void ht_lookup_run(void *state, uint64_t iters)
+{
+	struct ht_state		*s = (struct ht_state *)state;
+	struct ht_entry		*e;
+	struct xio_key_int32	key = { 0, {0} };
+	uint64_t		i, acc = 0;
+
+	for (i = 0; i < iters; i++) {
+		key.id = (uint32_t)(i * 7919) % HASH_KEYS;
+		HT_LOOKUP(&s->head, &key, e, ht);
+		acc += (uintptr_t)e;
+	}
+	sink = acc;
+}
+
+static void ht_insert_remove_run(void *state, uint64_t iters)
+{
+	struct ht_state		*s = (struct ht_state *)state;
+	struct ht_entry		*e;
+	struct xio_key_int32	key = { 0, {0} };
+	uint64_t		i;
+
+	for (i = 0; i < iters; i++) {
+		key.id = (uint32_t)(i * 7919) % HASH_KEYS;
+		HT_LOOKUP(&s->head, &key, e, ht);
+		HT_REMOVE(&s->head, e, ht_entry, ht);
+		HT_INSERT(&s->head, &key, e, ht);
+	}
+}
+
+static void ht_teardown(void *state)
+{
+	free(state);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash - the session, nexus and in flight request caches	     */
+/*---------------------------------------------------------------------------*/
+static void *sn_hash_setup(void)
+{
+	struct xio_sn_hash	*hash;
+	uint64_t		i;
+
+	hash = (struct xio_sn_hash *)calloc(1, sizeof(*hash));
+	if (!hash)
+		return NULL;
+	xio_sn_hash_init(hash);
+	for (i = 0; i < HASH_KEYS; i++)
+		xio_sn_hash_insert(hash, i, (void *)(uintptr_t)(i + 1));
+
+	return hash;
+}
+
+static void sn_hash_lookup_run(void *state, uint64_t iters)
+{
+	struct xio_sn_hash	*hash = (struct xio_sn_hash *)state;
+	uint64_t		i, acc = 0;
+
+	for (i = 0; i < iters; i++)
+		acc += (uintptr_t)xio_sn_hash_lookup(hash,
+						     (i * 7919) % HASH_KEYS);
+	sink = acc;
+}
+
+static void sn_hash_insert_remove_run(void *state, uint64_t iters)
+{
+	struct xio_sn_hash	*hash = (struct xio_sn_hash *)state;
+	uint64_t		i, key;
+	void			*val;
+
+	for (i = 0; i < iters; i++) {
+		key = (i * 7919) % HASH_KEYS;
+		val = xio_sn_hash_remove(hash, key);
+		xio_sn_hash_insert(hash, key, val);
+	}
+}
+
+static void sn_hash_teardown(void *state)
+{
+	xio_sn_hash_destroy((struct xio_sn_hash *)state);
+	free(state);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_mbuf TLV								     */
+/*---------------------------------------------------------------------------*/
+struct mbuf_state {
+	struct xio_mbuf		mbuf;
+	uint8_t			buf[MBUF_BUF_SIZE];
+};
+
+/* a header shaped like the session header: a few fixed width fields */
+static int mbuf_encode(struct xio_mbuf *mbuf, uint64_t sn)
+{
+	xio_mbuf_reset(mbuf);
+	if (xio_mbuf_tlv_start(mbuf))
+		return -1;
+	xio_mbuf_write_u32(mbuf, 0x1234);
+	xio_mbuf_write_u16(mbuf, 1);
+	xio_mbuf_write_u16(mbuf, 2);
+	xio_mbuf_write_u64(mbuf, sn);
+	xio_mbuf_write_u64(mbuf, ~sn);
+	xio_mbuf_write_u32(mbuf, 64);
+
+	return xio_mbuf_write_tlv(mbuf, XIO_MSG_REQ,
+				  xio_mbuf_tlv_payload_len(mbuf));
+}
+
+static void *mbuf_setup(void)
+{
+	struct mbuf_state *s;
+
+	s = (struct mbuf_state *)calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	xio_mbuf_init(&s->mbuf, s->buf, MBUF_BUF_SIZE, 0);
+	if (mbuf_encode(&s->mbuf, 0)) {
+		free(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+static void mbuf_encode_run(void *state, uint64_t iters)
+{
+	struct mbuf_state	*s = (struct mbuf_state *)state;
+	uint64_t		i;
+
+	for (i = 0; i < iters; i++)
+		mbuf_encode(&s->mbuf, i);
+}
+
+static void mbuf_decode_run(void *state, uint64_t iters)
+{
+	struct mbuf_state	*s = (struct mbuf_state *)state;
+	uint64_t		i, acc = 0, v64 = 0;
+	uint32_t		v32 = 0;
+	uint16_t		v16 = 0;
+
+	for (i = 0; i < iters; i++) {
+		xio_mbuf_reset(&s->mbuf);
+		if (xio_mbuf_read_first_tlv(&s->mbuf))
+			break;
+		xio_mbuf_read_u32(&s->mbuf, &v32);
+		acc += v32;
+		xio_mbuf_read_u16(&s->mbuf, &v16);
+		acc += v16;
+		xio_mbuf_read_u16(&s->mbuf, &v16);
+		acc += v16;
+		xio_mbuf_read_u64(&s->mbuf, &v64);
+		acc += v64;
+		xio_mbuf_read_u64(&s->mbuf, &v64);
+		acc += v64;
+		xio_mbuf_read_u32(&s->mbuf, &v32);
+		acc += v32;
+	}
+	sink = acc;
+}
+
+static void mbuf_teardown(void *state)
+{
+	free(state);
+}
+
+/*---------------------------------------------------------------------------*/
+/* memcpyv / memclonev							     */
+/*---------------------------------------------------------------------------*/
+struct iov_state {
+	struct xio_iovec	src[IOV_NR];
+	struct xio_iovec	dst[IOV_NR];
+	char			*sbuf;
+	char			*dbuf;
+};
+
+static void *iov_setup(void)
+{
+	struct iov_state	*s;
+	int			i;
+
+	s = (struct iov_state *)calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->sbuf = (char *)calloc(IOV_NR, IOV_SEG_SIZE);
+	s->dbuf = (char *)calloc(IOV_NR, IOV_SEG_SIZE);
+	if (!s->sbuf || !s->dbuf) {
+		free(s->sbuf);
+		free(s->dbuf);
+		free(s);
+		return NULL;
+	}
+	for (i = 0; i < IOV_NR; i++) {
+		s->src[i].iov_base	= s->sbuf + i * IOV_SEG_SIZE;
+		s->src[i].iov_len	= IOV_SEG_SIZE;
+	}
+
+	return s;
+}
+
+/* gather the source segments into one destination buffer */
+static void memcpyv_run(void *state, uint64_t iters)
+{
+	struct iov_state	*s = (struct iov_state *)state;
+	uint64_t		i, acc = 0;
+
+	for (i = 0; i < iters; i++) {
+		s->dst[0].iov_base	= s->dbuf;
+		s->dst[0].iov_len	= IOV_NR * IOV_SEG_SIZE;
+		acc += memcpyv(s->dst, 1, s->src, IOV_NR);
+	}
+	sink = acc;
+}
+
+static void memclonev_run(void *state, uint64_t iters)
+{
+	struct iov_state	*s = (struct iov_state *)state;
+	uint64_t		i, acc = 0;
+
+	for (i = 0; i < iters; i++)
+		acc += memclonev(s->dst, IOV_NR, s->src, IOV_NR);
+	sink = acc;
+}
+
+static void iov_teardown(void *state)
+{
+	struct iov_state *s = (struct iov_state *)state;
+
+	free(s->sbuf);
+	free(s->dbuf);
+	free(s);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_loop								     */
+/*---------------------------------------------------------------------------*/
+struct ev_state {
+	void			*loop;
+	struct xio_ev_data	evt;
+	uint64_t		count;
+	uint64_t		target;
+	int			fd;
+	int			pad;
+};
+
+static void *ev_loop_setup(void)
+{
+	struct ev_state *s;
+
+	s = (struct ev_state *)calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->loop = xio_ev_loop_create();
+	s->fd = eventfd(0, EFD_NONBLOCK);
+	if (!s->loop || s->fd == -1) {
+		if (s->loop)
+			xio_ev_loop_destroy(&s->loop);
+		free(s);
+		return NULL;
+	}
+	/* stays readable, level triggered - fires on every iteration */
+	eventfd_write(s->fd, 1);
+
+	return s;
+}
+
+static void ev_loop_fd_handler(int fd, int events, void *data)
+{
+	struct ev_state *s = (struct ev_state *)data;
+
+	if (++s->count == s->target)
+		xio_ev_loop_stop(s->loop);
+}
+
+static void ev_loop_add_del_run(void *state, uint64_t iters)
+{
+	struct ev_state	*s = (struct ev_state *)state;
+	uint64_t	i;
+
+	for (i = 0; i < iters; i++) {
+		xio_ev_loop_add(s->loop, s->fd, XIO_POLLIN,
+				ev_loop_fd_handler, s);
+		xio_ev_loop_del(s->loop, s->fd);
+		/* deleted handlers are released by the next iteration */
+		if ((i % EV_ADD_DEL_BATCH) == EV_ADD_DEL_BATCH - 1)
+			xio_ev_loop_run_timeout(s->loop, 0);
+	}
+	xio_ev_loop_run_timeout(s->loop, 0);
+}
+
+static void ev_loop_fd_dispatch_run(void *state, uint64_t iters)
+{
+	struct ev_state *s = (struct ev_state *)state;
+
+	s->count	= 0;
+	s->target	= iters;
+	xio_ev_loop_add(s->loop, s->fd, XIO_POLLIN, ev_loop_fd_handler, s);
+	xio_ev_loop_run(s->loop);
+	xio_ev_loop_del(s->loop, s->fd);
+	xio_ev_loop_run_timeout(s->loop, 0);
+}
+
+static void ev_loop_event_handler(void *data)
+{
+	struct ev_state *s = (struct ev_state *)data;
+
+	if (++s->count == s->target)
+		xio_ev_loop_stop(s->loop);
+	else
+		xio_ev_loop_add_event(s->loop, &s->evt);
+}
+
+static void ev_loop_event_dispatch_run(void *state, uint64_t iters)
+{
+	struct ev_state *s = (struct ev_state *)state;
+
+	s->count	= 0;
+	s->target	= iters;
+	xio_ev_loop_init_event(&s->evt, ev_loop_event_handler, s);
+	xio_ev_loop_add_event(s->loop, &s->evt);
+	xio_ev_loop_run(s->loop);
+}
+
+static void ev_loop_teardown(void *state)
+{
+	struct ev_state *s = (struct ev_state *)state;
+
+	close(s->fd);
+	xio_ev_loop_destroy(&s->loop);
+	free(s);
+}
+
+/*---------------------------------------------------------------------------*/
+/* the suite - names are part of the JSON schema, append only		     */
+/*---------------------------------------------------------------------------*/
+static struct mb_bench benches[] = {
+	{ "mempool_alloc_free", "xio_mempool alloc/free, one thread",
+	  mempool_setup, mempool_run, mempool_teardown },
+	{ "mempool_alloc_free_mt", "xio_mempool alloc/free, --threads",
+	  mempool_setup, mempool_mt_run, mempool_teardown },
+	{ "tasks_pool_get_put", "xio_tasks_pool get/put",
+	  tasks_pool_setup, tasks_pool_get_put_run, tasks_pool_teardown },
+	{ "tasks_pool_lookup", "xio_tasks_pool lookup over 16 slabs",
+	  tasks_pool_setup, tasks_pool_lookup_run, tasks_pool_teardown },
+	{ "timers_list_add_del", "xio_timers_list add/del, 64 resident",
+	  timers_list_setup, timers_list_run, timers_list_teardown },
+	{ "ht_lookup", "HT_LOOKUP, 1024 keys",
+	  ht_setup, ht_lookup_run, ht_teardown },
+	{ "ht_remove_insert", "HT_REMOVE + HT_INSERT, 1024 keys",
+	  ht_setup, ht_insert_remove_run, ht_teardown },
+	{ "sn_hash_lookup", "xio_sn_hash lookup, 1024 keys",
+	  sn_hash_setup, sn_hash_lookup_run, sn_hash_teardown },
+	{ "sn_hash_remove_insert", "xio_sn_hash remove + insert, 1024 keys",
+	  sn_hash_setup, sn_hash_insert_remove_run, sn_hash_teardown },
+	{ "mbuf_tlv_encode", "xio_mbuf TLV with a 28 byte header",
+	  mbuf_setup, mbuf_encode_run, mbuf_teardown },
+	{ "mbuf_tlv_decode", "xio_mbuf TLV with a 28 byte header",
+	  mbuf_setup, mbuf_decode_run, mbuf_teardown },
+	{ "memcpyv_4x1k", "memcpyv gather of 4 x 1KB segments",
+	  iov_setup, memcpyv_run, iov_teardown },
+	{ "memclonev_4", "memclonev of 4 segments",
+	  iov_setup, memclonev_run, iov_teardown },
+	{ "ev_loop_add_del", "xio_ev_loop_add + xio_ev_loop_del",
+	  ev_loop_setup, ev_loop_add_del_run, ev_loop_teardown },
+	{ "ev_loop_fd_dispatch", "fd handler dispatch per loop iteration",
+	  ev_loop_setup, ev_loop_fd_dispatch_run, ev_loop_teardown },
+	{ "ev_loop_event_dispatch", "scheduled event dispatch",
+	  ev_loop_setup, ev_loop_event_dispatch_run, ev_loop_teardown },
+};
+
+#define BENCHES_NR	(sizeof(benches) / sizeof(benches[0]))
+
+/*---------------------------------------------------------------------------*/
+/* cmp_double								     */
+/*---------------------------------------------------------------------------*/
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*---------------------------------------------------------------------------*/
+/* run_bench								     */
+/*---------------------------------------------------------------------------*/
+static int run_bench(struct mb_bench *b, struct mb_result *res)
+{
+	double		ns_op[MAX_REPS];
+	uint64_t	iters = CALIBRATE_ITERS;
+	uint64_t	start, elapsed, target;
+	uint64_t	allocs_start;
+	void		*state;
+	int		i;
+
+	state = b->setup();
+	if (!state) {
+		fprintf(stderr, "%s: setup failed\n", b->name);
+		return -1;
+	}
+
+	/* grow the batch until one repetition lasts the duration */
+	target = params.duration_ms * XIO_NS_IN_MSEC;
+	while (1) {
+		start = get_ns();
+		b->run(state, iters);
+		elapsed = get_ns() - start;
+		if (elapsed >= target)
+			break;
+		if (elapsed < target / 16)
+			iters *= 16;
+		else
+			iters = iters * target / elapsed + 1;
+	}
+	/* whole bursts for the mempool and threads */
+	iters = (iters + 1023) & ~1023ULL;
+
+	allocs_start = allocs;
+	for (i = 0; i < params.reps; i++) {
+		start = get_ns();
+		b->run(state, iters);
+		ns_op[i] = (double)(get_ns() - start) / iters;
+	}
+	res->allocs_op = (double)(allocs - allocs_start) /
+			 (iters * params.reps);
+
+	b->teardown(state);
+
+	qsort(ns_op, params.reps, sizeof(ns_op[0]), cmp_double);
+	res->name	= b->name;
+	res->iters	= iters;
+	res->ns_op	= ns_op[params.reps / 2];
+	res->ns_op_min	= ns_op[0];
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* selected								     */
+/*---------------------------------------------------------------------------*/
+static int selected(const char *name)
+{
+	const char	*p = params.filter;
+	size_t		len;
+
+	if (!p)
+		return 1;
+	/* comma separated substrings */
+	while (*p) {
+		len = strcspn(p, ",");
+		if (len && strlen(name) >= len) {
+			const char *s;
+
+			for (s = name; *s; s++)
+				if (!strncmp(s, p, len))
+					return 1;
+		}
+		p += len + (p[len] == ',');
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* write_json								     */
+/*---------------------------------------------------------------------------*/
+static int write_json(struct mb_result *res, int nr)
+{
+	FILE	*fp;
+	int	i;
+
+	fp = fopen(params.output_file, "w");
+	if (!fp) {
+		perror("fopen");
+		return -1;
+	}
+	/* fixed key order and one benchmark per line, diff friendly */
+	fprintf(fp, "{\n  \"schema\": 1,\n  \"duration_ms\": %d,\n"
+		"  \"reps\": %d,\n  \"threads\": %d,\n  \"benchmarks\": [\n",
+		params.duration_ms, params.reps, params.threads);
+	for (i = 0; i < nr; i++)
+		fprintf(fp, "    {\"name\": \"%s\", \"ns_per_op\": %.2f, "
+			"\"ns_per_op_min\": %.2f, \"allocs_per_op\": %.4f, "
+			"\"iterations\": %" PRIu64 "}%s\n",
+			res[i].name, res[i].ns_op, res[i].ns_op_min,
+			res[i].allocs_op, res[i].iters,
+			(i == nr - 1) ? "" : ",");
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* usage								     */
+/*---------------------------------------------------------------------------*/
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s [OPTIONS]\t\tmicro benchmarks of internals\n", argv0);
+	printf("\n");
+	printf("options:\n");
+	printf("\t-b, --bench=<list> ");
+	printf("\trun benchmarks matching any substring\n");
+	printf("\t-d, --duration=<msecs> ");
+	printf("\tminimum time of a repetition (default %d)\n",
+	       DEF_DURATION_MS);
+	printf("\t-r, --reps=<num> ");
+	printf("\trepetitions, the median is reported (default %d)\n",
+	       DEF_REPS);
+	printf("\t-t, --threads=<num> ");
+	printf("\tthreads of the _mt benchmarks (default online cpus)\n");
+	printf("\t-o, --output_file=<file> ");
+	printf("\twrite the results as JSON\n");
+	printf("\t-l, --list ");
+	printf("\tlist the benchmarks and exit\n");
+	printf("\t-h, --help ");
+	printf("\tdisplay this help and exit\n");
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_cmdline							     */
+/*---------------------------------------------------------------------------*/
+static int parse_cmdline(int argc, char **argv)
+{
+	static struct option const long_options[] = {
+		{ .name = "bench",	 .has_arg = 1, .val = 'b'},
+		{ .name = "duration",	 .has_arg = 1, .val = 'd'},
+		{ .name = "reps",	 .has_arg = 1, .val = 'r'},
+		{ .name = "threads",	 .has_arg = 1, .val = 't'},
+		{ .name = "output_file", .has_arg = 1, .val = 'o'},
+		{ .name = "list",	 .has_arg = 0, .val = 'l'},
+		{ .name = "help",	 .has_arg = 0, .val = 'h'},
+		{0, 0, 0, 0},
+	};
+	static char *short_options = "b:d:r:t:o:lh";
+	int c;
+
+	params.duration_ms	= DEF_DURATION_MS;
+	params.reps		= DEF_REPS;
+	params.threads		= sysconf(_SC_NPROCESSORS_ONLN);
+	if (params.threads < 2)
+		params.threads = 2;
+	if (params.threads > 64)
+		params.threads = 64;
+
+	optind = 0;
+	opterr = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options,
+				long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'b':
+			params.filter = optarg;
+			break;
+		case 'd':
+			params.duration_ms = strtol(optarg, NULL, 0);
+			if (params.duration_ms <= 0)
+				goto invalid;
+			break;
+		case 'r':
+			params.reps = strtol(optarg, NULL, 0);
+			if (params.reps <= 0 || params.reps > MAX_REPS)
+				goto invalid;
+			break;
+		case 't':
+			params.threads = strtol(optarg, NULL, 0);
+			if (params.threads <= 0 || params.threads > 64)
+				goto invalid;
+			break;
+		case 'o':
+			params.output_file = optarg;
+			break;
+		case 'l':
+			params.list = 1;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(0);
+		default:
+			goto invalid;
+		}
+	}
+	if (optind < argc)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "invalid command line\n");
+	usage(argv[0]);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct mb_result	res[BENCHES_NR];
+	unsigned int		i;
+	int			nr = 0, retval = 0;
+
+	if (parse_cmdline(argc, argv))
+		return -1;
+
+	if (params.list) {
+		for (i = 0; i < BENCHES_NR; i++)
+			printf("%-24s %s\n", benches[i].name,
+			       benches[i].desc);
+		return 0;
+	}
+
+	xio_init();
+
+	printf("%-24s %12s %12s %12s %14s\n",
+	       "benchmark", "ns/op", "min ns/op", "allocs/op", "iterations");
+	for (i = 0; i < BENCHES_NR; i++) {
+		if (!selected(benches[i].name))
+			continue;
+		if (run_bench(&benches[i], &res[nr])) {
+			retval = -1;
+			continue;
+		}
+		printf("%-24s %12.2f %12.2f %12.4f %14" PRIu64 "\n",
+		       res[nr].name, res[nr].ns_op, res[nr].ns_op_min,
+		       res[nr].allocs_op, res[nr].iters);
+		fflush(stdout);
+		nr++;
+	}
+
+	if (params.output_file && write_json(res, nr))
+		retval = -1;
+
+	xio_shutdown();
+
+	return retval;
+}
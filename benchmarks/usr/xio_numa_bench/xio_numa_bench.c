@@ -0,0 +1,556 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <numa.h>
+
+#include "libxio.h"
+
+/*
+ * numa placement: pairs of server and client contexts stream
+ * messages of a given size both ways. the client contexts always sit
+ * on the node of the interface serving the uri. the server contexts
+ * are placed with xio_context_create_set once on that node (local) and
+ * once on another node (remote), so their pools and buffers sit across
+ * the interconnect from the interface. needs at least two numa nodes
+ * for the remote run.
+ */
+
+#define PAIRS_NR		2
+#define MSG_SIZE		65536
+#define WINDOW			8
+#define SECONDS			3
+
+struct bench_params {
+	int			pairs_nr;
+	int			msg_size;
+	int			window;
+	int			seconds;
+};
+
+struct server_data {
+	struct bench_params	*params;
+	struct xio_context	*ctx;
+	struct xio_server	*server;
+	char			*buf;
+	pthread_t		thread_id;
+	volatile int		nsessions;
+	volatile int		nteardown;
+};
+
+struct client_data {
+	struct bench_params	*params;
+	struct xio_context	*ctx;
+	struct xio_connection	*conn;
+	struct xio_msg		*reqs;
+	char			*buf;
+	char			*rx_buf;	/* a response buffer per req */
+	char			url[256];
+	pthread_t		thread_id;
+	uint64_t		ndone;
+	uint64_t		end_ns;
+	int			stopping;
+	int			nerrors;
+};
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct server_data *sdata = (struct server_data *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		__sync_fetch_and_add(&sdata->nteardown, 1);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	struct server_data *sdata = (struct server_data *)cb_user_context;
+
+	__sync_fetch_and_add(&sdata->nsessions, 1);
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_request							     */
+/*---------------------------------------------------------------------------*/
+static int server_on_request(struct xio_session *session,
+			     struct xio_msg *req,
+			     int last_in_rxq,
+			     void *cb_user_context)
+{
+	struct server_data	*sdata = (struct server_data *)cb_user_context;
+	struct xio_msg		*rsp;
+	struct xio_iovec_ex	*sglist;
+
+	/* first touch from the loop thread, so on the context's node */
+	if (!sdata->buf) {
+		sdata->buf = (char *)malloc(sdata->params->msg_size);
+		memset(sdata->buf, 0x5a, sdata->params->msg_size);
+	}
+
+	rsp = (struct xio_msg *)calloc(1, sizeof(*rsp));
+	rsp->request		= req;
+	rsp->in.sgl_type	= XIO_SGL_TYPE_IOV;
+	rsp->out.sgl_type	= XIO_SGL_TYPE_IOV;
+	rsp->out.data_iov.max_nents = XIO_IOVLEN;
+	vmsg_sglist_set_nents(&rsp->out, 1);
+	sglist = vmsg_sglist(&rsp->out);
+	sglist[0].iov_base	= sdata->buf;
+	sglist[0].iov_len	= sdata->params->msg_size;
+	sglist[0].mr		= NULL;
+	if (xio_send_response(rsp)) {
+		fprintf(stderr, "send response failed. %s\n",
+			xio_strerror(xio_errno()));
+		free(rsp);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_send_response_complete					     */
+/*---------------------------------------------------------------------------*/
+static int server_on_send_response_complete(struct xio_session *session,
+					    struct xio_msg *rsp,
+					    void *cb_user_context)
+{
+	free(rsp);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+	.on_msg				=  server_on_request,
+	.on_msg_send_complete		=  server_on_send_response_complete,
+};
+
+/*---------------------------------------------------------------------------*/
+/* server_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *server_thread(void *data)
+{
+	struct server_data *sdata = (struct server_data *)data;
+
+	xio_context_run_loop(sdata->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_send								     */
+/*---------------------------------------------------------------------------*/
+static int client_send(struct client_data *cdata, struct xio_msg *req)
+{
+	struct xio_iovec_ex	*sglist;
+	size_t			size = cdata->params->msg_size;
+
+	memset(req, 0, sizeof(*req));
+	req->in.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->in.data_iov.max_nents = XIO_IOVLEN;
+	vmsg_sglist_set_nents(&req->in, 1);
+	sglist = vmsg_sglist(&req->in);
+	sglist[0].iov_base	= cdata->rx_buf + (req - cdata->reqs) * size;
+	sglist[0].iov_len	= size;
+	sglist[0].mr		= NULL;
+	req->out.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->out.data_iov.max_nents = XIO_IOVLEN;
+	vmsg_sglist_set_nents(&req->out, 1);
+	sglist = vmsg_sglist(&req->out);
+	sglist[0].iov_base	= cdata->buf;
+	sglist[0].iov_len	= size;
+	sglist[0].mr		= NULL;
+
+	return xio_send_request(cdata->conn, req);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_response							     */
+/*---------------------------------------------------------------------------*/
+static int client_on_response(struct xio_session *session,
+			      struct xio_msg *rsp,
+			      int last_in_rxq,
+			      void *cb_user_context)
+{
+	struct client_data *cdata = (struct client_data *)cb_user_context;
+
+	cdata->ndone++;
+	xio_release_response(rsp);
+
+	if (get_ns() >= cdata->end_ns) {
+		if (!cdata->stopping) {
+			cdata->stopping = 1;
+			xio_disconnect(cdata->conn);
+		}
+		return 0;
+	}
+	if (client_send(cdata, rsp))
+		cdata->nerrors++;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct client_data	*cdata = (struct client_data *)cb_user_context;
+	int			i;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		cdata->end_ns = get_ns() +
+				cdata->params->seconds * 1000000000ULL;
+		for (i = 0; i < cdata->params->window; i++) {
+			if (client_send(cdata, &cdata->reqs[i]))
+				cdata->nerrors++;
+		}
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "%s: %s. reason: %s\n", cdata->url,
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		cdata->nerrors++;
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		xio_context_stop_loop(cdata->ctx);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+	.on_msg				=  client_on_response,
+};
+
+/*---------------------------------------------------------------------------*/
+/* client_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *client_thread(void *data)
+{
+	struct client_data		*cdata = (struct client_data *)data;
+	struct xio_session_params	sparams;
+	struct xio_connection_params	cparams;
+	struct xio_session		*session;
+
+	memset(&sparams, 0, sizeof(sparams));
+	sparams.type		= XIO_SESSION_CLIENT;
+	sparams.ses_ops		= &client_ops;
+	sparams.user_context	= cdata;
+	sparams.uri		= cdata->url;
+
+	session = xio_session_create(&sparams);
+	if (!session) {
+		cdata->nerrors++;
+		return NULL;
+	}
+
+	memset(&cparams, 0, sizeof(cparams));
+	cparams.session			= session;
+	cparams.ctx			= cdata->ctx;
+	cparams.conn_user_context	= cdata;
+	cdata->conn = xio_connect(&cparams);
+	if (!cdata->conn) {
+		cdata->nerrors++;
+		xio_session_destroy(session);
+		return NULL;
+	}
+
+	xio_context_run_loop(cdata->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* run_placement							     */
+/*---------------------------------------------------------------------------*/
+static int run_placement(const char *name, const char *transport,
+			 const char *host, int port, int local_node,
+			 int server_node, struct bench_params *params)
+{
+	struct xio_context_set_attr	attr;
+	struct xio_context		**sctxs, **cctxs;
+	struct server_data		*sdata;
+	struct client_data		*cdata;
+	char				url[256];
+	uint64_t			start, total_ns, ndone = 0;
+	int				i, j, retval = 0;
+
+	sctxs = (struct xio_context **)calloc(params->pairs_nr,
+					      sizeof(*sctxs));
+	cctxs = (struct xio_context **)calloc(params->pairs_nr,
+					      sizeof(*cctxs));
+	sdata = (struct server_data *)calloc(params->pairs_nr,
+					     sizeof(*sdata));
+	cdata = (struct client_data *)calloc(params->pairs_nr,
+					     sizeof(*cdata));
+	sprintf(url, "%s://%s:%d", transport, host, port);
+
+	memset(&attr, 0, sizeof(attr));
+	attr.uri	= url;
+	attr.ctxs_nr	= params->pairs_nr;
+	attr.numa_node	= server_node;
+	if (xio_context_create_set(&attr, sctxs)) {
+		fprintf(stderr, "failed to create server contexts. %s\n",
+			xio_strerror(xio_errno()));
+		retval = -1;
+		goto cleanup;
+	}
+	attr.numa_node	= local_node;
+	if (xio_context_create_set(&attr, cctxs)) {
+		fprintf(stderr, "failed to create client contexts. %s\n",
+			xio_strerror(xio_errno()));
+		for (i = 0; i < params->pairs_nr; i++)
+			xio_context_destroy(sctxs[i]);
+		retval = -1;
+		goto cleanup;
+	}
+
+	/* one port per pair */
+	for (i = 0; i < params->pairs_nr; i++) {
+		sprintf(url, "%s://%s:%d", transport, host, port + i);
+		sdata[i].params	= params;
+		sdata[i].ctx	= sctxs[i];
+		sdata[i].server	= xio_bind(sctxs[i], &server_ops, url,
+					   NULL, 0, &sdata[i]);
+		if (!sdata[i].server) {
+			fprintf(stderr, "failed to bind %s. %s\n", url,
+				xio_strerror(xio_errno()));
+			retval = -1;
+			break;
+		}
+		pthread_create(&sdata[i].thread_id, NULL, server_thread,
+			       &sdata[i]);
+
+		cdata[i].params	= params;
+		cdata[i].ctx	= cctxs[i];
+		cdata[i].reqs	= (struct xio_msg *)
+			calloc(params->window, sizeof(*cdata[i].reqs));
+		cdata[i].buf	= (char *)malloc(params->msg_size);
+		memset(cdata[i].buf, 0xa5, params->msg_size);
+		cdata[i].rx_buf	= (char *)calloc(params->window,
+						 params->msg_size);
+		strcpy(cdata[i].url, url);
+	}
+	if (retval)
+		goto teardown;
+
+	start = get_ns();
+	for (i = 0; i < params->pairs_nr; i++)
+		pthread_create(&cdata[i].thread_id, NULL, client_thread,
+			       &cdata[i]);
+	for (i = 0; i < params->pairs_nr; i++)
+		pthread_join(cdata[i].thread_id, NULL);
+	total_ns = get_ns() - start;
+
+	for (i = 0; i < params->pairs_nr; i++) {
+		ndone += cdata[i].ndone;
+		if (cdata[i].nerrors)
+			retval = -1;
+	}
+	printf("%-6s: server node %d, client node %d: %.0f msg/sec, " \
+	       "%.1f MB/sec each way\n",
+	       name, server_node, local_node,
+	       ndone / (total_ns / 1000000000.0),
+	       ndone * (double)params->msg_size /
+	       (total_ns / 1000000000.0) / (1 << 20));
+
+teardown:
+	for (i = 0; i < params->pairs_nr; i++) {
+		if (!sdata[i].server)
+			continue;
+		/* let the server side finish its teardowns (up to 5 sec) */
+		for (j = 0; j < 5000 && sdata[i].nteardown <
+		     sdata[i].nsessions; j++)
+			usleep(1000);
+		xio_context_stop_loop(sctxs[i]);
+		pthread_join(sdata[i].thread_id, NULL);
+		xio_unbind(sdata[i].server);
+	}
+	for (i = 0; i < params->pairs_nr; i++) {
+		xio_context_destroy(sctxs[i]);
+		xio_context_destroy(cctxs[i]);
+		free(sdata[i].buf);
+		free(cdata[i].buf);
+		free(cdata[i].rx_buf);
+		free(cdata[i].reqs);
+	}
+cleanup:
+	free(sctxs);
+	free(cctxs);
+	free(sdata);
+	free(cdata);
+
+	return retval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* remote_node - the farthest node that has cpus			     */
+/*---------------------------------------------------------------------------*/
+static int remote_node(int local_node)
+{
+	struct bitmask	*mask;
+	int		node, best = -1, dist, best_dist = 0;
+
+	if (numa_available() < 0)
+		return -1;
+
+	mask = numa_allocate_cpumask();
+	for (node = 0; node <= numa_max_node(); node++) {
+		if (node == local_node || numa_node_to_cpus(node, mask) ||
+		    !numa_bitmask_weight(mask))
+			continue;
+		dist = numa_distance(local_node, node);
+		if (best == -1 || dist > best_dist) {
+			best = node;
+			best_dist = dist;
+		}
+	}
+	numa_free_cpumask(mask);
+
+	return best;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct bench_params	params;
+	const char		*transport;
+	char			url[256];
+	int			local, remote, port, retval = 0;
+
+	if (argc < 3) {
+		printf("Usage: %s <host> <port> <transport:optional> " \
+		       "<pairs:optional> <msg size:optional> " \
+		       "<window:optional> <seconds:optional>\n", argv[0]);
+		exit(1);
+	}
+	transport	= (argc > 3) ? argv[3] : "tcp";
+	port		= atoi(argv[2]);
+	params.pairs_nr	= (argc > 4) ? atoi(argv[4]) : PAIRS_NR;
+	params.msg_size	= (argc > 5) ? atoi(argv[5]) : MSG_SIZE;
+	params.window	= (argc > 6) ? atoi(argv[6]) : WINDOW;
+	params.seconds	= (argc > 7) ? atoi(argv[7]) : SECONDS;
+	if (params.pairs_nr < 1 || params.msg_size < 1 ||
+	    params.window < 1 || params.seconds < 1) {
+		fprintf(stderr, "invalid arguments\n");
+		exit(1);
+	}
+
+	xio_init();
+
+	/* loopback and wildcard addresses have no interface node, use
+	 * the node of the first cpu
+	 */
+	sprintf(url, "%s://%s:%d", transport, argv[1], port);
+	local = xio_uri_numa_node(url);
+	if (local < 0)
+		local = numa_available() < 0 ? -1 : numa_node_of_cpu(0);
+	remote = local < 0 ? -1 : remote_node(local);
+
+	printf("pairs %d, msg size %d, window %d, %d seconds, " \
+	       "interface node %d\n", params.pairs_nr, params.msg_size,
+	       params.window, params.seconds, local);
+
+	if (run_placement("local", transport, argv[1], port, local, local,
+			  &params))
+		retval = 1;
+	if (remote < 0)
+		printf("remote: skipped, a single numa node\n");
+	else if (run_placement("remote", transport, argv[1],
+			       port + params.pairs_nr, local, remote,
+			       &params))
+		retval = 1;
+
+	xio_shutdown();
+
+	return retval;
+}
@@ -0,0 +1,552 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxio.h"
+
+/*
+ * skewed latency server: a small share of the requests is slow (a
+ * simulated storage miss that sleeps), the rest are answered at once.
+ * all client connections land on one server context. handling the
+ * requests inline lets every slow request stall the whole context,
+ * a worker pool (xio_bind_worker_pool) keeps the fast ones flowing.
+ * reports client side latency percentiles for both modes.
+ */
+
+#define CLIENT_THREADS_NR	8
+#define WINDOW			8
+#define REQUESTS_NR		5000
+#define SLOW_PERMILLE		10
+#define SLOW_US			2000
+#define WORKER_THREADS_NR	8
+
+enum bench_mode {
+	MODE_INLINE,
+	MODE_POOL,
+};
+
+struct bench_params {
+	int			client_threads_nr;
+	int			window;
+	int			requests_nr;
+	int			slow_permille;
+	int			slow_us;
+	int			workers_nr;
+	int			ordered;
+	int			pad;
+};
+
+struct bench_server {
+	struct xio_context	*ctx;
+	struct xio_server	*server;
+	struct xio_worker_pool	*pool;
+	pthread_t		thread_id;
+	int			slow_us;
+	volatile int		nsessions;
+	volatile int		nteardown;
+	int			pad;
+};
+
+struct client_req {
+	struct xio_msg		msg;	/* must be first */
+	uint64_t		start_ns;
+	uint8_t			slow;
+	uint8_t			pad[7];
+};
+
+struct client_thread {
+	struct bench_params	*params;
+	struct xio_context	*ctx;
+	struct xio_session	*session;
+	struct xio_connection	*conn;
+	struct client_req	*reqs;
+	uint64_t		*lat_ns;
+	char			*url;
+	pthread_t		thread_id;
+	unsigned int		seed;
+	int			id;
+	int			nsent;
+	int			ndone;
+	int			nerrors;
+	int			pad;
+};
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct bench_server *srv = (struct bench_server *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		__sync_fetch_and_add(&srv->nteardown, 1);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	struct bench_server *srv = (struct bench_server *)cb_user_context;
+
+	__sync_fetch_and_add(&srv->nsessions, 1);
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_request - runs on the context or on a pool worker		     */
+/*---------------------------------------------------------------------------*/
+static int server_on_request(struct xio_session *session,
+			     struct xio_msg *req,
+			     int last_in_rxq,
+			     void *cb_user_context)
+{
+	struct bench_server	*srv = (struct bench_server *)cb_user_context;
+	struct xio_msg		*rsp;
+
+	if (req->in.header.iov_len &&
+	    *((uint8_t *)req->in.header.iov_base))
+		usleep(srv->slow_us);
+
+	rsp = (struct xio_msg *)calloc(1, sizeof(*rsp));
+	rsp->request		= req;
+	rsp->in.sgl_type	= XIO_SGL_TYPE_IOV;
+	rsp->out.sgl_type	= XIO_SGL_TYPE_IOV;
+	if (xio_send_response(rsp)) {
+		fprintf(stderr, "send response failed. %s\n",
+			xio_strerror(xio_errno()));
+		free(rsp);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_send_response_complete					     */
+/*---------------------------------------------------------------------------*/
+static int server_on_send_response_complete(struct xio_session *session,
+					    struct xio_msg *rsp,
+					    void *cb_user_context)
+{
+	free(rsp);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+	.on_msg				=  server_on_request,
+	.on_msg_send_complete		=  server_on_send_response_complete,
+};
+
+/*---------------------------------------------------------------------------*/
+/* server_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *server_thread(void *data)
+{
+	struct bench_server *srv = (struct bench_server *)data;
+
+	xio_context_run_loop(srv->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_send								     */
+/*---------------------------------------------------------------------------*/
+static int client_send(struct client_thread *tdata, struct client_req *req)
+{
+	struct bench_params *params = tdata->params;
+
+	memset(&req->msg, 0, sizeof(req->msg));
+	req->slow = (rand_r(&tdata->seed) % 1000) <
+		    params->slow_permille;
+	req->msg.out.header.iov_base	= &req->slow;
+	req->msg.out.header.iov_len	= sizeof(req->slow);
+	req->msg.in.sgl_type		= XIO_SGL_TYPE_IOV;
+	req->msg.out.sgl_type		= XIO_SGL_TYPE_IOV;
+	req->start_ns			= get_ns();
+	tdata->nsent++;
+
+	return xio_send_request(tdata->conn, &req->msg);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_response							     */
+/*---------------------------------------------------------------------------*/
+static int client_on_response(struct xio_session *session,
+			      struct xio_msg *rsp,
+			      int last_in_rxq,
+			      void *cb_user_context)
+{
+	struct client_thread	*tdata = (struct client_thread *)cb_user_context;
+	struct client_req	*req = (struct client_req *)rsp;
+
+	tdata->lat_ns[tdata->ndone++] = get_ns() - req->start_ns;
+	xio_release_response(rsp);
+
+	if (tdata->nsent < tdata->params->requests_nr) {
+		if (client_send(tdata, req))
+			tdata->nerrors++;
+	}
+	if (tdata->ndone + tdata->nerrors == tdata->nsent &&
+	    tdata->nsent == tdata->params->requests_nr)
+		xio_context_stop_loop(tdata->ctx);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_start								     */
+/*---------------------------------------------------------------------------*/
+static void client_start(struct client_thread *tdata)
+{
+	struct bench_params	*params = tdata->params;
+	int			i, window;
+
+	window = params->window < params->requests_nr ?
+		 params->window : params->requests_nr;
+	for (i = 0; i < window; i++) {
+		if (client_send(tdata, &tdata->reqs[i]))
+			tdata->nerrors++;
+	}
+	if (tdata->nerrors)
+		xio_context_stop_loop(tdata->ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct client_thread *tdata = (struct client_thread *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		/* start the clock once connected, not at xio_connect */
+		client_start(tdata);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "client %d: %s. reason: %s\n", tdata->id,
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		tdata->nerrors++;
+		xio_context_stop_loop(tdata->ctx);
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		xio_context_stop_loop(tdata->ctx);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+	.on_msg				=  client_on_response,
+};
+
+/*---------------------------------------------------------------------------*/
+/* client_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *client_thread(void *data)
+{
+	struct client_thread		*tdata = (struct client_thread *)data;
+	struct xio_session_params	sparams;
+	struct xio_connection_params	cparams;
+
+	memset(&sparams, 0, sizeof(sparams));
+	sparams.type		= XIO_SESSION_CLIENT;
+	sparams.ses_ops		= &client_ops;
+	sparams.user_context	= tdata;
+	sparams.uri		= tdata->url;
+
+	tdata->session = xio_session_create(&sparams);
+	if (!tdata->session) {
+		tdata->nerrors++;
+		return NULL;
+	}
+
+	memset(&cparams, 0, sizeof(cparams));
+	cparams.session			= tdata->session;
+	cparams.ctx			= tdata->ctx;
+	cparams.conn_user_context	= tdata;
+	tdata->conn = xio_connect(&cparams);
+	if (!tdata->conn) {
+		tdata->nerrors++;
+		xio_session_destroy(tdata->session);
+		return NULL;
+	}
+
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+
+	xio_disconnect(tdata->conn);
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* cmp_u64								     */
+/*---------------------------------------------------------------------------*/
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*---------------------------------------------------------------------------*/
+/* percentile								     */
+/*---------------------------------------------------------------------------*/
+static double percentile(uint64_t *lat, int nr, double p)
+{
+	int i = (int)(p * nr);
+
+	if (!nr)
+		return 0.0;
+	if (i >= nr)
+		i = nr - 1;
+
+	return lat[i] / 1000.0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* run_mode								     */
+/*---------------------------------------------------------------------------*/
+static int run_mode(enum bench_mode mode, const char *url,
+		    struct bench_params *params)
+{
+	struct bench_server		srv;
+	struct xio_worker_pool_attr	attr;
+	struct client_thread		*cdata;
+	uint64_t			*lat, start, total_ns;
+	int				i, nr = 0, retval = 0;
+
+	memset(&srv, 0, sizeof(srv));
+	srv.slow_us = params->slow_us;
+	srv.ctx = xio_context_create(NULL, 0, -1);
+	srv.server = xio_bind(srv.ctx, &server_ops, url, NULL, 0, &srv);
+	if (!srv.server) {
+		fprintf(stderr, "failed to bind %s. %s\n", url,
+			xio_strerror(xio_errno()));
+		xio_context_destroy(srv.ctx);
+		return -1;
+	}
+	if (mode == MODE_POOL) {
+		memset(&attr, 0, sizeof(attr));
+		attr.threads_nr = params->workers_nr;
+		attr.ordered	= params->ordered;
+		srv.pool = xio_worker_pool_create(&attr);
+		if (!srv.pool) {
+			fprintf(stderr, "failed to create worker pool. %s\n",
+				xio_strerror(xio_errno()));
+			xio_unbind(srv.server);
+			xio_context_destroy(srv.ctx);
+			return -1;
+		}
+		xio_bind_worker_pool(srv.server, srv.pool);
+	}
+	pthread_create(&srv.thread_id, NULL, server_thread, &srv);
+
+	cdata = (struct client_thread *)calloc(params->client_threads_nr,
+					       sizeof(*cdata));
+	for (i = 0; i < params->client_threads_nr; i++) {
+		cdata[i].params	= params;
+		cdata[i].id	= i;
+		cdata[i].seed	= 1 + i;
+		cdata[i].url	= (char *)url;
+		cdata[i].reqs	= (struct client_req *)
+			calloc(params->window, sizeof(*cdata[i].reqs));
+		cdata[i].lat_ns	= (uint64_t *)
+			calloc(params->requests_nr, sizeof(uint64_t));
+		cdata[i].ctx	= xio_context_create(NULL, 0, -1);
+	}
+
+	start = get_ns();
+	for (i = 0; i < params->client_threads_nr; i++)
+		pthread_create(&cdata[i].thread_id, NULL, client_thread,
+			       &cdata[i]);
+	for (i = 0; i < params->client_threads_nr; i++)
+		pthread_join(cdata[i].thread_id, NULL);
+	total_ns = get_ns() - start;
+
+	/* let the server side finish its teardowns (up to 5 seconds) */
+	for (i = 0; i < 5000 && srv.nteardown < srv.nsessions; i++)
+		usleep(1000);
+	xio_context_stop_loop(srv.ctx);
+	pthread_join(srv.thread_id, NULL);
+
+	lat = (uint64_t *)calloc((size_t)params->client_threads_nr *
+				 params->requests_nr, sizeof(uint64_t));
+	for (i = 0; i < params->client_threads_nr; i++) {
+		if (cdata[i].nerrors)
+			retval = -1;
+		memcpy(&lat[nr], cdata[i].lat_ns,
+		       cdata[i].ndone * sizeof(uint64_t));
+		nr += cdata[i].ndone;
+		xio_context_destroy(cdata[i].ctx);
+		free(cdata[i].reqs);
+		free(cdata[i].lat_ns);
+	}
+	free(cdata);
+
+	xio_unbind(srv.server);
+	if (srv.pool && xio_worker_pool_destroy(srv.pool))
+		retval = -1;
+	xio_context_destroy(srv.ctx);
+
+	qsort(lat, nr, sizeof(uint64_t), cmp_u64);
+	printf("%-6s: %d requests, %.0f req/sec, latency us: " \
+	       "p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+	       mode == MODE_POOL ? "pool" : "inline", nr,
+	       nr / (total_ns / 1000000000.0),
+	       percentile(lat, nr, 0.50), percentile(lat, nr, 0.90),
+	       percentile(lat, nr, 0.99), percentile(lat, nr, 0.999),
+	       nr ? lat[nr - 1] / 1000.0 : 0.0);
+	free(lat);
+
+	return retval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct bench_params	params;
+	const char		*transport, *mode;
+	char			url[256];
+	int			retval = 0;
+
+	if (argc < 3) {
+		printf("Usage: %s <host> <port> <transport:optional> " \
+		       "<inline|pool|both:optional> " \
+		       "<client threads:optional> <window:optional> " \
+		       "<requests per client:optional> " \
+		       "<slow permille:optional> <slow us:optional> " \
+		       "<workers:optional> <ordered:optional>\n", argv[0]);
+		exit(1);
+	}
+	transport			= (argc > 3) ? argv[3] : "tcp";
+	mode				= (argc > 4) ? argv[4] : "both";
+	params.client_threads_nr	= (argc > 5) ? atoi(argv[5]) :
+					  CLIENT_THREADS_NR;
+	params.window			= (argc > 6) ? atoi(argv[6]) : WINDOW;
+	params.requests_nr		= (argc > 7) ? atoi(argv[7]) :
+					  REQUESTS_NR;
+	params.slow_permille		= (argc > 8) ? atoi(argv[8]) :
+					  SLOW_PERMILLE;
+	params.slow_us			= (argc > 9) ? atoi(argv[9]) : SLOW_US;
+	params.workers_nr		= (argc > 10) ? atoi(argv[10]) :
+					  WORKER_THREADS_NR;
+	params.ordered			= (argc > 11) ? atoi(argv[11]) : 0;
+	if (params.client_threads_nr < 1 || params.window < 1 ||
+	    params.requests_nr < 1 || params.slow_permille < 0 ||
+	    params.slow_us < 0 || params.workers_nr < 1) {
+		fprintf(stderr, "invalid arguments\n");
+		exit(1);
+	}
+	sprintf(url, "%s://%s:%d", transport, argv[1], atoi(argv[2]));
+
+	xio_init();
+
+	printf("client threads %d, window %d, requests/client %d, " \
+	       "slow %d/1000 x %d us, workers %d%s\n",
+	       params.client_threads_nr, params.window, params.requests_nr,
+	       params.slow_permille, params.slow_us, params.workers_nr,
+	       params.ordered ? " (ordered)" : "");
+
+	if (strcmp(mode, "pool")) {
+		if (run_mode(MODE_INLINE, url, &params))
+			retval = 1;
+	}
+	if (strcmp(mode, "inline")) {
+		if (run_mode(MODE_POOL, url, &params))
+			retval = 1;
+	}
+
+	xio_shutdown();
+
+	return retval;
+}
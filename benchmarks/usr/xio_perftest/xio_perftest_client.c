@@ -46,6 +46,7 @@
 #include <errno.h>
 #include <sched.h>
 #include <pthread.h>
+#include <sys/timerfd.h>
 
 #include "libxio.h"
 #include "xio_msg.h"
@@ -53,10 +54,12 @@
 #include "xio_perftest_parameters.h"
 #include "xio_perftest_communication.h"
 #include "xio_perftest_resources.h"
+#include "xio_perftest_histogram.h"
 #include "xio_perftest.h"
 
 #define USECS_IN_SEC		1000000
 #define NSECS_IN_USEC		1000
+#define NSECS_IN_SEC		1000000000ULL
 #define ONE_MB			(1 << 20)
 
 struct thread_stat_data {
@@ -77,13 +80,18 @@ struct thread_data {
 	struct xio_context	*ctx;
 	struct perf_parameters	*user_param;
 	uint64_t		data_len;
+	uint64_t		interval;	/* open loop, in cycles */
+	cycles_t		next_send;	/* open loop, intended time */
 	int			tx_nr;
 	int			rx_nr;
 	int			cid;
 	int			affinity;
 	int			disconnect;
 	int			do_stat;
+	int			timer_fd;
+	int			closing;
 	pthread_t		thread_id;
+	struct perf_hist	hist;		/* nsecs, while do_stat */
 };
 
 /* private session data */
@@ -93,6 +101,8 @@ struct session_data {
 	double			min_lat_us;
 	double			max_lat_us;
 	double			avg_bw;
+	double			pct_lat_us[PERCENTILES_NR];
+	uint64_t		rate;		/* open loop target */
 	int			abort;
 	int			hs_connected;
 	struct xio_session	*session;
@@ -112,6 +122,17 @@ static uint64_t	hdr_len;
 static uint64_t	data_len;
 static FILE	*fd = NULL;
 static double	g_mhz;
+static struct perf_hist	hist;		/* all threads of a test */
+static int	results_nr;
+static double	percentiles[PERCENTILES_NR] = PERCENTILES;
+
+/*---------------------------------------------------------------------------*/
+/* cycles_to_nsec							     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t cycles_to_nsec(cycles_t cycles)
+{
+	return (uint64_t)(cycles * 1000.0 / g_mhz);
+}
 
 /*---------------------------------------------------------------------------*/
 /* statistics_thread_cb							     */
@@ -186,6 +207,145 @@ static void *statistics_thread_cb(void *data)
 	return NULL;
 }
 
+/*---------------------------------------------------------------------------*/
+/* prepare_request							     */
+/*---------------------------------------------------------------------------*/
+static void prepare_request(struct thread_data *tdata, struct xio_msg *msg)
+{
+	struct xio_iovec_ex	*sglist;
+
+	/* get pointers to internal buffers */
+	msg->in.header.iov_len = 0;
+	vmsg_sglist_set_nents(&msg->in, 0);
+
+	msg->out.header.iov_len = 0;
+	sglist = vmsg_sglist(&msg->out);
+	if (tdata->data_len) {
+		vmsg_sglist_set_nents(&msg->out, 1);
+		sglist[0].iov_base	= tdata->xbuf->addr;
+		sglist[0].iov_len	= tdata->xbuf->length;
+		sglist[0].mr		= tdata->xbuf->mr;
+	} else {
+		vmsg_sglist_set_nents(&msg->out, 0);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* open_loop_send							     */
+/*---------------------------------------------------------------------------*/
+static void open_loop_send(struct thread_data *tdata)
+{
+	struct xio_msg	*msg;
+	cycles_t	now = get_cycles();
+
+	/* everything that is due, in schedule order */
+	while (!tdata->disconnect && tdata->next_send <= now) {
+		/* window is full - late requests wait for a response */
+		msg = msg_pool_get(tdata->pool);
+		if (msg == NULL)
+			break;
+
+		prepare_request(tdata, msg);
+		/* measure from when it should have left, not when it could */
+		msg->user_context = (void *)tdata->next_send;
+		if (xio_send_request(tdata->conn, msg) == -1) {
+			if (xio_errno() != EAGAIN)
+				printf("**** [%p] Error - xio_send_request " \
+				       "failed. %s\n",
+				       tdata->session,
+				       xio_strerror(xio_errno()));
+			msg_pool_put(tdata->pool, msg);
+			break;
+		}
+		if (tdata->do_stat)
+			tdata->stat.scnt++;
+		tdata->tx_nr++;
+		tdata->next_send += tdata->interval;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* open_loop_stop							     */
+/*---------------------------------------------------------------------------*/
+static void open_loop_stop(struct thread_data *tdata)
+{
+	if (tdata->timer_fd < 0)
+		return;
+
+	xio_context_del_ev_handler(tdata->ctx, tdata->timer_fd);
+	close(tdata->timer_fd);
+	tdata->timer_fd = -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_disconnect - once the last response is in			     */
+/*---------------------------------------------------------------------------*/
+static void client_disconnect(struct thread_data *tdata)
+{
+	open_loop_stop(tdata);
+
+	if (tdata->closing || tdata->rx_nr != tdata->tx_nr)
+		return;
+
+	tdata->closing = 1;
+	xio_disconnect(tdata->conn);
+}
+
+/*---------------------------------------------------------------------------*/
+/* on_open_loop_tick							     */
+/*---------------------------------------------------------------------------*/
+static void on_open_loop_tick(int timer_fd, int events, void *data)
+{
+	struct thread_data	*tdata = (struct thread_data *)data;
+	uint64_t		expirations;
+
+	if (read(timer_fd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		fprintf(stderr, "timer read failed. %m\n");
+
+	if (tdata->disconnect) {
+		client_disconnect(tdata);
+		return;
+	}
+	open_loop_send(tdata);
+}
+
+/*---------------------------------------------------------------------------*/
+/* open_loop_start							     */
+/*---------------------------------------------------------------------------*/
+static int open_loop_start(struct thread_data *tdata)
+{
+	struct itimerspec	its;
+	uint64_t		tick_ns;
+
+	/* a tick per request, but not finer than the loop can keep up */
+	tick_ns = cycles_to_nsec(tdata->interval);
+	if (tick_ns < OPEN_LOOP_TICK_NSEC)
+		tick_ns = OPEN_LOOP_TICK_NSEC;
+
+	tdata->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					 TFD_NONBLOCK | TFD_CLOEXEC);
+	if (tdata->timer_fd < 0) {
+		fprintf(stderr, "timerfd_create failed. %m\n");
+		return -1;
+	}
+	its.it_interval.tv_sec	= tick_ns / NSECS_IN_SEC;
+	its.it_interval.tv_nsec	= tick_ns % NSECS_IN_SEC;
+	its.it_value		= its.it_interval;
+	if (timerfd_settime(tdata->timer_fd, 0, &its, NULL) ||
+	    xio_context_add_ev_handler(tdata->ctx, tdata->timer_fd,
+				       XIO_POLLIN, on_open_loop_tick,
+				       tdata)) {
+		fprintf(stderr, "open loop timer failed\n");
+		close(tdata->timer_fd);
+		tdata->timer_fd = -1;
+		return -1;
+	}
+	tdata->next_send = get_cycles();
+
+	return 0;
+}
+
 /*---------------------------------------------------------------------------*/
 /* worker_thread							     */
 /*---------------------------------------------------------------------------*/
@@ -193,7 +353,6 @@ static void *worker_thread(void *data)
 {
 	struct thread_data		*tdata = (struct thread_data *)data;
 	struct xio_connection_params	cparams;
-	struct xio_iovec_ex		*sglist;
 	cpu_set_t			cpuset;
 	struct xio_msg			*msg;
 	unsigned int			i;
@@ -205,6 +364,8 @@ static void *worker_thread(void *data)
 
 	pthread_setaffinity_np(tdata->thread_id, sizeof(cpu_set_t), &cpuset);
 
+	tdata->timer_fd = -1;
+
 	/* prepare data for the cuurent thread */
 	tdata->pool = msg_pool_alloc(tdata->user_param->queue_depth);
 
@@ -224,28 +385,20 @@ static void *worker_thread(void *data)
 	if (tdata->data_len)
 		tdata->xbuf = xio_alloc(tdata->data_len);
 
+	/* open loop - the timer sends, the queue depth only bounds it */
+	if (tdata->interval) {
+		if (open_loop_start(tdata))
+			tdata->sdata->abort = 1;
+		goto run;
+	}
+
 	for (i = 0;  i < tdata->user_param->queue_depth; i++) {
 		/* create transaction */
 		msg = msg_pool_get(tdata->pool);
 		if (msg == NULL)
 			break;
 
-		/* get pointers to internal buffers */
-		msg->in.header.iov_len = 0;
-
-		sglist = vmsg_sglist(&msg->in);
-		vmsg_sglist_set_nents(&msg->in, 0);
-
-		msg->out.header.iov_len = 0;
-		sglist = vmsg_sglist(&msg->out);
-		if (tdata->data_len) {
-			vmsg_sglist_set_nents(&msg->out, 1);
-			sglist[0].iov_base	= tdata->xbuf->addr;
-			sglist[0].iov_len	= tdata->xbuf->length;
-			sglist[0].mr		= tdata->xbuf->mr;
-		} else {
-			vmsg_sglist_set_nents(&msg->out, 0);
-		}
+		prepare_request(tdata, msg);
 		msg->user_context = (void *)get_cycles();
 		/* send first message */
 		if (xio_send_request(tdata->conn, msg) == -1) {
@@ -262,10 +415,12 @@ static void *worker_thread(void *data)
 		tdata->tx_nr++;
 	}
 
+run:
 	/* the default xio supplied main loop */
 	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
 
 	/* normal exit phase */
+	open_loop_stop(tdata);
 
 	if (tdata->pool)
 		msg_pool_free(tdata->pool);
@@ -339,6 +494,7 @@ static int on_response(struct xio_session *session,
 			tdata->stat.min_rtt = rtt;
 		tdata->stat.tot_rtt += rtt;
 		tdata->stat.ccnt++;
+		hist_record(&tdata->hist, cycles_to_nsec(rtt));
 	}
 
 	tdata->rx_nr++;
@@ -347,10 +503,15 @@ static int on_response(struct xio_session *session,
 	xio_release_response(msg);
 
 	if (tdata->disconnect) {
-		if (tdata->rx_nr == tdata->tx_nr)
-			xio_disconnect(tdata->conn);
-		else
-			msg_pool_put(tdata->pool, msg);
+		msg_pool_put(tdata->pool, msg);
+		client_disconnect(tdata);
+		return 0;
+	}
+
+	/* open loop - a free slot may let late requests go */
+	if (tdata->interval) {
+		msg_pool_put(tdata->pool, msg);
+		open_loop_send(tdata);
 		return 0;
 	}
 
@@ -403,6 +564,110 @@ static struct xio_session_ops ses_ops = {
 	.on_msg_error			=  on_msg_error
 };
 
+/*---------------------------------------------------------------------------*/
+/* collect_percentiles							     */
+/*---------------------------------------------------------------------------*/
+static void collect_percentiles(struct session_data *sess_data)
+{
+	unsigned int i;
+
+	hist_reset(&hist);
+	for (i = 0; i < threads_iter; i++)
+		hist_merge(&hist, &sess_data->tdata[i].hist);
+
+	for (i = 0; i < PERCENTILES_NR; i++)
+		sess_data->pct_lat_us[i] =
+			hist_percentile(&hist, percentiles[i]) /
+			(double)NSECS_IN_USEC;
+}
+
+/*---------------------------------------------------------------------------*/
+/* output_open								     */
+/*---------------------------------------------------------------------------*/
+static int output_open(struct perf_parameters *user_param)
+{
+	fd = fopen(user_param->output_file, "w");
+	if (fd == NULL) {
+		fprintf(stderr, "file open failed. %s\n",
+			user_param->output_file);
+		return -1;
+	}
+	if (user_param->output_format == JSON) {
+		fprintf(fd, "{\n \"version\": \"%s\",\n", XIO_PERF_VERSION);
+		fprintf(fd, " \"transport\": \"%s\",\n",
+			user_param->transport);
+		fprintf(fd, " \"test\": \"%s\",\n",
+			user_param->test_type == BW ? "BW" : "LAT");
+		fprintf(fd, " \"queue_depth\": %u,\n",
+			user_param->queue_depth);
+		fprintf(fd, " \"results\": [");
+	} else {
+		fprintf(fd, "size, threads, tps, bw[Mbps], lat[usec], " \
+			"p50[usec], p90[usec], p99[usec], p99.9[usec], " \
+			"p99.99[usec], rate, saturated\n");
+	}
+	fflush(fd);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* output_result							     */
+/*---------------------------------------------------------------------------*/
+static void output_result(struct perf_parameters *user_param,
+			  struct session_data *sess_data, int saturated)
+{
+	if (!fd)
+		return;
+
+	if (user_param->output_format == JSON) {
+		fprintf(fd, "%s\n  {\"size\": %lu, \"threads\": %d, " \
+			"\"rate\": %lu, \"tps\": %lu, \"bw\": %.2lf, " \
+			"\"lat_avg\": %.2lf, \"lat_min\": %.2lf, " \
+			"\"lat_max\": %.2lf, \"p50\": %.2lf, " \
+			"\"p90\": %.2lf, \"p99\": %.2lf, " \
+			"\"p99.9\": %.2lf, \"p99.99\": %.2lf, " \
+			"\"saturated\": %s}",
+			results_nr ? "," : "",
+			data_len, threads_iter, sess_data->rate,
+			sess_data->tps, sess_data->avg_bw,
+			sess_data->avg_lat_us, sess_data->min_lat_us,
+			sess_data->max_lat_us,
+			sess_data->pct_lat_us[0], sess_data->pct_lat_us[1],
+			sess_data->pct_lat_us[2], sess_data->pct_lat_us[3],
+			sess_data->pct_lat_us[4],
+			saturated ? "true" : "false");
+	} else {
+		fprintf(fd, "%lu, %d, %lu, %.2lf, %.2lf, %.2lf, %.2lf, " \
+			"%.2lf, %.2lf, %.2lf, %lu, %d\n",
+			data_len,
+			threads_iter,
+			sess_data->tps,
+			sess_data->avg_bw,
+			sess_data->avg_lat_us,
+			sess_data->pct_lat_us[0], sess_data->pct_lat_us[1],
+			sess_data->pct_lat_us[2], sess_data->pct_lat_us[3],
+			sess_data->pct_lat_us[4],
+			sess_data->rate, saturated);
+	}
+	results_nr++;
+	fflush(fd);
+}
+
+/*---------------------------------------------------------------------------*/
+/* output_close								     */
+/*---------------------------------------------------------------------------*/
+static void output_close(struct perf_parameters *user_param)
+{
+	if (!fd)
+		return;
+
+	if (user_param->output_format == JSON)
+		fprintf(fd, "\n ]\n}\n");
+	fclose(fd);
+	fd = NULL;
+}
+
 /*---------------------------------------------------------------------------*/
 /* run_client_test							     */
 /*---------------------------------------------------------------------------*/
@@ -422,6 +687,11 @@ int run_client_test(struct perf_parameters *user_param)
 	struct perf_command	command;
 	int			size_log2;
 	int			max_size_log2 = 24;
+	int			min_size_log2 = 0;
+	int			saturated;
+	int			steps = 0;
+	uint64_t		rate;
+	uint64_t		knee = 0;
 	struct xio_session_params params;
 
 
@@ -430,7 +700,14 @@ int run_client_test(struct perf_parameters *user_param)
 	g_mhz		= get_cpu_mhz(0);
 	max_cpus	= sysconf(_SC_NPROCESSORS_ONLN);
 	threads_iter	= 1;
-	size_log2	= 0;
+	rate		= user_param->rate;
+
+	/* a single size, e.g. for a rate sweep */
+	if (user_param->msg_size) {
+		min_size_log2 = __builtin_ctz(user_param->msg_size);
+		max_size_log2 = min_size_log2 + 1;
+	}
+	size_log2	= min_size_log2;
 
 	tdata = (struct thread_data *)
 			calloc(user_param->threads_num, sizeof(*tdata));
@@ -446,14 +723,8 @@ int run_client_test(struct perf_parameters *user_param)
 	}
 
 	if (user_param->output_file) {
-		fd = fopen(user_param->output_file, "w");
-		if (fd == NULL) {
-			fprintf(fd, "file open failed. %s\n",
-				user_param->output_file);
+		if (output_open(user_param))
 			goto cleanup2;
-		}
-		fprintf(fd, "size, threads, tps, bw[Mbps], lat[usec]\n");
-		fflush(fd);
 	}
 	i = intf_name_best_cpus(user_param->intf_name, &cpusmask, &cpusnr);
 	if (i == 0) {
@@ -472,6 +743,7 @@ int run_client_test(struct perf_parameters *user_param)
 		memset(tdata, 0, user_param->threads_num*sizeof(*tdata));
 		memset(&params, 0, sizeof(params));
 		sess_data.tdata = tdata;
+		sess_data.rate	= rate;
 
 		command.test_param.machine_type	= user_param->machine_type;
 		command.test_param.test_type	= user_param->test_type;
@@ -516,6 +788,11 @@ int run_client_test(struct perf_parameters *user_param)
 			sess_data.tdata[i].sdata		= &sess_data;
 			sess_data.tdata[i].user_param		= user_param;
 			sess_data.tdata[i].data_len		= data_len;
+			/* the rate is shared evenly by the threads */
+			if (rate)
+				sess_data.tdata[i].interval =
+					g_mhz * USECS_IN_SEC * threads_iter /
+					rate;
 
 			/* all threads are working on the same session */
 			sess_data.tdata[i].session	= sess_data.session;
@@ -536,6 +813,9 @@ int run_client_test(struct perf_parameters *user_param)
 			fprintf(stderr, "program aborted\n");
 			goto cleanup;
 		}
+		collect_percentiles(&sess_data);
+		saturated = rate &&
+			    sess_data.tps < SWEEP_KNEE_RATIO * rate;
 
 		/* send result to server */
 		command.results.bytes		= data_len;
@@ -545,6 +825,9 @@ int run_client_test(struct perf_parameters *user_param)
 		command.results.avg_lat		= sess_data.avg_lat_us;
 		command.results.min_lat		= sess_data.min_lat_us;
 		command.results.max_lat		= sess_data.max_lat_us;
+		command.results.rate		= rate;
+		memcpy(command.results.pct_lat, sess_data.pct_lat_us,
+		       sizeof(command.results.pct_lat));
 		command.command			= GetTestResults;
 
 		/* sync point */
@@ -558,30 +841,49 @@ int run_client_test(struct perf_parameters *user_param)
 		       sess_data.avg_lat_us,
 		       sess_data.min_lat_us,
 		       sess_data.max_lat_us);
-		if (fd)
-			fprintf(fd, "%lu, %d, %lu, %.2lf, %.2lf\n",
-				data_len,
-				threads_iter,
-				sess_data.tps,
-				sess_data.avg_bw,
-				sess_data.avg_lat_us);
-		fflush(fd);
+		printf(PERCENTILE_FMT,
+		       sess_data.pct_lat_us[0],
+		       sess_data.pct_lat_us[1],
+		       sess_data.pct_lat_us[2],
+		       sess_data.pct_lat_us[3],
+		       sess_data.pct_lat_us[4]);
+		if (rate)
+			printf("             rate %lu TPS%s\n", rate,
+			       saturated ? " - saturated" : "");
+		output_result(user_param, &sess_data, saturated);
 
 		/* sync point */
 		ctx_read_data(comm, NULL, 0, NULL);
 
+		/* raise the rate until the achieved one falls behind */
+		if (user_param->sweep_step) {
+			if (!saturated)
+				knee = rate;
+			if (!saturated && ++steps < SWEEP_MAX_STEPS) {
+				rate += user_param->sweep_step;
+				continue;
+			}
+			if (knee)
+				printf("             knee %lu TPS\n", knee);
+			else
+				printf("             knee below %lu TPS\n",
+				       user_param->rate);
+			rate	= user_param->rate;
+			knee	= 0;
+			steps	= 0;
+		}
+
 		if (++size_log2 < max_size_log2)
 			continue;
 
 		threads_iter++;
-		size_log2 = 0;
+		size_log2 = min_size_log2;
 	}
 
 	printf("%s", RESULT_LINE);
 
 cleanup:
-	if (fd)
-		fclose(fd);
+	output_close(user_param);
 
 	ctx_hand_shake(comm);
 
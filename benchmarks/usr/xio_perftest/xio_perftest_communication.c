@@ -592,8 +592,14 @@ int intf_best_cpus(const char *addr, uint64_t *cpusmask, int *nr)
 		return  -1;
 
 	numa_node = intf_numa_node(if_name);
-	if (numa_node < 0)
-		return -1;
+	if (numa_node < 0) {
+		/* loopback or no numa info - any online cpu will do */
+		*nr = sysconf(_SC_NPROCESSORS_ONLN);
+		if (*nr > 64)
+			*nr = 64;
+		*cpusmask = (*nr == 64) ? ~0ULL : (1ULL << *nr) - 1;
+		return 0;
+	}
 
 	retval = numa_node_to_cpusmask(numa_node, cpusmask, nr);
 
@@ -608,8 +614,14 @@ int intf_name_best_cpus(const char *if_name, uint64_t *cpusmask, int *nr)
 	int		numa_node, retval;
 
 	numa_node = intf_numa_node(if_name);
-	if (numa_node < 0)
-		return -1;
+	if (numa_node < 0) {
+		/* loopback or no numa info - any online cpu will do */
+		*nr = sysconf(_SC_NPROCESSORS_ONLN);
+		if (*nr > 64)
+			*nr = 64;
+		*cpusmask = (*nr == 64) ? ~0ULL : (1ULL << *nr) - 1;
+		return 0;
+	}
 
 	retval = numa_node_to_cpusmask(numa_node, cpusmask, nr);
 
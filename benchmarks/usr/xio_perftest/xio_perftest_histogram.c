@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string.h>
+#include <inttypes.h>
+#include "xio_perftest_histogram.h"
+
+/*---------------------------------------------------------------------------*/
+/* hist_highest_value - largest value that shares the bucket of index	     */
+/*---------------------------------------------------------------------------*/
+static uint64_t hist_highest_value(unsigned int index)
+{
+	unsigned int shift;
+	uint64_t     sub;
+
+	if (index < (1 << HIST_SUB_BITS))
+		return index;
+
+	shift = index / HIST_HALF_COUNT - 1;
+	sub = index % HIST_HALF_COUNT + HIST_HALF_COUNT;
+
+	return ((sub + 1) << shift) - 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* hist_reset								     */
+/*---------------------------------------------------------------------------*/
+void hist_reset(struct perf_hist *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+}
+
+/*---------------------------------------------------------------------------*/
+/* hist_merge								     */
+/*---------------------------------------------------------------------------*/
+void hist_merge(struct perf_hist *dst, const struct perf_hist *src)
+{
+	unsigned int i;
+
+	if (!src->total)
+		return;
+
+	for (i = 0; i < HIST_COUNTS_NR; i++)
+		dst->counts[i] += src->counts[i];
+	if (!dst->total || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->sum += src->sum;
+	dst->total += src->total;
+}
+
+/*---------------------------------------------------------------------------*/
+/* hist_percentile							     */
+/*---------------------------------------------------------------------------*/
+uint64_t hist_percentile(const struct perf_hist *hist, double percentile)
+{
+	uint64_t	target, count = 0;
+	uint64_t	value;
+	unsigned int	i;
+
+	if (!hist->total)
+		return 0;
+
+	target = (uint64_t)(percentile * hist->total / 100.0 + 0.5);
+	if (target < 1)
+		target = 1;
+	if (target > hist->total)
+		target = hist->total;
+
+	for (i = 0; i < HIST_COUNTS_NR; i++) {
+		count += hist->counts[i];
+		if (count >= target)
+			break;
+	}
+	value = hist_highest_value(i);
+
+	return value > hist->max ? hist->max : value;
+}
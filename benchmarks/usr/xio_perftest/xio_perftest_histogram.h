@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_PERFTEST_HISTOGRAM_H
+#define XIO_PERFTEST_HISTOGRAM_H
+
+/*
+ * latency histogram in the HdrHistogram layout: exact below 1024 ns, then
+ * 512 linear sub buckets per power of two - three significant digits up
+ * to HIST_MAX_BITS. recording is a shift and an increment, histograms of
+ * several threads merge by adding the counts.
+ */
+#define HIST_SUB_BITS		10
+#define HIST_MAX_BITS		36	/* ~68 seconds in ns */
+#define HIST_HALF_COUNT		(1 << (HIST_SUB_BITS - 1))
+#define HIST_COUNTS_NR		((HIST_MAX_BITS - HIST_SUB_BITS + 2) * \
+				 HIST_HALF_COUNT)
+
+struct perf_hist {
+	uint64_t		total;
+	uint64_t		min;
+	uint64_t		max;
+	uint64_t		sum;
+	uint64_t		counts[HIST_COUNTS_NR];
+};
+
+/*---------------------------------------------------------------------------*/
+/* hist_index								     */
+/*---------------------------------------------------------------------------*/
+static inline unsigned int hist_index(uint64_t value)
+{
+	unsigned int shift;
+
+	if (value < (1 << HIST_SUB_BITS))
+		return (unsigned int)value;
+	if (value >= (1ULL << HIST_MAX_BITS))
+		value = (1ULL << HIST_MAX_BITS) - 1;
+
+	shift = 63 - __builtin_clzll(value) - (HIST_SUB_BITS - 1);
+
+	return shift * HIST_HALF_COUNT + (unsigned int)(value >> shift);
+}
+
+/*---------------------------------------------------------------------------*/
+/* hist_record								     */
+/*---------------------------------------------------------------------------*/
+static inline void hist_record(struct perf_hist *hist, uint64_t value)
+{
+	hist->counts[hist_index(value)]++;
+	if (!hist->total || value < hist->min)
+		hist->min = value;
+	if (value > hist->max)
+		hist->max = value;
+	hist->sum += value;
+	hist->total++;
+}
+
+/*---------------------------------------------------------------------------*/
+/* hist_reset								     */
+/*---------------------------------------------------------------------------*/
+void hist_reset(struct perf_hist *hist);
+
+/*---------------------------------------------------------------------------*/
+/* hist_merge - add src counts to dst					     */
+/*---------------------------------------------------------------------------*/
+void hist_merge(struct perf_hist *dst, const struct perf_hist *src);
+
+/*---------------------------------------------------------------------------*/
+/* hist_percentile - value at or below which percentile % of the samples    */
+/*---------------------------------------------------------------------------*/
+uint64_t hist_percentile(const struct perf_hist *hist, double percentile);
+
+#endif /* XIO_PERFTEST_HISTOGRAM_H */
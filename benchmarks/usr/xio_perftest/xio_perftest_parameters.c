@@ -182,6 +182,25 @@ void usage(const char *argv0, int status)
 	printf("\t\t\tSet the number of messages to send " \
 	       "(default %d)\n", XIO_DEF_QUEUE_DEPTH);
 
+	printf("\t-b, --bytes=<size> ");
+	printf("\t\t\t\tTest only messages of <size> bytes " \
+	       "(default all powers of 2)\n");
+
+	printf("\t-R, --rate=<tps> ");
+	printf("\t\t\t\tOpen loop: send at a fixed rate and measure " \
+	       "from the intended\n\t\t\t\t\t\t\tsend time " \
+	       "(default 0 - closed loop)\n");
+
+	printf("\t-S, --sweep=<tps> ");
+	printf("\t\t\t\tRaise the rate by <tps> until the saturation " \
+	       "knee\n");
+
+	printf("\t-o, --output_file=<file> ");
+	printf("\t\t\tWrite the results to <file>\n");
+
+	printf("\t-F, --format=<csv|json> ");
+	printf("\t\t\tSet the output file format (default csv)\n");
+
 	printf("\t-v, --version ");
 	printf("\t\t\t\t\tPrint the version and exit\n");
 
@@ -196,7 +215,15 @@ void usage(const char *argv0, int status)
 /*---------------------------------------------------------------------------*/
 static int force_dependencies(struct perf_parameters *user_param)
 {
-	if (user_param->test_type == LAT) {
+	if (user_param->sweep_step && !user_param->rate) {
+		printf("sweep starts at the open loop rate - set it\n");
+		return -1;
+	}
+	if (user_param->rate) {
+		/* the rate, not the window, keeps the load */
+		if (user_param->queue_depth == XIO_DEF_QUEUE_DEPTH)
+			user_param->queue_depth = OPEN_LOOP_QUEUE_DEPTH;
+	} else if (user_param->test_type == LAT) {
 		user_param->queue_depth = LAT_QUEUE_DEPTH;
 		if (user_param->poll_timeout == XIO_DEF_POLL_TIMEOUT) {
 			if (user_param->machine_type == SERVER)
@@ -247,6 +274,10 @@ static void init_perf_params(struct perf_parameters *user_param)
 	user_param->test_type		= XIO_TEST_TYPE;
 	user_param->verb		= XIO_VERB;
 	user_param->machine_type	= SERVER;
+	user_param->output_format	= CSV;
+	user_param->msg_size		= 0;
+	user_param->rate		= 0;
+	user_param->sweep_step		= 0;
 	user_param->output_file		= NULL;
 	user_param->transport		= NULL;
 	user_param->portals_arr		= NULL;
@@ -315,13 +346,17 @@ int parse_cmdline(struct perf_parameters *user_param,
 			{ .name = "portals",	 .has_arg = 1, .val = 'w'},
 			{ .name = "poll_time",   .has_arg = 1, .val = 't'},
 			{ .name = "queue_depth", .has_arg = 1, .val = 'q'},
-			{ .name = "output file", .has_arg = 1, .val = 'o'},
+			{ .name = "output_file", .has_arg = 1, .val = 'o'},
+			{ .name = "format",	 .has_arg = 1, .val = 'F'},
+			{ .name = "bytes",	 .has_arg = 1, .val = 'b'},
+			{ .name = "rate",	 .has_arg = 1, .val = 'R'},
+			{ .name = "sweep",	 .has_arg = 1, .val = 'S'},
 			{ .name = "version",	 .has_arg = 0, .val = 'v'},
 			{ .name = "help",	 .has_arg = 0, .val = 'h'},
 			{0, 0, 0, 0},
 		};
 
-		static char *short_options = "c:i:p:n:r:w:t:q:o:vh";
+		static char *short_options = "c:i:p:n:r:w:t:q:o:F:b:R:S:vh";
 
 		c = getopt_long(argc, argv, short_options,
 				long_options, NULL);
@@ -419,6 +454,42 @@ int parse_cmdline(struct perf_parameters *user_param,
 				goto invalid_cmdline;
 
 		break;
+		case 'F':
+			if (!optarg)
+				goto invalid_cmdline;
+			if (!strcmp(optarg, "csv"))
+				user_param->output_format = CSV;
+			else if (!strcmp(optarg, "json"))
+				user_param->output_format = JSON;
+			else
+				goto invalid_cmdline;
+			break;
+		case 'b':
+			if (!optarg)
+				goto invalid_cmdline;
+			errno = 0;
+			l = strtol(optarg, NULL, 0);
+			if (errno || l <= 0 || (l & (l - 1))) {
+				fprintf(stderr, "size must be a power of 2\n");
+				goto invalid_cmdline;
+			}
+			user_param->msg_size = (uint32_t)l;
+			break;
+		case 'R':
+		case 'S':
+			if (!optarg)
+				goto invalid_cmdline;
+			errno = 0;
+			l = strtol(optarg, NULL, 0);
+			if (errno || l < 0) {
+				fprintf(stderr, "strtol failed :%m\n");
+				goto invalid_cmdline;
+			}
+			if (c == 'R')
+				user_param->rate = (uint64_t)l;
+			else
+				user_param->sweep_step = (uint64_t)l;
+			break;
 		case 'i':
 			if (optarg && !user_param->intf_name) {
 				user_param->intf_name = strdup(optarg);
@@ -515,13 +586,23 @@ void print_test_info(const struct perf_parameters *user_param)
 	       test_type_str(user_param->test_type));
 	printf(" Queue Depth		: %d\n",
 	       user_param->queue_depth);
+	if (user_param->msg_size)
+		printf(" Message Size		: %u\n",
+		       user_param->msg_size);
+	if (user_param->rate)
+		printf(" Open Loop Rate		: %" PRIu64 " TPS\n",
+		       user_param->rate);
+	if (user_param->sweep_step)
+		printf(" Sweep Step		: %" PRIu64 " TPS\n",
+		       user_param->sweep_step);
 	printf(" Threads		: %d\n",
 	       user_param->threads_num);
 	printf(" Poll timeout		: %d\n",
 	       user_param->poll_timeout);
 	if (user_param->output_file)
-		printf(" Output file		: %s\n",
-		       user_param->output_file);
+		printf(" Output file		: %s (%s)\n",
+		       user_param->output_file,
+		       user_param->output_format == JSON ? "json" : "csv");
 	printf(" CPU Affinity		: %x\n",
 	       user_param->cpu);
 	printf(" =============================================\n");
@@ -47,6 +47,9 @@ typedef enum { SERVER , CLIENT , UNCHOSEN} MachineType;
 /* verb operation */
 typedef enum { READ, WRITE} Verb;
 
+/* format of the output file */
+typedef enum { CSV, JSON} OutputFormat;
+
 
 
 #define LAT_QUEUE_DEPTH			1
@@ -57,6 +60,14 @@ typedef enum { READ, WRITE} Verb;
 #define SERVER_LAT_POLL_TIMEOUT		100
 #define CLIENT_LAT_POLL_TIMEOUT		100
 
+/* open loop: requests allowed in flight, and the finest timer tick */
+#define OPEN_LOOP_QUEUE_DEPTH		256
+#define OPEN_LOOP_TICK_NSEC		10000
+
+/* rate sweep: the knee is the last rate achieved within 5% */
+#define SWEEP_KNEE_RATIO		0.95
+#define SWEEP_MAX_STEPS			64
+
 
 #define XIO_DEF_PORT			2061
 #define XIO_DEF_CPU			0
@@ -90,6 +101,8 @@ typedef enum { READ, WRITE} Verb;
 #define RESULT_FMT		" #bytes     #threads   #TPS       BW average[MBps]   Latency average[usecs]   Latency low[usecs]   Latency peak[usecs]\n"
 /* Result print format */
 #define REPORT_FMT		" %-7lu     %d         %-7.2lu	  %-7.2lf            %-7.2lf		      %-7.2lf		    %-7.2lf\n"
+/* Latency percentiles print format, under each result */
+#define PERCENTILE_FMT		"             p50 %.2lf  p90 %.2lf  p99 %.2lf  p99.9 %.2lf  p99.99 %.2lf [usecs]\n"
 
 
 struct perf_parameters {
@@ -102,6 +115,10 @@ struct perf_parameters {
 	TestType		test_type;
 	MachineType		machine_type;
 	Verb			verb;
+	OutputFormat		output_format;
+	uint32_t		msg_size;
+	uint64_t		rate;
+	uint64_t		sweep_step;
 	char			*output_file;
 	char			*transport;
 	char			**portals_arr;
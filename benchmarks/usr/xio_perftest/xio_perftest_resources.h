@@ -42,6 +42,10 @@
 
 typedef enum { GetTestParams , GetTestResults} Command;
 
+/* latency percentiles reported for every test */
+#define PERCENTILES_NR		5
+#define PERCENTILES		{ 50.0, 90.0, 99.0, 99.9, 99.99 }
+
 struct test_parameters {
 	MachineType		machine_type;
 	TestType		test_type;
@@ -58,7 +62,8 @@ struct test_results {
 	double			avg_lat;
 	double			min_lat;
 	double			max_lat;
-
+	uint64_t		rate;		/* open loop target, 0 closed */
+	double			pct_lat[PERCENTILES_NR];
 };
 
 
@@ -345,6 +345,12 @@ static void on_test_results(struct test_results *results)
 	       results->avg_lat,
 	       results->min_lat,
 	       results->max_lat);
+	printf(PERCENTILE_FMT,
+	       results->pct_lat[0],
+	       results->pct_lat[1],
+	       results->pct_lat[2],
+	       results->pct_lat[3],
+	       results->pct_lat[4]);
 }
 
 /*---------------------------------------------------------------------------*/
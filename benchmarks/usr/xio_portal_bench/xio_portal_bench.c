@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxio.h"
+
+/*
+ * multi portal server with one slow thread: an accepting context hands
+ * every session the portals of PORTALS_NR server threads, the first of
+ * which sleeps before answering each request. the client opens one
+ * connection per portal and spreads a window of requests over them with
+ * xio_session_select_connection, once per XIO_OPTNAME_PORTAL_POLICY.
+ * round robin keeps feeding the slow thread its share, the load aware
+ * policies steer around it. reports throughput, latency percentiles and
+ * each connection's share of the requests.
+ */
+
+#define PORTALS_NR		4
+#define WINDOW			32
+#define REQUESTS_NR		20000
+#define SLOW_US			200
+
+struct bench_params {
+	int			portals_nr;
+	int			window;
+	int			requests_nr;
+	int			slow_us;
+};
+
+struct bench_portal {
+	struct xio_context	*ctx;
+	struct xio_server	*server;
+	pthread_t		thread_id;
+	int			slow_us;
+	int			pad;
+};
+
+struct bench_server {
+	struct xio_context	*ctx;
+	struct xio_server	*server;
+	struct bench_portal	*portals;
+	char			**portal_uris;
+	pthread_t		thread_id;
+	int			portals_nr;
+	int			pad;
+};
+
+struct client_req {
+	struct xio_msg		msg;	/* must be first */
+	uint64_t		start_ns;
+	int			conn_idx;
+	int			pad;
+};
+
+struct bench_client;
+
+/* one connection of the session per thread and context */
+struct client_thread {
+	struct bench_client	*cl;
+	struct xio_context	*ctx;
+	struct xio_connection	*conn;
+	pthread_t		thread_id;
+	int			id;
+	int			reqs;	/* answered on this connection */
+	uint64_t		lat_ns;
+};
+
+struct bench_client {
+	struct bench_params	*params;
+	struct xio_session	*session;
+	struct client_thread	*threads;
+	struct client_req	*reqs;
+	uint64_t		*lat_ns;
+	uint64_t		start_ns;
+	uint64_t		end_ns;
+	volatile int		nestablished;
+	volatile int		nsent;
+	volatile int		ndone;
+	volatile int		nerrors;
+	volatile int		session_down;
+	int			pad;
+};
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session - on the accepting context only		     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	struct bench_server *srv = (struct bench_server *)cb_user_context;
+
+	xio_accept(session, (const char **)srv->portal_uris,
+		   srv->portals_nr, NULL, 0);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_request - runs on the portal's context			     */
+/*---------------------------------------------------------------------------*/
+static int server_on_request(struct xio_session *session,
+			     struct xio_msg *req,
+			     int last_in_rxq,
+			     void *cb_user_context)
+{
+	struct bench_portal	*portal = (struct bench_portal *)cb_user_context;
+	struct xio_msg		*rsp;
+
+	if (portal->slow_us)
+		usleep(portal->slow_us);
+
+	rsp = (struct xio_msg *)calloc(1, sizeof(*rsp));
+	rsp->request		= req;
+	rsp->in.sgl_type	= XIO_SGL_TYPE_IOV;
+	rsp->out.sgl_type	= XIO_SGL_TYPE_IOV;
+	if (xio_send_response(rsp)) {
+		fprintf(stderr, "send response failed. %s\n",
+			xio_strerror(xio_errno()));
+		free(rsp);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_send_response_complete					     */
+/*---------------------------------------------------------------------------*/
+static int server_on_send_response_complete(struct xio_session *session,
+					    struct xio_msg *rsp,
+					    void *cb_user_context)
+{
+	free(rsp);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+	.on_msg				=  server_on_request,
+	.on_msg_send_complete		=  server_on_send_response_complete,
+};
+
+/*---------------------------------------------------------------------------*/
+/* run_loop_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *run_loop_thread(void *data)
+{
+	struct xio_context *ctx = (struct xio_context *)data;
+
+	xio_context_run_loop(ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_start								     */
+/*---------------------------------------------------------------------------*/
+static int server_start(struct bench_server *srv, const char *transport,
+			const char *host, int port,
+			struct bench_params *params)
+{
+	struct bench_portal	*portal;
+	char			uri[256];
+	int			i;
+
+	memset(srv, 0, sizeof(*srv));
+	srv->portals_nr	 = params->portals_nr;
+	srv->portals	 = (struct bench_portal *)
+		calloc(params->portals_nr, sizeof(*srv->portals));
+	srv->portal_uris = (char **)calloc(params->portals_nr, sizeof(char *));
+
+	for (i = 0; i < params->portals_nr; i++) {
+		portal		 = &srv->portals[i];
+		portal->slow_us	 = (i == 0) ? params->slow_us : 0;
+		portal->ctx	 = xio_context_create(NULL, 0, -1);
+		sprintf(uri, "%s://%s:%d", transport, host, port + 1 + i);
+		srv->portal_uris[i] = strdup(uri);
+		portal->server = xio_bind(portal->ctx, &server_ops, uri,
+					  NULL, 0, portal);
+		if (!portal->server) {
+			fprintf(stderr, "failed to bind %s. %s\n", uri,
+				xio_strerror(xio_errno()));
+			return -1;
+		}
+		pthread_create(&portal->thread_id, NULL, run_loop_thread,
+			       portal->ctx);
+	}
+
+	srv->ctx = xio_context_create(NULL, 0, -1);
+	sprintf(uri, "%s://%s:%d", transport, host, port);
+	srv->server = xio_bind(srv->ctx, &server_ops, uri, NULL, 0, srv);
+	if (!srv->server) {
+		fprintf(stderr, "failed to bind %s. %s\n", uri,
+			xio_strerror(xio_errno()));
+		return -1;
+	}
+	pthread_create(&srv->thread_id, NULL, run_loop_thread, srv->ctx);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_stop								     */
+/*---------------------------------------------------------------------------*/
+static void server_stop(struct bench_server *srv)
+{
+	struct bench_portal	*portal;
+	int			i;
+
+	if (srv->ctx) {
+		xio_context_stop_loop(srv->ctx);
+		if (srv->server) {
+			pthread_join(srv->thread_id, NULL);
+			xio_unbind(srv->server);
+		}
+		xio_context_destroy(srv->ctx);
+	}
+	for (i = 0; i < srv->portals_nr; i++) {
+		portal = &srv->portals[i];
+		if (!portal->ctx)
+			continue;
+		xio_context_stop_loop(portal->ctx);
+		if (portal->server) {
+			pthread_join(portal->thread_id, NULL);
+			xio_unbind(portal->server);
+		}
+		xio_context_destroy(portal->ctx);
+		free(srv->portal_uris[i]);
+	}
+	free(srv->portal_uris);
+	free(srv->portals);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_stop_all							     */
+/*---------------------------------------------------------------------------*/
+static void client_stop_all(struct bench_client *cl)
+{
+	int i;
+
+	for (i = 0; i < cl->params->portals_nr; i++)
+		xio_context_stop_loop(cl->threads[i].ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_send - from any client thread					     */
+/*---------------------------------------------------------------------------*/
+static int client_send(struct client_thread *tdata, struct client_req *req)
+{
+	struct bench_client	*cl = tdata->cl;
+	struct xio_connection	*conn;
+	int			i;
+
+	conn = xio_session_select_connection(cl->session);
+	if (!conn)
+		return -1;
+	for (i = 0; i < cl->params->portals_nr; i++)
+		if (cl->threads[i].conn == conn)
+			break;
+	if (i == cl->params->portals_nr)
+		return -1;
+
+	memset(&req->msg, 0, sizeof(req->msg));
+	req->msg.in.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->msg.out.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->conn_idx		= i;
+	req->start_ns		= get_ns();
+
+	/* connections of other threads take the request via their ring */
+	if (i == tdata->id)
+		return xio_send_request(conn, &req->msg);
+
+	return xio_post_msg(conn, XIO_POST_SEND_REQUEST, &req->msg);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_response							     */
+/*---------------------------------------------------------------------------*/
+static int client_on_response(struct xio_session *session,
+			      struct xio_msg *rsp,
+			      int last_in_rxq,
+			      void *cb_user_context)
+{
+	struct client_thread	*tdata = (struct client_thread *)cb_user_context;
+	struct bench_client	*cl = tdata->cl;
+	struct client_req	*req = (struct client_req *)rsp;
+	uint64_t		lat = get_ns() - req->start_ns;
+	int			done;
+
+	tdata->reqs++;
+	tdata->lat_ns += lat;
+	xio_release_response(rsp);
+
+	done = __sync_fetch_and_add(&cl->ndone, 1);
+	cl->lat_ns[done] = lat;
+
+	if (__sync_fetch_and_add(&cl->nsent, 1) < cl->params->requests_nr) {
+		if (client_send(tdata, req))
+			__sync_fetch_and_add(&cl->nerrors, 1);
+	}
+	if (done + 1 + cl->nerrors == cl->params->requests_nr) {
+		cl->end_ns = get_ns();
+		client_stop_all(cl);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_start								     */
+/*---------------------------------------------------------------------------*/
+static void client_start(struct client_thread *tdata)
+{
+	struct bench_client	*cl = tdata->cl;
+	struct bench_params	*params = cl->params;
+	int			i, window;
+
+	cl->start_ns = get_ns();
+	window = params->window < params->requests_nr ?
+		 params->window : params->requests_nr;
+	for (i = 0; i < window; i++) {
+		__sync_fetch_and_add(&cl->nsent, 1);
+		if (client_send(tdata, &cl->reqs[i]))
+			__sync_fetch_and_add(&cl->nerrors, 1);
+	}
+	if (cl->nerrors)
+		client_stop_all(cl);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct bench_client	*cl = (struct bench_client *)cb_user_context;
+	struct client_thread	*tdata;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		/* start once every portal is connected */
+		tdata = (struct client_thread *)
+				event_data->conn_user_context;
+		if (__sync_add_and_fetch(&cl->nestablished, 1) ==
+		    cl->params->portals_nr)
+			client_start(tdata);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "client: %s. reason: %s\n",
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		__sync_fetch_and_add(&cl->nerrors, 1);
+		client_stop_all(cl);
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		cl->session_down = 1;
+		client_stop_all(cl);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+	.on_msg				=  client_on_response,
+};
+
+/*---------------------------------------------------------------------------*/
+/* client_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *client_thread(void *data)
+{
+	struct client_thread		*tdata = (struct client_thread *)data;
+	struct bench_client		*cl = tdata->cl;
+	struct xio_connection_params	cparams;
+
+	/* conn_idx 0 lets the session place the connection */
+	memset(&cparams, 0, sizeof(cparams));
+	cparams.session			= cl->session;
+	cparams.ctx			= tdata->ctx;
+	cparams.conn_user_context	= tdata;
+	tdata->conn = xio_connect(&cparams);
+	if (!tdata->conn) {
+		fprintf(stderr, "connect failed. %s\n",
+			xio_strerror(xio_errno()));
+		__sync_fetch_and_add(&cl->nerrors, 1);
+		client_stop_all(cl);
+		return NULL;
+	}
+
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+
+	xio_disconnect(tdata->conn);
+	while (!cl->session_down)
+		xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* cmp_u64								     */
+/*---------------------------------------------------------------------------*/
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*---------------------------------------------------------------------------*/
+/* percentile								     */
+/*---------------------------------------------------------------------------*/
+static double percentile(uint64_t *lat, int nr, double p)
+{
+	int i = (int)(p * nr);
+
+	if (!nr)
+		return 0.0;
+	if (i >= nr)
+		i = nr - 1;
+
+	return lat[i] / 1000.0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* run_policy								     */
+/*---------------------------------------------------------------------------*/
+static int run_policy(enum xio_portal_policy policy, const char *name,
+		      const char *url, struct bench_params *params)
+{
+	struct xio_session_params	sparams;
+	struct bench_client		cl;
+	struct client_thread		*tdata;
+	uint64_t			total_ns;
+	int				i, optval = policy, retval = 0;
+
+	if (xio_set_opt(NULL, XIO_OPTLEVEL_ACCELIO, XIO_OPTNAME_PORTAL_POLICY,
+			&optval, sizeof(optval))) {
+		fprintf(stderr, "failed to set portal policy. %s\n",
+			xio_strerror(xio_errno()));
+		return -1;
+	}
+
+	memset(&cl, 0, sizeof(cl));
+	cl.params	= params;
+	cl.threads	= (struct client_thread *)
+		calloc(params->portals_nr, sizeof(*cl.threads));
+	cl.reqs		= (struct client_req *)
+		calloc(params->window, sizeof(*cl.reqs));
+	cl.lat_ns	= (uint64_t *)calloc(params->requests_nr,
+					     sizeof(uint64_t));
+	for (i = 0; i < params->portals_nr; i++) {
+		cl.threads[i].cl	= &cl;
+		cl.threads[i].id	= i;
+		cl.threads[i].ctx	= xio_context_create(NULL, 0, -1);
+	}
+
+	memset(&sparams, 0, sizeof(sparams));
+	sparams.type		= XIO_SESSION_CLIENT;
+	sparams.ses_ops		= &client_ops;
+	sparams.user_context	= &cl;
+	sparams.uri		= (char *)url;
+
+	cl.session = xio_session_create(&sparams);
+	if (!cl.session) {
+		retval = -1;
+		goto cleanup;
+	}
+
+	for (i = 0; i < params->portals_nr; i++)
+		pthread_create(&cl.threads[i].thread_id, NULL, client_thread,
+			       &cl.threads[i]);
+	for (i = 0; i < params->portals_nr; i++)
+		pthread_join(cl.threads[i].thread_id, NULL);
+	total_ns = cl.end_ns - cl.start_ns;
+
+	if (cl.nerrors || cl.ndone != params->requests_nr)
+		retval = -1;
+
+	qsort(cl.lat_ns, cl.ndone, sizeof(uint64_t), cmp_u64);
+	printf("%-8s: %d requests, %.0f req/sec, latency us: " \
+	       "p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+	       name, cl.ndone,
+	       total_ns ? cl.ndone / (total_ns / 1000000000.0) : 0.0,
+	       percentile(cl.lat_ns, cl.ndone, 0.50),
+	       percentile(cl.lat_ns, cl.ndone, 0.90),
+	       percentile(cl.lat_ns, cl.ndone, 0.99),
+	       cl.ndone ? cl.lat_ns[cl.ndone - 1] / 1000.0 : 0.0);
+	printf("          per connection requests (avg us):");
+	for (i = 0; i < params->portals_nr; i++) {
+		tdata = &cl.threads[i];
+		printf(" %d (%.1f)", tdata->reqs,
+		       tdata->reqs ? tdata->lat_ns / 1000.0 / tdata->reqs : 0.0);
+	}
+	printf("\n");
+
+cleanup:
+	for (i = 0; i < params->portals_nr; i++)
+		xio_context_destroy(cl.threads[i].ctx);
+	free(cl.threads);
+	free(cl.reqs);
+	free(cl.lat_ns);
+
+	return retval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct bench_params	params;
+	struct bench_server	srv;
+	const char		*transport, *policy;
+	char			url[256];
+	int			port, retval = 0;
+
+	if (argc < 3) {
+		printf("Usage: %s <host> <port> <transport:optional> " \
+		       "<rr|least|latency|all:optional> " \
+		       "<portals:optional> <window:optional> " \
+		       "<requests:optional> <slow us:optional>\n", argv[0]);
+		exit(1);
+	}
+	port			= atoi(argv[2]);
+	transport		= (argc > 3) ? argv[3] : "tcp";
+	policy			= (argc > 4) ? argv[4] : "all";
+	params.portals_nr	= (argc > 5) ? atoi(argv[5]) : PORTALS_NR;
+	params.window		= (argc > 6) ? atoi(argv[6]) : WINDOW;
+	params.requests_nr	= (argc > 7) ? atoi(argv[7]) : REQUESTS_NR;
+	params.slow_us		= (argc > 8) ? atoi(argv[8]) : SLOW_US;
+	if (params.portals_nr < 1 || params.window < 1 ||
+	    params.requests_nr < 1 || params.slow_us < 0) {
+		fprintf(stderr, "invalid arguments\n");
+		exit(1);
+	}
+	sprintf(url, "%s://%s:%d", transport, argv[1], port);
+
+	xio_init();
+
+	printf("portals %d (portal 0 sleeps %d us per request), " \
+	       "window %d, requests %d\n",
+	       params.portals_nr, params.slow_us, params.window,
+	       params.requests_nr);
+
+	if (server_start(&srv, transport, argv[1], port, &params)) {
+		server_stop(&srv);
+		xio_shutdown();
+		return 1;
+	}
+
+	if (!strcmp(policy, "rr") || !strcmp(policy, "all"))
+		if (run_policy(XIO_PORTAL_POLICY_ROUND_ROBIN, "rr",
+			       url, &params))
+			retval = 1;
+	if (!strcmp(policy, "least") || !strcmp(policy, "all"))
+		if (run_policy(XIO_PORTAL_POLICY_LEAST_OUTSTANDING, "least",
+			       url, &params))
+			retval = 1;
+	if (!strcmp(policy, "latency") || !strcmp(policy, "all"))
+		if (run_policy(XIO_PORTAL_POLICY_LOWEST_LATENCY, "latency",
+			       url, &params))
+			retval = 1;
+
+	server_stop(&srv);
+	xio_shutdown();
+
+	return retval;
+}
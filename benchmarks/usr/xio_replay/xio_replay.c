@@ -0,0 +1,1476 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "libxio.h"
+#include "xio_capture.h"
+#include "xio_perftest_histogram.h"
+
+/*
+ * capture replay: reproduces the message sizes and timing of a capture
+ * taken with XIO_CAPTURE=<file> against a test server over loopback.
+ *
+ * the requests and one way messages of the capture are sent at their
+ * captured offsets - scaled by -x - each captured connection mapped onto
+ * one of the replay connections. a client side capture is replayed from
+ * its sent messages, a server side one from its received messages. every
+ * request carries a small replay header telling the test server the size
+ * of the response to return and, when the capture has it, how long to
+ * hold it - the time the request spent at the captured server.
+ *
+ * a replay connection keeps at most -q messages outstanding; messages
+ * that find none free wait for a completion and count as delayed. the
+ * replay reports the response latency next to the captured one, and the
+ * lag of the sends behind their schedule.
+ *
+ * the client and the test server run in one process by default; -S runs
+ * only the server and -r only the client, for two processes.
+ */
+
+#define DEF_PORT		2281
+#define DEF_QUEUE		256
+#define MAX_CONNS		256
+#define DEF_MAX_CONNS		64
+#define REPLAY_MAGIC		0x52504c59	/* "RPLY" */
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+/* leads the header of every replayed request */
+struct replay_hdr {
+	uint32_t		magic;
+	uint32_t		rsp_hdr_len;
+	uint32_t		rsp_data_len;
+	uint32_t		service_ns;
+};
+
+/* a message to replay */
+struct replay_item {
+	uint64_t		t_ns;		/* since the first message */
+	uint32_t		hdr_len;
+	uint32_t		data_len;
+	uint32_t		rsp_hdr_len;
+	uint32_t		rsp_data_len;
+	uint32_t		service_ns;	/* 0 - not captured */
+	uint32_t		rsp_ns;		/* 0 - not captured */
+	int32_t			next;		/* backlog of the connection */
+	uint16_t		conn;
+	uint8_t			type;		/* enum xio_capture_type */
+	uint8_t			pad;
+};
+
+struct replay_conn;
+
+struct replay_req {
+	struct xio_msg		msg;		/* must be first */
+	struct replay_conn	*rconn;
+	struct replay_req	*next_free;
+	struct replay_hdr	*hdr;		/* the header buffer */
+	uint64_t		start_ns;
+};
+
+/* a connection of the client, its conn_user_context */
+struct replay_conn {
+	struct xio_session	*session;
+	struct xio_connection	*conn;
+	struct replay_req	*reqs;
+	struct replay_req	*free_reqs;
+	char			*hdrs;
+	int32_t			backlog_head;
+	int32_t			backlog_tail;
+};
+
+/* a pending response of the test server */
+struct held_rsp {
+	uint64_t		due_ns;
+	struct xio_msg		*req;
+	struct xio_connection	*conn;
+};
+
+struct replay_params {
+	const char		*capture_file;
+	const char		*output_file;
+	const char		*transport;
+	const char		*addr;
+	double			speed;
+	int			port;
+	int			conns;
+	int			queue;
+	int			info;
+	int			server_only;
+	int			client_only;
+	int			no_service;
+	int			pad;
+};
+
+/*---------------------------------------------------------------------------*/
+/* globals								     */
+/*---------------------------------------------------------------------------*/
+static struct replay_params	params;
+
+/* the capture */
+static struct xio_capture_rec	*recs;
+static size_t			recs_nr;
+static int32_t			capture_pid;
+static int			capture_conns;
+static struct replay_item	*items;
+static size_t			items_nr;
+static uint32_t			max_hdr_len;
+static uint32_t			max_data_len;
+
+/* the client */
+static struct xio_context	*client_ctx;
+static struct replay_conn	*conns;
+static struct xio_buf		*client_in_buf;
+static struct xio_buf		*client_out_buf;
+static int			client_tfd = -1;
+static int			established;
+static int			sessions_up;
+static int			failed;
+static size_t			cursor;		/* next item to send */
+static size_t			completed;
+static size_t			delayed;
+static size_t			errors;
+static uint64_t			t0_ns;
+static uint64_t			t_end_ns;
+static struct perf_hist		lat_hist;
+static struct perf_hist		lag_hist;
+
+/* the test server */
+static struct xio_context	*server_ctx;
+static struct xio_server	*server;
+static struct xio_buf		*server_in_buf;
+static struct xio_buf		*server_out_buf;
+static struct xio_msg		*free_rsps;	/* via user_context */
+static struct held_rsp		*held;		/* min heap by due_ns */
+static size_t			held_nr;
+static size_t			held_max;
+static int			server_tfd = -1;
+static volatile int		server_sessions;
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* timer_arm - absolute CLOCK_MONOTONIC expiry, 0 disarms		     */
+/*---------------------------------------------------------------------------*/
+static void timer_arm(int tfd, uint64_t due_ns)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (due_ns) {
+		its.it_value.tv_sec	= due_ns / 1000000000ULL;
+		its.it_value.tv_nsec	= due_ns % 1000000000ULL;
+	}
+	timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*---------------------------------------------------------------------------*/
+/* timer_ack								     */
+/*---------------------------------------------------------------------------*/
+static void timer_ack(int tfd)
+{
+	uint64_t expirations;
+
+	if (read(tfd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		perror("read timerfd");
+}
+
+/*---------------------------------------------------------------------------*/
+/* rec_time_cmp								     */
+/*---------------------------------------------------------------------------*/
+static int rec_time_cmp(const void *a, const void *b)
+{
+	const struct xio_capture_rec *ra = (const struct xio_capture_rec *)a;
+	const struct xio_capture_rec *rb = (const struct xio_capture_rec *)b;
+
+	return (ra->ts_ns > rb->ts_ns) - (ra->ts_ns < rb->ts_ns);
+}
+
+/*---------------------------------------------------------------------------*/
+/* rec_key_cmp - by connection, then sn					     */
+/*---------------------------------------------------------------------------*/
+static int rec_key_cmp(const void *a, const void *b)
+{
+	const struct xio_capture_rec *ra = (const struct xio_capture_rec *)a;
+	const struct xio_capture_rec *rb = (const struct xio_capture_rec *)b;
+
+	if (ra->session_id != rb->session_id)
+		return ra->session_id < rb->session_id ? -1 : 1;
+	if (ra->conn_idx != rb->conn_idx)
+		return ra->conn_idx < rb->conn_idx ? -1 : 1;
+	return (ra->sn > rb->sn) - (ra->sn < rb->sn);
+}
+
+/*---------------------------------------------------------------------------*/
+/* load_capture								     */
+/*---------------------------------------------------------------------------*/
+static int load_capture(const char *path)
+{
+	struct xio_capture_file_hdr	hdr;
+	FILE				*fp;
+	long				size;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		perror(path);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.magic != XIO_CAPTURE_MAGIC) {
+		fprintf(stderr, "%s: not a capture file\n", path);
+		goto cleanup;
+	}
+	if (hdr.version != XIO_CAPTURE_VERSION ||
+	    hdr.rec_size != sizeof(struct xio_capture_rec)) {
+		fprintf(stderr, "%s: capture version %u is not supported\n",
+			path, hdr.version);
+		goto cleanup;
+	}
+	capture_pid = hdr.pid;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp) - (long)sizeof(hdr);
+	fseek(fp, sizeof(hdr), SEEK_SET);
+
+	recs_nr = size / sizeof(*recs);
+	recs = (struct xio_capture_rec *)malloc(recs_nr * sizeof(*recs) + 1);
+	if (!recs || fread(recs, sizeof(*recs), recs_nr, fp) != recs_nr) {
+		fprintf(stderr, "%s: read failed\n", path);
+		goto cleanup;
+	}
+	fclose(fp);
+
+	/* the contexts append their batches out of order */
+	qsort(recs, recs_nr, sizeof(*recs), rec_time_cmp);
+
+	return 0;
+
+cleanup:
+	fclose(fp);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* is_msg_of_side - a request or one way message seen on that side	     */
+/*---------------------------------------------------------------------------*/
+static inline int is_msg_of_side(const struct xio_capture_rec *rec, int dir)
+{
+	return rec->dir == dir && rec->type != XIO_CAPTURE_RSP;
+}
+
+/*---------------------------------------------------------------------------*/
+/* build_items - the messages to replay, with their responses		     */
+/*---------------------------------------------------------------------------*/
+static int build_items(void)
+{
+	struct xio_capture_rec	*rsps, *keys, *rsp;
+	size_t			i, rsps_nr = 0, keys_nr = 0;
+	int			dir = XIO_CAPTURE_RX;
+	int			k;
+
+	/* a client capture sent its messages, a server one received them */
+	for (i = 0; i < recs_nr; i++)
+		if (is_msg_of_side(&recs[i], XIO_CAPTURE_TX)) {
+			dir = XIO_CAPTURE_TX;
+			break;
+		}
+
+	items = (struct replay_item *)calloc(recs_nr + 1, sizeof(*items));
+	rsps = (struct xio_capture_rec *)malloc((recs_nr + 1) * sizeof(*rsps));
+	keys = (struct xio_capture_rec *)malloc((recs_nr + 1) * sizeof(*keys));
+	if (!items || !rsps || !keys) {
+		fprintf(stderr, "out of memory\n");
+		free(rsps);
+		free(keys);
+		return -1;
+	}
+
+	/* the responses, opposite to the requests, by connection and sn */
+	for (i = 0; i < recs_nr; i++)
+		if (recs[i].type == XIO_CAPTURE_RSP && recs[i].dir != dir)
+			rsps[rsps_nr++] = recs[i];
+	qsort(rsps, rsps_nr, sizeof(*rsps), rec_key_cmp);
+
+	/* the captured connections */
+	for (i = 0; i < recs_nr; i++)
+		if (is_msg_of_side(&recs[i], dir)) {
+			keys[keys_nr] = recs[i];
+			keys[keys_nr++].sn = 0;
+		}
+	qsort(keys, keys_nr, sizeof(*keys), rec_key_cmp);
+	for (i = 0, k = 0; i < keys_nr; i++)
+		if (!k || rec_key_cmp(&keys[k - 1], &keys[i]))
+			keys[k++] = keys[i];
+	capture_conns = k;
+
+	for (i = 0; i < recs_nr; i++) {
+		struct replay_item	*item = &items[items_nr];
+		struct xio_capture_rec	key;
+
+		if (!is_msg_of_side(&recs[i], dir))
+			continue;
+
+		item->t_ns	= recs[i].ts_ns - recs[0].ts_ns;
+		item->hdr_len	= recs[i].hdr_len;
+		item->data_len	= recs[i].data_len;
+		item->type	= recs[i].type;
+		item->next	= -1;
+
+		key = recs[i];
+		key.sn = 0;
+		item->conn = (uint16_t)(((struct xio_capture_rec *)bsearch(
+					&key, keys, capture_conns,
+					sizeof(*keys), rec_key_cmp) - keys) %
+					MAX_CONNS);
+
+		rsp = item->type == XIO_CAPTURE_REQ ?
+			(struct xio_capture_rec *)bsearch(&recs[i], rsps,
+							  rsps_nr,
+							  sizeof(*rsps),
+							  rec_key_cmp) : NULL;
+		if (rsp) {
+			item->rsp_hdr_len	= rsp->hdr_len;
+			item->rsp_data_len	= rsp->data_len;
+			item->rsp_ns		= rsp->rsp_ns;
+			/* sent by the captured server - its time there */
+			if (rsp->dir == XIO_CAPTURE_TX)
+				item->service_ns = rsp->rsp_ns;
+		}
+		if (item->hdr_len > max_hdr_len)
+			max_hdr_len = item->hdr_len;
+		if (item->rsp_hdr_len > max_hdr_len)
+			max_hdr_len = item->rsp_hdr_len;
+		if (item->data_len > max_data_len)
+			max_data_len = item->data_len;
+		if (item->rsp_data_len > max_data_len)
+			max_data_len = item->rsp_data_len;
+		items_nr++;
+	}
+	/* offsets from the first message replayed */
+	for (i = 1; i < items_nr; i++)
+		items[i].t_ns -= items[0].t_ns;
+	if (items_nr)
+		items[0].t_ns = 0;
+
+	free(rsps);
+	free(keys);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_dist								     */
+/*---------------------------------------------------------------------------*/
+static void print_dist(const char *name, const struct perf_hist *hist,
+		       double div)
+{
+	if (!hist->total) {
+		printf("  %-22s -\n", name);
+		return;
+	}
+	printf("  %-22s p50 %-10.1f p99 %-10.1f max %-10.1f\n", name,
+	       hist_percentile(hist, 50.0) / div,
+	       hist_percentile(hist, 99.0) / div, hist->max / div);
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_info - the shape of the captured traffic			     */
+/*---------------------------------------------------------------------------*/
+static void print_info(void)
+{
+	static const char *const dirs[] = { "tx", "rx" };
+	static const char *const types[] = { "request", "response",
+					     "one way" };
+	struct perf_hist	*hist;
+	uint64_t		last_ns[MAX_CONNS];
+	size_t			counts[2][3];
+	size_t			i;
+	int			d, t;
+
+	hist = (struct perf_hist *)calloc(4, sizeof(*hist));
+	if (!hist)
+		return;
+	memset(counts, 0, sizeof(counts));
+	for (i = 0; i < recs_nr; i++)
+		if (recs[i].dir < 2 && recs[i].type < 3)
+			counts[recs[i].dir][recs[i].type]++;
+
+	printf("capture of pid %d: %zu records, %d connections, %.3f s\n",
+	       capture_pid, recs_nr, capture_conns,
+	       recs_nr ? (recs[recs_nr - 1].ts_ns - recs[0].ts_ns) / 1e9 : 0);
+	for (d = 0; d < 2; d++)
+		for (t = 0; t < 3; t++)
+			if (counts[d][t])
+				printf("  %s %-18s %zu\n", dirs[d], types[t],
+				       counts[d][t]);
+
+	/* per connection gaps between the messages replayed */
+	memset(last_ns, 0, sizeof(last_ns));
+	for (i = 0; i < items_nr; i++) {
+		if (i && items[i].t_ns >= last_ns[items[i].conn] &&
+		    last_ns[items[i].conn])
+			hist_record(&hist[0],
+				    items[i].t_ns - last_ns[items[i].conn]);
+		last_ns[items[i].conn] = items[i].t_ns ? items[i].t_ns : 1;
+		hist_record(&hist[1], items[i].hdr_len + items[i].data_len);
+		if (items[i].type == XIO_CAPTURE_REQ) {
+			hist_record(&hist[2], items[i].rsp_hdr_len +
+					      items[i].rsp_data_len);
+			if (items[i].rsp_ns)
+				hist_record(&hist[3], items[i].rsp_ns);
+		}
+	}
+	printf("\n%zu messages to replay\n", items_nr);
+	print_dist("inter-arrival [usecs]", &hist[0], 1e3);
+	print_dist("message [bytes]", &hist[1], 1);
+	print_dist("response [bytes]", &hist[2], 1);
+	print_dist(items_nr && items[0].service_ns ?
+		   "server time [usecs]" : "round trip [usecs]",
+		   &hist[3], 1e3);
+	free(hist);
+}
+
+/*---------------------------------------------------------------------------*/
+/* alloc_buf								     */
+/*---------------------------------------------------------------------------*/
+static struct xio_buf *alloc_buf(size_t len)
+{
+	struct xio_buf *buf = xio_alloc(len ? len : 1);
+
+	if (!buf)
+		fprintf(stderr, "xio_alloc %zu failed\n", len);
+	return buf;
+}
+
+/*---------------------------------------------------------------------------*/
+/* held_push - min heap of responses held by the test server		     */
+/*---------------------------------------------------------------------------*/
+static int held_push(uint64_t due_ns, struct xio_msg *req,
+		     struct xio_connection *conn)
+{
+	struct held_rsp	*tmp;
+	size_t		i, parent;
+
+	if (held_nr == held_max) {
+		held_max = held_max ? 2 * held_max : 256;
+		tmp = (struct held_rsp *)realloc(held,
+						 held_max * sizeof(*held));
+		if (!tmp)
+			return -1;
+		held = tmp;
+	}
+	for (i = held_nr++; i; i = parent) {
+		parent = (i - 1) / 2;
+		if (held[parent].due_ns <= due_ns)
+			break;
+		held[i] = held[parent];
+	}
+	held[i].due_ns	= due_ns;
+	held[i].req	= req;
+	held[i].conn	= conn;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* held_pop								     */
+/*---------------------------------------------------------------------------*/
+static struct xio_msg *held_pop(void)
+{
+	struct xio_msg	*req = held[0].req;
+	struct held_rsp	last = held[--held_nr];
+	size_t		i = 0, child;
+
+	while ((child = 2 * i + 1) < held_nr) {
+		if (child + 1 < held_nr &&
+		    held[child + 1].due_ns < held[child].due_ns)
+			child++;
+		if (last.due_ns <= held[child].due_ns)
+			break;
+		held[i] = held[child];
+		i = child;
+	}
+	held[i] = last;
+
+	return req;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_respond - the sizes the replay header asks for		     */
+/*---------------------------------------------------------------------------*/
+static void server_respond(struct xio_msg *req)
+{
+	struct replay_hdr	*rhdr = (struct replay_hdr *)
+					req->in.header.iov_base;
+	struct xio_iovec_ex	*sglist;
+	struct xio_msg		*rsp;
+
+	rsp = free_rsps;
+	if (rsp)
+		free_rsps = (struct xio_msg *)rsp->user_context;
+	else
+		rsp = (struct xio_msg *)malloc(sizeof(*rsp));
+	if (!rsp) {
+		fprintf(stderr, "out of memory\n");
+		return;
+	}
+	memset(rsp, 0, sizeof(*rsp));
+	rsp->request		= req;
+	rsp->in.sgl_type	= XIO_SGL_TYPE_IOV;
+	rsp->out.sgl_type	= XIO_SGL_TYPE_IOV;
+	rsp->out.data_iov.max_nents = XIO_IOVLEN;
+	/* an empty header has no base */
+	rsp->out.header.iov_len	= min(rhdr->rsp_hdr_len, max_hdr_len);
+	if (rsp->out.header.iov_len)
+		rsp->out.header.iov_base = server_out_buf->addr;
+	sglist = vmsg_sglist(&rsp->out);
+	if (rhdr->rsp_data_len) {
+		sglist[0].iov_base	= server_out_buf->addr;
+		sglist[0].iov_len	= min(rhdr->rsp_data_len,
+					      server_out_buf->length);
+		sglist[0].mr		= server_out_buf->mr;
+		vmsg_sglist_set_nents(&rsp->out, 1);
+	}
+	if (xio_send_response(rsp)) {
+		fprintf(stderr, "send response failed. %s\n",
+			xio_strerror(xio_errno()));
+		rsp->user_context = free_rsps;
+		free_rsps = rsp;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_timer - the held responses that are due			     */
+/*---------------------------------------------------------------------------*/
+static void server_on_timer(int fd, int events, void *data)
+{
+	uint64_t now = get_ns();
+
+	timer_ack(fd);
+	while (held_nr && held[0].due_ns <= now)
+		server_respond(held_pop());
+	timer_arm(fd, held_nr ? held[0].due_ns : 0);
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_msg							     */
+/*---------------------------------------------------------------------------*/
+static int server_on_msg(struct xio_session *session, struct xio_msg *msg,
+			 int last_in_rxq, void *cb_user_context)
+{
+	struct replay_hdr	*rhdr = (struct replay_hdr *)
+					msg->in.header.iov_base;
+	uint64_t		due_ns;
+
+	if (msg->type == XIO_MSG_TYPE_ONE_WAY) {
+		xio_release_msg(msg);
+		return 0;
+	}
+	if (msg->in.header.iov_len < sizeof(*rhdr) ||
+	    rhdr->magic != REPLAY_MAGIC) {
+		fprintf(stderr, "request without a replay header\n");
+		return 0;
+	}
+	if (!rhdr->service_ns || params.no_service) {
+		server_respond(msg);
+		return 0;
+	}
+	due_ns = get_ns() + rhdr->service_ns;
+	/* the conn_user_context of the server connections is the connection */
+	if (held_push(due_ns, msg, (struct xio_connection *)cb_user_context)) {
+		server_respond(msg);
+		return 0;
+	}
+	if (held[0].req == msg)
+		timer_arm(server_tfd, due_ns);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_rsp_send_complete						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_rsp_send_complete(struct xio_session *session,
+				       struct xio_msg *rsp,
+				       void *cb_user_context)
+{
+	rsp->user_context = free_rsps;
+	free_rsps = rsp;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_msg_error							     */
+/*---------------------------------------------------------------------------*/
+static int server_on_msg_error(struct xio_session *session,
+			       enum xio_status error,
+			       enum xio_msg_direction direction,
+			       struct xio_msg *msg,
+			       void *cb_user_context)
+{
+	if (direction == XIO_MSG_DIRECTION_OUT &&
+	    msg->type == XIO_MSG_TYPE_RSP)
+		server_on_rsp_send_complete(session, msg, cb_user_context);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_assign_data_in_buf						     */
+/*---------------------------------------------------------------------------*/
+static int server_assign_data_in_buf(struct xio_msg *msg,
+				     void *cb_user_context)
+{
+	struct xio_iovec_ex *sglist = vmsg_sglist(&msg->in);
+
+	sglist[0].iov_base	= server_in_buf->addr;
+	sglist[0].iov_len	= server_in_buf->length;
+	sglist[0].mr		= server_in_buf->mr;
+	vmsg_sglist_set_nents(&msg->in, 1);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct xio_connection_attr	attr;
+	size_t				i, nr;
+
+	switch (event_data->event) {
+	case XIO_SESSION_NEW_CONNECTION_EVENT:
+		memset(&attr, 0, sizeof(attr));
+		attr.user_context = event_data->conn;
+		xio_modify_connection(event_data->conn, &attr,
+				      XIO_CONNECTION_ATTR_USER_CTX);
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		/* drop the held responses of the connection and reheap */
+		for (i = 0, nr = held_nr, held_nr = 0; i < nr; i++)
+			if (held[i].conn != event_data->conn)
+				held_push(held[i].due_ns, held[i].req,
+					  held[i].conn);
+		timer_arm(server_tfd, held_nr ? held[0].due_ns : 0);
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		server_sessions--;
+		xio_session_destroy(session);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	server_sessions++;
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+	.on_msg				=  server_on_msg,
+	.on_msg_send_complete		=  server_on_rsp_send_complete,
+	.on_msg_error			=  server_on_msg_error,
+	.assign_data_in_buf		=  server_assign_data_in_buf,
+};
+
+/*---------------------------------------------------------------------------*/
+/* server_run - the test server thread					     */
+/*---------------------------------------------------------------------------*/
+static void *server_run(void *data)
+{
+	xio_context_run_loop(server_ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_start								     */
+/*---------------------------------------------------------------------------*/
+static int server_start(pthread_t *thread_id)
+{
+	char uri[256];
+
+	server_ctx = xio_context_create(NULL, 0, -1);
+	if (!server_ctx)
+		return -1;
+	server_in_buf	= alloc_buf(max_data_len);
+	server_out_buf	= alloc_buf(max_data_len);
+	if (!server_in_buf || !server_out_buf)
+		return -1;
+
+	server_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (server_tfd < 0 ||
+	    xio_context_add_ev_handler(server_ctx, server_tfd, XIO_POLLIN,
+				       server_on_timer, NULL)) {
+		perror("timerfd");
+		return -1;
+	}
+
+	sprintf(uri, "%s://%s:%d", params.transport, params.addr,
+		params.port);
+	server = xio_bind(server_ctx, &server_ops, uri, NULL, 0, NULL);
+	if (!server) {
+		fprintf(stderr, "failed to bind %s. %s\n", uri,
+			xio_strerror(xio_errno()));
+		return -1;
+	}
+	if (thread_id)
+		pthread_create(thread_id, NULL, server_run, NULL);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_stop								     */
+/*---------------------------------------------------------------------------*/
+static void server_stop(void)
+{
+	struct xio_msg *rsp;
+
+	if (server)
+		xio_unbind(server);
+	if (server_tfd >= 0) {
+		xio_context_del_ev_handler(server_ctx, server_tfd);
+		close(server_tfd);
+	}
+	while (free_rsps) {
+		rsp = free_rsps;
+		free_rsps = (struct xio_msg *)rsp->user_context;
+		free(rsp);
+	}
+	free(held);
+	if (server_in_buf)
+		xio_free(&server_in_buf);
+	if (server_out_buf)
+		xio_free(&server_out_buf);
+	if (server_ctx)
+		xio_context_destroy(server_ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* item_due_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t item_due_ns(size_t idx)
+{
+	return t0_ns + (uint64_t)(items[idx].t_ns / params.speed);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_done - disconnect once every message completed		     */
+/*---------------------------------------------------------------------------*/
+static void client_done(void)
+{
+	int i;
+
+	if (completed < items_nr || t_end_ns)
+		return;
+
+	t_end_ns = get_ns();
+	for (i = 0; i < params.conns; i++)
+		if (conns[i].conn)
+			xio_disconnect(conns[i].conn);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_send - one item on a free request of the connection		     */
+/*---------------------------------------------------------------------------*/
+static void client_send(struct replay_conn *rconn, size_t idx)
+{
+	struct replay_item	*item = &items[idx];
+	struct replay_req	*req = rconn->free_reqs;
+	struct xio_iovec_ex	*sglist;
+	uint64_t		now;
+	int			retval;
+
+	rconn->free_reqs = req->next_free;
+
+	memset(&req->msg, 0, sizeof(req->msg));
+	req->msg.in.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->msg.out.sgl_type	= XIO_SGL_TYPE_IOV;
+	req->msg.in.data_iov.max_nents	= XIO_IOVLEN;
+	req->msg.out.data_iov.max_nents	= XIO_IOVLEN;
+
+	req->msg.out.header.iov_len	= item->hdr_len;
+	if (item->type == XIO_CAPTURE_REQ) {
+		req->hdr->rsp_hdr_len	= item->rsp_hdr_len;
+		req->hdr->rsp_data_len	= item->rsp_data_len;
+		req->hdr->service_ns	= item->service_ns;
+		req->msg.out.header.iov_len = max(item->hdr_len,
+						  sizeof(*req->hdr));
+	}
+	if (req->msg.out.header.iov_len)
+		req->msg.out.header.iov_base = req->hdr;
+	sglist = vmsg_sglist(&req->msg.out);
+	if (item->data_len) {
+		sglist[0].iov_base	= client_out_buf->addr;
+		sglist[0].iov_len	= item->data_len;
+		sglist[0].mr		= client_out_buf->mr;
+		vmsg_sglist_set_nents(&req->msg.out, 1);
+	}
+	vmsg_sglist_set_nents(&req->msg.in, 0);
+
+	now = get_ns();
+	hist_record(&lag_hist, now - min(now, item_due_ns(idx)));
+	req->start_ns = now;
+	if (item->type == XIO_CAPTURE_REQ)
+		retval = xio_send_request(rconn->conn, &req->msg);
+	else
+		retval = xio_send_msg(rconn->conn, &req->msg);
+	if (retval) {
+		fprintf(stderr, "send failed. %s\n",
+			xio_strerror(xio_errno()));
+		errors++;
+		completed++;
+		req->next_free = rconn->free_reqs;
+		rconn->free_reqs = req;
+		client_done();
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_dispatch - send when due, or wait for a free request		     */
+/*---------------------------------------------------------------------------*/
+static void client_dispatch(size_t idx)
+{
+	struct replay_conn *rconn = &conns[items[idx].conn % params.conns];
+
+	if (rconn->free_reqs && rconn->backlog_head < 0) {
+		client_send(rconn, idx);
+		return;
+	}
+	delayed++;
+	if (rconn->backlog_head < 0)
+		rconn->backlog_head = idx;
+	else
+		items[rconn->backlog_tail].next = idx;
+	rconn->backlog_tail = idx;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_timer - the items that are due				     */
+/*---------------------------------------------------------------------------*/
+static void client_on_timer(int fd, int events, void *data)
+{
+	uint64_t now = get_ns();
+
+	timer_ack(fd);
+	while (cursor < items_nr && item_due_ns(cursor) <= now)
+		client_dispatch(cursor++);
+	timer_arm(fd, cursor < items_nr ? item_due_ns(cursor) : 0);
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_complete - a response or a one way send completion		     */
+/*---------------------------------------------------------------------------*/
+static void client_complete(struct replay_req *req, int error)
+{
+	struct replay_conn	*rconn = req->rconn;
+	int32_t			idx;
+
+	if (error)
+		errors++;
+	else
+		hist_record(&lat_hist, get_ns() - req->start_ns);
+	completed++;
+
+	req->next_free = rconn->free_reqs;
+	rconn->free_reqs = req;
+
+	idx = rconn->backlog_head;
+	if (idx >= 0 && !error) {
+		rconn->backlog_head = items[idx].next;
+		client_send(rconn, idx);
+	}
+	client_done();
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_msg							     */
+/*---------------------------------------------------------------------------*/
+static int client_on_msg(struct xio_session *session, struct xio_msg *msg,
+			 int last_in_rxq, void *cb_user_context)
+{
+	if (msg->type == XIO_MSG_TYPE_RSP) {
+		xio_release_response(msg);
+		client_complete((struct replay_req *)msg, 0);
+	} else {
+		xio_release_msg(msg);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_ow_msg_send_complete					     */
+/*---------------------------------------------------------------------------*/
+static int client_on_ow_msg_send_complete(struct xio_session *session,
+					  struct xio_msg *msg,
+					  void *cb_user_context)
+{
+	client_complete((struct replay_req *)msg, 0);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_msg_error - flushed on disconnect				     */
+/*---------------------------------------------------------------------------*/
+static int client_on_msg_error(struct xio_session *session,
+			       enum xio_status error,
+			       enum xio_msg_direction direction,
+			       struct xio_msg *msg,
+			       void *cb_user_context)
+{
+	struct replay_conn	*rconn = (struct replay_conn *)cb_user_context;
+	int32_t			idx;
+
+	if (direction != XIO_MSG_DIRECTION_OUT)
+		return 0;
+
+	client_complete((struct replay_req *)msg, 1);
+	/* nothing more goes out on the connection */
+	while ((idx = rconn->backlog_head) >= 0) {
+		rconn->backlog_head = items[idx].next;
+		errors++;
+		completed++;
+	}
+	client_done();
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_assign_data_in_buf						     */
+/*---------------------------------------------------------------------------*/
+static int client_assign_data_in_buf(struct xio_msg *msg,
+				     void *cb_user_context)
+{
+	struct xio_iovec_ex *sglist = vmsg_sglist(&msg->in);
+
+	sglist[0].iov_base	= client_in_buf->addr;
+	sglist[0].iov_len	= client_in_buf->length;
+	sglist[0].mr		= client_in_buf->mr;
+	vmsg_sglist_set_nents(&msg->in, 1);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct replay_conn *rconn = (struct replay_conn *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		/* the clock starts once all connections are up */
+		if (++established == params.conns) {
+			t0_ns = get_ns();
+			timer_arm(client_tfd, t0_ns);
+		}
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_REFUSED_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "client: %s. reason: %s\n",
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		failed = 1;
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		rconn->conn = NULL;
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		rconn->session = NULL;
+		if (--sessions_up == 0)
+			xio_context_stop_loop(client_ctx);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+	.on_msg				=  client_on_msg,
+	.on_ow_msg_send_complete	=  client_on_ow_msg_send_complete,
+	.on_msg_error			=  client_on_msg_error,
+	.assign_data_in_buf		=  client_assign_data_in_buf,
+};
+
+/*---------------------------------------------------------------------------*/
+/* client_init - the replay connections and their requests		     */
+/*---------------------------------------------------------------------------*/
+static int client_init(void)
+{
+	struct xio_session_params	sparams;
+	struct xio_connection_params	cparams;
+	struct replay_conn		*rconn;
+	size_t				hdr_size;
+	char				uri[256];
+	int				i, j;
+
+	client_ctx = xio_context_create(NULL, 0, -1);
+	if (!client_ctx)
+		return -1;
+	client_in_buf	= alloc_buf(max_data_len);
+	client_out_buf	= alloc_buf(max_data_len);
+	if (!client_in_buf || !client_out_buf)
+		return -1;
+	memset(client_out_buf->addr, 0x5a, client_out_buf->length);
+
+	client_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	if (client_tfd < 0 ||
+	    xio_context_add_ev_handler(client_ctx, client_tfd, XIO_POLLIN,
+				       client_on_timer, NULL)) {
+		perror("timerfd");
+		return -1;
+	}
+
+	conns = (struct replay_conn *)calloc(params.conns, sizeof(*conns));
+	if (!conns)
+		return -1;
+
+	/* room for the captured header or the replay header */
+	hdr_size = max(max_hdr_len, sizeof(struct replay_hdr));
+	hdr_size = (hdr_size + 7) & ~7UL;
+
+	/* the connections of one uri share a nexus - the transport
+	 * connection - as in the captured process
+	 */
+	sprintf(uri, "%s://%s:%d", params.transport, params.addr,
+		params.port);
+	for (i = 0; i < params.conns; i++) {
+		rconn = &conns[i];
+		rconn->backlog_head = -1;
+		rconn->reqs = (struct replay_req *)calloc(params.queue,
+							  sizeof(*rconn->reqs));
+		rconn->hdrs = (char *)calloc(params.queue, hdr_size);
+		if (!rconn->reqs || !rconn->hdrs)
+			return -1;
+		for (j = params.queue - 1; j >= 0; j--) {
+			rconn->reqs[j].rconn	= rconn;
+			rconn->reqs[j].hdr	= (struct replay_hdr *)
+						  (rconn->hdrs + j * hdr_size);
+			rconn->reqs[j].hdr->magic = REPLAY_MAGIC;
+			rconn->reqs[j].next_free = rconn->free_reqs;
+			rconn->free_reqs	= &rconn->reqs[j];
+		}
+
+		memset(&sparams, 0, sizeof(sparams));
+		sparams.type		= XIO_SESSION_CLIENT;
+		sparams.ses_ops		= &client_ops;
+		sparams.user_context	= rconn;
+		sparams.uri		= uri;
+		rconn->session = xio_session_create(&sparams);
+		if (!rconn->session)
+			return -1;
+		sessions_up++;
+
+		memset(&cparams, 0, sizeof(cparams));
+		cparams.session			= rconn->session;
+		cparams.ctx			= client_ctx;
+		cparams.conn_user_context	= rconn;
+		rconn->conn = xio_connect(&cparams);
+		if (!rconn->conn)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_destroy							     */
+/*---------------------------------------------------------------------------*/
+static void client_destroy(void)
+{
+	int i;
+
+	for (i = 0; conns && i < params.conns; i++) {
+		free(conns[i].reqs);
+		free(conns[i].hdrs);
+	}
+	free(conns);
+	if (client_tfd >= 0) {
+		xio_context_del_ev_handler(client_ctx, client_tfd);
+		close(client_tfd);
+	}
+	if (client_in_buf)
+		xio_free(&client_in_buf);
+	if (client_out_buf)
+		xio_free(&client_out_buf);
+	if (client_ctx)
+		xio_context_destroy(client_ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_result								     */
+/*---------------------------------------------------------------------------*/
+static void print_result(void)
+{
+	struct perf_hist	*rsp_hist;
+	double			cap_sec, rep_sec;
+	size_t			i;
+
+	rsp_hist = (struct perf_hist *)calloc(1, sizeof(*rsp_hist));
+	if (!rsp_hist)
+		return;
+	for (i = 0; i < items_nr; i++)
+		if (items[i].rsp_ns)
+			hist_record(rsp_hist, items[i].rsp_ns);
+
+	cap_sec = items_nr ? items[items_nr - 1].t_ns / 1e9 : 0;
+	rep_sec = (t_end_ns - t0_ns) / 1e9;
+	printf("replayed %zu messages on %d connections at %gx, "
+	       "%zu delayed, %zu errors\n", items_nr, params.conns,
+	       params.speed, delayed, errors);
+	printf("  %-22s %-10.3f replayed %-10.3f\n", "captured [secs]",
+	       cap_sec, rep_sec);
+	printf("  %-22s %-10.0f replayed %-10.0f\n", "captured [msgs/sec]",
+	       cap_sec > 0 ? items_nr / cap_sec : 0,
+	       rep_sec > 0 ? items_nr / rep_sec : 0);
+	print_dist("latency [usecs]", &lat_hist, 1e3);
+	if (lat_hist.total)
+		printf("  %-22s p99.9 %-8.1f\n", "",
+		       hist_percentile(&lat_hist, 99.9) / 1e3);
+	print_dist(items_nr && items[0].service_ns ?
+		   "server time [usecs]" : "captured rtt [usecs]",
+		   rsp_hist, 1e3);
+	print_dist("send lag [usecs]", &lag_hist, 1e3);
+
+	if (params.output_file) {
+		FILE *fp = fopen(params.output_file, "a");
+
+		if (!fp) {
+			perror(params.output_file);
+		} else {
+			fprintf(fp, "{\"capture\": \"%s\", \"messages\": %zu, "
+				"\"conns\": %d, \"speed\": %g, "
+				"\"delayed\": %zu, \"errors\": %zu, "
+				"\"captured_sec\": %.6f, "
+				"\"replayed_sec\": %.6f, "
+				"\"lat_us\": {\"p50\": %.2f, \"p99\": %.2f, "
+				"\"p99.9\": %.2f, \"max\": %.2f}, "
+				"\"captured_rsp_us\": {\"p50\": %.2f, "
+				"\"p99\": %.2f}, \"lag_p99_us\": %.2f}\n",
+				params.capture_file, items_nr, params.conns,
+				params.speed, delayed, errors, cap_sec,
+				rep_sec,
+				hist_percentile(&lat_hist, 50.0) / 1e3,
+				hist_percentile(&lat_hist, 99.0) / 1e3,
+				hist_percentile(&lat_hist, 99.9) / 1e3,
+				lat_hist.max / 1e3,
+				hist_percentile(rsp_hist, 50.0) / 1e3,
+				hist_percentile(rsp_hist, 99.0) / 1e3,
+				hist_percentile(&lag_hist, 99.0) / 1e3);
+			fclose(fp);
+		}
+	}
+	free(rsp_hist);
+}
+
+/*---------------------------------------------------------------------------*/
+/* usage								     */
+/*---------------------------------------------------------------------------*/
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s [OPTIONS] <capture>\treplay a capture over loopback\n",
+	       argv0);
+	printf("\n");
+	printf("options:\n");
+	printf("\t-i, --info ");
+	printf("\tprint the shape of the captured traffic and exit\n");
+	printf("\t-r, --transport=<name> ");
+	printf("\ttransport (default tcp)\n");
+	printf("\t-a, --address=<host> ");
+	printf("\tlisten and connect address (default 127.0.0.1)\n");
+	printf("\t-p, --port=<port> ");
+	printf("\tport of the test server (default %d)\n", DEF_PORT);
+	printf("\t-x, --speed=<factor> ");
+	printf("\ttime scale, 2 replays twice as fast (default 1)\n");
+	printf("\t-c, --conns=<nr> ");
+	printf("\treplay connections (default the captured, max %d)\n",
+	       DEF_MAX_CONNS);
+	printf("\t-q, --queue=<msgs> ");
+	printf("\tmessages in flight per connection (default %d)\n",
+	       DEF_QUEUE);
+	printf("\t-z, --no-service ");
+	printf("\trespond at once, not after the captured server time\n");
+	printf("\t-S, --server ");
+	printf("\trun only the test server\n");
+	printf("\t-C, --client ");
+	printf("\trun only the client, against a -S process\n");
+	printf("\t-o, --output_file=<file> ");
+	printf("\tappend the result to a file as a json line\n");
+	printf("\t-h, --help ");
+	printf("\tdisplay this help and exit\n");
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_cmdline							     */
+/*---------------------------------------------------------------------------*/
+static int parse_cmdline(int argc, char **argv)
+{
+	static struct option const long_options[] = {
+		{ .name = "info",	 .has_arg = 0, .val = 'i'},
+		{ .name = "transport",	 .has_arg = 1, .val = 'r'},
+		{ .name = "address",	 .has_arg = 1, .val = 'a'},
+		{ .name = "port",	 .has_arg = 1, .val = 'p'},
+		{ .name = "speed",	 .has_arg = 1, .val = 'x'},
+		{ .name = "conns",	 .has_arg = 1, .val = 'c'},
+		{ .name = "queue",	 .has_arg = 1, .val = 'q'},
+		{ .name = "no-service",	 .has_arg = 0, .val = 'z'},
+		{ .name = "server",	 .has_arg = 0, .val = 'S'},
+		{ .name = "client",	 .has_arg = 0, .val = 'C'},
+		{ .name = "output_file", .has_arg = 1, .val = 'o'},
+		{ .name = "help",	 .has_arg = 0, .val = 'h'},
+		{0, 0, 0, 0},
+	};
+	static char *short_options = "ir:a:p:x:c:q:zSCo:h";
+	int c;
+
+	params.transport	= "tcp";
+	params.addr		= "127.0.0.1";
+	params.port		= DEF_PORT;
+	params.speed		= 1.0;
+	params.queue		= DEF_QUEUE;
+
+	optind = 0;
+	opterr = 0;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options,
+				long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'i':
+			params.info = 1;
+			break;
+		case 'r':
+			params.transport = optarg;
+			break;
+		case 'a':
+			params.addr = optarg;
+			break;
+		case 'p':
+			params.port = strtol(optarg, NULL, 0);
+			break;
+		case 'x':
+			params.speed = strtod(optarg, NULL);
+			if (params.speed <= 0)
+				goto invalid;
+			break;
+		case 'c':
+			params.conns = strtol(optarg, NULL, 0);
+			if (params.conns <= 0 || params.conns > MAX_CONNS)
+				goto invalid;
+			break;
+		case 'q':
+			params.queue = strtol(optarg, NULL, 0);
+			if (params.queue <= 0)
+				goto invalid;
+			break;
+		case 'z':
+			params.no_service = 1;
+			break;
+		case 'S':
+			params.server_only = 1;
+			break;
+		case 'C':
+			params.client_only = 1;
+			break;
+		case 'o':
+			params.output_file = optarg;
+			break;
+		case 'h':
+			usage(argv[0]);
+			exit(0);
+		default:
+			goto invalid;
+		}
+	}
+	if (optind == argc - 1)
+		params.capture_file = argv[optind];
+	else if (optind != argc || !params.server_only)
+		goto invalid;
+	if (params.server_only && params.client_only)
+		goto invalid;
+
+	return 0;
+
+invalid:
+	fprintf(stderr, "invalid command line\n");
+	usage(argv[0]);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	pthread_t	server_thread;
+	int		opt, i;
+	int		retval = -1;
+
+	if (parse_cmdline(argc, argv))
+		return -1;
+
+	if (params.capture_file) {
+		if (load_capture(params.capture_file) || build_items())
+			return -1;
+		if (params.info) {
+			print_info();
+			return 0;
+		}
+		if (!items_nr) {
+			fprintf(stderr, "no messages to replay\n");
+			return -1;
+		}
+		if (!params.conns)
+			params.conns = min(capture_conns, DEF_MAX_CONNS);
+	} else {
+		/* a server of its own does not know the sizes to come */
+		max_hdr_len	= 4096;
+		max_data_len	= 1 << 20;
+	}
+
+	xio_init();
+
+	/* the captured headers may exceed the default inline limit */
+	if (max_hdr_len > 256) {
+		opt = max_hdr_len;
+		xio_set_opt(NULL, XIO_OPTLEVEL_ACCELIO,
+			    XIO_OPTNAME_MAX_INLINE_HEADER, &opt, sizeof(opt));
+	}
+
+	if (params.server_only) {
+		if (server_start(NULL))
+			goto cleanup;
+		printf("test server on %s://%s:%d\n", params.transport,
+		       params.addr, params.port);
+		fflush(stdout);
+		xio_context_run_loop(server_ctx, XIO_INFINITE);
+		retval = 0;
+		goto cleanup;
+	}
+	if (!params.client_only && server_start(&server_thread))
+		goto cleanup;
+
+	if (client_init()) {
+		fprintf(stderr, "client setup failed. %s\n",
+			xio_strerror(xio_errno()));
+		goto cleanup;
+	}
+	xio_context_run_loop(client_ctx, XIO_INFINITE);
+	if (failed || !t_end_ns)
+		goto cleanup;
+
+	print_result();
+	retval = 0;
+
+cleanup:
+	/* connections that never came up would not drain, just exit */
+	if (retval)
+		return retval;
+
+	client_destroy();
+	if (!params.client_only && !params.server_only) {
+		/* let the server side of the sessions tear down */
+		for (i = 0; server_sessions && i < 1000; i++)
+			usleep(1000);
+		xio_context_stop_loop(server_ctx);
+		pthread_join(server_thread, NULL);
+	}
+	server_stop();
+	xio_shutdown();
+
+	return retval;
+}
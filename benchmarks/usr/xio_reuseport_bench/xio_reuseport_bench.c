@@ -0,0 +1,615 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libxio.h"
+
+/*
+ * multi-context listener: connection setup rate and load balance of
+ * "reuseport" (every server context binds the same uri, the kernel
+ * spreads the tcp connections with SO_REUSEPORT) against "redirect"
+ * (one acceptor context hands out a portal per worker context through
+ * xio_accept, as in examples/usr/hello_world_mt).
+ */
+
+#define SERVER_THREADS_NR	4
+#define CLIENT_THREADS_NR	4
+#define SESSIONS_NR		64
+#define ROUNDS_NR		10
+#define MAX_SERVER_THREADS	64
+
+enum bench_mode {
+	MODE_REUSEPORT,
+	MODE_REDIRECT,
+};
+
+struct server_thread {
+	struct bench_server	*srv;
+	struct xio_context	*ctx;
+	struct xio_server	*server;
+	char			portal[256];
+	pthread_t		thread_id;
+	int			id;
+	volatile int		ready;
+	volatile int		nconns;
+	int			pad;
+};
+
+struct bench_server {
+	enum bench_mode		mode;
+	int			threads_nr;
+	volatile int		nsessions;
+	volatile int		nteardown;
+	/* redirect acceptor */
+	struct xio_context	*ctx;
+	struct xio_server	*server;
+	const char		*portals[MAX_SERVER_THREADS];
+	pthread_t		thread_id;
+	volatile int		ready;
+	int			pad;
+	struct server_thread	tdata[MAX_SERVER_THREADS];
+};
+
+struct client_thread {
+	struct xio_context	*ctx;
+	struct xio_session	**sessions;
+	struct xio_connection	**conns;
+	char			*url;
+	pthread_t		thread_id;
+	int			id;
+	int			sessions_nr;
+	int			rounds_nr;
+	int			nestablished;
+	int			nerrors;
+	int			nteardown;
+	uint64_t		setup_ns;
+};
+
+/*---------------------------------------------------------------------------*/
+/* get_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t get_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct server_thread *tdata = (struct server_thread *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_NEW_CONNECTION_EVENT:
+		__sync_fetch_and_add(&tdata->nconns, 1);
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		__sync_fetch_and_add(&tdata->srv->nteardown, 1);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int server_on_new_session(struct xio_session *session,
+				 struct xio_new_session_req *req,
+				 void *cb_user_context)
+{
+	struct server_thread *tdata = (struct server_thread *)cb_user_context;
+
+	__sync_fetch_and_add(&tdata->srv->nsessions, 1);
+	xio_accept(session, NULL, 0, NULL, 0);
+
+	return 0;
+}
+
+static struct xio_session_ops server_ops = {
+	.on_session_event		=  server_on_session_event,
+	.on_new_session			=  server_on_new_session,
+};
+
+/*---------------------------------------------------------------------------*/
+/* acceptor_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int acceptor_on_session_event(struct xio_session *session,
+				     struct xio_session_event_data *event_data,
+				     void *cb_user_context)
+{
+	struct bench_server *srv = (struct bench_server *)cb_user_context;
+	struct server_thread *tdata;
+
+	/* the session belongs to the acceptor, the connections opened on
+	 * the worker portals carry the worker as their user context
+	 */
+	tdata = (event_data->conn_user_context == srv) ? NULL :
+		(struct server_thread *)event_data->conn_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_NEW_CONNECTION_EVENT:
+		if (tdata)
+			__sync_fetch_and_add(&tdata->nconns, 1);
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		__sync_fetch_and_add(&srv->nteardown, 1);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* acceptor_on_new_session						     */
+/*---------------------------------------------------------------------------*/
+static int acceptor_on_new_session(struct xio_session *session,
+				   struct xio_new_session_req *req,
+				   void *cb_user_context)
+{
+	struct bench_server *srv = (struct bench_server *)cb_user_context;
+
+	__sync_fetch_and_add(&srv->nsessions, 1);
+	xio_accept(session, srv->portals, srv->threads_nr, NULL, 0);
+
+	return 0;
+}
+
+static struct xio_session_ops acceptor_ops = {
+	.on_session_event		=  acceptor_on_session_event,
+	.on_new_session			=  acceptor_on_new_session,
+};
+
+/*---------------------------------------------------------------------------*/
+/* server_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *server_thread(void *data)
+{
+	struct server_thread	*tdata = (struct server_thread *)data;
+	long			ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int			cpu = tdata->id % (ncpus > 0 ? ncpus : 1);
+	cpu_set_t		cpuset;
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+
+	tdata->ctx = xio_context_create(NULL, 0, cpu);
+	tdata->server = xio_bind(tdata->ctx, &server_ops, tdata->portal,
+				 NULL, 0, tdata);
+	if (!tdata->server) {
+		fprintf(stderr, "thread %d: failed to bind %s. %s\n",
+			tdata->id, tdata->portal, xio_strerror(xio_errno()));
+		tdata->ready = -1;
+		xio_context_destroy(tdata->ctx);
+		return NULL;
+	}
+	tdata->ready = 1;
+
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* acceptor_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *acceptor_thread(void *data)
+{
+	struct bench_server	*srv = (struct bench_server *)data;
+
+	xio_context_run_loop(srv->ctx, XIO_INFINITE);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_on_session_event						     */
+/*---------------------------------------------------------------------------*/
+static int client_on_session_event(struct xio_session *session,
+				   struct xio_session_event_data *event_data,
+				   void *cb_user_context)
+{
+	struct client_thread *tdata = (struct client_thread *)cb_user_context;
+
+	switch (event_data->event) {
+	case XIO_SESSION_CONNECTION_ESTABLISHED_EVENT:
+		if (++tdata->nestablished + tdata->nerrors ==
+		    tdata->sessions_nr)
+			xio_context_stop_loop(tdata->ctx);
+		break;
+	case XIO_SESSION_REJECT_EVENT:
+	case XIO_SESSION_CONNECTION_ERROR_EVENT:
+		fprintf(stderr, "client %d: %s. reason: %s\n", tdata->id,
+			xio_session_event_str(event_data->event),
+			xio_strerror(event_data->reason));
+		if (tdata->nestablished + ++tdata->nerrors ==
+		    tdata->sessions_nr)
+			xio_context_stop_loop(tdata->ctx);
+		break;
+	case XIO_SESSION_CONNECTION_TEARDOWN_EVENT:
+		xio_connection_destroy(event_data->conn);
+		break;
+	case XIO_SESSION_TEARDOWN_EVENT:
+		xio_session_destroy(session);
+		if (++tdata->nteardown == tdata->sessions_nr)
+			xio_context_stop_loop(tdata->ctx);
+		break;
+	default:
+		break;
+	};
+
+	return 0;
+}
+
+static struct xio_session_ops client_ops = {
+	.on_session_event		=  client_on_session_event,
+};
+
+/*---------------------------------------------------------------------------*/
+/* client_round								     */
+/*---------------------------------------------------------------------------*/
+static int client_round(struct client_thread *tdata)
+{
+	struct xio_session_params	params;
+	struct xio_connection_params	cparams;
+	uint64_t			start;
+	int				i;
+
+	tdata->nestablished	= 0;
+	tdata->nerrors		= 0;
+	tdata->nteardown	= 0;
+
+	memset(&params, 0, sizeof(params));
+	params.type		= XIO_SESSION_CLIENT;
+	params.ses_ops		= &client_ops;
+	params.user_context	= tdata;
+	params.uri		= tdata->url;
+
+	memset(&cparams, 0, sizeof(cparams));
+	cparams.ctx			= tdata->ctx;
+	cparams.conn_user_context	= tdata;
+
+	start = get_ns();
+	for (i = 0; i < tdata->sessions_nr; i++) {
+		tdata->sessions[i] = xio_session_create(&params);
+		if (!tdata->sessions[i])
+			return -1;
+		cparams.session = tdata->sessions[i];
+		tdata->conns[i] = xio_connect(&cparams);
+		if (!tdata->conns[i])
+			return -1;
+	}
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+	tdata->setup_ns += get_ns() - start;
+
+	for (i = 0; i < tdata->sessions_nr; i++)
+		xio_disconnect(tdata->conns[i]);
+	xio_context_run_loop(tdata->ctx, XIO_INFINITE);
+
+	return tdata->nerrors ? -1 : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* client_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *client_thread(void *data)
+{
+	struct client_thread *tdata = (struct client_thread *)data;
+	int i;
+
+	for (i = 0; i < tdata->rounds_nr; i++) {
+		if (client_round(tdata)) {
+			tdata->rounds_nr = i;
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_start								     */
+/*---------------------------------------------------------------------------*/
+static int server_start(struct bench_server *srv, const char *transport,
+			const char *host, int port)
+{
+	struct server_thread	*tdata;
+	char			url[256];
+	int			i;
+
+	if (srv->mode == MODE_REDIRECT) {
+		sprintf(url, "%s://%s:%d", transport, host, port);
+		srv->ctx = xio_context_create(NULL, 0, -1);
+		srv->server = xio_bind(srv->ctx, &acceptor_ops, url,
+				       NULL, 0, srv);
+		if (!srv->server) {
+			fprintf(stderr, "failed to bind %s. %s\n", url,
+				xio_strerror(xio_errno()));
+			return -1;
+		}
+	}
+
+	for (i = 0; i < srv->threads_nr; i++) {
+		tdata = &srv->tdata[i];
+		tdata->srv = srv;
+		tdata->id = i;
+		/* redirect: one port per worker, reuseport: one port */
+		sprintf(tdata->portal, "%s://%s:%d", transport, host,
+			srv->mode == MODE_REDIRECT ? port + 1 + i : port);
+		srv->portals[i] = tdata->portal;
+		pthread_create(&tdata->thread_id, NULL, server_thread, tdata);
+		while (!tdata->ready)
+			usleep(100);
+		if (tdata->ready < 0)
+			return -1;
+	}
+	if (srv->mode == MODE_REDIRECT)
+		pthread_create(&srv->thread_id, NULL, acceptor_thread, srv);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_stop								     */
+/*---------------------------------------------------------------------------*/
+static void server_stop(struct bench_server *srv)
+{
+	int i;
+
+	/* let the server side finish its teardowns (up to 5 seconds) */
+	for (i = 0; i < 5000 && srv->nteardown < srv->nsessions; i++)
+		usleep(1000);
+
+	for (i = 0; i < srv->threads_nr; i++) {
+		if (srv->tdata[i].ready <= 0)
+			continue;
+		xio_context_stop_loop(srv->tdata[i].ctx);
+		pthread_join(srv->tdata[i].thread_id, NULL);
+	}
+	if (srv->server) {
+		xio_context_stop_loop(srv->ctx);
+		pthread_join(srv->thread_id, NULL);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* server_destroy							     */
+/*---------------------------------------------------------------------------*/
+static void server_destroy(struct bench_server *srv)
+{
+	int i;
+
+	for (i = 0; i < srv->threads_nr; i++) {
+		if (srv->tdata[i].ready <= 0)
+			continue;
+		xio_unbind(srv->tdata[i].server);
+		xio_context_destroy(srv->tdata[i].ctx);
+	}
+	if (srv->server)
+		xio_unbind(srv->server);
+	if (srv->ctx)
+		xio_context_destroy(srv->ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* run_mode								     */
+/*---------------------------------------------------------------------------*/
+static int run_mode(enum bench_mode mode, const char *transport,
+		    const char *host, int port, int server_threads_nr,
+		    int client_threads_nr, int sessions_nr, int rounds_nr)
+{
+	struct bench_server	*srv;
+	struct client_thread	*cdata;
+	char			url[256];
+	uint64_t		start, total_ns, setup_ns = 0;
+	double			mean;
+	int			reuse_port = (mode == MODE_REUSEPORT);
+	int			i, nsessions = 0, retval = 0;
+	int			min_conns = -1, max_conns = 0;
+
+	xio_set_opt(NULL, XIO_OPTLEVEL_TCP, XIO_OPTNAME_TCP_REUSE_PORT,
+		    &reuse_port, sizeof(reuse_port));
+
+	srv = (struct bench_server *)calloc(1, sizeof(*srv));
+	srv->mode = mode;
+	srv->threads_nr = server_threads_nr;
+	if (server_start(srv, transport, host, port)) {
+		server_stop(srv);
+		server_destroy(srv);
+		free(srv);
+		return -1;
+	}
+
+	sprintf(url, "%s://%s:%d", transport, host, port);
+	cdata = (struct client_thread *)calloc(client_threads_nr,
+					       sizeof(*cdata));
+	for (i = 0; i < client_threads_nr; i++) {
+		cdata[i].id		= i;
+		cdata[i].url		= url;
+		cdata[i].sessions_nr	= sessions_nr;
+		cdata[i].rounds_nr	= rounds_nr;
+		cdata[i].sessions = (struct xio_session **)
+				calloc(sessions_nr, sizeof(void *));
+		cdata[i].conns = (struct xio_connection **)
+				calloc(sessions_nr, sizeof(void *));
+		cdata[i].ctx = xio_context_create(NULL, 0, -1);
+	}
+
+	start = get_ns();
+	for (i = 0; i < client_threads_nr; i++)
+		pthread_create(&cdata[i].thread_id, NULL, client_thread,
+			       &cdata[i]);
+	for (i = 0; i < client_threads_nr; i++)
+		pthread_join(cdata[i].thread_id, NULL);
+	total_ns = get_ns() - start;
+
+	for (i = 0; i < client_threads_nr; i++) {
+		if (cdata[i].rounds_nr != rounds_nr)
+			retval = -1;
+		nsessions += cdata[i].rounds_nr * sessions_nr;
+		setup_ns  += cdata[i].setup_ns;
+	}
+
+	server_stop(srv);
+
+	for (i = 0; i < client_threads_nr; i++) {
+		xio_context_destroy(cdata[i].ctx);
+		free(cdata[i].sessions);
+		free(cdata[i].conns);
+	}
+	free(cdata);
+	server_destroy(srv);
+
+	mean = (double)nsessions / server_threads_nr;
+	for (i = 0; i < server_threads_nr; i++) {
+		int n = srv->tdata[i].nconns;
+
+		if (min_conns < 0 || n < min_conns)
+			min_conns = n;
+		if (n > max_conns)
+			max_conns = n;
+	}
+
+	printf("%-9s: %d sessions, %.0f sessions/sec, setup %.1f us/session\n",
+	       mode == MODE_REUSEPORT ? "reuseport" : "redirect",
+	       nsessions, nsessions / (total_ns / 1000000000.0),
+	       nsessions ? setup_ns / 1000.0 / nsessions : 0.0);
+	printf("%-9s  per context conns: min %d max %d, " \
+	       "min/mean %.2f max/mean %.2f\n", "",
+	       min_conns, max_conns,
+	       mean > 0 ? min_conns / mean : 0.0,
+	       mean > 0 ? max_conns / mean : 0.0);
+
+	printf("%-9s  conns per context:", "");
+	for (i = 0; i < server_threads_nr; i++)
+		printf(" %d", srv->tdata[i].nconns);
+	printf("\n");
+
+	free(srv);
+
+	return retval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	const char	*transport, *mode;
+	int		port, server_threads_nr, client_threads_nr;
+	int		sessions_nr, rounds_nr, incoming_cpu, dual_stream;
+	int		retval = 0;
+
+	if (argc < 3) {
+		printf("Usage: %s <host> <port> <transport:optional> " \
+		       "<reuseport|redirect|both:optional> " \
+		       "<server threads:optional> <client threads:optional> " \
+		       "<sessions:optional> <rounds:optional> " \
+		       "<incoming cpu:optional> <dual stream:optional>\n",
+		       argv[0]);
+		exit(1);
+	}
+	port			= atoi(argv[2]);
+	transport		= (argc > 3) ? argv[3] : "tcp";
+	mode			= (argc > 4) ? argv[4] : "both";
+	server_threads_nr	= (argc > 5) ? atoi(argv[5]) : SERVER_THREADS_NR;
+	client_threads_nr	= (argc > 6) ? atoi(argv[6]) : CLIENT_THREADS_NR;
+	sessions_nr		= (argc > 7) ? atoi(argv[7]) : SESSIONS_NR;
+	rounds_nr		= (argc > 8) ? atoi(argv[8]) : ROUNDS_NR;
+	incoming_cpu		= (argc > 9) ? atoi(argv[9]) : 0;
+	dual_stream		= (argc > 10) ? atoi(argv[10]) : 1;
+	if (server_threads_nr < 1 || server_threads_nr > MAX_SERVER_THREADS ||
+	    client_threads_nr < 1 || sessions_nr < 1 || rounds_nr < 1) {
+		fprintf(stderr, "invalid arguments\n");
+		exit(1);
+	}
+
+	xio_init();
+
+	xio_set_opt(NULL, XIO_OPTLEVEL_TCP, XIO_OPTNAME_TCP_INCOMING_CPU,
+		    &incoming_cpu, sizeof(incoming_cpu));
+	xio_set_opt(NULL, XIO_OPTLEVEL_TCP, XIO_OPTNAME_TCP_DUAL_STREAM,
+		    &dual_stream, sizeof(dual_stream));
+
+	printf("server contexts %d, client threads %d, sessions/round %d, " \
+	       "rounds %d\n", server_threads_nr, client_threads_nr,
+	       sessions_nr, rounds_nr);
+
+	if (strcmp(mode, "redirect")) {
+		if (run_mode(MODE_REUSEPORT, transport, argv[1], port,
+			     server_threads_nr, client_threads_nr,
+			     sessions_nr, rounds_nr))
+			retval = 1;
+	}
+	if (strcmp(mode, "reuseport")) {
+		if (run_mode(MODE_REDIRECT, transport, argv[1], port,
+			     server_threads_nr, client_threads_nr,
+			     sessions_nr, rounds_nr))
+			retval = 1;
+	}
+
+	xio_shutdown();
+
+	return retval;
+}
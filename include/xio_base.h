@@ -167,6 +167,34 @@ enum xio_msg_direction {
 	XIO_MSG_DIRECTION_IN
 };
 
+/**
+ * @enum xio_post_op
+ * @brief operation carried out by the connection's context for a message
+ *	  handed over by xio_post_msg
+ */
+enum xio_post_op {
+	XIO_POST_SEND_REQUEST,		/**< xio_send_request		    */
+	XIO_POST_SEND_RESPONSE,		/**< xio_send_response		    */
+	XIO_POST_SEND_MSG,		/**< xio_send_msg		    */
+	XIO_POST_RELEASE_MSG,		/**< xio_release_msg		    */
+	XIO_POST_RELEASE_RESPONSE,	/**< xio_release_response	    */
+};
+
+/**
+ * @enum xio_portal_policy
+ * @brief how a client session spreads its connections over the portals
+ *	  returned by the server's xio_accept, and its requests over its
+ *	  connections (see xio_session_select_connection)
+ */
+enum xio_portal_policy {
+	XIO_PORTAL_POLICY_ROUND_ROBIN,	   /**< rotate, ignore the load	    */
+	XIO_PORTAL_POLICY_LEAST_OUTSTANDING, /**< fewest requests queued on */
+					   /**< the server thread and in    */
+					   /**< flight from this session    */
+	XIO_PORTAL_POLICY_LOWEST_LATENCY,  /**< lowest moving average of    */
+					   /**< the response time	    */
+};
+
 
 /**
  * @enum xio_msg_flags
@@ -340,6 +368,8 @@ enum xio_session_event {
 	XIO_SESSION_CONNECTION_REFUSED_EVENT,	  /**< connection refused event*/
 	XIO_SESSION_CONNECTION_ERROR_EVENT,	  /**< connection error event */
 	XIO_SESSION_ERROR_EVENT,		  /**< session error event    */
+	XIO_SESSION_CONNECTION_MIGRATED_EVENT,	  /**< connection moved to   */
+						  /**< another context	      */
 };
 
 /**
@@ -585,6 +615,28 @@ struct xio_session_ops {
 				       struct xio_msg *msg,
 				       void *conn_user_context);
 
+	/**
+	 * batched send completion notification - responses and one way
+	 * messages.
+	 *
+	 *  @param[in] session			the session
+	 *  @param[in] msgs			array of completed messages in
+	 *					completion order
+	 *  @param[in] nr			number of messages in msgs
+	 *  @param[in] conn_user_context	user private data provided on
+	 *					connection creation
+	 *
+	 *  @returns 0
+	 *  @note  when set, replaces on_msg_send_complete and
+	 *	   on_ow_msg_send_complete. completions are coalesced per
+	 *	   connection up to XIO_OPTNAME_SEND_COMP_BATCH messages and
+	 *	   flushed at the end of the event loop pass. the msgs array
+	 *	   is owned by the library and valid only during the callback
+	 */
+	int (*on_msgs_send_complete)(struct xio_session *session,
+				     struct xio_msg **msgs,
+				     int nr,
+				     void *conn_user_context);
 };
 
 /**
@@ -654,6 +706,57 @@ enum xio_connection_attr_mask {
 	XIO_CONNECTION_ATTR_PROTO		= 1 << 2,
 	XIO_CONNECTION_ATTR_PEER_ADDR		= 1 << 3,
 	XIO_CONNECTION_ATTR_LOCAL_ADDR		= 1 << 4,
+	XIO_CONNECTION_ATTR_COUNTERS		= 1 << 5,
+	XIO_CONNECTION_ATTR_RSP_LATENCY		= 1 << 6,
+};
+
+/**
+ * @struct xio_connection_counters
+ * @brief connection traffic counters (XIO_CONNECTION_ATTR_COUNTERS).
+ *	  counters run from connection creation, the last four fields are
+ *	  current queue depths
+ */
+struct xio_connection_counters {
+	uint64_t		tx_msgs;	/**< messages sent	      */
+	uint64_t		tx_bytes;	/**< bytes sent		      */
+	uint64_t		rx_msgs;	/**< messages received	      */
+	uint64_t		rx_bytes;	/**< bytes received	      */
+	uint64_t		credit_stalls;	/**< sends held back waiting  */
+						/**< for peer credits	      */
+	uint64_t		eagains;	/**< sends pushed back by the */
+						/**< transport		      */
+	uint64_t		retransmits;	/**< requests resent after a  */
+						/**< reconnect		      */
+	uint32_t		reqs_outstanding; /**< requests sent and not  */
+						/**< yet answered	      */
+	uint32_t		reqs_pending;	/**< requests received and    */
+						/**< not yet answered	      */
+	uint32_t		tx_queued;	/**< messages waiting to be   */
+						/**< sent		      */
+	uint32_t		tx_in_flight;	/**< messages sent and not    */
+						/**< yet completed	      */
+};
+
+/* log-linear buckets: values below 2^(XIO_LAT_HIST_SUB_BITS + 1) ns get a
+ * bucket each, every further power of two is split in
+ * 2^XIO_LAT_HIST_SUB_BITS equal buckets, i.e. 6.25% resolution up to
+ * 2^36 ns (~68 seconds). longer samples land in the last bucket
+ */
+#define XIO_LAT_HIST_SUB_BITS	4
+#define XIO_LAT_HIST_BUCKETS	528
+
+/**
+ * @struct xio_latency_hist
+ * @brief latency histogram (XIO_CONNECTION_ATTR_RSP_LATENCY) - time
+ *	  from xio_send_request to the arrival of the response, in
+ *	  nanoseconds
+ */
+struct xio_latency_hist {
+	uint64_t		count;		/**< number of samples	      */
+	uint64_t		min_ns;		/**< smallest sample	      */
+	uint64_t		max_ns;		/**< largest sample	      */
+	uint64_t		sum_ns;		/**< sum of all samples	      */
+	uint64_t		buckets[XIO_LAT_HIST_BUCKETS];
 };
 
 /**
@@ -670,6 +773,9 @@ struct xio_connection_attr {
 	enum xio_proto		proto;	        /**< protocol type           */
 	struct sockaddr_storage	peer_addr;	/**< address of peer	     */
 	struct sockaddr_storage	local_addr;	/**< address of local	     */
+	struct xio_connection_counters counters; /**< traffic counters	     */
+	struct xio_latency_hist	*rsp_latency;	/**< caller supplied buffer  */
+						/**< for the response latency*/
 };
 
 /**
@@ -723,6 +829,77 @@ int xio_disconnect(struct xio_connection *conn);
  */
 int xio_connection_destroy(struct xio_connection *conn);
 
+/**
+ * move an established connection, with its nexus, transport handle and
+ * task pools, to another context
+ *
+ * call on the connection's current context. the connection must be
+ * idle: online, no messages queued or in flight, no received message
+ * held by the application, and not sharing its nexus with another
+ * session. the new context takes over asynchronously and reports
+ * XIO_SESSION_CONNECTION_MIGRATED_EVENT from its loop - a failure there
+ * carries the reason and disconnects the connection. messages handed
+ * to xio_post_msg meanwhile are kept and run on the new context.
+ *
+ * @param[in] conn	The xio connection handle
+ * @param[in] ctx	The target context
+ *
+ * @returns success (0), or a (negative) error value - EAGAIN when the
+ *	    connection is not idle, EEXIST when the session already has a
+ *	    connection on ctx, XIO_E_NOT_SUPPORTED when the transport can
+ *	    not migrate
+ */
+int xio_connection_migrate(struct xio_connection *conn,
+			   struct xio_context *ctx);
+
+/**
+ * pick the connection of a client session to carry the next request
+ *
+ * chooses among the session's online connections following the
+ * session's XIO_OPTNAME_PORTAL_POLICY: round robin, the fewest requests
+ * outstanding on the connection plus the queue depth last reported by
+ * its server thread, or the lowest expected response time. servers
+ * report their load on every response. a session has one connection
+ * per context, send with xio_send_request on the connection's context
+ * or with xio_post_msg from any other thread.
+ *
+ * @param[in] session	The xio session handle
+ *
+ * @returns the connection, or NULL (ENOTCONN) when the session has no
+ *	    online connection
+ */
+struct xio_connection *xio_session_select_connection(
+		struct xio_session *session);
+
+/**
+ * send a request on one of the client session's connections
+ *
+ * the connection is chosen as by xio_session_select_connection, or by
+ * rendezvous hashing of key when one is given so that requests sharing a
+ * key keep going to the same connection while it is up. connections
+ * whose transport is reconnecting are skipped and requests still queued
+ * on them are moved to another connection. requests flushed when a
+ * connection is lost are resent on another connection instead of being
+ * reported in on_msg_error; a request that was already delivered when
+ * its connection failed may thus be served twice. the response is
+ * delivered on the connection that carried the request.
+ *
+ * @param[in] session	The xio session handle
+ * @param[in] ctx	The caller's context - the request is sent in place
+ *			when the chosen connection runs on ctx and posted
+ *			with xio_post_msg otherwise. may be NULL
+ * @param[in] msg	The request (a single message, msg->next is NULL)
+ * @param[in] key	Affinity key, or NULL to follow the session's
+ *			XIO_OPTNAME_PORTAL_POLICY
+ *
+ * @returns success (0), or a (negative) error value - ENOTCONN when the
+ *	    session has no connection to send on
+ */
+int xio_session_send_request(struct xio_session *session,
+			     struct xio_context *ctx,
+			     struct xio_msg *msg,
+			     const uint64_t *key);
+
 /**
  * modify connection parameters
  *
@@ -738,6 +915,11 @@ int xio_modify_connection(struct xio_connection *conn,
 /**
  * query connection parameters
  *
+ * XIO_CONNECTION_ATTR_COUNTERS and XIO_CONNECTION_ATTR_RSP_LATENCY
+ * snapshot the connection's statistics and are meant to be called on the
+ * connection's context. for the latter, attr->rsp_latency points to the
+ * histogram to fill in.
+ *
  * @param[in] conn	The xio connection handle
  * @param[in] attr	The connection attributes structure
  * @param[in] attr_mask attribute mask to modify
@@ -747,6 +929,19 @@ int xio_modify_connection(struct xio_connection *conn,
 int xio_query_connection(struct xio_connection *conn,
 			 struct xio_connection_attr *attr,
 			 int attr_mask);
+
+/**
+ * value at a percentile of a latency histogram
+ *
+ * @param[in] hist	The histogram, as returned by xio_query_connection
+ * @param[in] ppm	The percentile in parts per million (990000 is the
+ *			99th percentile)
+ *
+ * @returns the highest value, in nanoseconds, that falls in the bucket
+ *	    holding the percentile, or 0 when the histogram is empty
+ */
+uint64_t xio_latency_hist_percentile(const struct xio_latency_hist *hist,
+				     uint32_t ppm);
 /**
  * send request to responder
  *
@@ -811,6 +1006,48 @@ int xio_release_response(struct xio_msg *rsp);
 int xio_send_msg(struct xio_connection *conn,
 		 struct xio_msg *msg);
 
+/**
+ * send one way message to many remote peers (fan out)
+ *
+ * the message header and data are referenced by all destinations, not
+ * copied per connection. a single send completion, or a single message
+ * error carrying the first failure, is delivered for @msg once the last
+ * destination is done with it, on that destination's session.
+ * all the connections must belong to the caller's context.
+ * read receipts are not supported.
+ *
+ * @param[in] conns	Array of xio connection handles
+ * @param[in] conns_nr	Number of connections in @conns
+ * @param[in] msg	The message to send
+ *
+ * @returns success (0), or a (negative) error value if no destination
+ *	    accepted the message - no completion is delivered in that case
+ */
+int xio_send_msg_multi(struct xio_connection **conns, int conns_nr,
+		       struct xio_msg *msg);
+
+/**
+ * hand a message operation to the connection's context from any thread
+ *
+ * the message is queued on a lock free per connection ring and the
+ * operation runs later on the context's loop thread, in posting order
+ * per producer. one wakeup is raised per batch of posts, not per post.
+ * a request or one way message that can not be sent there is reported
+ * through on_msg_error. posts must stop before the connection's
+ * teardown event is handled.
+ *
+ * @param[in] conn	The xio connection handle
+ * @param[in] op	The operation to perform - @ref xio_post_op
+ * @param[in] msg	The message, a single one (msg->next must be NULL)
+ *
+ * @returns success (0), or a (negative) error value - EAGAIN when the
+ *	    ring is full, EBUSY when the message was queued but the context
+ *	    could not be woken up. it then runs with the next post that
+ *	    wakes the context and must not be posted again
+ */
+int xio_post_msg(struct xio_connection *conn, enum xio_post_op op,
+		 struct xio_msg *msg);
+
 /**
  * release one way message resources back to xio when message is no longer
  * needed
@@ -974,6 +1211,26 @@ enum xio_optname {
 	XIO_OPTNAME_MAX_INLINE_DATA,    /**< set/get maximum inline data      */
 					  /**< size			      */
 
+	XIO_OPTNAME_SEND_COMP_BATCH,	  /**< set/get maximum send	      */
+					  /**< completions coalesced per      */
+					  /**< on_msgs_send_complete call     */
+
+	XIO_OPTNAME_PORTAL_POLICY,	  /**< set/get enum xio_portal_policy */
+					  /**< of sessions created later      */
+
+	XIO_OPTNAME_MSG_TRACE,		  /**< set/get int - stamp requests'  */
+					  /**< lifecycle and record the	      */
+					  /**< latency breakdown. also set by */
+					  /**< XIO_MSG_TRACE=<file>	      */
+
+	XIO_OPTNAME_CAPTURE,		  /**< set/get int - record metadata  */
+					  /**< of the messages, no payloads.  */
+					  /**< also set by XIO_CAPTURE=<file> */
+
+	XIO_OPTNAME_EV_TRACE_DUMP,	  /**< set char * path or NULL -      */
+					  /**< write the event trace rings    */
+					  /**< (--enable-ev-trace builds)     */
+
 
 	/* XIO_OPTLEVEL_RDMA/TCP */
 	XIO_OPTNAME_ENABLE_MEM_POOL = 200,/**< enables the internal	      */
@@ -991,6 +1248,10 @@ enum xio_optname {
 	XIO_OPTNAME_TCP_SO_RCVBUF,	       /**< tcp socket receive buffer */
 	XIO_OPTNAME_TCP_DUAL_STREAM,	       /**< performance boost for the */
 					       /**< price of two fd resources */
+	XIO_OPTNAME_TCP_REUSE_PORT,	       /**< bind the same uri on many */
+					       /**< contexts (SO_REUSEPORT)   */
+	XIO_OPTNAME_TCP_INCOMING_CPU,	       /**< steer accepted sockets to */
+					       /**< the listener on their cpu */
 };
 
 /**
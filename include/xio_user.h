@@ -219,6 +219,49 @@ struct xio_context *xio_context_create(struct xio_context_attr *ctx_attr,
 				       int polling_timeout_us,
 				       int cpu_hint);
 
+/**
+ * @struct xio_context_set_attr
+ * @brief  placement of a set of contexts
+ */
+struct xio_context_set_attr {
+	const char		*uri;		/**< contexts go on the cores */
+						/**< local to the interface   */
+						/**< serving uri, optional    */
+	struct xio_context_attr	*ctx_attr;	/**< for every context	      */
+	int			ctxs_nr;	/**< contexts to create	      */
+	int			polling_timeout_us; /**< as in create	      */
+	int			numa_node;	/**< -1 - follow uri, n - use */
+						/**< the cores of node n      */
+	int			pad;
+};
+
+/**
+ * creates a set of contexts placed on the cores of one numa node
+ *
+ * the node is the one of the network interface that serves attr->uri,
+ * unless attr->numa_node forces another. without either, or when the
+ * interface has no node (loopback, wildcard address), all the allowed
+ * cores are used. the contexts spread round robin over the cores, the
+ * thread that runs a context's loop is pinned to its core and the
+ * memory pools of the context are allocated on its node.
+ *
+ * @param[in] attr	placement attributes
+ * @param[out] ctxs	array of attr->ctxs_nr context handles
+ *
+ * @returns success (0), or a (negative) error value
+ */
+int xio_context_create_set(struct xio_context_set_attr *attr,
+			   struct xio_context **ctxs);
+
+/**
+ * numa node of the network interface that serves an uri
+ *
+ * @param[in] uri	uri to look up, only its address part is used
+ *
+ * @returns the node, or -1 when unknown
+ */
+int xio_uri_numa_node(const char *uri);
+
 /**
  * get context poll parameters to assign to external dispatcher
  *
@@ -464,6 +507,113 @@ int xio_mempool_alloc(struct xio_mempool *mpool,
  */
 void xio_mempool_free(struct xio_mempool_obj *mp_obj);
 
+/*---------------------------------------------------------------------------*/
+/* XIO worker pool API							     */
+/*---------------------------------------------------------------------------*/
+struct xio_server;
+struct xio_worker_pool;
+
+/**
+ * @struct xio_worker_pool_attr
+ * @brief worker pool creation attributes
+ */
+struct xio_worker_pool_attr {
+	int		threads_nr;	/**< number of worker threads	      */
+	int		queue_depth;	/**< requests in flight, 0 - default  */
+	int		ordered;	/**< keep per connection order	      */
+	int		pad;
+};
+
+/**
+ * creates a pool of threads that run servers' request handlers
+ *
+ * unordered pools spread requests over the workers and idle workers
+ * steal from busy ones. a request that finds the pool full runs inline
+ * on the context. ordered pools keep all requests of a connection on
+ * one worker. when the pool is full, a connection's requests wait on
+ * the connection behind the ones it already has on the pool, and run
+ * inline when it has none - the context never waits for the pool.
+ *
+ * @param[in] attr	pool attributes, queue_depth is at most 512
+ *
+ * @returns pool handle, or NULL upon error
+ */
+struct xio_worker_pool *xio_worker_pool_create(
+		struct xio_worker_pool_attr *attr);
+
+/**
+ * destroys a worker pool. servers using it must be destroyed first
+ *
+ * @param[in] pool	the pool handle
+ *
+ * @returns success (0), or a (negative) error value - EBUSY while
+ *	    requests are in flight
+ */
+int xio_worker_pool_destroy(struct xio_worker_pool *pool);
+
+/**
+ * runs the server's on_msg for requests on a worker pool
+ *
+ * applies to connections accepted after the call. on_msg of a
+ * dispatched request runs on a worker thread and may call
+ * xio_send_response there - the response is handed to the
+ * connection's context. other calls on the connection from the handler
+ * must go through xio_post_msg. one way messages, requests asking for
+ * a read receipt and all other callbacks stay on the context.
+ *
+ * @param[in] server	the server handle
+ * @param[in] pool	the pool handle, NULL to run requests inline
+ *
+ * @returns success (0), or a (negative) error value
+ */
+int xio_bind_worker_pool(struct xio_server *server,
+			 struct xio_worker_pool *pool);
+
+/*---------------------------------------------------------------------------*/
+/* XIO connection rebalancer API					     */
+/*---------------------------------------------------------------------------*/
+struct xio_rebalancer;
+
+/**
+ * @struct xio_rebalancer_attr
+ * @brief rebalancer creation attributes
+ */
+struct xio_rebalancer_attr {
+	struct xio_context	**ctxs;		/**< contexts to balance      */
+	int			ctxs_nr;	/**< at least two	      */
+	int			interval_ms;	/**< sampling, 0 - 1 second   */
+	int			threshold;	/**< imbalance in percent of  */
+						/**< the busiest context that */
+						/**< triggers a move, 0 - 25  */
+	int			pad;
+};
+
+/**
+ * starts a thread that watches the message rate of a set of contexts
+ *
+ * when the busiest context exceeds the idlest by more than the
+ * threshold, one connection whose recent load is closest to half the
+ * gap moves from the busiest to the idlest context with
+ * xio_connection_migrate, at most one per interval. the loops of the
+ * contexts must not run while xio_rebalancer_destroy is called.
+ *
+ * @param[in] attr	rebalancer attributes
+ *
+ * @returns rebalancer handle, or NULL upon error
+ */
+struct xio_rebalancer *xio_rebalancer_create(
+		struct xio_rebalancer_attr *attr);
+
+/**
+ * stops a rebalancer and cancels a migration it has not carried out
+ * yet. call it while the loops of the contexts are stopped
+ *
+ * @param[in] rb	the rebalancer handle
+ *
+ * @returns success (0), or a (negative) error value
+ */
+int xio_rebalancer_destroy(struct xio_rebalancer *rb);
+
 
 #ifdef __cplusplus
 }
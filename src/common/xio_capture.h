@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_CAPTURE_H
+#define XIO_CAPTURE_H
+
+/*
+ * traffic capture
+ *
+ * with XIO_OPTNAME_CAPTURE set, the session layer records the metadata of
+ * every application message it sends or delivers - direction, type,
+ * header and data sizes, time and response time - never the payload.
+ * requests and responses carry the sn of the request, so the two ends of
+ * a round trip pair up. in user space the records are appended to a per
+ * process file that xio_replay summarizes and replays.
+ */
+
+#define XIO_CAPTURE_MAGIC		0x50435858	/* "XXCP" */
+#define XIO_CAPTURE_VERSION		1
+
+enum xio_capture_dir {
+	XIO_CAPTURE_TX,			/* sent by the application	*/
+	XIO_CAPTURE_RX			/* delivered to the application	*/
+};
+
+enum xio_capture_type {
+	XIO_CAPTURE_REQ,
+	XIO_CAPTURE_RSP,
+	XIO_CAPTURE_ONE_WAY
+};
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_capture_file_hdr {
+	uint32_t		magic;
+	uint32_t		version;
+	int32_t			pid;
+	uint32_t		rec_size;
+};
+
+struct xio_capture_rec {
+	uint64_t		ts_ns;		/* monotonic			*/
+	uint32_t		session_id;
+	uint16_t		conn_idx;
+	uint8_t			dir;		/* enum xio_capture_dir		*/
+	uint8_t			type;		/* enum xio_capture_type	*/
+	uint32_t		sn;		/* of the request		*/
+	uint32_t		hdr_len;
+	uint32_t		data_len;
+	/* rx response: round trip, tx response: time at the server,
+	 * saturated
+	 */
+	uint32_t		rsp_ns;
+};
+
+#endif /* XIO_CAPTURE_H */
@@ -70,8 +70,13 @@ void xio_set_error(int errnum);
 
 #define XIO_TLV_LEN			sizeof(struct xio_tlv)
 #define XIO_SESSION_HDR_LEN		sizeof(struct xio_session_hdr)
-#define XIO_TRANSPORT_OFFSET		(XIO_TLV_LEN + XIO_SESSION_HDR_LEN)
+#define XIO_SESSION_TRACE_LEN		sizeof(struct xio_session_trace_hdr)
+/* the largest - see xio_mbuf_session_hdr_len */
+#define XIO_TRANSPORT_OFFSET		(XIO_TLV_LEN + XIO_SESSION_HDR_LEN + \
+					 XIO_SESSION_TRACE_LEN)
 #define MAX_PRIVATE_DATA_LEN		1024
+#define XIO_MAX_SEND_COMP_BATCH		64
+#define XIO_POST_QUEUE_DEPTH		1024	/* power of 2 */
 
 /**
  * extended message flags
@@ -82,12 +87,56 @@ enum xio_msg_flags_ex {
 	XIO_MSG_FLAG_EX_IMM_READ_RECEIPT  = (1 << 10), /**< immediate receipt  */
 	XIO_MSG_FLAG_EX_RECEIPT_FIRST	  = (1 << 11), /**< read receipt first */
 	XIO_MSG_FLAG_EX_RECEIPT_LAST	  = (1 << 12), /**< read receipt last  */
+	XIO_MSG_FLAG_EX_MULTI		  = (1 << 13), /**< fan out clone      */
+	XIO_MSG_FLAG_EX_DISPATCHED	  = (1 << 14), /**< on a worker pool   */
+	XIO_MSG_FLAG_EX_LOAD_REPORT	  = (1 << 15), /**< hdr carries load   */
+	XIO_MSG_FLAG_EX_SESSION_SEND	  = (1 << 16), /**< may fail over      */
+	XIO_MSG_FLAG_EX_TRACE		  = (1 << 17), /**< lifecycle traced   */
+	XIO_MSG_FLAG_EX_TRACE_TIMES	  = (1 << 18), /**< hdr trace trailer  */
+};
+
+struct xio_connection;
+
+/**
+ * hands requests received on a connection to someone other than the
+ * context's loop thread (see xio_worker_pool). dispatch returns 0 when it
+ * took the request and will call on_msg itself, -1 to have it run inline.
+ * done runs on the connection's context for every XIO_POST_DISPATCH_DONE.
+ */
+struct xio_dispatcher {
+	int			(*dispatch)(struct xio_dispatcher *dispatcher,
+					    struct xio_connection *connection,
+					    struct xio_msg *msg,
+					    int last_in_rxq);
+	void			(*done)(struct xio_dispatcher *dispatcher,
+					struct xio_connection *connection);
+};
+
+/**
+ * state of one xio_send_msg_multi call. every destination gets a clone of
+ * the user's message (clone->user_context points back here) and all clones
+ * reference the same payload. the last clone to complete fires the single
+ * completion on the user's message.
+ */
+struct xio_msg_multi {
+	struct xio_msg		*msg;		/* the user's message	      */
+	struct xio_msg		*clones;	/* one per destination	      */
+	/* payload copy shared by all clones, owned by the transport that
+	 * created it and released by shared_free
+	 */
+	void			*shared;
+	void			(*shared_free)(void *shared);
+	volatile int32_t	refcnt;
+	int32_t			status;		/* first error		      */
+	int32_t			clones_nr;
+	int32_t			pad;
 };
 
 #define xio_clear_ex_flags(flag) \
 	((*(flag)) &= ~(XIO_MSG_FLAG_EX_RECEIPT_FIRST| \
 			XIO_MSG_FLAG_EX_RECEIPT_LAST | \
-			XIO_MSG_FLAG_EX_IMM_READ_RECEIPT))
+			XIO_MSG_FLAG_EX_IMM_READ_RECEIPT | \
+			XIO_MSG_FLAG_EX_TRACE))
 
 
 #define xio_app_receipt_request(rq) \
@@ -186,6 +235,18 @@ struct xio_options {
 	int			rcv_queue_depth_msgs;
 	uint64_t		snd_queue_depth_bytes;
 	uint64_t		rcv_queue_depth_bytes;
+	int			send_comp_batch;
+	int			portal_policy;
+	int			msg_trace;
+	int			capture;
+};
+
+/* embedded in user visible objects - see xio_idr.c */
+struct xio_idr_entry {
+	struct list_head	list_entry;
+	const char		*name;
+	uint32_t		magic;
+	uint32_t		pad;
 };
 
 struct xio_sge {
@@ -210,7 +271,9 @@ PACKED_MEMORY(struct xio_session_hdr {
 	uint16_t		sn;		/* serial number	*/
 	uint16_t		ack_sn;		/* ack serial number	*/
 	uint16_t		credits_msgs;
-	uint16_t		pad[3];
+	uint16_t		load_inflight;	/* server thread load, */
+	uint16_t		load_svc_us;	/* on responses	       */
+	uint16_t		pad;
 	uint32_t		receipt_result;
 	uint64_t		credits_bytes;
 #ifdef XIO_SESSION_DEBUG
@@ -219,6 +282,16 @@ PACKED_MEMORY(struct xio_session_hdr {
 #endif
 });
 
+/* follows the session header of a response flagged
+ * XIO_MSG_FLAG_EX_TRACE_TIMES: the residence of its traced request here
+ */
+PACKED_MEMORY(struct xio_session_trace_hdr {
+	uint32_t		queue_ns;
+	uint32_t		app_ns;
+	uint32_t		reply_ns;
+	uint32_t		pad;
+});
+
 /* setup flags */
 #define XIO_CID			1
 
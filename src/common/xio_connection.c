@@ -54,7 +54,9 @@
 #include "xio_context.h"
 #include "xio_nexus.h"
 #include "xio_session.h"
+#include "xio_sn_hash.h"
 #include "xio_connection.h"
+#include "xio_capture.h"
 #include <xio-advanced-env.h>
 
 #define MSG_POOL_SZ			1024
@@ -120,6 +122,7 @@ static struct xio_transition xio_transition_table[][2] = {
 };
 
 static void xio_connection_post_destroy(struct kref *kref);
+static void xio_connection_post_drain(void *data);
 
 /*---------------------------------------------------------------------------*/
 /* xio_connection_next_transit					     */
@@ -211,6 +214,122 @@ static int xio_free_ow_msg_pool(struct xio_connection *connection)
 	return 0;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_connection_index_req						     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_connection_index_req(struct xio_connection *connection,
+					    struct xio_msg *msg)
+{
+	if (!IS_APPLICATION_MSG(msg->type) || !IS_REQUEST(msg->type))
+		return;
+
+	if (xio_sn_hash_insert(&connection->reqs_hash, msg->sn, msg)) {
+		ERROR_LOG("indexing request failed. sn:%llu\n", msg->sn);
+		connection->reqs_unindexed++;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_unindex_req						     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_connection_unindex_req(
+		struct xio_connection *connection,
+		struct xio_msg *msg)
+{
+	if (!IS_APPLICATION_MSG(msg->type) || !IS_REQUEST(msg->type))
+		return;
+
+	if (!xio_sn_hash_remove(&connection->reqs_hash, msg->sn) &&
+	    connection->reqs_unindexed)
+		connection->reqs_unindexed--;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_index_io_task						     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_connection_index_io_task(
+		struct xio_connection *connection,
+		struct xio_task *task)
+{
+	if (xio_sn_hash_insert(&connection->io_tasks_hash,
+			       task->imsg.sn, task)) {
+		ERROR_LOG("indexing io task failed. sn:%llu\n",
+			  task->imsg.sn);
+		connection->io_tasks_unindexed++;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_unindex_io_task					     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_connection_unindex_io_task(
+		struct xio_connection *connection,
+		struct xio_task *task)
+{
+	void *val = xio_sn_hash_lookup(&connection->io_tasks_hash,
+				       task->imsg.sn);
+
+	if (val == task)
+		xio_sn_hash_remove(&connection->io_tasks_hash, task->imsg.sn);
+	else if (!val && connection->io_tasks_unindexed)
+		connection->io_tasks_unindexed--;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_flush_send_comp					     */
+/*---------------------------------------------------------------------------*/
+void xio_connection_flush_send_comp(struct xio_connection *connection)
+{
+	struct xio_msg	*msgs[XIO_MAX_SEND_COMP_BATCH];
+	struct xio_task	*tasks[XIO_MAX_SEND_COMP_BATCH];
+	int		nr = connection->tx_comp_nr;
+
+	if (nr == 0)
+		return;
+
+	xio_ctx_remove_event(connection->ctx, &connection->tx_comp_event);
+
+	/* take the batch before the callback - it may close the connection
+	 * and re-enter here, or complete more messages
+	 */
+	memcpy(msgs, connection->tx_comp_msgs, nr * sizeof(msgs[0]));
+	memcpy(tasks, connection->tx_comp_tasks, nr * sizeof(tasks[0]));
+	connection->tx_comp_nr = 0;
+
+	if (connection->ses_ops.on_msgs_send_complete)
+		connection->ses_ops.on_msgs_send_complete(
+				connection->session, msgs, nr,
+				connection->cb_user_context);
+
+	/* recycle the tasks only after the user released the messages */
+	xio_tasks_pool_put_bulk(tasks, nr);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_send_comp_handler					     */
+/*---------------------------------------------------------------------------*/
+static void xio_connection_send_comp_handler(void *data)
+{
+	xio_connection_flush_send_comp((struct xio_connection *)data);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_queue_send_comp					     */
+/*---------------------------------------------------------------------------*/
+void xio_connection_queue_send_comp(struct xio_connection *connection,
+				    struct xio_task *task)
+{
+	connection->tx_comp_msgs[connection->tx_comp_nr] = task->omsg;
+	connection->tx_comp_tasks[connection->tx_comp_nr] = task;
+
+	if (++connection->tx_comp_nr >= g_options.send_comp_batch) {
+		xio_connection_flush_send_comp(connection);
+		return;
+	}
+	/* flush what is left once the current completion batch is done */
+	xio_ctx_add_event(connection->ctx, &connection->tx_comp_event);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_connection_create						     */
 /*---------------------------------------------------------------------------*/
@@ -245,12 +364,21 @@ struct xio_connection *xio_connection_create(struct xio_session *session,
 		connection->enable_flow_control = g_options.enable_flow_control;
 
 		connection->conn_idx	= conn_idx;
+		connection->portal_idx	= XIO_PORTAL_IDX_NONE;
+		connection->counters	= xio_ctx_stats_conn_attach(
+						ctx, session->session_id,
+						conn_idx, session->uri,
+						&connection->stats_slot);
+		if (!connection->counters)
+			connection->counters = &connection->counters_priv;
 		connection->cb_user_context = cb_user_context;
 		memcpy(&connection->ses_ops, &session->ses_ops,
 		       sizeof(session->ses_ops));
 
 		INIT_LIST_HEAD(&connection->io_tasks_list);
 		INIT_LIST_HEAD(&connection->post_io_tasks_list);
+		xio_sn_hash_init(&connection->io_tasks_hash);
+		xio_sn_hash_init(&connection->reqs_hash);
 		INIT_LIST_HEAD(&connection->pre_send_list);
 
 		xio_msg_list_init(&connection->reqs_msgq);
@@ -258,9 +386,14 @@ struct xio_connection *xio_connection_create(struct xio_session *session,
 
 		xio_msg_list_init(&connection->in_flight_reqs_msgq);
 		xio_msg_list_init(&connection->in_flight_rsps_msgq);
+		xio_msg_list_init(&connection->dispatch_backlog);
 
 		xio_init_ow_msg_pool(connection);
 
+		xio_ctx_init_event(&connection->tx_comp_event,
+				   xio_connection_send_comp_handler,
+				   connection);
+
 		kref_init(&connection->kref);
 		list_add_tail(&connection->ctx_list_entry, &ctx->ctx_list);
 
@@ -305,6 +438,67 @@ static void xio_connection_set_ow_send_comp_params(struct xio_msg *msg)
 	set_bits(XIO_MSG_FLAG_IMM_SEND_COMP, &msg->flags);
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_connection_trace_send - a request leaves its queue, a response	     */
+/* reports the time its request spent here				     */
+/*---------------------------------------------------------------------------*/
+static void xio_connection_trace_send(struct xio_connection *connection,
+				      struct xio_task *task,
+				      struct xio_session_hdr *hdr,
+				      struct xio_session_trace_hdr *trace,
+				      int is_req)
+{
+	struct xio_context	*ctx = connection->ctx;
+	uint64_t		now = get_cycles();
+
+	if (is_req) {
+		task->trace[XIO_TRACE_SUBMIT]	= task->omsg->timestamp;
+		task->trace[XIO_TRACE_DEQUEUE]	= now;
+		task->trace[XIO_TRACE_XPORT]	= 0;
+		task->trace[XIO_TRACE_WIRE]	= 0;
+		return;
+	}
+	hdr->flags	|= XIO_MSG_FLAG_EX_TRACE | XIO_MSG_FLAG_EX_TRACE_TIMES;
+	trace->queue_ns	 = xio_ctx_span_ns(ctx,
+					   task->trace[XIO_TRACE_RX],
+					   task->trace[XIO_TRACE_DELIVER]);
+	trace->app_ns	 = xio_ctx_span_ns(ctx,
+					   task->trace[XIO_TRACE_DELIVER],
+					   task->trace[XIO_TRACE_SUBMIT]);
+	trace->reply_ns	 = xio_ctx_span_ns(ctx,
+					   task->trace[XIO_TRACE_SUBMIT],
+					   now);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_capture - the metadata of a message, never its payload    */
+/*---------------------------------------------------------------------------*/
+void xio_connection_capture(struct xio_connection *connection,
+			    struct xio_vmsg *vmsg, int dir, int type,
+			    uint64_t sn, uint64_t rsp_ns)
+{
+	struct xio_capture_rec	rec;
+	struct xio_sg_table_ops	*sgtbl_ops;
+	void			*sgtbl;
+
+	sgtbl		= xio_sg_table_get(vmsg);
+	sgtbl_ops	= (struct xio_sg_table_ops *)
+				xio_sg_table_ops_get(vmsg->sgl_type);
+
+	rec.ts_ns	= xio_ctx_cycles_to_ns64(connection->ctx, get_cycles());
+	rec.session_id	= connection->session->session_id;
+	rec.conn_idx	= connection->conn_idx;
+	rec.dir		= (uint8_t)dir;
+	rec.type	= (uint8_t)type;
+	rec.sn		= (uint32_t)sn;
+	rec.hdr_len	= (uint32_t)vmsg->header.iov_len;
+	rec.data_len	= (uint32_t)min(tbl_length(sgtbl_ops, sgtbl),
+					0xffffffffULL);
+	rec.rsp_ns	= (uint32_t)min(rsp_ns, 0xffffffffULL);
+
+	xio_ctx_record(connection->ctx, XIO_CTX_REC_CAPTURE, &rec);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_connection_send							     */
 /*---------------------------------------------------------------------------*/
@@ -314,6 +508,7 @@ int xio_connection_send(struct xio_connection *connection,
 	struct xio_task		*task = NULL;
 	struct xio_task		*req_task = NULL;
 	struct xio_session_hdr	hdr = {0};
+	struct xio_session_trace_hdr trace;
 	struct xio_sg_table_ops	*sgtbl_ops;
 	void			*sgtbl;
 	size_t			tx_bytes = 0;
@@ -329,8 +524,10 @@ int xio_connection_send(struct xio_connection *connection,
 
 	/* flow control test */
 	if (!is_control && connection->enable_flow_control) {
-		if (connection->peer_credits_msgs == 0)
+		if (connection->peer_credits_msgs == 0) {
+			connection->counters->credit_stalls++;
 			return -EAGAIN;
+		}
 
 		sgtbl	  = xio_sg_table_get(&msg->out);
 		sgtbl_ops = (struct xio_sg_table_ops *)
@@ -347,8 +544,10 @@ int xio_connection_send(struct xio_connection *connection,
 			return -XIO_E_PEER_QUEUE_SIZE_MISMATCH;
 		}
 
-		if (connection->peer_credits_bytes < tx_bytes)
+		if (connection->peer_credits_bytes < tx_bytes) {
+			connection->counters->credit_stalls++;
 			return -EAGAIN;
+		}
 
 	}
 
@@ -394,6 +593,7 @@ int xio_connection_send(struct xio_connection *connection,
 			task = container_of(msg->request,
 					    struct xio_task, imsg);
 
+			xio_connection_unindex_io_task(connection, task);
 			list_move_tail(&task->tasks_list_entry,
 				       &connection->pre_send_list);
 
@@ -426,8 +626,20 @@ int xio_connection_send(struct xio_connection *connection,
 	    connection->session->ses_ops.on_ow_msg_send_complete)
 		xio_connection_set_ow_send_comp_params(msg);
 
-	hdr.flags		= (uint32_t)msg->flags;
+	hdr.flags		= (uint32_t)(msg->flags &
+					 ~(XIO_MSG_FLAG_EX_MULTI |
+					   XIO_MSG_FLAG_EX_SESSION_SEND));
 	hdr.dest_session_id	= connection->session->peer_session_id;
+	if (msg->type == XIO_MSG_TYPE_RSP && !standalone_receipt) {
+		/* let the client weigh this server thread's portal */
+		hdr.flags	   |= XIO_MSG_FLAG_EX_LOAD_REPORT;
+		hdr.load_inflight  = (uint16_t)min(
+					connection->ctx->reqs_pending,
+					(uint32_t)0xffff);
+		hdr.load_svc_us	   = (uint16_t)min(
+					connection->ctx->svc_ewma_ns / 1000,
+					(uint32_t)0xffff);
+	}
 	if (!task->is_control || task->tlv_type == XIO_ACK_REQ) {
 		if (IS_REQUEST(msg->type)) {
 			/*
@@ -466,12 +678,27 @@ int xio_connection_send(struct xio_connection *connection,
 	hdr.connection = uint64_from_ptr(connection);
 	hdr.session = uint64_from_ptr(connection->session);
 #endif
+	/* a response keeps what xio_on_req_recv saw on its request */
+	if (is_req)
+		task->traced = !standalone_receipt &&
+			       (msg->flags & XIO_MSG_FLAG_EX_TRACE);
+	if (unlikely(task->traced))
+		xio_connection_trace_send(connection, task, &hdr, &trace,
+					  is_req);
+
 	xio_session_write_header(task, &hdr);
+	if (unlikely(hdr.flags & XIO_MSG_FLAG_EX_TRACE_TIMES))
+		xio_session_write_trace(task, &trace);
+
+	xio_ev_trace(connection->ctx->ev_trace, XIO_EV_CONN_SEND, connection,
+		     task->ltid, (uint32_t)tx_bytes, hdr.serial_num);
 
 	/* send it */
 	retval = xio_nexus_send(connection->nexus, task);
 	if (retval != 0) {
 		rc = (retval == -EAGAIN) ? EAGAIN : xio_errno();
+		if (rc == EAGAIN)
+			connection->counters->eagains++;
 		if (!task->is_control || task->tlv_type == XIO_ACK_REQ) {
 			if (connection->enable_flow_control) {
 				connection->credits_msgs = hdr.credits_msgs;
@@ -488,10 +715,12 @@ int xio_connection_send(struct xio_connection *connection,
 	return 0;
 
 cleanup:
-	if (is_req)
+	if (is_req) {
 		xio_tasks_pool_put(task);
-	else
+	} else {
 		list_move(&task->tasks_list_entry, &connection->io_tasks_list);
+		xio_connection_index_io_task(connection, task);
+	}
 
 
 	return -rc;
@@ -504,6 +733,9 @@ static int xio_connection_flush_msgs(struct xio_connection *connection)
 {
 	struct xio_msg		*pmsg, *tmp_pmsg, *omsg = NULL;
 
+	/* deliver completions that are already out of the in flight queue */
+	xio_connection_flush_send_comp(connection);
+
 	if (!xio_msg_list_empty(&connection->reqs_msgq))
 		omsg = xio_msg_list_first(&connection->reqs_msgq);
 	xio_msg_list_foreach_safe(pmsg, &connection->in_flight_reqs_msgq,
@@ -515,6 +747,7 @@ static int xio_connection_flush_msgs(struct xio_connection *connection)
 		else
 			xio_msg_list_insert_tail(&connection->reqs_msgq,
 						 pmsg, pdata);
+		xio_connection_index_req(connection, pmsg);
 		if ((pmsg->type == XIO_MSG_TYPE_REQ) ||
 		    (pmsg->type == XIO_ONE_WAY_REQ)) {
 			if (connection->enable_flow_control) {
@@ -570,6 +803,10 @@ static void xio_connection_notify_req_msgs_flush(struct xio_connection
 	xio_msg_list_foreach_safe(pmsg, &connection->reqs_msgq,
 				  tmp_pmsg, pdata) {
 		xio_msg_list_remove(&connection->reqs_msgq, pmsg, pdata);
+		xio_connection_unindex_req(connection, pmsg);
+		if (pmsg->type == XIO_MSG_TYPE_REQ &&
+		    connection->counters->reqs_outstanding)
+			connection->counters->reqs_outstanding--;
 		xio_session_notify_msg_error(connection, pmsg,
 					     status,
 					     XIO_MSG_DIRECTION_OUT);
@@ -734,11 +971,14 @@ int xio_connection_restart_tasks(struct xio_connection *connection)
 			else
 				is_req = IS_REQUEST(ptask->tlv_type);
 
-			if (is_req)
+			if (is_req) {
 				xio_tasks_pool_put(ptask);
-			else
+			} else {
 				list_move(&ptask->tasks_list_entry,
 					  &connection->io_tasks_list);
+				xio_connection_index_io_task(connection,
+							     ptask);
+			}
 		}
 	}
 
@@ -796,11 +1036,13 @@ static inline int xio_connection_xmit_inl(
 				return 1;
 			} else  {
 				xio_msg_list_remove(msgq, msg, pdata);
+				xio_connection_unindex_req(connection, msg);
 				return -1;
 			}
 		} else {
 			*retry_cnt = 0;
 			xio_msg_list_remove(msgq, msg, pdata);
+			xio_connection_unindex_req(connection, msg);
 			if (IS_APPLICATION_MSG(msg->type)) {
 				xio_msg_list_insert_tail(
 						in_flight_msgq, msg,
@@ -900,12 +1142,14 @@ int xio_connection_remove_msg_from_queue(struct xio_connection *connection,
 	if (!IS_APPLICATION_MSG(msg->type))
 		return 0;
 
-	if (IS_REQUEST(msg->type))
+	if (IS_REQUEST(msg->type)) {
 		xio_msg_list_remove(
 				&connection->reqs_msgq, msg, pdata);
-	else
+		xio_connection_unindex_req(connection, msg);
+	} else {
 		xio_msg_list_remove(
 				&connection->rsps_msgq, msg, pdata);
+	}
 
 	return 0;
 }
@@ -915,7 +1159,12 @@ int xio_connection_remove_msg_from_queue(struct xio_connection *connection,
 /*---------------------------------------------------------------------------*/
 int xio_connection_restart(struct xio_connection *connection)
 {
-	int retval;
+	struct xio_msg	*pmsg;
+	int		retval;
+
+	/* requests the reconnect sends again */
+	xio_msg_list_foreach(pmsg, &connection->in_flight_reqs_msgq, pdata)
+		connection->counters->retransmits++;
 
 	retval = xio_connection_flush_msgs(connection);
 	if (retval)
@@ -936,6 +1185,62 @@ int xio_connection_restart(struct xio_connection *connection)
 	return 0;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_connection_failover_reqs						     */
+/*---------------------------------------------------------------------------*/
+void xio_connection_failover_reqs(struct xio_connection *connection)
+{
+	struct xio_msg		*pmsg, *tmp_pmsg;
+	struct xio_sg_table_ops	*sgtbl_ops;
+	void			*sgtbl;
+	size_t			tx_bytes;
+
+	/* closing - the requests are flushed back to the user */
+	if (connection->disconnecting)
+		return;
+
+	/* requests that already went to the nexus are resent by the
+	 * reconnect, only the ones still queued here are moved
+	 */
+	xio_msg_list_foreach_safe(pmsg, &connection->reqs_msgq,
+				  tmp_pmsg, pdata) {
+		if (pmsg->type != XIO_MSG_TYPE_REQ ||
+		    !(pmsg->flags & XIO_MSG_FLAG_EX_SESSION_SEND))
+			continue;
+
+		sgtbl	  = xio_sg_table_get(&pmsg->out);
+		sgtbl_ops = (struct xio_sg_table_ops *)
+				xio_sg_table_ops_get(pmsg->out.sgl_type);
+		tx_bytes  = pmsg->out.header.iov_len +
+			    tbl_length(sgtbl_ops, sgtbl);
+
+		xio_msg_list_remove(&connection->reqs_msgq, pmsg, pdata);
+		xio_connection_unindex_req(connection, pmsg);
+		if (connection->counters->reqs_outstanding)
+			connection->counters->reqs_outstanding--;
+		if (connection->enable_flow_control) {
+			connection->tx_queued_msgs--;
+			connection->tx_bytes -= tx_bytes;
+		}
+		if (!xio_session_failover_msg(connection, pmsg))
+			continue;
+
+		/* no other connection, wait for the reconnect */
+		if (tmp_pmsg)
+			xio_msg_list_insert_before(tmp_pmsg, pmsg, pdata);
+		else
+			xio_msg_list_insert_tail(&connection->reqs_msgq,
+						 pmsg, pdata);
+		xio_connection_index_req(connection, pmsg);
+		connection->counters->reqs_outstanding++;
+		if (connection->enable_flow_control) {
+			connection->tx_queued_msgs++;
+			connection->tx_bytes += tx_bytes;
+		}
+		break;
+	}
+}
+
 
 /*---------------------------------------------------------------------------*/
 /* xio_send_request							     */
@@ -1016,27 +1321,40 @@ int xio_send_request(struct xio_connection *connection,
 
 
 		pmsg->timestamp = get_cycles();
+		if (unlikely(g_options.msg_trace))
+			pmsg->flags |= XIO_MSG_FLAG_EX_TRACE;
 		xio_stat_inc(stats, XIO_STAT_TX_MSG);
 		xio_stat_add(stats, XIO_STAT_TX_BYTES, tx_bytes);
+		connection->counters->tx_msgs++;
+		connection->counters->tx_bytes += tx_bytes;
 
 		pmsg->sn = xio_session_get_sn(connection->session);
 		pmsg->type = XIO_MSG_TYPE_REQ;
+		connection->counters->reqs_outstanding++;
+		if (unlikely(g_options.capture))
+			xio_connection_capture(connection, &pmsg->out,
+					       XIO_CAPTURE_TX, XIO_CAPTURE_REQ,
+					       pmsg->sn, 0);
 
 		if (connection->enable_flow_control) {
 			connection->tx_queued_msgs++;
 			connection->tx_bytes += tx_bytes;
 		}
-		if (nr == -1)
+		if (nr == -1) {
 			xio_msg_list_insert_tail(&connection->reqs_msgq, pmsg,
 						 pdata);
-		else {
+			xio_connection_index_req(connection, pmsg);
+		} else {
 			nr++;
 			xio_msg_list_insert_tail(&reqs_msgq, pmsg, pdata);
 		}
 		pmsg = pmsg->next;
 	}
-	if (nr > 0)
+	if (nr > 0) {
+		xio_msg_list_foreach(pmsg, &reqs_msgq, pdata)
+			xio_connection_index_req(connection, pmsg);
 		xio_msg_list_concat(&connection->reqs_msgq, &reqs_msgq, pdata);
+	}
 
 send:
 	/* do not xmit until connection is assigned */
@@ -1061,9 +1379,20 @@ int xio_send_response(struct xio_msg *msg)
 	struct xio_sg_table_ops	*sgtbl_ops;
 	void			*sgtbl;
 	size_t			bytes;
+	uint64_t		delay;
 	int			valid;
 	int			retval = 0;
 
+	if (unlikely(msg->request->flags & XIO_MSG_FLAG_EX_DISPATCHED)) {
+		/* the request went to a worker pool, the response may come
+		 * from any thread - let the connection's context send it.
+		 * the flag is cleared there, so a failed post can be retried
+		 */
+		task = container_of(msg->request, struct xio_task, imsg);
+		return xio_connection_post(task->connection,
+					   XIO_POST_SEND_RESPONSE, msg);
+	}
+
 	while (pmsg) {
 		task	   = container_of(pmsg->request, struct xio_task, imsg);
 		connection = task->connection;
@@ -1107,8 +1436,18 @@ int xio_send_response(struct xio_msg *msg)
 		}
 
 		/* Server latency */
-		xio_stat_add(stats, XIO_STAT_APPDELAY,
-			     get_cycles() - task->imsg.timestamp);
+		delay = get_cycles() - task->imsg.timestamp;
+		xio_stat_add(stats, XIO_STAT_APPDELAY, delay);
+		if (unlikely(task->traced))
+			task->trace[XIO_TRACE_SUBMIT] = task->imsg.timestamp +
+							delay;
+		if (connection->counters->reqs_pending) {
+			connection->counters->reqs_pending--;
+			connection->ctx->reqs_pending--;
+			xio_ewma_update(&connection->ctx->svc_ewma_ns,
+					xio_ctx_cycles_to_ns(connection->ctx,
+							     delay));
+		}
 
 		valid = xio_session_is_valid_out_msg(connection->session, pmsg);
 		if (!valid) {
@@ -1126,6 +1465,13 @@ int xio_send_response(struct xio_msg *msg)
 
 		xio_stat_inc(stats, XIO_STAT_TX_MSG);
 		xio_stat_add(stats, XIO_STAT_TX_BYTES, bytes);
+		connection->counters->tx_msgs++;
+		connection->counters->tx_bytes += bytes;
+		if (unlikely(g_options.capture))
+			xio_connection_capture(
+				connection, &pmsg->out, XIO_CAPTURE_TX,
+				XIO_CAPTURE_RSP, task->imsg.sn,
+				xio_ctx_cycles_to_ns64(connection->ctx, delay));
 
 		pmsg->flags |= XIO_MSG_FLAG_EX_RECEIPT_LAST;
 		if ((pmsg->request->flags &
@@ -1213,10 +1559,21 @@ int xio_connection_release_read_receipt(struct xio_connection *connection,
 }
 
 /*---------------------------------------------------------------------------*/
-/* xio_send_msg								     */
+/* xio_connection_send_closed						     */
 /*---------------------------------------------------------------------------*/
-int xio_send_msg(struct xio_connection *connection,
-		 struct xio_msg *msg)
+static inline int xio_connection_send_closed(struct xio_connection *connection)
+{
+	return connection->disconnecting ||
+	       (connection->state != XIO_CONNECTION_STATE_ONLINE &&
+		connection->state != XIO_CONNECTION_STATE_ESTABLISHED &&
+		connection->state != XIO_CONNECTION_STATE_INIT);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_queue_msgs						     */
+/*---------------------------------------------------------------------------*/
+static int xio_connection_queue_msgs(struct xio_connection *connection,
+				     struct xio_msg *msg)
 {
 	struct xio_msg_list	reqs_msgq;
 	struct xio_statistics	*stats = &connection->ctx->stats;
@@ -1228,14 +1585,6 @@ int xio_send_msg(struct xio_connection *connection,
 	int			nr = -1;
 	int			retval = 0;
 
-	if (unlikely(connection->disconnecting ||
-		     (connection->state != XIO_CONNECTION_STATE_ONLINE &&
-		      connection->state != XIO_CONNECTION_STATE_ESTABLISHED &&
-		      connection->state != XIO_CONNECTION_STATE_INIT))) {
-		xio_set_error(XIO_ESHUTDOWN);
-		return -1;
-	}
-
 	if (msg->next) {
 		xio_msg_list_init(&reqs_msgq);
 		nr = 0;
@@ -1277,28 +1626,57 @@ int xio_send_msg(struct xio_connection *connection,
 		pmsg->timestamp = get_cycles();
 		xio_stat_inc(stats, XIO_STAT_TX_MSG);
 		xio_stat_add(stats, XIO_STAT_TX_BYTES, tx_bytes);
+		connection->counters->tx_msgs++;
+		connection->counters->tx_bytes += tx_bytes;
 
 		pmsg->sn = xio_session_get_sn(connection->session);
 		pmsg->type = XIO_ONE_WAY_REQ;
+		if (unlikely(g_options.capture))
+			xio_connection_capture(connection, &pmsg->out,
+					       XIO_CAPTURE_TX,
+					       XIO_CAPTURE_ONE_WAY,
+					       pmsg->sn, 0);
 
 		if (connection->enable_flow_control) {
 			connection->tx_queued_msgs++;
 			connection->tx_bytes += tx_bytes;
 		}
-		if (nr == -1)
+		if (nr == -1) {
 			xio_msg_list_insert_tail(&connection->reqs_msgq, pmsg,
 						 pdata);
-		else {
+			xio_connection_index_req(connection, pmsg);
+		} else {
 			nr++;
 			xio_msg_list_insert_tail(&reqs_msgq, pmsg, pdata);
 		}
 
 		pmsg = pmsg->next;
 	}
-	if (nr > 0)
+	if (nr > 0) {
+		xio_msg_list_foreach(pmsg, &reqs_msgq, pdata)
+			xio_connection_index_req(connection, pmsg);
 		xio_msg_list_concat(&connection->reqs_msgq, &reqs_msgq, pdata);
+	}
 
 send:
+	return retval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_send_msg								     */
+/*---------------------------------------------------------------------------*/
+int xio_send_msg(struct xio_connection *connection,
+		 struct xio_msg *msg)
+{
+	int retval;
+
+	if (unlikely(xio_connection_send_closed(connection))) {
+		xio_set_error(XIO_ESHUTDOWN);
+		return -1;
+	}
+
+	retval = xio_connection_queue_msgs(connection, msg);
+
 	/* do not xmit until connection is assigned */
 	if (xio_is_connection_online(connection)) {
 		if (xio_connection_xmit(connection))
@@ -1309,6 +1687,135 @@ send:
 }
 EXPORT_SYMBOL(xio_send_msg);
 
+/*---------------------------------------------------------------------------*/
+/* xio_msg_multi_finish							     */
+/*---------------------------------------------------------------------------*/
+static void xio_msg_multi_finish(struct xio_connection *connection,
+				 struct xio_msg_multi *multi)
+{
+	struct xio_msg		*msg = multi->msg;
+	enum xio_status		status = (enum xio_status)multi->status;
+
+	if (multi->shared_free)
+		multi->shared_free(multi->shared);
+	kfree(multi);
+
+	if (status != XIO_E_SUCCESS) {
+		xio_session_notify_msg_error(connection, msg, status,
+					     XIO_MSG_DIRECTION_OUT);
+		return;
+	}
+	if (connection->ses_ops.on_msgs_send_complete) {
+		connection->ses_ops.on_msgs_send_complete(
+				connection->session, &msg, 1,
+				connection->cb_user_context);
+		return;
+	}
+	if (connection->ses_ops.on_ow_msg_send_complete)
+		connection->ses_ops.on_ow_msg_send_complete(
+				connection->session, msg,
+				connection->cb_user_context);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_multi_done						     */
+/*---------------------------------------------------------------------------*/
+void xio_connection_multi_done(struct xio_connection *connection,
+			       struct xio_msg *clone,
+			       enum xio_status status)
+{
+	struct xio_msg_multi *multi = (struct xio_msg_multi *)
+						clone->user_context;
+
+	if (status != XIO_E_SUCCESS)
+		xio_sync_bool_compare_and_swap(&multi->status, 0, status);
+
+	if (xio_sync_fetch_and_add32(&multi->refcnt, -1) == 1)
+		xio_msg_multi_finish(connection, multi);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_send_msg_multi							     */
+/*---------------------------------------------------------------------------*/
+int xio_send_msg_multi(struct xio_connection **conns, int conns_nr,
+		       struct xio_msg *msg)
+{
+	struct xio_msg_multi	*multi;
+	struct xio_connection	*last = NULL;
+	struct xio_msg		*clone;
+	int			i;
+
+	if (!conns || conns_nr <= 0 || !msg || msg->next ||
+	    msg->flags & XIO_MSG_FLAG_REQUEST_READ_RECEIPT) {
+		xio_set_error(EINVAL);
+		ERROR_LOG("invalid fan out message\n");
+		return -1;
+	}
+	/* the shared payload comes from the context's pool, which is not
+	 * thread safe, and is freed by whichever destination ends last
+	 */
+	for (i = 0; i < conns_nr; i++) {
+		if (!conns[i] || conns[i]->ctx != conns[0]->ctx) {
+			xio_set_error(EINVAL);
+			ERROR_LOG("fan out connections not on one context\n");
+			return -1;
+		}
+	}
+
+	multi = (struct xio_msg_multi *)
+		kcalloc(1, sizeof(*multi) + conns_nr * sizeof(*clone),
+			GFP_KERNEL);
+	if (!multi) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("failed to allocate fan out of %d\n", conns_nr);
+		return -1;
+	}
+	multi->msg	 = msg;
+	multi->clones	 = (struct xio_msg *)(multi + 1);
+	multi->clones_nr = conns_nr;
+	/* one reference per destination and one held while submitting, so
+	 * that destinations completing right away cannot finish the fan out
+	 */
+	multi->refcnt	 = conns_nr + 1;
+
+	for (i = 0; i < conns_nr; i++) {
+		clone = &multi->clones[i];
+		/* header and data are referenced, never copied */
+		clone->out		= msg->out;
+		clone->flags		= msg->flags | XIO_MSG_FLAG_EX_MULTI;
+		clone->user_context	= multi;
+
+		if (xio_connection_send_closed(conns[i]) ||
+		    xio_connection_queue_msgs(conns[i], clone)) {
+			xio_sync_bool_compare_and_swap(&multi->status, 0,
+						       XIO_E_MSG_DISCARDED);
+			xio_sync_fetch_and_add32(&multi->refcnt, -1);
+			continue;
+		}
+		last = conns[i];
+		/* once queued, the clone is always completed or flushed
+		 * through xio_connection_multi_done, also if xmit fails
+		 */
+		if (xio_is_connection_online(conns[i]) &&
+		    xio_connection_xmit(conns[i]))
+			DEBUG_LOG("fan out xmit deferred. conn:%p\n",
+				  conns[i]);
+	}
+
+	if (xio_sync_fetch_and_add32(&multi->refcnt, -1) != 1)
+		return 0;
+
+	if (!last) {
+		kfree(multi);
+		ERROR_LOG("fan out failed on all %d connections\n", conns_nr);
+		return -1;
+	}
+	xio_msg_multi_finish(last, multi);
+
+	return 0;
+}
+EXPORT_SYMBOL(xio_send_msg_multi);
+
 /*---------------------------------------------------------------------------*/
 /* xio_connection_xmit_msgs						     */
 /*---------------------------------------------------------------------------*/
@@ -1338,9 +1845,25 @@ int xio_connection_close(struct xio_connection *connection)
 
 	xio_ctx_del_work(connection->ctx, &connection->fin_work);
 
+	if (connection->post_queue) {
+		xio_ctx_del_work(connection->ctx, &connection->post_work);
+		/* late posts fail here and are reported to the user */
+		xio_connection_post_drain(connection);
+		kfree(connection->post_queue);
+	}
+
+	xio_connection_flush_send_comp(connection);
+
+	xio_sn_hash_destroy(&connection->io_tasks_hash);
+	xio_sn_hash_destroy(&connection->reqs_hash);
+
 	xio_free_ow_msg_pool(connection);
+	/* requests the application never answered */
+	connection->ctx->reqs_pending -= connection->counters->reqs_pending;
 	list_del(&connection->ctx_list_entry);
 
+	xio_ctx_stats_conn_detach(connection->stats_slot);
+	kfree(connection->rsp_lat);
 	kfree(connection);
 
 	return 0;
@@ -1353,6 +1876,7 @@ void xio_connection_queue_io_task(struct xio_connection *connection,
 				  struct xio_task *task)
 {
 	list_move_tail(&task->tasks_list_entry, &connection->io_tasks_list);
+	xio_connection_index_io_task(connection, task);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -1422,6 +1946,7 @@ int xio_release_response(struct xio_msg *msg)
 				xio_send_credits_ack(connection);
 		}
 
+		xio_connection_unindex_io_task(connection, task);
 		list_move_tail(&task->tasks_list_entry,
 			       &connection->post_io_tasks_list);
 
@@ -1478,6 +2003,7 @@ int xio_release_msg(struct xio_msg *msg)
 				xio_send_credits_ack(connection);
 		}
 
+		xio_connection_unindex_io_task(connection, task);
 		list_move_tail(&task->tasks_list_entry,
 			       &connection->post_io_tasks_list);
 
@@ -1494,6 +2020,382 @@ int xio_release_msg(struct xio_msg *msg)
 }
 EXPORT_SYMBOL(xio_release_msg);
 
+/*---------------------------------------------------------------------------*/
+/* xio_post_queue_push							     */
+/*---------------------------------------------------------------------------*/
+static int xio_post_queue_push(struct xio_post_queue *q,
+			       int op, struct xio_msg *msg)
+{
+	struct xio_post_slot	*slot;
+	uint64_t		pos = q->tail;
+	int64_t			diff;
+
+	/* a slot is free for position pos when its seq equals pos */
+	while (1) {
+		slot = &q->slots[pos & (XIO_POST_QUEUE_DEPTH - 1)];
+		diff = (int64_t)slot->seq - (int64_t)pos;
+		if (diff == 0) {
+			if (xio_sync_bool_compare_and_swap(&q->tail,
+							   pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			return -1;
+		}
+		pos = q->tail;
+	}
+	slot->msg = msg;
+	slot->op  = op;
+	xio_sync_synchronize();
+	slot->seq = pos + 1;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_post_queue_pop							     */
+/*---------------------------------------------------------------------------*/
+static struct xio_msg *xio_post_queue_pop(struct xio_post_queue *q,
+					  int *op)
+{
+	struct xio_post_slot	*slot;
+	struct xio_msg		*msg;
+
+	slot = &q->slots[q->head & (XIO_POST_QUEUE_DEPTH - 1)];
+	if (slot->seq != q->head + 1)
+		return NULL;
+	xio_sync_synchronize();
+	msg = slot->msg;
+	*op = slot->op;
+	xio_sync_synchronize();
+	slot->seq = q->head + XIO_POST_QUEUE_DEPTH;
+	q->head++;
+
+	return msg;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_post_exec						     */
+/*---------------------------------------------------------------------------*/
+static void xio_connection_post_exec(struct xio_connection *connection,
+				     int op, struct xio_msg *msg)
+{
+	int retval;
+
+	switch (op) {
+	case XIO_POST_SEND_REQUEST:
+		retval = xio_send_request(connection, msg);
+		if (retval)
+			xio_session_notify_msg_error(connection, msg,
+						     (enum xio_status)
+						     xio_errno(),
+						     XIO_MSG_DIRECTION_OUT);
+		break;
+	case XIO_POST_SEND_MSG:
+		retval = xio_send_msg(connection, msg);
+		if (retval)
+			xio_session_notify_msg_error(connection, msg,
+						     (enum xio_status)
+						     xio_errno(),
+						     XIO_MSG_DIRECTION_OUT);
+		break;
+	case XIO_POST_SEND_RESPONSE:
+		/* back on the context's thread - send inline */
+		msg->request->flags &= ~XIO_MSG_FLAG_EX_DISPATCHED;
+		retval = xio_send_response(msg);
+		break;
+	case XIO_POST_RELEASE_MSG:
+		retval = xio_release_msg(msg);
+		break;
+	case XIO_POST_RELEASE_RESPONSE:
+		retval = xio_release_response(msg);
+		break;
+	default:
+		retval = -1;
+		break;
+	}
+	if (retval)
+		DEBUG_LOG("posted op %d failed. connection:%p, msg:%p, %s\n",
+			  op, connection, msg, xio_strerror(xio_errno()));
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_post_drain						     */
+/*---------------------------------------------------------------------------*/
+static void xio_connection_post_drain(void *data)
+{
+	struct xio_connection	*connection = (struct xio_connection *)data;
+	struct xio_post_queue	*q = connection->post_queue;
+	struct xio_msg		*msg;
+	int			op, i, puts = 0;
+
+	/* disarm before draining: a post that races with the drain rings
+	 * the doorbell again instead of being left behind
+	 */
+	xio_sync_bool_compare_and_swap(&connection->post_armed, 1, 0);
+
+	for (i = 0; i < XIO_POST_QUEUE_DEPTH; i++) {
+		msg = xio_post_queue_pop(q, &op);
+		if (!msg)
+			break;
+		if (op == XIO_POST_DISPATCH_DONE) {
+			connection->dispatcher->done(connection->dispatcher,
+						     connection);
+			puts++;
+		} else
+			xio_connection_post_exec(connection, op, msg);
+	}
+	/* every put is backed by its own reference, so only the last one
+	 * can free the connection
+	 */
+	while (puts--)
+		kref_put(&connection->kref, xio_connection_post_destroy);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_post_queue_get					     */
+/*---------------------------------------------------------------------------*/
+static struct xio_post_queue *xio_connection_post_queue_get(
+		struct xio_connection *connection)
+{
+	struct xio_post_queue	*q;
+	uint64_t		i;
+
+	/* allocated on first post, the racing producers agree on one */
+	q = (struct xio_post_queue *)kcalloc(1, sizeof(*q), GFP_KERNEL);
+	if (!q) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("post queue allocation failed\n");
+		return NULL;
+	}
+	for (i = 0; i < XIO_POST_QUEUE_DEPTH; i++)
+		q->slots[i].seq = i;
+	xio_sync_synchronize();
+
+	if (!xio_sync_bool_compare_and_swap(&connection->post_queue,
+					    NULL, q)) {
+		kfree(q);
+		q = connection->post_queue;
+	}
+
+	return q;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_post_wake						     */
+/*---------------------------------------------------------------------------*/
+int xio_connection_post_wake(struct xio_connection *connection)
+{
+	/* one doorbell per batch: only the post that arms the connection
+	 * wakes up its context
+	 */
+	if (!xio_sync_bool_compare_and_swap(&connection->post_armed, 0, 1))
+		return 0;
+
+	if (xio_ctx_add_work(connection->ctx, connection,
+			     xio_connection_post_drain,
+			     &connection->post_work)) {
+		/* disarm so that the next post or wake rings again */
+		connection->post_armed = 0;
+		xio_set_error(EBUSY);
+		ERROR_LOG("failed to wake up connection:%p\n", connection);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_post							     */
+/*---------------------------------------------------------------------------*/
+int xio_connection_post(struct xio_connection *connection, int op,
+			struct xio_msg *msg)
+{
+	struct xio_post_queue	*q;
+
+	q = connection->post_queue;
+	if (unlikely(!q)) {
+		q = xio_connection_post_queue_get(connection);
+		if (!q)
+			return -1;
+	}
+	if (xio_post_queue_push(q, op, msg)) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+
+	/* on failure the message stays queued and runs with the next wake */
+	return xio_connection_post_wake(connection);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_post_msg								     */
+/*---------------------------------------------------------------------------*/
+int xio_post_msg(struct xio_connection *connection, enum xio_post_op op,
+		 struct xio_msg *msg)
+{
+	if (!connection || !msg || msg->next ||
+	    (unsigned)op > XIO_POST_RELEASE_RESPONSE) {
+		xio_set_error(EINVAL);
+		return -1;
+	}
+
+	return xio_connection_post(connection, op, msg);
+}
+EXPORT_SYMBOL(xio_post_msg);
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_post_release						     */
+/*---------------------------------------------------------------------------*/
+static void xio_connection_post_release(struct xio_connection *connection)
+{
+	/* release the posts that queued up while the doorbell was held */
+	if (connection->post_queue)
+		xio_connection_post_drain(connection);
+	else
+		connection->post_armed = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_is_quiescent						     */
+/*---------------------------------------------------------------------------*/
+static int xio_connection_is_quiescent(struct xio_connection *connection)
+{
+	/* nothing may be held by the application either: requests not yet
+	 * answered, and released messages whose tasks are still referenced
+	 * would be completed and put by the new context
+	 */
+	return !connection->counters->reqs_pending &&
+	       list_empty(&connection->post_io_tasks_list) &&
+	       xio_msg_list_empty(&connection->reqs_msgq) &&
+	       xio_msg_list_empty(&connection->rsps_msgq) &&
+	       xio_msg_list_empty(&connection->in_flight_reqs_msgq) &&
+	       xio_msg_list_empty(&connection->in_flight_rsps_msgq) &&
+	       list_empty(&connection->io_tasks_list) &&
+	       list_empty(&connection->pre_send_list) &&
+	       !connection->tx_comp_nr &&
+	       !xio_is_work_pending(&connection->hello_work) &&
+	       !xio_is_work_pending(&connection->fin_work);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_has_connection_on						     */
+/*---------------------------------------------------------------------------*/
+static int xio_session_has_connection_on(struct xio_session *session,
+					 struct xio_context *ctx)
+{
+	struct xio_connection	*connection;
+	int			found = 0;
+
+	spin_lock(&session->connections_list_lock);
+	list_for_each_entry(connection, &session->connections_list,
+			    connections_list_entry) {
+		if (connection->ctx == ctx) {
+			found = 1;
+			break;
+		}
+	}
+	if ((session->lead_connection &&
+	     session->lead_connection->ctx == ctx) ||
+	    (session->redir_connection &&
+	     session->redir_connection->ctx == ctx))
+		found = 1;
+	spin_unlock(&session->connections_list_lock);
+
+	return found;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_migrate_handler					     */
+/*---------------------------------------------------------------------------*/
+static void xio_connection_migrate_handler(void *data)
+{
+	struct xio_connection	*connection = (struct xio_connection *)data;
+	struct xio_context	*ctx = connection->migrate_ctx;
+	enum xio_status		reason = XIO_E_SUCCESS;
+
+	/* runs on the new context */
+	connection->ctx = ctx;
+	connection->migrate_ctx = NULL;
+	list_add_tail(&connection->ctx_list_entry, &ctx->ctx_list);
+	xio_ctx_stats_conn_move(ctx, connection->stats_slot);
+
+	if (xio_nexus_attach(connection->nexus, ctx)) {
+		reason = (enum xio_status)xio_errno();
+		ERROR_LOG("failed to attach connection:%p to ctx:%p. %s\n",
+			  connection, ctx, xio_strerror(reason));
+	}
+
+	xio_connection_post_release(connection);
+
+	xio_session_notify_connection_migrated(connection->session,
+					       connection, reason);
+	if (reason != XIO_E_SUCCESS)
+		xio_disconnect(connection);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_connection_migrate						     */
+/*---------------------------------------------------------------------------*/
+int xio_connection_migrate(struct xio_connection *connection,
+			   struct xio_context *ctx)
+{
+	struct xio_context *old_ctx;
+
+	if (!connection || !ctx || !connection->session) {
+		xio_set_error(EINVAL);
+		return -1;
+	}
+	if (ctx == connection->ctx || connection->migrate_ctx ||
+	    xio_session_has_connection_on(connection->session, ctx)) {
+		xio_set_error(EEXIST);
+		return -1;
+	}
+	if (connection->state != XIO_CONNECTION_STATE_ONLINE ||
+	    connection->disconnecting || !connection->nexus) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+	/* hold the post doorbell: posts queue up until the new context
+	 * takes over
+	 */
+	if (!xio_sync_bool_compare_and_swap(&connection->post_armed, 0, 1)) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+	/* detaching first lets the transport deliver its batched send
+	 * completions, which empties the in flight queues below
+	 */
+	if (xio_nexus_detach(connection->nexus)) {
+		xio_connection_post_release(connection);
+		return -1;
+	}
+	old_ctx = connection->ctx;
+	if (!xio_connection_is_quiescent(connection)) {
+		xio_nexus_attach(connection->nexus, old_ctx);
+		xio_connection_post_release(connection);
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+
+	list_del(&connection->ctx_list_entry);
+	connection->migrate_ctx = ctx;
+	if (xio_ctx_add_work(ctx, connection,
+			     xio_connection_migrate_handler,
+			     &connection->migrate_work)) {
+		ERROR_LOG("failed to hand connection:%p to ctx:%p\n",
+			  connection, ctx);
+		connection->migrate_ctx = NULL;
+		list_add_tail(&connection->ctx_list_entry,
+			      &old_ctx->ctx_list);
+		xio_nexus_attach(connection->nexus, old_ctx);
+		xio_connection_post_release(connection);
+		return -1;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(xio_connection_migrate);
+
 /*---------------------------------------------------------------------------*/
 /* xio_poll_completions							     */
 /*---------------------------------------------------------------------------*/
@@ -1757,18 +2659,24 @@ int xio_cancel_request(struct xio_connection *connection,
 
 
 	/* search the tx */
-	xio_msg_list_foreach_safe(pmsg, &connection->reqs_msgq,
-				  tmp_pmsg, pdata) {
-		if (pmsg->sn == req->sn) {
-			ERROR_LOG("[%llu] - message found on reqs_msgq\n",
-				  req->sn);
-			xio_msg_list_remove(&connection->reqs_msgq,
-					    pmsg, pdata);
-			xio_session_notify_cancel(
-				connection, pmsg, XIO_E_MSG_CANCELED);
-			return 0;
+	pmsg = (struct xio_msg *)xio_sn_hash_remove(&connection->reqs_hash,
+						    req->sn);
+	if (!pmsg && connection->reqs_unindexed) {
+		xio_msg_list_foreach_safe(pmsg, &connection->reqs_msgq,
+					  tmp_pmsg, pdata) {
+			if (pmsg->sn == req->sn) {
+				connection->reqs_unindexed--;
+				break;
+			}
 		}
 	}
+	if (pmsg) {
+		ERROR_LOG("[%llu] - message found on reqs_msgq\n",
+			  req->sn);
+		xio_msg_list_remove(&connection->reqs_msgq, pmsg, pdata);
+		xio_session_notify_cancel(connection, pmsg, XIO_E_MSG_CANCELED);
+		return 0;
+	}
 	hdr.sn			 = htonll(req->sn);
 	hdr.requester_session_id =
 		htonl(connection->session->session_id);
@@ -1808,6 +2716,15 @@ struct xio_task *xio_connection_find_io_task(struct xio_connection *connection,
 {
 	struct xio_task *ptask;
 
+	/* look in the io tasks index */
+	ptask = (struct xio_task *)xio_sn_hash_lookup(
+			&connection->io_tasks_hash, msg_sn);
+	if (ptask && ptask->imsg.sn == msg_sn)
+		return ptask;
+
+	if (!connection->io_tasks_unindexed)
+		return NULL;
+
 	/* look in the tx_comp */
 	list_for_each_entry(ptask, &connection->io_tasks_list,
 			    tasks_list_entry) {
@@ -1836,6 +2753,7 @@ int xio_cancel(struct xio_msg *req, enum xio_status result)
 					    task, result);
 	/* release the message */
 	if (result == XIO_E_MSG_CANCELED) {
+		xio_connection_unindex_io_task(task->connection, task);
 		/* the rx task is returned back to pool */
 		xio_tasks_pool_put(task);
 	}
@@ -1890,6 +2808,32 @@ exit:
 }
 EXPORT_SYMBOL(xio_modify_connection);
 
+/*---------------------------------------------------------------------------*/
+/* xio_connection_get_counters						     */
+/*---------------------------------------------------------------------------*/
+static void xio_connection_get_counters(struct xio_connection *connection,
+					struct xio_connection_counters *counters)
+{
+	struct xio_msg		*pmsg;
+	uint32_t		nr;
+
+	*counters = *connection->counters;
+
+	nr = 0;
+	xio_msg_list_foreach(pmsg, &connection->reqs_msgq, pdata)
+		nr++;
+	xio_msg_list_foreach(pmsg, &connection->rsps_msgq, pdata)
+		nr++;
+	counters->tx_queued = nr;
+
+	nr = 0;
+	xio_msg_list_foreach(pmsg, &connection->in_flight_reqs_msgq, pdata)
+		nr++;
+	xio_msg_list_foreach(pmsg, &connection->in_flight_rsps_msgq, pdata)
+		nr++;
+	counters->tx_in_flight = nr;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_query_connection							     */
 /*---------------------------------------------------------------------------*/
@@ -1929,6 +2873,23 @@ int xio_query_connection(struct xio_connection *connection,
 					 &attr->local_addr,
 					 sizeof(attr->local_addr));
 
+	if (attr_mask & XIO_CONNECTION_ATTR_COUNTERS)
+		xio_connection_get_counters(connection, &attr->counters);
+
+	if (attr_mask & XIO_CONNECTION_ATTR_RSP_LATENCY) {
+		if (!attr->rsp_latency) {
+			xio_set_error(EINVAL);
+			ERROR_LOG("no latency histogram buffer\n");
+			return -1;
+		}
+		if (connection->rsp_lat)
+			memcpy(attr->rsp_latency, connection->rsp_lat,
+			       sizeof(*attr->rsp_latency));
+		else
+			memset(attr->rsp_latency, 0,
+			       sizeof(*attr->rsp_latency));
+	}
+
 	/*
 	memset(&nattr, 0, sizeof(nattr));
 	if (test_bits(XIO_CONNECTION_ATTR_TOS, &attr_mask)) {
@@ -1958,6 +2919,48 @@ exit:
 }
 EXPORT_SYMBOL(xio_query_connection);
 
+/*---------------------------------------------------------------------------*/
+/* xio_latency_hist_percentile						     */
+/*---------------------------------------------------------------------------*/
+uint64_t xio_latency_hist_percentile(const struct xio_latency_hist *hist,
+				     uint32_t ppm)
+{
+	uint64_t	rank, seen = 0, value;
+	unsigned int	idx, shift;
+
+	if (!hist || !hist->count)
+		return 0;
+	if (ppm > 1000000)
+		ppm = 1000000;
+
+	/* samples at or below the percentile, at least one */
+	rank = (hist->count * ppm + 999999) / 1000000;
+	if (!rank)
+		rank = 1;
+
+	for (idx = 0; idx < XIO_LAT_HIST_BUCKETS; idx++) {
+		seen += hist->buckets[idx];
+		if (seen >= rank)
+			break;
+	}
+	if (idx == XIO_LAT_HIST_BUCKETS)
+		return hist->max_ns;
+
+	if (idx < (2 << XIO_LAT_HIST_SUB_BITS)) {
+		value = idx;
+	} else {
+		/* top of the bucket: mantissa (16..31) << shift, plus the
+		 * bits below
+		 */
+		shift = (idx >> XIO_LAT_HIST_SUB_BITS) - 1;
+		value = ((uint64_t)(idx - (shift << XIO_LAT_HIST_SUB_BITS) + 1)
+			 << shift) - 1;
+	}
+
+	return value < hist->max_ns ? value : hist->max_ns;
+}
+EXPORT_SYMBOL(xio_latency_hist_percentile);
+
 /*---------------------------------------------------------------------------*/
 /* xio_connection_send_hello_req					     */
 /*---------------------------------------------------------------------------*/
@@ -2036,6 +3039,7 @@ static void xio_connection_post_destroy(struct kref *kref)
 	struct xio_session	*session;
 	struct xio_context	*ctx;
 	int			destroy_session = 0;
+	int			disable_teardown;
 	int			close_reason;
 	struct xio_connection	*tmp_connection = NULL;
 
@@ -2078,6 +3082,8 @@ static void xio_connection_post_destroy(struct kref *kref)
 	destroy_session = ((session->connections_nr == 0) &&
 			(session->lead_connection == NULL) &&
 			(session->redir_connection == NULL));
+	/* once unlocked, the last connection may tear the session down */
+	disable_teardown = session->disable_teardown;
 	spin_unlock(&session->connections_list_lock);
 	retval = xio_connection_close(tmp_connection);
 
@@ -2085,7 +3091,7 @@ static void xio_connection_post_destroy(struct kref *kref)
 		ERROR_LOG("failed to close connection");
 		return;
 	}
-	if (session->disable_teardown)
+	if (disable_teardown)
 		return;
 
 	if (destroy_session)
@@ -2098,17 +3104,13 @@ static void xio_connection_post_destroy(struct kref *kref)
 int xio_connection_destroy(struct xio_connection *connection)
 {
 	int			retval = 0;
-	int			found;
 	struct xio_session	*session;
 
 	if (connection == NULL) {
 		xio_set_error(EINVAL);
 		return -1;
 	}
-	found = xio_idr_lookup_uobj(usr_idr, connection);
-	if (found) {
-		xio_idr_remove_uobj(usr_idr, connection);
-	} else {
+	if (xio_idr_remove_uobj(usr_idr, &connection->idr_entry)) {
 		ERROR_LOG("connection not found:%p\n", connection);
 		xio_set_error(XIO_E_USER_OBJ_NOT_FOUND);
 		return -1;
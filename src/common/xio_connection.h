@@ -65,6 +65,29 @@ struct xio_transition {
 };
 
 
+/* internal post op: a worker pool finished a dispatched request and
+ * drops the connection reference taken for it
+ */
+#define XIO_POST_DISPATCH_DONE		(XIO_POST_RELEASE_RESPONSE + 1)
+
+/* bounded multi producer ring of messages posted by foreign threads,
+ * drained by the connection's context (see xio_post_msg)
+ */
+struct xio_post_slot {
+	volatile uint64_t		seq;
+	struct xio_msg			*msg;
+	uint32_t			op;
+	uint32_t			pad;
+};
+
+struct xio_post_queue {
+	volatile uint64_t		tail;
+	char				tail_pad[56];
+	uint64_t			head;
+	char				head_pad[56];
+	struct xio_post_slot		slots[XIO_POST_QUEUE_DEPTH];
+};
+
 struct xio_connection {
 	struct xio_nexus		*nexus;
 	struct xio_session		*session;
@@ -89,7 +112,7 @@ struct xio_connection {
 	uint16_t			disconnecting;
 	uint16_t			is_flushed;
 	uint16_t			send_req_toggle;
-	uint16_t			pad;
+	uint16_t			portal_idx; /* in session's portals */
 	uint32_t			close_reason;
 	int32_t				tx_queued_msgs;
 	struct kref			kref;
@@ -105,14 +128,23 @@ struct xio_connection {
 	xio_work_handle_t		fin_work;
 	xio_delayed_work_handle_t	fin_delayed_work;
 	xio_delayed_work_handle_t	fin_timeout_work;
+	xio_ctx_event_t			tx_comp_event;
 
 	struct list_head		io_tasks_list;
+	/* io_tasks_list indexed by imsg.sn */
+	struct xio_sn_hash		io_tasks_hash;
+	/* application requests in reqs_msgq indexed by sn */
+	struct xio_sn_hash		reqs_hash;
+	/* entries the indexes failed to take - found by walking the lists */
+	uint32_t			reqs_unindexed;
+	uint32_t			io_tasks_unindexed;
 	struct list_head		post_io_tasks_list;
 	struct list_head		pre_send_list;
 	struct list_head		connections_list_entry;
 	struct list_head		ctx_list_entry;
 	struct xio_session_ops		ses_ops;
 	void				*cb_user_context;
+	struct xio_idr_entry		idr_entry;
 
 	size_t				tx_bytes;
 	uint64_t			credits_bytes;
@@ -122,6 +154,54 @@ struct xio_connection {
 	uint32_t			nexus_attr_mask;
 	struct xio_nexus_init_attr	nexus_attr;
 
+	/* coalesced send completions - see on_msgs_send_complete */
+	int				tx_comp_nr;
+	int				tx_comp_pad;
+	struct xio_msg			*tx_comp_msgs[XIO_MAX_SEND_COMP_BATCH];
+	struct xio_task			*tx_comp_tasks[XIO_MAX_SEND_COMP_BATCH];
+
+	/* cross thread submission - see xio_post_msg */
+	struct xio_dispatcher		*dispatcher;
+	/* requests on the dispatcher, and the ones waiting on the
+	 * connection for room there - context thread only
+	 */
+	struct xio_msg_list		dispatch_backlog;
+	int32_t				dispatched;
+	int32_t				dispatch_pad;
+	struct xio_post_queue		*post_queue;
+	xio_work_handle_t		post_work;
+	volatile int32_t		post_armed;
+	int32_t				post_pad;
+
+	/* live migration - see xio_connection_migrate */
+	struct xio_context		*migrate_ctx;
+	xio_work_handle_t		migrate_work;
+	/* counters->rx_msgs when the rebalancer last looked */
+	uint64_t			rx_msgs_mark;
+
+	/* load balancing - see xio_session_select_connection. the
+	 * requests in flight are counters->reqs_pending (server side) and
+	 * counters->reqs_outstanding (client side)
+	 */
+	uint32_t			rtt_ewma_ns;
+	uint16_t			peer_inflight;	/* last reported by */
+	uint16_t			peer_svc_us;	/* the server	    */
+	/* set while the nexus reconnects, stored by the owning context
+	 * and read by the selector from any context
+	 */
+	atomic_t			reconnecting;
+	uint32_t			reconnecting_pad;
+
+	/* statistics - see XIO_CONNECTION_ATTR_COUNTERS. counters points
+	 * into the statistics segment when the context publishes one,
+	 * else to counters_priv
+	 */
+	struct xio_connection_counters	*counters;
+	void				*stats_slot;
+	struct xio_connection_counters	counters_priv;
+	/* allocated with the first response */
+	struct xio_latency_hist		*rsp_lat;
+
 #ifdef XIO_SESSION_DEBUG
 	uint64_t			peer_connection;
 	uint64_t			peer_session;
@@ -149,6 +229,37 @@ static inline void xio_connection_set_ops(
 	memcpy(&connection->ses_ops, ses_ops, sizeof(*ses_ops));
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_latency_hist_index						     */
+/*---------------------------------------------------------------------------*/
+static inline unsigned int xio_latency_hist_index(uint64_t ns)
+{
+	unsigned int shift, idx;
+
+	if (ns < (2 << XIO_LAT_HIST_SUB_BITS))
+		return (unsigned int)ns;
+
+	/* position of the top bit beyond the sub bucket bits */
+	shift = 63 - __builtin_clzll(ns) - XIO_LAT_HIST_SUB_BITS;
+	idx   = (shift << XIO_LAT_HIST_SUB_BITS) + (unsigned int)(ns >> shift);
+
+	return idx < XIO_LAT_HIST_BUCKETS ? idx : XIO_LAT_HIST_BUCKETS - 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_latency_hist_record						     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_latency_hist_record(struct xio_latency_hist *hist,
+					   uint64_t ns)
+{
+	hist->buckets[xio_latency_hist_index(ns)]++;
+	if (!hist->count++ || ns < hist->min_ns)
+		hist->min_ns = ns;
+	if (ns > hist->max_ns)
+		hist->max_ns = ns;
+	hist->sum_ns += ns;
+}
+
 int xio_connection_send(struct xio_connection *connection,
 			struct xio_msg *msg);
 
@@ -195,6 +306,15 @@ int xio_connection_error_event(struct xio_connection *connection,
 int xio_connection_remove_in_flight(struct xio_connection *connection,
 				    struct xio_msg *msg);
 
+void xio_connection_queue_send_comp(struct xio_connection *connection,
+				    struct xio_task *task);
+
+void xio_connection_flush_send_comp(struct xio_connection *connection);
+
+void xio_connection_multi_done(struct xio_connection *connection,
+			       struct xio_msg *clone,
+			       enum xio_status status);
+
 int xio_connection_remove_msg_from_queue(struct xio_connection *connection,
 					 struct xio_msg *msg);
 
@@ -213,6 +333,8 @@ char *xio_connection_state_str(enum xio_connection_state state);
 
 int xio_connection_restart(struct xio_connection *connection);
 
+void xio_connection_failover_reqs(struct xio_connection *connection);
+
 int xio_on_fin_req_send_comp(struct xio_connection *connection,
 			     struct xio_task *task);
 
@@ -235,11 +357,20 @@ int xio_on_connection_hello_rsp_recv(struct xio_connection *connection,
 
 int xio_send_credits_ack(struct xio_connection *connection);
 
+int xio_connection_post(struct xio_connection *connection, int op,
+			struct xio_msg *msg);
+
+int xio_connection_post_wake(struct xio_connection *connection);
+
 int xio_on_credits_ack_send_comp(struct xio_connection *connection,
 				 struct xio_task *task);
 
 int xio_on_credits_ack_recv(struct xio_connection *connection,
 			    struct xio_task *task);
 
+void xio_connection_capture(struct xio_connection *connection,
+			    struct xio_vmsg *vmsg, int dir, int type,
+			    uint64_t sn, uint64_t rsp_ns);
+
 #endif /*XIO_CONNECTION_H */
 
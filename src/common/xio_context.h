@@ -51,6 +51,13 @@ enum xio_context_event {
 	XIO_CONTEXT_EVENT_POST_CLOSE
 };
 
+/* records a context buffers for a per process file - see xio_ctx_record */
+enum xio_ctx_rec_type {
+	XIO_CTX_REC_MSG_TRACE,		/* struct xio_msg_trace_rec	*/
+	XIO_CTX_REC_CAPTURE,		/* struct xio_capture_rec	*/
+	XIO_CTX_REC_TYPES
+};
+
 enum xio_counters {
 	XIO_STAT_TX_MSG,
 	XIO_STAT_RX_MSG,
@@ -68,7 +75,10 @@ enum xio_counters {
 /*---------------------------------------------------------------------------*/
 struct xio_statistics {
 	uint64_t	hertz;
-	uint64_t	counter[XIO_STAT_LAST];
+	/* in the statistics segment when published, else counter_priv */
+	uint64_t	*counter;
+	void		*shm;
+	uint64_t	counter_priv[XIO_STAT_LAST];
 	char		*name[XIO_STAT_LAST];
 };
 
@@ -81,7 +91,13 @@ struct xio_context {
 	unsigned int			flags;
 	uint64_t			worker;
 	int				run_private;
-	int				pad;
+	int				placed;	/* pin the loop thread */
+	/* requests handed to the application and not yet answered, and
+	 * the moving average of their service time. reported to clients
+	 * for portal selection - see xio_server_portal_load
+	 */
+	uint32_t			reqs_pending;
+	uint32_t			svc_ewma_ns;
 	struct xio_statistics		stats;
 	void				*user_context;
 	struct xio_workqueue		*workqueue;
@@ -90,7 +106,10 @@ struct xio_context {
 	/* list of sessions using this connection */
 	struct xio_observable		observable;
 	void				*netlink_sock;
+	void				*recs[XIO_CTX_REC_TYPES]; /* buffered */
+	void				*ev_trace;	/* xio_ev_trace_ring */
 	struct dentry			*ctx_dentry;
+	struct xio_idr_entry		idr_entry;
 };
 
 /*---------------------------------------------------------------------------*/
@@ -115,6 +134,30 @@ int xio_add_counter(struct xio_context *ctx, char *name);
 /*---------------------------------------------------------------------------*/
 int xio_del_counter(struct xio_context *ctx, int counter);
 
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_record - buffer a record for the process file of its type	     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_record(struct xio_context *ctx, enum xio_ctx_rec_type type,
+		    const void *rec);
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_attach - counters of a new connection in the	     */
+/* statistics segment, NULL to keep them private			     */
+/*---------------------------------------------------------------------------*/
+struct xio_connection_counters *xio_ctx_stats_conn_attach(
+		struct xio_context *ctx, uint32_t session_id,
+		uint32_t conn_idx, const char *peer, void **slot);
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_detach						     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_stats_conn_detach(void *slot);
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_move - connection migrated to ctx			     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_stats_conn_move(struct xio_context *ctx, void *slot);
+
 /*---------------------------------------------------------------------------*/
 /* xio_ctx_stat_add							     */
 /*---------------------------------------------------------------------------*/
@@ -149,6 +192,58 @@ static inline void xio_stat_inc(struct xio_statistics *stats, int counter)
 	stats->counter[counter]++;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_cycles_to_ns							     */
+/*---------------------------------------------------------------------------*/
+static inline uint32_t xio_ctx_cycles_to_ns(struct xio_context *ctx,
+					    uint64_t cycles)
+{
+	/* saturate well before cycles * 10^9 overflows */
+	if (!ctx->stats.hertz || cycles >= 4 * ctx->stats.hertz)
+		return 0xffffffff;
+
+	return (uint32_t)(cycles * 1000000000ULL / ctx->stats.hertz);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_span_ns - from one cycle stamp to a later one, 0 if unstamped   */
+/*---------------------------------------------------------------------------*/
+static inline uint32_t xio_ctx_span_ns(struct xio_context *ctx,
+				       uint64_t from, uint64_t to)
+{
+	if (!from || to <= from)
+		return 0;
+
+	return xio_ctx_cycles_to_ns(ctx, to - from);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_cycles_to_ns64						     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_ctx_cycles_to_ns64(struct xio_context *ctx,
+					      uint64_t cycles)
+{
+	uint64_t hz = ctx->stats.hertz;
+
+	if (!hz)
+		return 0;
+	/* whole seconds apart so that long intervals do not overflow */
+	return (cycles / hz) * 1000000000ULL +
+	       (cycles % hz) * 1000000000ULL / hz;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ewma_update - moving average with 1/8 weight for the new sample	     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_ewma_update(uint32_t *avg, uint32_t sample)
+{
+	if (!*avg)
+		*avg = sample;
+	else
+		*avg = (uint32_t)((int64_t)*avg +
+				  ((int64_t)sample - (int64_t)*avg) / 8);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_ctx_add_delayed_work						     */
 /*---------------------------------------------------------------------------*/
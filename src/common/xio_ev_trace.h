@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_EV_TRACE_H
+#define XIO_EV_TRACE_H
+
+/*
+ * hot path event tracer
+ *
+ * built with --enable-ev-trace (XIO_EV_TRACE), otherwise every
+ * xio_ev_trace() compiles away. each context owns a ring of fixed size
+ * records that wraps around, so it always holds the most recent history.
+ * the loop thread appends with plain stores - a cycle stamp and a few ids,
+ * no formatting, no locks.
+ *
+ * rings are written out by XIO_OPTNAME_EV_TRACE_DUMP, and with
+ * XIO_EV_TRACE_CRASH=1 also from a fatal signal. xio_ev_trace_decode turns
+ * the dump into per object timelines or Chrome trace JSON.
+ */
+
+#define XIO_EV_TRACE_MAGIC		0x56455458	/* "XTEV" */
+#define XIO_EV_TRACE_VERSION		1
+
+#define XIO_EV_TRACE_NO_TASK		0xffff
+
+enum xio_ev_trace_event {
+	XIO_EV_CONN_SEND = 1,	/* obj connection, arg msg sn		*/
+	XIO_EV_NEXUS_SEND,	/* obj nexus, arg connection		*/
+	XIO_EV_TCP_XMIT,	/* obj transport, arg transport sn	*/
+	XIO_EV_TCP_RX,		/* obj transport, arg tlv type		*/
+	XIO_EV_RDMA_WC,		/* obj transport, arg wc opcode		*/
+	XIO_EV_TASK_GET,	/* obj tasks pool			*/
+	XIO_EV_TASK_PUT,	/* obj tasks pool			*/
+	XIO_EV_LAST
+};
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_ev_trace_rec {
+	uint64_t		cycles;
+	uint64_t		obj;		/* the emitting object	*/
+	uint64_t		arg;
+	uint32_t		size;		/* bytes		*/
+	uint16_t		task;		/* ltid			*/
+	uint8_t			event;
+	uint8_t			pad;
+};
+
+struct xio_ev_trace_ring {
+	uint64_t		head;		/* records ever written */
+	uint64_t		mask;
+	struct xio_ev_trace_rec	*rec;
+	struct list_head	rings_list_entry;
+	int32_t			cpu;
+	uint32_t		ctx_id;
+};
+
+/* dump: a file header, then per ring a ring header and its records
+ * oldest first
+ */
+struct xio_ev_trace_file_hdr {
+	uint32_t		magic;
+	uint32_t		version;
+	int32_t			pid;
+	uint32_t		rec_size;
+	uint64_t		hertz;		/* of the cycle stamps	*/
+	uint32_t		rings_nr;
+	uint32_t		pad;
+};
+
+struct xio_ev_trace_ring_hdr {
+	uint32_t		ctx_id;
+	int32_t			cpu;
+	uint64_t		recs_nr;
+	uint64_t		lost;		/* overwritten		*/
+};
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_dump - write all rings to path, NULL for the default	     */
+/*---------------------------------------------------------------------------*/
+int xio_ev_trace_dump(const char *path);
+
+#ifdef XIO_EV_TRACE
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_emit							     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_ev_trace_emit(struct xio_ev_trace_ring *ring,
+				     int event, const void *obj, int task,
+				     uint32_t size, uint64_t arg)
+{
+	struct xio_ev_trace_rec *rec;
+
+	if (unlikely(!ring))
+		return;
+
+	rec = &ring->rec[ring->head & ring->mask];
+	rec->cycles	= get_cycles();
+	rec->obj	= (uint64_t)(uintptr_t)obj;
+	rec->arg	= arg;
+	rec->size	= size;
+	rec->task	= (uint16_t)task;
+	rec->event	= (uint8_t)event;
+	ring->head++;
+}
+
+#define xio_ev_trace(ring, event, obj, task, size, arg)			\
+	xio_ev_trace_emit((struct xio_ev_trace_ring *)(ring), (event),	\
+			  (obj), (task), (size), (arg))
+#else
+#define xio_ev_trace(ring, event, obj, task, size, arg)			\
+	do { } while (0)
+#endif
+
+#endif /* XIO_EV_TRACE_H */
@@ -39,46 +39,53 @@
 #include "xio_log.h"
 #include "xio_common.h"
 #include "xio_hash.h"
-#include <sys/hashtable.h>
 #include "xio_idr.h"
 #include <xio-advanced-env.h>
 
-struct xio_idr_entry {
-	void					*key;
-	char					*name;
-	HT_ENTRY(xio_idr_entry, xio_key_int64)	idr_ht_entry;
+/*
+ * user objects carry their own xio_idr_entry. a handle is valid while the
+ * entry's magic is XIO_IDR_MAGIC_LIVE, so validating a handle is a plain
+ * load and needs no lock. destroy flips the magic with a compare and swap,
+ * so of two racing destroys of the same handle only one succeeds.
+ *
+ * the entries are also linked on a registry, sharded by object address,
+ * only to report leaked objects in xio_idr_destroy.
+ */
+#define XIO_IDR_MAGIC_LIVE	0x78696f21	/* "xio!" */
+#define XIO_IDR_MAGIC_DEAD	0xdeadd1e0
+#define XIO_IDR_SHARDS		64
+#define idr_shard(entry)	\
+	(int64_hash(uint64_from_ptr(entry)) & (XIO_IDR_SHARDS - 1))
+
+struct xio_idr_shard {
+	struct list_head	list;
+	spinlock_t		lock;
+	int			pad;
 };
 
 struct xio_idr {
-	HT_HEAD(, xio_idr_entry, HASHTABLE_PRIME_MEDIUM) cache;
-	spinlock_t lock;
-	int	   pad;
+	struct xio_idr_shard	shards[XIO_IDR_SHARDS];
 };
 
 /*---------------------------------------------------------------------------*/
 /* xio_idr_remove_uobj							     */
 /*---------------------------------------------------------------------------*/
-int xio_idr_remove_uobj(struct xio_idr *idr, void *uobj)
+int xio_idr_remove_uobj(struct xio_idr *idr, struct xio_idr_entry *entry)
 {
-	struct xio_idr_entry	*idr_entry = NULL;
-	struct xio_key_int64	key;
+	struct xio_idr_shard	*shard;
 
-	if (!idr || !uobj)
+	if (!idr || !entry)
 		return -1;
 
-	spin_lock(&idr->lock);
-	key.id = uint64_from_ptr(uobj);
-	HT_LOOKUP(&idr->cache, &key, idr_entry, idr_ht_entry);
-	if (idr_entry == NULL) {
-		spin_unlock(&idr->lock);
+	if (!xio_sync_bool_compare_and_swap(&entry->magic,
+					    XIO_IDR_MAGIC_LIVE,
+					    XIO_IDR_MAGIC_DEAD))
 		return -1;
-	}
 
-	HT_REMOVE(&idr->cache, idr_entry, xio_idr_entry, idr_ht_entry);
-	spin_unlock(&idr->lock);
-
-	kfree(idr_entry->name);
-	kfree(idr_entry);
+	shard = &idr->shards[idr_shard(entry)];
+	spin_lock(&shard->lock);
+	list_del_init(&entry->list_entry);
+	spin_unlock(&shard->lock);
 
 	return 0;
 }
@@ -86,53 +93,44 @@ int xio_idr_remove_uobj(struct xio_idr *idr, void *uobj)
 /*---------------------------------------------------------------------------*/
 /* xio_idr_lookup_uobj							     */
 /*---------------------------------------------------------------------------*/
-int xio_idr_lookup_uobj(struct xio_idr *idr, void *uobj)
+int xio_idr_lookup_uobj(struct xio_idr *idr, struct xio_idr_entry *entry)
 {
-	struct xio_idr_entry	*idr_entry = NULL;
-	struct xio_key_int64	key;
-
-	if (!idr || !uobj)
+	if (!idr || !entry)
 		return 0;
 
-	spin_lock(&idr->lock);
-	key.id = uint64_from_ptr(uobj);
-	HT_LOOKUP(&idr->cache, &key, idr_entry, idr_ht_entry);
-	spin_unlock(&idr->lock);
-
-	return (idr != NULL);
+	return (entry->magic == XIO_IDR_MAGIC_LIVE);
 }
 
 /*---------------------------------------------------------------------------*/
-/* xio_sessions_cache_add			                             */
+/* xio_idr_add_uobj							     */
 /*---------------------------------------------------------------------------*/
-int xio_idr_add_uobj(struct xio_idr *idr, void *uobj, const char *obj_name)
+int xio_idr_add_uobj(struct xio_idr *idr, struct xio_idr_entry *entry,
+		     const char *obj_name)
 {
-	struct xio_idr_entry	*idr1_entry = NULL, *idr_entry;
-	struct xio_key_int64	key;
+	struct xio_idr_shard	*shard;
+	uint32_t		magic;
 	int			retval = -1;
 
-	if (!idr || !uobj)
+	if (!idr || !entry)
 		return -1;
 
-	idr_entry = (struct xio_idr_entry *)
-			kcalloc(1, sizeof(*idr_entry), GFP_KERNEL);
-	if (idr_entry == NULL)
-		return -1;
-
-	spin_lock(&idr->lock);
-	key.id = uint64_from_ptr(uobj);
-	HT_LOOKUP(&idr->cache, &key, idr1_entry, idr_ht_entry);
-	if (idr1_entry != NULL)
+	shard = &idr->shards[idr_shard(entry)];
+	spin_lock(&shard->lock);
+	magic = entry->magic;
+	if (magic == XIO_IDR_MAGIC_LIVE)
 		goto exit;
 
-	idr_entry->key = uobj;
-	idr_entry->name = kstrdup(obj_name, GFP_KERNEL);
-	HT_INSERT(&idr->cache, &key, idr_entry, idr_ht_entry);
+	entry->name = obj_name;
+	list_add(&entry->list_entry, &shard->list);
+	/* publish only once linked, remove relies on it */
+	if (!xio_sync_bool_compare_and_swap(&entry->magic, magic,
+					    XIO_IDR_MAGIC_LIVE)) {
+		list_del_init(&entry->list_entry);
+		goto exit;
+	}
 	retval = 0;
 exit:
-	spin_unlock(&idr->lock);
-	if (retval)
-		kfree(idr_entry);
+	spin_unlock(&shard->lock);
 
 	return retval;
 }
@@ -143,13 +141,16 @@ exit:
 struct xio_idr *xio_idr_create(void)
 {
 	struct xio_idr *idr;
+	int		i;
 
 	idr = (struct xio_idr *)kcalloc(1, sizeof(*idr), GFP_KERNEL);
 	if (idr == NULL)
 		return NULL;
 
-	HT_INIT(&idr->cache, xio_int64_hash, xio_int64_cmp, xio_int64_cp);
-	spin_lock_init(&idr->lock);
+	for (i = 0; i < XIO_IDR_SHARDS; i++) {
+		INIT_LIST_HEAD(&idr->shards[i].list);
+		spin_lock_init(&idr->shards[i].lock);
+	}
 
 	return idr;
 }
@@ -159,16 +160,20 @@ struct xio_idr *xio_idr_create(void)
 /*---------------------------------------------------------------------------*/
 void xio_idr_destroy(struct xio_idr *idr)
 {
-	struct xio_idr_entry *idr_entry = NULL;
+	struct xio_idr_entry *entry, *tmp;
+	int		     i;
+
 	if (!idr)
 		return;
 
-	HT_FOREACH_SAFE(idr_entry, &idr->cache, idr_ht_entry) {
-		HT_REMOVE(&idr->cache, idr_entry, xio_idr_entry, idr_ht_entry);
-		ERROR_LOG("user object leaked: %p, type:struct %s\n", idr_entry->key, idr_entry->name);
-		kfree(idr_entry->name);
-		kfree(idr_entry);
+	for (i = 0; i < XIO_IDR_SHARDS; i++) {
+		list_for_each_entry_safe(entry, tmp, &idr->shards[i].list,
+					 list_entry) {
+			list_del_init(&entry->list_entry);
+			entry->magic = XIO_IDR_MAGIC_DEAD;
+			ERROR_LOG("user object leaked: %p, type:struct %s\n",
+				  entry, entry->name);
+		}
 	}
 	kfree(idr);
 }
-
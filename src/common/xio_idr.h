@@ -43,13 +43,14 @@ struct xio_idr;
 /*---------------------------------------------------------------------------*/
 /* user object cache							     */
 /*---------------------------------------------------------------------------*/
- struct xio_idr *xio_idr_create(void);
+struct xio_idr *xio_idr_create(void);
 
-int xio_idr_add_uobj(struct xio_idr *cache, void *uobj, const char *obj_name);
+int xio_idr_add_uobj(struct xio_idr *cache, struct xio_idr_entry *entry,
+		     const char *obj_name);
 
-int xio_idr_remove_uobj(struct xio_idr *cache, void *uobj);
+int xio_idr_remove_uobj(struct xio_idr *cache, struct xio_idr_entry *entry);
 
-int xio_idr_lookup_uobj(struct xio_idr *cache, void *uobj);
+int xio_idr_lookup_uobj(struct xio_idr *cache, struct xio_idr_entry *entry);
 
 void xio_idr_destroy(struct xio_idr *cache);
 
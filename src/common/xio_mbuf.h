@@ -70,9 +70,20 @@ struct xio_mbuf {
 #define xio_mbuf_set_session_hdr(mbuf)	 \
 			((mbuf)->curr = sum_to_ptr((mbuf)->tlv.head, XIO_TLV_LEN))
 
+/* the session header and, on a response reporting the residence of a
+ * traced request, its trailer. both peers read the flag from the same
+ * bytes, so the transport header lands at the same offset
+ */
+#define xio_mbuf_session_hdr_len(mbuf)		\
+			((ntohl(((struct xio_session_hdr *)sum_to_ptr( \
+				(mbuf)->tlv.head, XIO_TLV_LEN))->flags) & \
+			  XIO_MSG_FLAG_EX_TRACE_TIMES) ? \
+			 XIO_SESSION_HDR_LEN + XIO_SESSION_TRACE_LEN : \
+			 XIO_SESSION_HDR_LEN)
+
 #define xio_mbuf_set_trans_hdr(mbuf)		\
 			((mbuf)->curr = sum_to_ptr((mbuf)->tlv.head, \
-				XIO_TLV_LEN + XIO_SESSION_HDR_LEN))
+				XIO_TLV_LEN + xio_mbuf_session_hdr_len(mbuf)))
 
 #define xio_mbuf_tlv_head(mbuf)		((mbuf)->tlv.head)
 
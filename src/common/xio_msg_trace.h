@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_MSG_TRACE_H
+#define XIO_MSG_TRACE_H
+
+/*
+ * per message lifecycle tracing
+ *
+ * with XIO_OPTNAME_MSG_TRACE set, requests carry XIO_MSG_FLAG_EX_TRACE and
+ * their task collects cycle stamps along the way out and back. the server
+ * answers a traced request with its own residence times in a trailer to
+ * the response's session header (XIO_MSG_FLAG_EX_TRACE_TIMES), already in
+ * ns so the two clocks never meet. untraced messages keep the fixed header. on delivery of the
+ * response the client folds everything into one xio_msg_trace_rec and
+ * hands it to xio_ctx_record - in user space records are appended to a
+ * per process file that xio_msg_trace_report reads.
+ *
+ * transports stamp arrival once per receive batch on every task, traced
+ * or not - the session header that tells is parsed only later.
+ */
+
+#define XIO_MSG_TRACE_MAGIC		0x54474d58	/* "XMGT" */
+#define XIO_MSG_TRACE_VERSION		1
+
+/* stamps taken on a task, in cycles */
+enum xio_msg_trace_stamp {
+	XIO_TRACE_SUBMIT,	/* xio_send_request/response		*/
+	XIO_TRACE_DEQUEUE,	/* left the connection queue		*/
+	XIO_TRACE_XPORT,	/* handed to the transport		*/
+	XIO_TRACE_WIRE,		/* sendmsg returned / posted		*/
+	XIO_TRACE_RX,		/* arrived at the transport		*/
+	XIO_TRACE_DELIVER,	/* handed to the application		*/
+	XIO_TRACE_STAMPS
+};
+
+/* stages of a request's round trip, in ns */
+enum xio_msg_trace_stage {
+	XIO_TRACE_STAGE_QUEUE,		/* submit -> dequeue		*/
+	XIO_TRACE_STAGE_SEND,		/* dequeue -> transport		*/
+	XIO_TRACE_STAGE_TRANSPORT,	/* transport -> wire		*/
+	XIO_TRACE_STAGE_NETWORK,	/* round trip less remote time	*/
+	XIO_TRACE_STAGE_REMOTE_QUEUE,	/* remote rx -> delivery	*/
+	XIO_TRACE_STAGE_REMOTE_APP,	/* remote delivery -> response	*/
+	XIO_TRACE_STAGE_REMOTE_REPLY,	/* remote response -> header	*/
+	XIO_TRACE_STAGE_DELIVER,	/* rx -> delivery		*/
+	XIO_TRACE_STAGE_TOTAL,		/* submit -> delivery		*/
+	XIO_TRACE_STAGES
+};
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_msg_trace_file_hdr {
+	uint32_t		magic;
+	uint32_t		version;
+	int32_t			pid;
+	uint32_t		rec_size;
+};
+
+struct xio_msg_trace_rec {
+	uint64_t		sn;
+	uint32_t		session_id;
+	uint32_t		conn_idx;
+	uint32_t		tx_bytes;
+	uint32_t		rx_bytes;
+	uint32_t		stage_ns[XIO_TRACE_STAGES];	/* saturated */
+	uint32_t		pad;
+};
+
+/*---------------------------------------------------------------------------*/
+/* xio_msg_trace_stamp							     */
+/*---------------------------------------------------------------------------*/
+#define xio_msg_trace_stamp(task, stamp)				\
+	do {								\
+		if (unlikely((task)->traced))				\
+			(task)->trace[stamp] = get_cycles();		\
+	} while (0)
+
+#endif /* XIO_MSG_TRACE_H */
@@ -448,6 +448,7 @@ static int xio_nexus_swap(struct xio_nexus *old, struct xio_nexus *_new)
 {
 	struct xio_transport		*transport;
 	struct xio_tasks_pool		*initial_tasks_pool;
+	struct xio_transport_base	*new_transport_hndl;
 
 	if (old->transport != _new->transport) {
 		ERROR_LOG("can't swap not the same transport\n");
@@ -488,17 +489,23 @@ static int xio_nexus_swap(struct xio_nexus *old, struct xio_nexus *_new)
 	_new->initial_tasks_pool = initial_tasks_pool;
 
 	xio_tasks_pool_remap(old->primary_tasks_pool, _new->transport_hndl);
+	new_transport_hndl = _new->transport_hndl;
 	/* make old_nexus->transport_hndl copy of new_nexus->transport_hndl
 	 * old_nexus->trasport_hndl will be closed, note that observers were
 	 * swapped
 	 */
-	if (transport->dup2(_new->transport_hndl, &old->transport_hndl)) {
+	if (transport->dup2(new_transport_hndl, &old->transport_hndl)) {
 		ERROR_LOG("dup2 transport failed\n");
 		return -1;
 	}
 
-	/* silently close new_nexus */
-	xio_nexus_close(_new, NULL);
+	/* new_nexus is observing the old transport_hndl that dup2 closed and
+	 * is destroyed by its close event, possibly already inside dup2, so
+	 * it must not be touched here. dup2 took an extra reference on
+	 * new_transport_hndl for new_nexus that its destroy never drops;
+	 * release it here, old_nexus holds the remaining one
+	 */
+	transport->close(new_transport_hndl);
 
 	/* TODO what about messages held by the application */
 
@@ -906,6 +913,7 @@ static int xio_nexus_initial_pool_create(struct xio_nexus *nexus)
 	params.pool_dd_data_sz		   = pool_dd_sz;
 	params.slab_dd_data_sz		   = slab_dd_sz;
 	params.task_dd_data_sz		   = task_dd_sz;
+	params.node_id			   = transport_hndl->ctx->nodeid;
 	params.pool_hooks.context	   = transport_hndl;
 	params.pool_hooks.slab_pre_create  =
 		(int (*)(void *, int, void *, void *))
@@ -954,6 +962,7 @@ static int xio_nexus_initial_pool_create(struct xio_nexus *nexus)
 		ERROR_LOG("xio_tasks_pool_create failed\n");
 		goto cleanup;
 	}
+	nexus->initial_tasks_pool->ev_trace = transport_hndl->ctx->ev_trace;
 
 	return 0;
 
@@ -1017,6 +1026,7 @@ static int xio_nexus_primary_pool_create(struct xio_nexus *nexus)
 	params.pool_dd_data_sz		   = pool_dd_sz;
 	params.slab_dd_data_sz		   = slab_dd_sz;
 	params.task_dd_data_sz		   = task_dd_sz;
+	params.node_id			   = nexus->transport_hndl->ctx->nodeid;
 	params.pool_hooks.context	   = nexus->transport_hndl;
 	params.pool_hooks.slab_pre_create  =
 		(int (*)(void *, int, void *, void *))
@@ -1065,6 +1075,8 @@ static int xio_nexus_primary_pool_create(struct xio_nexus *nexus)
 		ERROR_LOG("xio_tasks_pool_create failed\n");
 		goto cleanup;
 	}
+	nexus->primary_tasks_pool->ev_trace =
+				nexus->transport_hndl->ctx->ev_trace;
 
 	return 0;
 
@@ -1758,7 +1770,7 @@ struct xio_nexus *xio_nexus_open(struct xio_context *ctx,
 {
 	struct xio_transport		*transport;
 	struct xio_nexus		*nexus;
-	char				proto[8];
+	char				proto[16];
 	struct xio_transport_init_attr	*ptrans_init_attr = NULL;
 	struct xio_nexus_query_params	query;
 
@@ -1981,6 +1993,7 @@ int xio_nexus_connect(struct xio_nexus *nexus, const char *portal_uri,
 			ERROR_LOG("transport connect failed\n");
 			goto cleanup3;
 		}
+		xio_nexus_cache_set_portal(nexus);
 		nexus->state = XIO_NEXUS_STATE_CONNECTING;
 		break;
 	case XIO_NEXUS_STATE_CONNECTED:
@@ -2176,6 +2189,7 @@ static int xio_nexus_xmit(struct xio_nexus *nexus)
 
 		task = list_first_entry(&nexus->tx_queue,
 					struct xio_task,  tasks_list_entry);
+		xio_msg_trace_stamp(task, XIO_TRACE_XPORT);
 		retval = nexus->transport->send(nexus->transport_hndl, task);
 		if (retval != 0) {
 			union xio_nexus_event_data nexus_event_data;
@@ -2218,6 +2232,9 @@ int xio_nexus_send(struct xio_nexus *nexus, struct xio_task *task)
 	if (!nexus->transport->send)
 		return 0;
 
+	xio_ev_trace(nexus->transport_hndl->ctx->ev_trace, XIO_EV_NEXUS_SEND,
+		     nexus, task->ltid, 0, uint64_from_ptr(task->connection));
+
 	/* push to end of the queue */
 	list_move_tail(&task->tasks_list_entry, &nexus->tx_queue);
 
@@ -2503,6 +2520,11 @@ static int xio_nexus_client_reconnect(struct xio_nexus *nexus)
 
 	xio_nexus_state_set(nexus, XIO_NEXUS_STATE_RECONNECT);
 
+	/* let sessions move queued work to their other connections */
+	xio_observable_notify_all_observers(&nexus->observable,
+					    XIO_NEXUS_EVENT_RECONNECTING,
+					    NULL);
+
 	/* All portal_uri and out_if were saved in the nexus
 	 * observer is not used in this flow
 	 */
@@ -2540,6 +2562,57 @@ int xio_nexus_update_task(struct xio_nexus *nexus, struct xio_task *task)
 	return 0;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_nexus_detach							     */
+/*---------------------------------------------------------------------------*/
+int xio_nexus_detach(struct xio_nexus *nexus)
+{
+	struct list_head	*pos;
+	int			observers_nr = 0;
+
+	if (!nexus->transport->detach || !nexus->transport->attach) {
+		xio_set_error(XIO_E_NOT_SUPPORTED);
+		return -1;
+	}
+	/* a nexus shared by several sessions moves with all of them or
+	 * not at all - only single session nexuses are supported
+	 */
+	list_for_each(pos, &nexus->observable.observers_list)
+		observers_nr++;
+	if (observers_nr != 1 || nexus->state != XIO_NEXUS_STATE_CONNECTED ||
+	    !list_empty(&nexus->tx_queue) ||
+	    xio_is_delayed_work_pending(&nexus->close_time_hndl)) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+	if (nexus->transport->detach(nexus->transport_hndl))
+		return -1;
+
+	xio_nexus_cache_unset_portal(nexus);
+	xio_context_unreg_observer(nexus->transport_hndl->ctx,
+				   &nexus->ctx_observer);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_nexus_attach							     */
+/*---------------------------------------------------------------------------*/
+int xio_nexus_attach(struct xio_nexus *nexus, struct xio_context *ctx)
+{
+	int retval;
+
+	/* the handle belongs to the new context even if attach fails, so
+	 * that it is torn down there
+	 */
+	retval = nexus->transport->attach(nexus->transport_hndl, ctx);
+	xio_context_reg_observer(nexus->transport_hndl->ctx,
+				 &nexus->ctx_observer);
+	xio_nexus_cache_set_portal(nexus);
+
+	return retval;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_nexus_set_server							     */
 /*---------------------------------------------------------------------------*/
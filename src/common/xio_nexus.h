@@ -65,7 +65,8 @@ enum xio_nexus_event {
 	XIO_NEXUS_EVENT_CANCEL_REQUEST,
 	XIO_NEXUS_EVENT_CANCEL_RESPONSE,
 	XIO_NEXUS_EVENT_ERROR,
-	XIO_NEXUS_EVENT_MESSAGE_ERROR
+	XIO_NEXUS_EVENT_MESSAGE_ERROR,
+	XIO_NEXUS_EVENT_RECONNECTING
 };
 
 enum xio_nexus_state {
@@ -153,7 +154,7 @@ struct xio_nexus {
 	short				is_first_req;
 	short				reconnect_retries;
 	int				is_listener;
-	int				pad;
+	int				cache_indexed;
 	xio_delayed_work_handle_t	close_time_hndl;
 
 	struct list_head		observers_htbl;
@@ -169,7 +170,12 @@ struct xio_nexus {
 	uint32_t			trans_attr_mask;
 	struct xio_transport_init_attr	trans_attr;
 
-	HT_ENTRY(xio_nexus, xio_key_int32) nexus_htbl;
+	uint32_t			cache_shard;
+	uint32_t			cache_pad;
+
+	/* portals cache chain - nexuses sharing (uri, ctx, tos) key */
+	struct xio_nexus		*cache_next;
+	uint64_t			cache_key;
 };
 
 /*---------------------------------------------------------------------------*/
@@ -373,6 +379,16 @@ int xio_nexus_query(struct xio_nexus *nexus,
 		    struct xio_nexus_attr *attr,
 		    int attr_mask);
 
+/*---------------------------------------------------------------------------*/
+/* xio_nexus_detach							     */
+/*---------------------------------------------------------------------------*/
+int xio_nexus_detach(struct xio_nexus *nexus);
+
+/*---------------------------------------------------------------------------*/
+/* xio_nexus_attach							     */
+/*---------------------------------------------------------------------------*/
+int xio_nexus_attach(struct xio_nexus *nexus, struct xio_context *ctx);
+
 
 #endif /*XIO_NEXUS_H */
 
@@ -51,29 +51,80 @@
 #include "xio_transport.h"
 #include "xio_transport.h"
 #include "xio_nexus.h"
+#include "xio_sn_hash.h"
 #include "xio_nexus_cache.h"
 
+/* two independent sharded indexes:
+ *  - nexus_cache:   cid -> nexus, sharded by cid
+ *  - portals_cache: (portal_uri hash, ctx, tos) -> chain of nexuses,
+ *		     sharded by ctx so that threads connecting on their
+ *		     own contexts do not share a lock
+ */
+#define XIO_NEXUS_CACHE_SHARDS		64
+#define cid_shard(id)	((uint32_t)(id) & (XIO_NEXUS_CACHE_SHARDS - 1))
 
-static HT_HEAD(, xio_nexus, HASHTABLE_PRIME_SMALL)  nexus_cache;
-static spinlock_t cs_lock;
+static struct xio_sn_hash nexus_cache[XIO_NEXUS_CACHE_SHARDS];
+static spinlock_t cs_lock[XIO_NEXUS_CACHE_SHARDS];
+static struct xio_sn_hash portals_cache[XIO_NEXUS_CACHE_SHARDS];
+static spinlock_t ps_lock[XIO_NEXUS_CACHE_SHARDS];
+static int cid;  /* = 0 global nexus provider */
 
 /*---------------------------------------------------------------------------*/
-/* xio_nexus_cache_add				                             */
+/* portal_shard							     */
 /*---------------------------------------------------------------------------*/
-static int nexus_cache_add(struct xio_nexus *nexus, int nexus_id)
+static inline uint32_t portal_shard(struct xio_context *ctx)
 {
-	struct xio_nexus *c;
-	struct xio_key_int32  key = {
-		nexus_id
-	};
+	return int64_hash(uint64_from_ptr(ctx)) &
+		(XIO_NEXUS_CACHE_SHARDS - 1);
+}
 
-	HT_LOOKUP(&nexus_cache, &key, c, nexus_htbl);
-	if (c != NULL)
-		return -1;
+/*---------------------------------------------------------------------------*/
+/* portal_key								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t portal_key(const char *portal_uri,
+				  struct xio_context *ctx,
+				  int tos_enabled, uint8_t tos)
+{
+	uint64_t key = (uint64_t)str_hash(portal_uri) << 32;
 
-	HT_INSERT(&nexus_cache, &key, nexus, nexus_htbl);
+	key ^= int64_hash(uint64_from_ptr(ctx));
+	if (tos_enabled)
+		key ^= (uint64_t)(0x100 | tos) << 16;
 
-	return 0;
+	return key;
+}
+
+/*---------------------------------------------------------------------------*/
+/* portals_cache_unlink						     */
+/*---------------------------------------------------------------------------*/
+static void portals_cache_unlink(struct xio_nexus *nexus)
+{
+	struct xio_sn_hash *tbl;
+	struct xio_nexus *c, *prev = NULL;
+	uint32_t shard = nexus->cache_shard;
+
+	tbl = &portals_cache[shard];
+
+	spin_lock(&ps_lock[shard]);
+	c = (struct xio_nexus *)xio_sn_hash_lookup(tbl, nexus->cache_key);
+	while (c && c != nexus) {
+		prev = c;
+		c = c->cache_next;
+	}
+	if (c) {
+		if (prev)
+			prev->cache_next = nexus->cache_next;
+		else if (nexus->cache_next)
+			/* replaces the existing entry - never grows */
+			xio_sn_hash_insert_reserved(tbl, nexus->cache_key,
+						    nexus->cache_next);
+		else
+			xio_sn_hash_remove(tbl, nexus->cache_key);
+	}
+	spin_unlock(&ps_lock[shard]);
+
+	nexus->cache_next    = NULL;
+	nexus->cache_indexed = 0;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -82,18 +133,17 @@ static int nexus_cache_add(struct xio_nexus *nexus, int nexus_id)
 int xio_nexus_cache_remove(int nexus_id)
 {
 	struct xio_nexus *c;
-	struct xio_key_int32  key;
+	uint32_t shard = cid_shard(nexus_id);
 
-	spin_lock(&cs_lock);
-	key.id = nexus_id;
-	HT_LOOKUP(&nexus_cache, &key, c, nexus_htbl);
-	if (c == NULL) {
-		spin_unlock(&cs_lock);
+	spin_lock(&cs_lock[shard]);
+	c = (struct xio_nexus *)xio_sn_hash_remove(&nexus_cache[shard],
+						   (uint32_t)nexus_id);
+	spin_unlock(&cs_lock[shard]);
+	if (c == NULL)
 		return -1;
-	}
 
-	HT_REMOVE(&nexus_cache, c, xio_nexus, nexus_htbl);
-	spin_unlock(&cs_lock);
+	if (c->cache_indexed)
+		portals_cache_unlink(c);
 
 	return 0;
 }
@@ -104,12 +154,12 @@ int xio_nexus_cache_remove(int nexus_id)
 struct xio_nexus *xio_nexus_cache_lookup(int nexus_id)
 {
 	struct xio_nexus *c;
-	struct xio_key_int32  key;
+	uint32_t shard = cid_shard(nexus_id);
 
-	spin_lock(&cs_lock);
-	key.id = nexus_id;
-	HT_LOOKUP(&nexus_cache, &key, c, nexus_htbl);
-	spin_unlock(&cs_lock);
+	spin_lock(&cs_lock[shard]);
+	c = (struct xio_nexus *)xio_sn_hash_lookup(&nexus_cache[shard],
+						   (uint32_t)nexus_id);
+	spin_unlock(&cs_lock[shard]);
 
 	return c;
 }
@@ -120,18 +170,71 @@ struct xio_nexus *xio_nexus_cache_lookup(int nexus_id)
 int xio_nexus_cache_add(struct xio_nexus *nexus,
 			int *nexus_id)
 {
-	static int cid;  /* = 0 global nexus provider */
-	int retval;
+	int id = xio_sync_fetch_and_add32(&cid, 1);
+	uint32_t shard = cid_shard(id);
+	int retval = -1;
+
+	if (xio_sn_hash_reserve(&nexus_cache[shard], &cs_lock[shard]))
+		return -1;
 
-	spin_lock(&cs_lock);
-	retval = nexus_cache_add(nexus, cid);
+	spin_lock(&cs_lock[shard]);
+	if (!xio_sn_hash_lookup(&nexus_cache[shard], (uint32_t)id))
+		retval = xio_sn_hash_insert_reserved(&nexus_cache[shard],
+						     (uint32_t)id, nexus);
+	spin_unlock(&cs_lock[shard]);
 	if (retval == 0)
-		*nexus_id = cid++;
-	spin_unlock(&cs_lock);
+		*nexus_id = id;
 
 	return retval;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_nexus_cache_set_portal			                             */
+/*---------------------------------------------------------------------------*/
+int xio_nexus_cache_set_portal(struct xio_nexus *nexus)
+{
+	struct xio_transport_base *trans_hndl = nexus->transport_hndl;
+	struct xio_sn_hash *tbl;
+	uint32_t shard;
+	int tos_enabled, retval;
+
+	if (nexus->cache_indexed || !trans_hndl->portal_uri)
+		return 0;
+
+	tos_enabled = test_bits(XIO_NEXUS_ATTR_TOS, &nexus->trans_attr_mask);
+	shard = portal_shard(trans_hndl->ctx);
+	tbl = &portals_cache[shard];
+
+	nexus->cache_shard = shard;
+	nexus->cache_key   = portal_key(trans_hndl->portal_uri,
+					trans_hndl->ctx, tos_enabled,
+					nexus->trans_attr.tos);
+
+	if (xio_sn_hash_reserve(tbl, &ps_lock[shard]))
+		return -1;
+
+	spin_lock(&ps_lock[shard]);
+	nexus->cache_next = (struct xio_nexus *)
+				xio_sn_hash_lookup(tbl, nexus->cache_key);
+	retval = xio_sn_hash_insert_reserved(tbl, nexus->cache_key, nexus);
+	if (retval == 0)
+		nexus->cache_indexed = 1;
+	else
+		nexus->cache_next = NULL;
+	spin_unlock(&ps_lock[shard]);
+
+	return retval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_nexus_cache_unset_portal			                             */
+/*---------------------------------------------------------------------------*/
+void xio_nexus_cache_unset_portal(struct xio_nexus *nexus)
+{
+	if (nexus->cache_indexed)
+		portals_cache_unlink(nexus);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_nexus_cache_find				                             */
 /*---------------------------------------------------------------------------*/
@@ -139,9 +242,14 @@ struct xio_nexus *xio_nexus_cache_find(struct xio_nexus_query_params *query)
 {
 	struct xio_nexus *nexus;
 	int		  tos_enabled;
+	uint32_t	  shard = portal_shard(query->ctx);
+	uint64_t	  key = portal_key(query->portal_uri, query->ctx,
+					   query->tos_enabled, query->tos);
 
-	spin_lock(&cs_lock);
-	HT_FOREACH(nexus, &nexus_cache, nexus_htbl) {
+	spin_lock(&ps_lock[shard]);
+	nexus = (struct xio_nexus *)xio_sn_hash_lookup(&portals_cache[shard],
+						       key);
+	for (; nexus; nexus = nexus->cache_next) {
 		if (nexus->transport_hndl->portal_uri) {
 			if ((strcmp(nexus->transport_hndl->portal_uri,
 				query->portal_uri) != 0) ||
@@ -155,13 +263,11 @@ struct xio_nexus *xio_nexus_cache_find(struct xio_nexus_query_params *query)
 			if (tos_enabled && nexus->trans_attr.tos != query->tos)
 				continue;
 			/* match found */
-			goto found;
+			break;
 		}
 	}
-	nexus = NULL;
+	spin_unlock(&ps_lock[shard]);
 
-found:
-	spin_unlock(&cs_lock);
 	return  nexus;
 }
 
@@ -170,13 +276,25 @@ found:
 /*---------------------------------------------------------------------------*/
 void nexus_cache_construct(void)
 {
-	HT_INIT(&nexus_cache, xio_int32_hash, xio_int32_cmp, xio_int32_cp);
-	spin_lock_init(&cs_lock);
+	int i;
+
+	for (i = 0; i < XIO_NEXUS_CACHE_SHARDS; i++) {
+		xio_sn_hash_init(&nexus_cache[i]);
+		spin_lock_init(&cs_lock[i]);
+		xio_sn_hash_init(&portals_cache[i]);
+		spin_lock_init(&ps_lock[i]);
+	}
 }
 
-/*
+/*---------------------------------------------------------------------------*/
+/* nexus_cache_destruct				                     */
+/*---------------------------------------------------------------------------*/
 void nexus_cache_destruct(void)
 {
-}
-*/
+	int i;
 
+	for (i = 0; i < XIO_NEXUS_CACHE_SHARDS; i++) {
+		xio_sn_hash_destroy(&nexus_cache[i]);
+		xio_sn_hash_destroy(&portals_cache[i]);
+	}
+}
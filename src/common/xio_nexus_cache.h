@@ -60,6 +60,11 @@ struct xio_nexus_query_params {
 /*---------------------------------------------------------------------------*/
 void nexus_cache_construct(void);
 
+/*---------------------------------------------------------------------------*/
+/* nexus_cache_destruct							     */
+/*---------------------------------------------------------------------------*/
+void nexus_cache_destruct(void);
+
 int xio_nexus_cache_add(
 		struct xio_nexus *nexus,
 		int *nexus_id);
@@ -70,6 +75,14 @@ int xio_nexus_cache_remove(
 struct xio_nexus *xio_nexus_cache_lookup(
 		int nexus_id);
 
+/* make the nexus reachable by xio_nexus_cache_find once its transport
+ * handle carries a portal uri (i.e. after connect)
+ */
+int xio_nexus_cache_set_portal(struct xio_nexus *nexus);
+
+/* drop the portal index entry, e.g. before the nexus changes context */
+void xio_nexus_cache_unset_portal(struct xio_nexus *nexus);
+
 struct xio_nexus *xio_nexus_cache_find(struct xio_nexus_query_params *query);
 
 
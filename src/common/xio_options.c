@@ -43,6 +43,7 @@
 #include "xio_observer.h"
 #include "xio_transport.h"
 #include "xio_log.h"
+#include "xio_ev_trace.h"
 
 #define XIO_OPTVAL_DEF_MAX_IN_IOVSZ			XIO_IOVLEN
 #define XIO_OPTVAL_DEF_MAX_OUT_IOVSZ			XIO_IOVLEN
@@ -54,6 +55,7 @@
 #define XIO_OPTVAL_DEF_RCV_QUEUE_DEPTH_BYTES		(64*1024*1024)
 #define XIO_OPTVAL_DEF_MAX_INLINE_HEADER		256
 #define XIO_OPTVAL_DEF_MAX_INLINE_DATA			(8*1024)
+#define XIO_OPTVAL_DEF_SEND_COMP_BATCH			16
 
 /* xio options */
 struct xio_options			g_options = {
@@ -67,6 +69,10 @@ struct xio_options			g_options = {
 	XIO_OPTVAL_DEF_RCV_QUEUE_DEPTH_MSGS,	/*rcv_queue_depth_msgs*/
 	XIO_OPTVAL_DEF_SND_QUEUE_DEPTH_BYTES,	/*snd_queue_depth_bytes*/
 	XIO_OPTVAL_DEF_RCV_QUEUE_DEPTH_BYTES,	/*rcv_queue_depth_bytes*/
+	XIO_OPTVAL_DEF_SEND_COMP_BATCH,		/*send_comp_batch*/
+	XIO_PORTAL_POLICY_ROUND_ROBIN,		/*portal_policy*/
+	0,					/*msg_trace*/
+	0,					/*capture*/
 };
 
 /*---------------------------------------------------------------------------*/
@@ -194,7 +200,7 @@ static int xio_general_set_opt(void *xio_obj, int optname,
 	case XIO_OPTNAME_SND_QUEUE_DEPTH_MSGS:
 		if (*((int *)optval) < 1)
 			break;
-		g_options.snd_queue_depth_msgs = (int)*((uint64_t *)optval);
+		g_options.snd_queue_depth_msgs = *((int *)optval);
 		return 0;
 		break;
 	case XIO_OPTNAME_RCV_QUEUE_DEPTH_MSGS:
@@ -231,6 +237,38 @@ static int xio_general_set_opt(void *xio_obj, int optname,
 		g_options.max_inline_data = *((int *)optval);
 		return 0;
 		break;
+	case XIO_OPTNAME_SEND_COMP_BATCH:
+		if (optlen != sizeof(int))
+			break;
+		if (*((int *)optval) < 1 ||
+		    *((int *)optval) > XIO_MAX_SEND_COMP_BATCH)
+			break;
+		g_options.send_comp_batch = *((int *)optval);
+		return 0;
+		break;
+	case XIO_OPTNAME_PORTAL_POLICY:
+		if (optlen != sizeof(int))
+			break;
+		if (*((int *)optval) < XIO_PORTAL_POLICY_ROUND_ROBIN ||
+		    *((int *)optval) > XIO_PORTAL_POLICY_LOWEST_LATENCY)
+			break;
+		g_options.portal_policy = *((int *)optval);
+		return 0;
+		break;
+	case XIO_OPTNAME_MSG_TRACE:
+		if (optlen != sizeof(int))
+			break;
+		g_options.msg_trace = !!*((int *)optval);
+		return 0;
+		break;
+	case XIO_OPTNAME_CAPTURE:
+		if (optlen != sizeof(int))
+			break;
+		g_options.capture = !!*((int *)optval);
+		return 0;
+		break;
+	case XIO_OPTNAME_EV_TRACE_DUMP:
+		return xio_ev_trace_dump((const char *)optval);
 	default:
 		break;
 	}
@@ -293,6 +331,22 @@ static int xio_general_get_opt(void  *xio_obj, int optname,
 		*optlen = sizeof(int);
 		 *((int *)optval) = g_options.max_inline_data;
 		 return 0;
+	case XIO_OPTNAME_SEND_COMP_BATCH:
+		*optlen = sizeof(int);
+		 *((int *)optval) = g_options.send_comp_batch;
+		 return 0;
+	case XIO_OPTNAME_PORTAL_POLICY:
+		*optlen = sizeof(int);
+		 *((int *)optval) = g_options.portal_policy;
+		 return 0;
+	case XIO_OPTNAME_MSG_TRACE:
+		*optlen = sizeof(int);
+		 *((int *)optval) = g_options.msg_trace;
+		 return 0;
+	case XIO_OPTNAME_CAPTURE:
+		*optlen = sizeof(int);
+		 *((int *)optval) = g_options.capture;
+		 return 0;
 	default:
 		break;
 	}
@@ -53,6 +53,7 @@
 #include "xio_context.h"
 #include "xio_session.h"
 #include "xio_nexus.h"
+#include "xio_sn_hash.h"
 #include "xio_connection.h"
 #include "xio_server.h"
 #include <xio-advanced-env.h>
@@ -61,6 +62,87 @@ static int xio_on_nexus_event(void *observer, void *notifier, int event,
 			      void *event_data);
 static void xio_server_destroy(struct kref *kref);
 
+static spinlock_t	servers_lock;
+static LIST_HEAD(servers_list);
+
+/*---------------------------------------------------------------------------*/
+/* xio_servers_construct						     */
+/*---------------------------------------------------------------------------*/
+void xio_servers_construct(void)
+{
+	spin_lock_init(&servers_lock);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_uri_get_port - the port of "proto://host:port[/resource]", 0 if none  */
+/*---------------------------------------------------------------------------*/
+static uint16_t xio_uri_get_port(const char *uri)
+{
+	const char	*p, *colon = NULL;
+	uint32_t	port = 0;
+
+	p = strstr(uri, "://");
+	if (p == NULL)
+		return 0;
+	p += 3;
+	if (*p == '[') {	/* IPv6 */
+		p = strchr(p, ']');
+		if (p == NULL)
+			return 0;
+	}
+	for (; *p && *p != '/'; p++)
+		if (*p == ':')
+			colon = p;
+	if (colon == NULL)
+		return 0;
+	for (p = colon + 1; *p >= '0' && *p <= '9'; p++) {
+		port = port * 10 + (*p - '0');
+		if (port > 0xffff)
+			return 0;
+	}
+
+	return (uint16_t)port;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_server_portal_load						     */
+/*---------------------------------------------------------------------------*/
+int xio_server_portal_load(const char *portal, uint16_t *inflight,
+			   uint16_t *svc_us)
+{
+	struct xio_server	*server, *found = NULL;
+	char			proto[16], sproto[16];
+	uint16_t		port;
+
+	/* the portal as bound, else a server of the same protocol bound
+	 * to the portal's port (e.g. on the wildcard address)
+	 */
+	port = xio_uri_get_port(portal);
+	if (xio_uri_get_proto(portal, proto, sizeof(proto)))
+		proto[0] = 0;
+
+	spin_lock(&servers_lock);
+	list_for_each_entry(server, &servers_list, servers_list_entry) {
+		if (!strcmp(server->uri, portal)) {
+			found = server;
+			break;
+		}
+		if (!found && port && server->port == port &&
+		    !xio_uri_get_proto(server->uri, sproto, sizeof(sproto)) &&
+		    !strcmp(proto, sproto))
+			found = server;
+	}
+	if (found) {
+		*inflight = (uint16_t)min(found->ctx->reqs_pending,
+					  (uint32_t)0xffff);
+		*svc_us	  = (uint16_t)min(found->ctx->svc_ewma_ns / 1000,
+					  (uint32_t)0xffff);
+	}
+	spin_unlock(&servers_lock);
+
+	return found ? 0 : -1;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_server_reg_observer						     */
 /*---------------------------------------------------------------------------*/
@@ -68,7 +150,10 @@ int xio_server_reg_observer(struct xio_server *server,
 			    struct xio_observer *observer)
 {
 	kref_get(&server->kref);
+	/* migrated nexuses unregister from their own context */
+	spin_lock(&server->nexus_observable_lock);
 	xio_observable_reg_observer(&server->nexus_observable, observer);
+	spin_unlock(&server->nexus_observable_lock);
 
 	return 0;
 }
@@ -79,7 +164,9 @@ int xio_server_reg_observer(struct xio_server *server,
 void xio_server_unreg_observer(struct xio_server *server,
 			       struct xio_observer *observer)
 {
+	spin_lock(&server->nexus_observable_lock);
 	xio_observable_unreg_observer(&server->nexus_observable, observer);
+	spin_unlock(&server->nexus_observable_lock);
 	kref_put(&server->kref, xio_server_destroy);
 }
 
@@ -148,9 +235,13 @@ static int xio_on_new_message(struct xio_server *server,
 		/* get transport class routines */
 		session->validators_cls = xio_nexus_get_validators_cls(nexus);
 
+		/* a migrated nexus lives on another context than the
+		 * server
+		 */
 		connection =
 			xio_session_alloc_connection(session,
-						     server->ctx, 0,
+						     nexus->transport_hndl->ctx,
+						     0,
 						     server->cb_private_data);
 		if (!connection) {
 			ERROR_LOG("server failed to allocate new connection\n");
@@ -162,9 +253,12 @@ static int xio_on_new_message(struct xio_server *server,
 			goto cleanup1;
 		}
 		connection = connection1;
+		connection->dispatcher = server->dispatcher;
 
-		xio_idr_add_uobj(usr_idr, session, "xio_session");
-		xio_idr_add_uobj(usr_idr, connection, "xio_connection");
+		xio_idr_add_uobj(usr_idr, &session->idr_entry,
+				 "xio_session");
+		xio_idr_add_uobj(usr_idr, &connection->idr_entry,
+				 "xio_connection");
 		xio_connection_set_state(connection,
 					 XIO_CONNECTION_STATE_ONLINE);
 
@@ -186,7 +280,7 @@ static int xio_on_new_message(struct xio_server *server,
 
 		connection = xio_session_alloc_connection(
 				task->session,
-				server->ctx, 0,
+				nexus->transport_hndl->ctx, 0,
 				server->cb_private_data);
 
 		if (!connection) {
@@ -199,6 +293,7 @@ static int xio_on_new_message(struct xio_server *server,
 			goto cleanup1;
 		}
 		connection = connection1;
+		connection->dispatcher = server->dispatcher;
 
 		/* copy the server attributes to the connection */
 		xio_connection_set_ops(connection, &server->ops);
@@ -209,7 +304,8 @@ static int xio_on_new_message(struct xio_server *server,
 		session->state = XIO_SESSION_STATE_ONLINE;
 		xio_connection_set_state(connection,
 					 XIO_CONNECTION_STATE_ONLINE);
-		xio_idr_add_uobj(usr_idr, connection, "xio_connection");
+		xio_idr_add_uobj(usr_idr, &connection->idr_entry,
+				 "xio_connection");
 	} else {
 		ERROR_LOG("server unexpected message\n");
 		return -1;
@@ -290,6 +386,7 @@ struct xio_server *xio_bind(struct xio_context *ctx,
 	struct xio_server	*server;
 	int			retval;
 	int			backlog = 0;
+	uint16_t		port = 0;
 
 	if ((ctx == NULL) || (ops == NULL) || (uri == NULL)) {
 		ERROR_LOG("invalid parameters ctx:%p, ops:%p, uri:%p\n",
@@ -320,6 +417,7 @@ struct xio_server *xio_bind(struct xio_context *ctx,
 	XIO_OBSERVER_INIT(&server->observer, server, xio_on_nexus_event);
 
 	XIO_OBSERVABLE_INIT(&server->nexus_observable, server);
+	spin_lock_init(&server->nexus_observable_lock);
 
 	server->listener = xio_nexus_open(ctx, uri, NULL, 0, 0, NULL);
 	if (server->listener == NULL) {
@@ -327,13 +425,20 @@ struct xio_server *xio_bind(struct xio_context *ctx,
 		goto cleanup;
 	}
 	retval = xio_nexus_listen(server->listener,
-				  uri, src_port, backlog);
+				  uri, &port, backlog);
 	if (retval != 0) {
 		ERROR_LOG("connection listen failed\n");
 		goto cleanup1;
 	}
+	if (src_port)
+		*src_port = port;
+	server->port = port;
 	xio_nexus_set_server(server->listener, server);
-	xio_idr_add_uobj(usr_idr, server, "xio_server");
+	xio_idr_add_uobj(usr_idr, &server->idr_entry, "xio_server");
+
+	spin_lock(&servers_lock);
+	list_add_tail(&server->servers_list_entry, &servers_list);
+	spin_unlock(&servers_lock);
 
 	return server;
 
@@ -356,6 +461,10 @@ static void xio_server_destroy(struct kref *kref)
 						 struct xio_server, kref);
 
 	DEBUG_LOG("xio_server_destroy - server:%p\n", server);
+	spin_lock(&servers_lock);
+	list_del(&server->servers_list_entry);
+	spin_unlock(&servers_lock);
+
 	xio_observable_unreg_all_observers(&server->nexus_observable);
 
 	xio_nexus_close(server->listener, NULL);
@@ -373,15 +482,11 @@ static void xio_server_destroy(struct kref *kref)
 int xio_unbind(struct xio_server *server)
 {
 	int retval = 0;
-	int found;
 
 	if (server == NULL)
 		return -1;
 
-	found = xio_idr_lookup_uobj(usr_idr, server);
-	if (found) {
-		xio_idr_remove_uobj(usr_idr, server);
-	} else {
+	if (xio_idr_remove_uobj(usr_idr, &server->idr_entry)) {
 		ERROR_LOG("server not found:%p\n", server);
 		xio_set_error(XIO_E_USER_OBJ_NOT_FOUND);
 		return -1;
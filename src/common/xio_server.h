@@ -55,6 +55,14 @@ struct xio_server {
 	struct kref			kref;
 	void				*cb_private_data;
 	struct xio_observable		nexus_observable;
+	struct xio_idr_entry		idr_entry;
+	/* request offload for the server's connections, optional */
+	struct xio_dispatcher		*dispatcher;
+	spinlock_t			nexus_observable_lock;
+	uint16_t			port;	/* bound port */
+	uint16_t			pad;
+	/* all bound servers - see xio_server_portal_load */
+	struct list_head		servers_list_entry;
 };
 
 /*---------------------------------------------------------------------------*/
@@ -69,5 +77,16 @@ int xio_server_reg_observer(struct xio_server *server,
 void xio_server_unreg_observer(struct xio_server *server,
 			       struct xio_observer *observer);
 
+/*---------------------------------------------------------------------------*/
+/* xio_servers_construct						     */
+/*---------------------------------------------------------------------------*/
+void xio_servers_construct(void);
+
+/*---------------------------------------------------------------------------*/
+/* xio_server_portal_load						     */
+/*---------------------------------------------------------------------------*/
+int xio_server_portal_load(const char *portal, uint16_t *inflight,
+			   uint16_t *svc_us);
+
 #endif /*XIO_SERVER_H */
 
@@ -53,7 +53,9 @@
 #include "xio_workqueue.h"
 #include "xio_context.h"
 #include "xio_nexus.h"
+#include "xio_sn_hash.h"
 #include "xio_connection.h"
+#include "xio_capture.h"
 #include "xio_sessions_cache.h"
 #include "xio_session.h"
 #include "xio_session_priv.h"
@@ -236,6 +238,8 @@ void xio_session_write_header(struct xio_task *task,
 	PACK_SVAL(hdr, tmp_hdr, sn);
 	PACK_SVAL(hdr, tmp_hdr, ack_sn);
 	PACK_SVAL(hdr, tmp_hdr, credits_msgs);
+	PACK_SVAL(hdr, tmp_hdr, load_inflight);
+	PACK_SVAL(hdr, tmp_hdr, load_svc_us);
 	PACK_LVAL(hdr, tmp_hdr, receipt_result);
 	PACK_LLVAL(hdr, tmp_hdr, credits_bytes);
 #ifdef XIO_SESSION_DEBUG
@@ -265,6 +269,8 @@ void xio_session_read_header(struct xio_task *task,
 	UNPACK_SVAL(tmp_hdr, hdr, sn);
 	UNPACK_SVAL(tmp_hdr, hdr, ack_sn);
 	UNPACK_SVAL(tmp_hdr, hdr, credits_msgs);
+	UNPACK_SVAL(tmp_hdr, hdr, load_inflight);
+	UNPACK_SVAL(tmp_hdr, hdr, load_svc_us);
 	UNPACK_LVAL(tmp_hdr, hdr, receipt_result);
 	UNPACK_LLVAL(tmp_hdr, hdr, credits_bytes);
 #ifdef XIO_SESSION_DEBUG
@@ -275,6 +281,43 @@ void xio_session_read_header(struct xio_task *task,
 	xio_mbuf_inc(&task->mbuf, sizeof(struct xio_session_hdr));
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_session_write_trace - the trailer of a header flagged		     */
+/* XIO_MSG_FLAG_EX_TRACE_TIMES, right after xio_session_write_header	     */
+/*---------------------------------------------------------------------------*/
+void xio_session_write_trace(struct xio_task *task,
+			     struct xio_session_trace_hdr *trace)
+{
+	struct xio_session_trace_hdr *tmp_trace;
+
+	tmp_trace = (struct xio_session_trace_hdr *)
+			xio_mbuf_get_curr_ptr(&task->mbuf);
+
+	PACK_LVAL(trace, tmp_trace, queue_ns);
+	PACK_LVAL(trace, tmp_trace, app_ns);
+	PACK_LVAL(trace, tmp_trace, reply_ns);
+
+	xio_mbuf_inc(&task->mbuf, sizeof(struct xio_session_trace_hdr));
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_read_trace - right after xio_session_read_header		     */
+/*---------------------------------------------------------------------------*/
+void xio_session_read_trace(struct xio_task *task,
+			    struct xio_session_trace_hdr *trace)
+{
+	struct xio_session_trace_hdr *tmp_trace;
+
+	tmp_trace = (struct xio_session_trace_hdr *)
+			xio_mbuf_get_curr_ptr(&task->mbuf);
+
+	UNPACK_LVAL(tmp_trace, trace, queue_ns);
+	UNPACK_LVAL(tmp_trace, trace, app_ns);
+	UNPACK_LVAL(tmp_trace, trace, reply_ns);
+
+	xio_mbuf_inc(&task->mbuf, sizeof(struct xio_session_trace_hdr));
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_session_notify_teardown						     */
 /*---------------------------------------------------------------------------*/
@@ -402,6 +445,25 @@ void xio_session_notify_connection_teardown(struct xio_session *session,
 				session->cb_user_context);
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_session_notify_connection_migrated				     */
+/*---------------------------------------------------------------------------*/
+void xio_session_notify_connection_migrated(struct xio_session *session,
+					    struct xio_connection *connection,
+					    enum xio_status reason)
+{
+	struct xio_session_event_data  event = {};
+	event.event = XIO_SESSION_CONNECTION_MIGRATED_EVENT;
+	event.reason = reason;
+	event.conn = connection;
+	event.conn_user_context = connection->cb_user_context;
+
+	if (session->ses_ops.on_session_event)
+		session->ses_ops.on_session_event(
+				session, &event,
+				session->cb_user_context);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_session_notify_connection_error					     */
 /*---------------------------------------------------------------------------*/
@@ -433,6 +495,7 @@ static int xio_on_req_recv(struct xio_connection *connection,
 	struct xio_vmsg *vmsg = &msg->in;
 	struct xio_sg_table_ops	*sgtbl_ops;
 	void			*sgtbl;
+	uint64_t		rx_bytes;
 
 	sgtbl		= xio_sg_table_get(&msg->in);
 	sgtbl_ops	= (struct xio_sg_table_ops *)
@@ -466,6 +529,7 @@ static int xio_on_req_recv(struct xio_connection *connection,
 	msg->sn		= hdr.serial_num;
 	msg->flags	= 0;
 	msg->next	= NULL;
+	task->traced	= !!(hdr.flags & XIO_MSG_FLAG_EX_TRACE);
 
 	if (test_bits(XIO_MSG_FLAG_LAST_IN_BATCH, &task->imsg_flags))
 		set_bits(XIO_MSG_FLAG_LAST_IN_BATCH, &msg->flags);
@@ -482,9 +546,18 @@ static int xio_on_req_recv(struct xio_connection *connection,
 		xio_task_addref(task);
 
 	msg->timestamp = get_cycles();
+	if (unlikely(task->traced))
+		task->trace[XIO_TRACE_DELIVER] = msg->timestamp;
+	rx_bytes = vmsg->header.iov_len + tbl_length(sgtbl_ops, sgtbl);
 	xio_stat_inc(stats, XIO_STAT_RX_MSG);
-	xio_stat_add(stats, XIO_STAT_RX_BYTES,
-		     vmsg->header.iov_len + tbl_length(sgtbl_ops, sgtbl));
+	xio_stat_add(stats, XIO_STAT_RX_BYTES, rx_bytes);
+	connection->counters->rx_msgs++;
+	connection->counters->rx_bytes += rx_bytes;
+	if (unlikely(g_options.capture))
+		xio_connection_capture(connection, vmsg, XIO_CAPTURE_RX,
+				       task->tlv_type == XIO_ONE_WAY_REQ ?
+				       XIO_CAPTURE_ONE_WAY : XIO_CAPTURE_REQ,
+				       msg->sn, 0);
 
 	if (test_bits(XIO_MSG_FLAG_EX_IMM_READ_RECEIPT, &hdr.flags)) {
 		xio_task_addref(task);
@@ -492,12 +565,33 @@ static int xio_on_req_recv(struct xio_connection *connection,
 		xio_connection_send_read_receipt(connection, msg);
 	}
 
+	/* counted until the response goes out - see xio_send_response */
+	if (task->tlv_type == XIO_MSG_REQ && !task->status) {
+		connection->counters->reqs_pending++;
+		connection->ctx->reqs_pending++;
+	}
+
 	/* notify the upper layer */
 	if (task->status) {
 		xio_session_notify_msg_error(connection, msg,
 					     (enum xio_status)task->status,
 					     XIO_MSG_DIRECTION_IN);
 		task->status = 0;
+	} else if (connection->dispatcher &&
+		   task->tlv_type == XIO_MSG_REQ &&
+		   !(hdr.flags & (XIO_MSG_FLAG_REQUEST_READ_RECEIPT |
+				  XIO_MSG_FLAG_EX_IMM_READ_RECEIPT))) {
+		/* offload the handler, run it here if the pool is full */
+		msg->flags |= XIO_MSG_FLAG_EX_DISPATCHED;
+		if (connection->dispatcher->dispatch(connection->dispatcher,
+						     connection, msg,
+						     task->last_in_rxq)) {
+			msg->flags &= ~XIO_MSG_FLAG_EX_DISPATCHED;
+			connection->ses_ops.on_msg(
+					connection->session, msg,
+					task->last_in_rxq,
+					connection->cb_user_context);
+		}
 	} else {
 		/*if (connection->ses_ops.on_msg) */
 			connection->ses_ops.on_msg(
@@ -518,6 +612,70 @@ static int xio_on_req_recv(struct xio_connection *connection,
 	return 0;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_session_trace_rsp - break a traced request's round trip down	     */
+/*---------------------------------------------------------------------------*/
+static void xio_session_trace_rsp(struct xio_connection *connection,
+				  struct xio_task *sender_task,
+				  struct xio_task *task,
+				  struct xio_session_hdr *hdr,
+				  struct xio_session_trace_hdr *trace,
+				  uint64_t rx_bytes)
+{
+	struct xio_context		*ctx = connection->ctx;
+	struct xio_msg			*omsg = sender_task->omsg;
+	uint64_t			*t = sender_task->trace;
+	struct xio_sg_table_ops		*sgtbl_ops;
+	void				*sgtbl;
+	struct xio_msg_trace_rec	rec;
+	uint64_t			tx_bytes, remote;
+	uint32_t			rtt;
+
+	sender_task->traced = 0;
+
+	t[XIO_TRACE_RX]		= task->trace[XIO_TRACE_RX];
+	t[XIO_TRACE_DELIVER]	= get_cycles();
+	/* transports that do not stamp the wire */
+	if (!t[XIO_TRACE_WIRE])
+		t[XIO_TRACE_WIRE] = t[XIO_TRACE_XPORT];
+
+	sgtbl		= xio_sg_table_get(&omsg->out);
+	sgtbl_ops	= (struct xio_sg_table_ops *)
+				xio_sg_table_ops_get(omsg->out.sgl_type);
+	tx_bytes	= omsg->out.header.iov_len +
+			  tbl_length(sgtbl_ops, sgtbl);
+
+	memset(&rec, 0, sizeof(rec));
+	rec.sn		= hdr->serial_num;
+	rec.session_id	= connection->session->session_id;
+	rec.conn_idx	= connection->conn_idx;
+	rec.tx_bytes	= (uint32_t)min(tx_bytes, 0xffffffffULL);
+	rec.rx_bytes	= (uint32_t)min(rx_bytes, 0xffffffffULL);
+
+	rec.stage_ns[XIO_TRACE_STAGE_QUEUE] =
+		xio_ctx_span_ns(ctx, t[XIO_TRACE_SUBMIT], t[XIO_TRACE_DEQUEUE]);
+	rec.stage_ns[XIO_TRACE_STAGE_SEND] =
+		xio_ctx_span_ns(ctx, t[XIO_TRACE_DEQUEUE], t[XIO_TRACE_XPORT]);
+	rec.stage_ns[XIO_TRACE_STAGE_TRANSPORT] =
+		xio_ctx_span_ns(ctx, t[XIO_TRACE_XPORT], t[XIO_TRACE_WIRE]);
+	rec.stage_ns[XIO_TRACE_STAGE_REMOTE_QUEUE] = trace->queue_ns;
+	rec.stage_ns[XIO_TRACE_STAGE_REMOTE_APP]   = trace->app_ns;
+	rec.stage_ns[XIO_TRACE_STAGE_REMOTE_REPLY] = trace->reply_ns;
+	rec.stage_ns[XIO_TRACE_STAGE_DELIVER] =
+		xio_ctx_span_ns(ctx, t[XIO_TRACE_RX], t[XIO_TRACE_DELIVER]);
+	rec.stage_ns[XIO_TRACE_STAGE_TOTAL] =
+		xio_ctx_span_ns(ctx, t[XIO_TRACE_SUBMIT],
+				t[XIO_TRACE_DELIVER]);
+
+	/* what the wire and the peer's transport took */
+	remote	= (uint64_t)trace->queue_ns + trace->app_ns + trace->reply_ns;
+	rtt	= xio_ctx_span_ns(ctx, t[XIO_TRACE_WIRE], t[XIO_TRACE_RX]);
+	rec.stage_ns[XIO_TRACE_STAGE_NETWORK] =
+		(rtt > remote) ? (uint32_t)(rtt - remote) : 0;
+
+	xio_ctx_record(ctx, XIO_CTX_REC_MSG_TRACE, &rec);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_on_rsp_recv				                             */
 /*---------------------------------------------------------------------------*/
@@ -525,10 +683,13 @@ static int xio_on_rsp_recv(struct xio_connection *connection,
 			   struct xio_task *task)
 {
 	struct xio_session_hdr	hdr;
+	struct xio_session_trace_hdr trace = {};
 	struct xio_msg		*msg = &task->imsg;
 	struct xio_msg		*omsg;
 	struct xio_task		*sender_task = task->sender_task;
 	struct xio_statistics	*stats = &connection->ctx->stats;
+	uint64_t		rtt, rtt_ns;
+	uint64_t		rx_bytes;
 	int			standalone_receipt = 0;
 
 	if ((connection->state != XIO_CONNECTION_STATE_ONLINE) &&
@@ -545,6 +706,8 @@ static int xio_on_rsp_recv(struct xio_connection *connection,
 
 	/* read session header */
 	xio_session_read_header(task, &hdr);
+	if (unlikely(hdr.flags & XIO_MSG_FLAG_EX_TRACE_TIMES))
+		xio_session_read_trace(task, &trace);
 
 	/* standalone receipt */
 	if (xio_app_receipt_request(&hdr) ==
@@ -579,11 +742,30 @@ static int xio_on_rsp_recv(struct xio_connection *connection,
 
 	omsg		= sender_task->omsg;
 
-	xio_stat_add(stats, XIO_STAT_DELAY,
-		     get_cycles() - omsg->timestamp);
+	rtt = get_cycles() - omsg->timestamp;
+	xio_stat_add(stats, XIO_STAT_DELAY, rtt);
 	xio_stat_inc(stats, XIO_STAT_RX_MSG);
+	connection->counters->rx_msgs++;
 	omsg->next	= NULL;
 
+	if (task->tlv_type == XIO_MSG_RSP && !standalone_receipt) {
+		rtt_ns = xio_ctx_cycles_to_ns64(connection->ctx, rtt);
+		if (connection->counters->reqs_outstanding)
+			connection->counters->reqs_outstanding--;
+		xio_ewma_update(&connection->rtt_ewma_ns,
+				(uint32_t)min(rtt_ns, 0xffffffffULL));
+		if (unlikely(!connection->rsp_lat))
+			connection->rsp_lat = (struct xio_latency_hist *)
+				kcalloc(1, sizeof(*connection->rsp_lat),
+					GFP_KERNEL);
+		if (likely(connection->rsp_lat))
+			xio_latency_hist_record(connection->rsp_lat, rtt_ns);
+	}
+	if (hdr.flags & XIO_MSG_FLAG_EX_LOAD_REPORT)
+		xio_session_update_portal_load(connection,
+					       hdr.load_inflight,
+					       hdr.load_svc_us);
+
 	xio_clear_ex_flags(&omsg->flags);
 
 	task->connection = connection;
@@ -637,6 +819,9 @@ static int xio_on_rsp_recv(struct xio_connection *connection,
 						omsg,
 						task->last_in_rxq,
 						connection->cb_user_context);
+		} else if (omsg->flags & XIO_MSG_FLAG_EX_MULTI) {
+			xio_connection_multi_done(connection, omsg,
+						  XIO_E_SUCCESS);
 		} else {
 			if (connection->ses_ops.on_ow_msg_send_complete) {
 				connection->ses_ops.on_ow_msg_send_complete(
@@ -678,9 +863,16 @@ static int xio_on_rsp_recv(struct xio_connection *connection,
 			sgtbl_ops	= (struct xio_sg_table_ops *)
 					xio_sg_table_ops_get(msg->in.sgl_type);
 
-			xio_stat_add(stats, XIO_STAT_RX_BYTES,
-				     vmsg->header.iov_len +
-				     tbl_length(sgtbl_ops, sgtbl));
+			rx_bytes = vmsg->header.iov_len +
+				   tbl_length(sgtbl_ops, sgtbl);
+			xio_stat_add(stats, XIO_STAT_RX_BYTES, rx_bytes);
+			connection->counters->rx_bytes += rx_bytes;
+			if (unlikely(g_options.capture))
+				xio_connection_capture(
+					connection, vmsg, XIO_CAPTURE_RX,
+					XIO_CAPTURE_RSP, omsg->sn,
+					xio_ctx_cycles_to_ns64(connection->ctx,
+							       rtt));
 
 			omsg->request	= msg;
 			if (task->status) {
@@ -690,6 +882,12 @@ static int xio_on_rsp_recv(struct xio_connection *connection,
 					XIO_MSG_DIRECTION_IN);
 				task->status = 0;
 			} else {
+				if (unlikely(sender_task->traced))
+					xio_session_trace_rsp(connection,
+							      sender_task,
+							      task, &hdr,
+							      &trace,
+							      rx_bytes);
 				/*if (connection->ses_ops.on_msg) */
 					connection->ses_ops.on_msg(
 						connection->session,
@@ -733,6 +931,11 @@ static int xio_on_rsp_send_comp(
 		 * release responses
 		 */
 		xio_clear_ex_flags(&task->omsg->flags);
+		if (connection->ses_ops.on_msgs_send_complete) {
+			/* the task is recycled when the batch is flushed */
+			xio_connection_queue_send_comp(connection, task);
+			goto exit;
+		}
 		if (connection->ses_ops.on_msg_send_complete) {
 			connection->ses_ops.on_msg_send_complete(
 					connection->session, task->omsg,
@@ -823,6 +1026,18 @@ static int xio_on_ow_req_send_comp(
 			 tbl_length(sgtbl_ops, sgtbl));
 	}
 
+	/* fan out clone - the user is notified once all clones are done */
+	if (omsg->flags & XIO_MSG_FLAG_EX_MULTI) {
+		xio_tasks_pool_put(task);
+		xio_connection_multi_done(connection, omsg, XIO_E_SUCCESS);
+		goto exit;
+	}
+
+	if (connection->ses_ops.on_msgs_send_complete) {
+		xio_connection_queue_send_comp(connection, task);
+		goto exit;
+	}
+
 	/* send completion notification to
 	 * release request
 	 */
@@ -889,8 +1104,32 @@ int xio_on_nexus_reconnected(struct xio_session *session,
 	else
 		connection = xio_session_find_connection(session, nexus);
 
-	if (connection)
+	if (connection) {
+		atomic_set(&connection->reconnecting, 0);
 		xio_connection_restart(connection);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_on_nexus_reconnecting			                             */
+/*---------------------------------------------------------------------------*/
+int xio_on_nexus_reconnecting(struct xio_session *session,
+			      struct xio_nexus *nexus)
+{
+	struct xio_connection		*connection;
+
+	if (session->lead_connection &&
+	    session->lead_connection->nexus == nexus)
+		connection = session->lead_connection;
+	else
+		connection = xio_session_find_connection(session, nexus);
+
+	if (connection) {
+		atomic_set(&connection->reconnecting, 1);
+		xio_connection_failover_reqs(connection);
+	}
 
 	return 0;
 }
@@ -932,7 +1171,10 @@ int xio_on_nexus_message_error(struct xio_session *session,
 	xio_connection_remove_msg_from_queue(task->connection, task->omsg);
 	xio_connection_queue_io_task(task->connection, task);
 
-	if (task->session->ses_ops.on_msg_error)
+	if (task->omsg->flags & XIO_MSG_FLAG_EX_MULTI)
+		xio_connection_multi_done(task->connection, task->omsg,
+					  event_data->msg_error.reason);
+	else if (task->session->ses_ops.on_msg_error)
 		task->session->ses_ops.on_msg_error(
 				task->session,
 				event_data->msg_error.reason,
@@ -1393,6 +1635,7 @@ struct xio_session *xio_session_create(struct xio_session_params *params)
 	session->rcv_queue_depth_msgs	= g_options.rcv_queue_depth_msgs;
 	session->snd_queue_depth_bytes	= g_options.snd_queue_depth_bytes;
 	session->rcv_queue_depth_bytes	= g_options.rcv_queue_depth_bytes;
+	session->portal_policy		= g_options.portal_policy;
 
 	memcpy(&session->ses_ops, params->ses_ops,
 	       sizeof(*params->ses_ops));
@@ -1412,7 +1655,7 @@ struct xio_session *xio_session_create(struct xio_session_params *params)
 			  session);
 		goto cleanup3;
 	}
-	xio_idr_add_uobj(usr_idr, session, "xio_session");
+	xio_idr_add_uobj(usr_idr, &session->idr_entry, "xio_session");
 
 	return session;
 
@@ -1434,7 +1677,6 @@ EXPORT_SYMBOL(xio_session_create);
 /*---------------------------------------------------------------------------*/
 int xio_session_destroy(struct xio_session *session)
 {
-	int found;
 	int i;
 
 
@@ -1448,10 +1690,7 @@ int xio_session_destroy(struct xio_session *session)
 		return -1;
 	}
 
-	found = xio_idr_lookup_uobj(usr_idr, session);
-	if (found) {
-		xio_idr_remove_uobj(usr_idr, session);
-	} else {
+	if (xio_idr_remove_uobj(usr_idr, &session->idr_entry)) {
 		ERROR_LOG("session not found:%p\n", session);
 		xio_set_error(XIO_E_USER_OBJ_NOT_FOUND);
 		return -1;
@@ -1469,6 +1708,7 @@ int xio_session_destroy(struct xio_session *session)
 		kfree(session->portals_array[i]);
 	kfree(session->services_array);
 	kfree(session->portals_array);
+	kfree(session->portals_load);
 	kfree(session->hs_private_data);
 	kfree(session->uri);
 	XIO_OBSERVER_DESTROY(&session->observer);
@@ -1514,6 +1754,8 @@ const char *xio_session_event_str(enum xio_session_event event)
 		return "connection error";
 	case XIO_SESSION_ERROR_EVENT:
 		return "session error";
+	case XIO_SESSION_CONNECTION_MIGRATED_EVENT:
+		return "connection migrated";
 	};
 	return "unknown session event";
 }
@@ -1596,6 +1838,19 @@ int xio_session_notify_cancel(struct xio_connection *connection,
 	return 0;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_session_connection_lost						     */
+/*---------------------------------------------------------------------------*/
+static inline int xio_session_connection_lost(struct xio_connection *connection)
+{
+	/* an orderly close by either side flushes, it never fails over */
+	if (connection->disconnecting)
+		return 0;
+
+	return connection->close_reason != XIO_E_SESSION_CLOSED &&
+	       connection->close_reason != XIO_E_SESSION_REJECTED;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_session_notify_msg_error						     */
 /*---------------------------------------------------------------------------*/
@@ -1603,6 +1858,20 @@ int xio_session_notify_msg_error(struct xio_connection *connection,
 				 struct xio_msg *msg, enum xio_status result,
 				 enum xio_msg_direction direction)
 {
+	if (direction == XIO_MSG_DIRECTION_OUT &&
+	    msg->flags & XIO_MSG_FLAG_EX_MULTI) {
+		xio_connection_multi_done(connection, msg, result);
+		return 0;
+	}
+	if (direction == XIO_MSG_DIRECTION_OUT &&
+	    msg->flags & XIO_MSG_FLAG_EX_SESSION_SEND) {
+		/* connection was lost - try one of its siblings */
+		if ((result == XIO_E_MSG_FLUSHED || result == XIO_ESHUTDOWN) &&
+		    xio_session_connection_lost(connection) &&
+		    !xio_session_failover_msg(connection, msg))
+			return 0;
+		msg->flags &= ~XIO_MSG_FLAG_EX_SESSION_SEND;
+	}
 	/* notify the upper layer */
 	if (connection->ses_ops.on_msg_error)
 		connection->ses_ops.on_msg_error(
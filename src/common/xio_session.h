@@ -61,6 +61,14 @@ enum xio_session_state {
 /*---------------------------------------------------------------------------*/
 /* structures				                                     */
 /*---------------------------------------------------------------------------*/
+#define XIO_PORTAL_IDX_NONE		0xffff
+
+/* load of the server thread behind a portal, as last reported */
+struct xio_portal_load {
+	uint16_t			inflight;
+	uint16_t			svc_us;
+};
+
 struct xio_session {
 	struct xio_transport_msg_validators_cls	*validators_cls;
 	struct xio_session_ops		ses_ops;
@@ -73,14 +81,14 @@ struct xio_session {
 	uint16_t			rcv_queue_depth_msgs;
 	uint16_t			peer_snd_queue_depth_msgs;
 	uint16_t			peer_rcv_queue_depth_msgs;
-	uint16_t			pad[2];
+	uint16_t			portal_policy;
+	uint16_t			last_selected;
 	uint64_t			snd_queue_depth_bytes;
 	uint64_t			rcv_queue_depth_bytes;
 	uint64_t			peer_snd_queue_depth_bytes;
 	uint64_t			peer_rcv_queue_depth_bytes;
 	struct list_head		sessions_list_entry;
 	struct list_head		connections_list;
-	HT_ENTRY(xio_session, xio_key_int32) sessions_htbl;
 
 	struct xio_msg			*setup_req;
 	struct xio_observer		observer;
@@ -92,6 +100,7 @@ struct xio_session {
 	char				*uri;
 	char				**portals_array;
 	char				**services_array;
+	struct xio_portal_load		*portals_load;
 
 	/*
 	 *  References a user-controlled data buffer. The contents of
@@ -120,6 +129,7 @@ struct xio_session {
 	int				disable_teardown;
 	struct xio_connection		*lead_connection;
 	struct xio_connection		*redir_connection;
+	struct xio_idr_entry		idr_entry;
 	xio_work_handle_t		teardown_work;
 
 };
@@ -131,6 +141,10 @@ void xio_session_write_header(
 		struct xio_task *task,
 		struct xio_session_hdr *hdr);
 
+void xio_session_write_trace(
+		struct xio_task *task,
+		struct xio_session_trace_hdr *trace);
+
 static inline uint64_t xio_session_get_sn(
 		struct xio_session *session)
 {
@@ -220,10 +234,18 @@ void xio_session_notify_connection_teardown(
 					struct xio_session *session,
 					struct xio_connection *connection);
 
+void xio_session_notify_connection_migrated(
+					struct xio_session *session,
+					struct xio_connection *connection,
+					enum xio_status reason);
+
 int xio_session_notify_msg_error(struct xio_connection *connection,
 				 struct xio_msg *msg, enum xio_status result,
 				 enum xio_msg_direction direction);
 
+int xio_session_failover_msg(struct xio_connection *connection,
+			     struct xio_msg *msg);
+
 void xio_session_notify_teardown(struct xio_session *session, int reason);
 
 void xio_session_notify_rejected(struct xio_session *session);
@@ -55,6 +55,7 @@
 #include "xio_context.h"
 #include "xio_nexus.h"
 #include "xio_session.h"
+#include "xio_sn_hash.h"
 #include "xio_connection.h"
 #include "xio_session_priv.h"
 #include <xio-advanced-env.h>
@@ -150,6 +151,132 @@ struct xio_msg *xio_session_write_setup_req(struct xio_session *session)
 	return msg;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_read_portals_load						     */
+/*---------------------------------------------------------------------------*/
+static int xio_read_portals_load(struct xio_session *session,
+				 uint8_t *ptr, uint8_t *end)
+{
+	uint16_t	nr = 0;
+	uint16_t	i, len;
+
+	session->portals_load = (struct xio_portal_load *)kcalloc(
+			session->portals_array_len,
+			sizeof(struct xio_portal_load), GFP_KERNEL);
+	if (session->portals_load == NULL) {
+		ERROR_LOG("allocation failed\n");
+		xio_set_error(ENOMEM);
+		return -1;
+	}
+
+	/* servers that do not report their load end the message here */
+	if (end - ptr < (long)sizeof(uint16_t))
+		return 0;
+	len = xio_read_uint16(&nr, 0, ptr);
+	ptr = ptr + len;
+	if (nr != session->portals_array_len ||
+	    end - ptr < (long)(nr * 2 * sizeof(uint16_t)))
+		return 0;
+
+	for (i = 0; i < nr; i++) {
+		len = xio_read_uint16(&session->portals_load[i].inflight,
+				      0, ptr);
+		ptr = ptr + len;
+		len = xio_read_uint16(&session->portals_load[i].svc_us,
+				      0, ptr);
+		ptr = ptr + len;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_portal_score						     */
+/*---------------------------------------------------------------------------*/
+static uint64_t xio_session_portal_score(struct xio_session *session,
+					 uint16_t idx)
+{
+	struct xio_portal_load	*load = &session->portals_load[idx];
+	struct xio_connection	*connection;
+	uint64_t		conns = 0, outstanding = 0;
+	uint64_t		rtt_us = 0, rtt_nr = 0, lat_us;
+
+	spin_lock(&session->connections_list_lock);
+	list_for_each_entry(connection, &session->connections_list,
+			    connections_list_entry) {
+		if (connection->portal_idx != idx)
+			continue;
+		conns++;
+		outstanding += connection->counters->reqs_outstanding;
+		if (connection->rtt_ewma_ns) {
+			rtt_us += connection->rtt_ewma_ns / 1000;
+			rtt_nr++;
+		}
+	}
+	spin_unlock(&session->connections_list_lock);
+
+	if (session->portal_policy == XIO_PORTAL_POLICY_LOWEST_LATENCY) {
+		/* prefer our own measurement over the server's report */
+		lat_us = rtt_nr ? rtt_us / rtt_nr : load->svc_us;
+		return (lat_us + 1) * (conns + 1);
+	}
+
+	return load->inflight + outstanding + conns;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_pick_portal						     */
+/*---------------------------------------------------------------------------*/
+static uint16_t xio_session_pick_portal(struct xio_session *session)
+{
+	uint64_t	score, best_score = 0;
+	uint16_t	i, idx, best = 0;
+
+	if (session->portal_policy == XIO_PORTAL_POLICY_ROUND_ROBIN ||
+	    session->portals_load == NULL) {
+		best = session->last_opened_portal++;
+		if (session->last_opened_portal ==
+		    session->portals_array_len)
+			session->last_opened_portal = 0;
+		return best;
+	}
+
+	/* scan from the last pick on, so ties keep rotating */
+	for (i = 0; i < session->portals_array_len; i++) {
+		idx = (session->last_opened_portal + i) %
+		      session->portals_array_len;
+		score = xio_session_portal_score(session, idx);
+		if (i == 0 || score < best_score) {
+			best_score = score;
+			best = idx;
+		}
+	}
+	session->last_opened_portal = (best + 1) %
+				      session->portals_array_len;
+
+	return best;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_update_portal_load					     */
+/*---------------------------------------------------------------------------*/
+void xio_session_update_portal_load(struct xio_connection *connection,
+				    uint16_t inflight, uint16_t svc_us)
+{
+	struct xio_session *session = connection->session;
+
+	connection->peer_inflight = inflight;
+	connection->peer_svc_us	  = svc_us;
+
+	if (session->portals_load &&
+	    connection->portal_idx < session->portals_array_len) {
+		session->portals_load[connection->portal_idx].inflight =
+								inflight;
+		session->portals_load[connection->portal_idx].svc_us =
+								svc_us;
+	}
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_session_accept_connections					     */
 /*---------------------------------------------------------------------------*/
@@ -158,23 +285,19 @@ int xio_session_accept_connections(struct xio_session *session)
 	struct xio_connection	*connection, *tmp_connection;
 	struct xio_nexus	*nexus;
 	int			retval = 0;
+	uint16_t		pid;
 	char			*portal;
 
 	list_for_each_entry_safe(connection, tmp_connection,
 				 &session->connections_list,
 				 connections_list_entry) {
 		if (connection->nexus == NULL) {
-			if (connection->conn_idx == 0) {
-				portal = session->portals_array[
-						session->last_opened_portal++];
-				if (session->last_opened_portal ==
-				    session->portals_array_len)
-					session->last_opened_portal = 0;
-			} else {
-				int pid = (connection->conn_idx %
-					   session->portals_array_len);
-				portal = session->portals_array[pid];
-			}
+			if (connection->conn_idx == 0)
+				pid = xio_session_pick_portal(session);
+			else
+				pid = (connection->conn_idx %
+				       session->portals_array_len);
+			portal = session->portals_array[pid];
 			nexus = xio_nexus_open(connection->ctx, portal,
 					       &session->observer,
 					       session->session_id,
@@ -193,6 +316,7 @@ int xio_session_accept_connections(struct xio_session *session)
 				retval = -1;
 				break;
 			}
+			connection->portal_idx = pid;
 			DEBUG_LOG("reconnecting to %s. connection:%p, " \
 				  "nexus:%p\n",
 				  portal, connection, nexus);
@@ -390,6 +514,12 @@ int xio_read_setup_rsp(struct xio_connection *connection,
 		} else {
 			rsp->private_data = NULL;
 		}
+
+		if (session->portals_array_len &&
+		    xio_read_portals_load(session, ptr,
+					  (uint8_t *)msg->in.header.iov_base +
+					  msg->in.header.iov_len))
+			return -1;
 		break;
 	case XIO_ACTION_REDIRECT:
 		len = xio_read_uint16(&session->services_array_len, 0, ptr);
@@ -569,7 +699,8 @@ int xio_on_setup_rsp_recv(struct xio_connection *connection,
 					XIO_CONNECTION_STATE_ONLINE;
 
 			/* temporary account it as user object */
-			xio_idr_add_uobj(usr_idr, session->lead_connection,
+			xio_idr_add_uobj(usr_idr,
+					 &session->lead_connection->idr_entry,
 					 "xio_connection");
 			xio_disconnect_initial_connection(
 						session->lead_connection);
@@ -829,6 +960,11 @@ int xio_client_on_nexus_event(void *observer, void *sender, int event,
 			 " session:%p, nexus:%p\n", observer, sender);
 		xio_on_nexus_reconnected(session, nexus);
 		break;
+	case XIO_NEXUS_EVENT_RECONNECTING:
+		DEBUG_LOG("session: [notification] - connection reconnecting" \
+			 " session:%p, nexus:%p\n", observer, sender);
+		xio_on_nexus_reconnecting(session, nexus);
+		break;
 	case XIO_NEXUS_EVENT_CLOSED:
 		DEBUG_LOG("session: [notification] - nexus closed. " \
 			 "session:%p, nexus:%p\n", observer, sender);
@@ -966,7 +1102,8 @@ struct xio_connection *xio_connect(struct xio_connection_params *cparams)
 				cparams->conn_user_context);
 		if (session->state == XIO_SESSION_STATE_REFUSED ||
 		    session->state == XIO_SESSION_STATE_REJECTED) {
-			xio_idr_add_uobj(usr_idr, connection, "xio_connection");
+			xio_idr_add_uobj(usr_idr, &connection->idr_entry,
+					 "xio_connection");
 			mutex_unlock(&session->lock);
 			retval = xio_ctx_add_work(
 					connection->ctx,
@@ -988,16 +1125,13 @@ struct xio_connection *xio_connect(struct xio_connection_params *cparams)
 		   session->state == XIO_SESSION_STATE_ACCEPTED) {
 		struct xio_nexus *nexus;
 		char *portal;
-		if (cparams->conn_idx == 0) {
-			portal = session->portals_array[
-					session->last_opened_portal++];
-			if (session->last_opened_portal ==
-			    session->portals_array_len)
-					session->last_opened_portal = 0;
-		} else {
-			int pid = (cparams->conn_idx % session->portals_array_len);
-			portal = session->portals_array[pid];
-		}
+		uint16_t pid;
+
+		if (cparams->conn_idx == 0)
+			pid = xio_session_pick_portal(session);
+		else
+			pid = (cparams->conn_idx % session->portals_array_len);
+		portal = session->portals_array[pid];
 		connection  = xio_session_alloc_connection(
 				session, ctx,
 				cparams->conn_idx,
@@ -1016,6 +1150,7 @@ struct xio_connection *xio_connect(struct xio_connection_params *cparams)
 				  nexus, tmp_connection, connection);
 			goto cleanup;
 		}
+		connection->portal_idx = pid;
 		retval = xio_nexus_connect(nexus, portal,
 					   &session->observer,
 					   cparams->out_addr);
@@ -1031,7 +1166,7 @@ struct xio_connection *xio_connect(struct xio_connection_params *cparams)
 	}
 
 
-	xio_idr_add_uobj(usr_idr, connection, "xio_connection");
+	xio_idr_add_uobj(usr_idr, &connection->idr_entry, "xio_connection");
 
 	if (cparams->enable_tos) {
 		connection->nexus_attr_mask = attr_mask;
@@ -1061,3 +1196,171 @@ cleanup2:
 }
 EXPORT_SYMBOL(xio_connect);
 
+/*---------------------------------------------------------------------------*/
+/* xio_session_is_selectable						     */
+/*---------------------------------------------------------------------------*/
+static inline int xio_session_is_selectable(struct xio_connection *connection)
+{
+	return connection->state == XIO_CONNECTION_STATE_ONLINE &&
+	       !connection->disconnecting &&
+	       !atomic_read(&connection->reconnecting);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_hash_weight						     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_session_hash_weight(uint64_t key,
+					       struct xio_connection *conn)
+{
+	/* splitmix64 finalizer over key and connection */
+	uint64_t x = key ^ ((uint64_t)(uintptr_t)conn * 0x9e3779b97f4a7c15ULL);
+
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+
+	return x ^ (x >> 31);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_pick_connection						     */
+/*---------------------------------------------------------------------------*/
+static struct xio_connection *xio_session_pick_connection(
+		struct xio_session *session, const uint64_t *key)
+{
+	struct xio_connection	*connection, *best = NULL;
+	uint64_t		score, best_score = 0, lat_ns;
+	uint16_t		nr = 0, target = 0;
+
+	spin_lock(&session->connections_list_lock);
+	if (key) {
+		/* rendezvous hashing - a key keeps its connection as long
+		 * as that connection stays up
+		 */
+		list_for_each_entry(connection, &session->connections_list,
+				    connections_list_entry) {
+			if (!xio_session_is_selectable(connection))
+				continue;
+			score = xio_session_hash_weight(*key, connection);
+			if (!best || score > best_score) {
+				best = connection;
+				best_score = score;
+			}
+		}
+		goto exit;
+	}
+	if (session->portal_policy == XIO_PORTAL_POLICY_ROUND_ROBIN) {
+		list_for_each_entry(connection, &session->connections_list,
+				    connections_list_entry) {
+			if (xio_session_is_selectable(connection))
+				nr++;
+		}
+		if (nr)
+			target = session->last_selected++ % nr;
+		nr = 0;
+	}
+	list_for_each_entry(connection, &session->connections_list,
+			    connections_list_entry) {
+		if (!xio_session_is_selectable(connection))
+			continue;
+
+		switch (session->portal_policy) {
+		case XIO_PORTAL_POLICY_LEAST_OUTSTANDING:
+			score = connection->counters->reqs_outstanding +
+				connection->peer_inflight;
+			break;
+		case XIO_PORTAL_POLICY_LOWEST_LATENCY:
+			/* expected completion of one more request */
+			lat_ns = connection->rtt_ewma_ns ?
+				 connection->rtt_ewma_ns :
+				 connection->peer_svc_us * 1000ULL;
+			score = (lat_ns + 1) *
+				(connection->counters->reqs_outstanding + 1);
+			break;
+		default:
+			score = (nr++ == target) ? 0 : 1;
+			break;
+		}
+		if (!best || score < best_score) {
+			best = connection;
+			best_score = score;
+		}
+	}
+exit:
+	spin_unlock(&session->connections_list_lock);
+
+	if (!best)
+		xio_set_error(ENOTCONN);
+
+	return best;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_select_connection					     */
+/*---------------------------------------------------------------------------*/
+struct xio_connection *xio_session_select_connection(
+		struct xio_session *session)
+{
+	if (!session) {
+		xio_set_error(EINVAL);
+		return NULL;
+	}
+
+	return xio_session_pick_connection(session, NULL);
+}
+EXPORT_SYMBOL(xio_session_select_connection);
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_send_request						     */
+/*---------------------------------------------------------------------------*/
+int xio_session_send_request(struct xio_session *session,
+			     struct xio_context *ctx,
+			     struct xio_msg *msg,
+			     const uint64_t *key)
+{
+	struct xio_connection	*connection;
+	int			retval;
+
+	if (!session || !msg || msg->next) {
+		xio_set_error(EINVAL);
+		return -1;
+	}
+
+	connection = xio_session_pick_connection(session, key);
+	if (!connection)
+		return -1;
+
+	msg->flags |= XIO_MSG_FLAG_EX_SESSION_SEND;
+	if (connection->ctx == ctx)
+		retval = xio_send_request(connection, msg);
+	else
+		retval = xio_post_msg(connection, XIO_POST_SEND_REQUEST, msg);
+	if (retval)
+		msg->flags &= ~XIO_MSG_FLAG_EX_SESSION_SEND;
+
+	return retval;
+}
+EXPORT_SYMBOL(xio_session_send_request);
+
+/*---------------------------------------------------------------------------*/
+/* xio_session_failover_msg						     */
+/*---------------------------------------------------------------------------*/
+int xio_session_failover_msg(struct xio_connection *connection,
+			     struct xio_msg *msg)
+{
+	struct xio_connection	*target;
+
+	target = xio_session_pick_connection(connection->session, NULL);
+	if (!target || target == connection)
+		return -1;
+
+	DEBUG_LOG("session:%p - request sn:%llu moved from connection:%p " \
+		  "to connection:%p\n", connection->session, msg->sn,
+		  connection, target);
+
+	/* runs on connection's context */
+	if (target->ctx == connection->ctx)
+		return xio_send_request(target, msg);
+
+	return xio_post_msg(target, XIO_POST_SEND_REQUEST, msg);
+}
+
@@ -118,6 +118,12 @@ int xio_on_nexus_message_error(struct xio_session *session,
 void xio_session_read_header(struct xio_task *task,
 			     struct xio_session_hdr *hdr);
 
+/*---------------------------------------------------------------------------*/
+/* xio_session_read_trace						     */
+/*---------------------------------------------------------------------------*/
+void xio_session_read_trace(struct xio_task *task,
+			    struct xio_session_trace_hdr *trace);
+
 /*---------------------------------------------------------------------------*/
 /* xio_session_notify_teardown						     */
 /*---------------------------------------------------------------------------*/
@@ -221,6 +227,12 @@ int xio_read_setup_rsp(struct xio_connection *connection,
 int xio_on_setup_rsp_recv(struct xio_connection *connection,
 			  struct xio_task *task);
 
+/*---------------------------------------------------------------------------*/
+/* xio_session_update_portal_load					     */
+/*---------------------------------------------------------------------------*/
+void xio_session_update_portal_load(struct xio_connection *connection,
+				    uint16_t inflight, uint16_t svc_us);
+
 
 /*---------------------------------------------------------------------------*/
 /* xio_on_fin_rsp_recv				                             */
@@ -278,4 +290,7 @@ static inline void xio_connection_set_nexus(struct xio_connection *connection,
 int xio_on_nexus_reconnected(struct xio_session *session,
 			     struct xio_nexus *nexus);
 
+int xio_on_nexus_reconnecting(struct xio_session *session,
+			      struct xio_nexus *nexus);
+
 #endif /* XIO_SESSION_PRIV_H */
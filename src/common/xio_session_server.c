@@ -53,8 +53,10 @@
 #include "xio_context.h"
 #include "xio_nexus.h"
 #include "xio_session.h"
+#include "xio_sn_hash.h"
 #include "xio_connection.h"
 #include "xio_session_priv.h"
+#include "xio_server.h"
 #include <xio-advanced-env.h>
 
 /*---------------------------------------------------------------------------*/
@@ -210,6 +212,7 @@ struct xio_msg *xio_session_write_accept_rsp(struct xio_session *session,
 	uint8_t			*buf;
 	uint8_t			*ptr;
 	uint16_t		len, i, str_len, tot_len;
+	uint16_t		inflight, svc_us;
 
 
 	/* calculate length */
@@ -217,6 +220,9 @@ struct xio_msg *xio_session_write_accept_rsp(struct xio_session *session,
 	for (i = 0; i < portals_array_len; i++)
 		tot_len += strlen(portals_array[i]) + sizeof(uint16_t);
 	tot_len += user_context_len;
+	if (action == XIO_ACTION_ACCEPT && portals_array_len)
+		tot_len += sizeof(uint16_t) +
+			   portals_array_len * 2 * sizeof(uint16_t);
 
 	if (tot_len > SETUP_BUFFER_LEN)  {
 		ERROR_LOG("buffer is too small\n");
@@ -297,6 +303,25 @@ struct xio_msg *xio_session_write_accept_rsp(struct xio_session *session,
 		ptr  = ptr + len;
 	}
 
+	/* load of the server threads behind the portals, appended so that
+	 * older clients just ignore it. unknown portals report no load
+	 */
+	if (action == XIO_ACTION_ACCEPT && portals_array_len) {
+		len = xio_write_uint16(portals_array_len, 0, ptr);
+		ptr  = ptr + len;
+		for (i = 0; i < portals_array_len; i++) {
+			if (xio_server_portal_load(portals_array[i],
+						   &inflight, &svc_us)) {
+				inflight = 0;
+				svc_us	 = 0;
+			}
+			len = xio_write_uint16(inflight, 0, ptr);
+			ptr  = ptr + len;
+			len = xio_write_uint16(svc_us, 0, ptr);
+			ptr  = ptr + len;
+		}
+	}
+
 	msg->out.header.iov_len = ptr - (uint8_t *)msg->out.header.iov_base;
 
 	if (msg->out.header.iov_len != tot_len) {
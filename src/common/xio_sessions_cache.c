@@ -48,29 +48,19 @@
 #include "xio_task.h"
 #include "xio_workqueue.h"
 #include "xio_session.h"
+#include "xio_sn_hash.h"
 #include "xio_sessions_cache.h"
 
-static HT_HEAD(, xio_session, HASHTABLE_PRIME_SMALL)  sessions_cache;
-static spinlock_t ss_lock;
-
-/*---------------------------------------------------------------------------*/
-/* sessions_cache_add							     */
-/*---------------------------------------------------------------------------*/
-static int sessions_cache_add(struct xio_session *session,
-			      uint32_t session_id)
-{
-	struct xio_session *s;
-	struct xio_key_int32  key = {
-		session_id
-	};
-	HT_LOOKUP(&sessions_cache, &key, s, sessions_htbl);
-	if (s != NULL)
-		return -1;
+/* session ids are handed out sequentially so the low bits spread them
+ * evenly over the shards. each shard has its own lock and table, so
+ * setup and teardown on different threads rarely meet on a lock
+ */
+#define XIO_SESSIONS_CACHE_SHARDS	64
+#define ss_shard(id)	((id) & (XIO_SESSIONS_CACHE_SHARDS - 1))
 
-	HT_INSERT(&sessions_cache, &key, session, sessions_htbl);
-
-	return 0;
-}
+static struct xio_sn_hash sessions_cache[XIO_SESSIONS_CACHE_SHARDS];
+static spinlock_t ss_lock[XIO_SESSIONS_CACHE_SHARDS];
+static uint32_t sid;  /* = 0 global session provider */
 
 /*---------------------------------------------------------------------------*/
 /* xio_sessions_cache_remove				                     */
@@ -78,20 +68,14 @@ static int sessions_cache_add(struct xio_session *session,
 int xio_sessions_cache_remove(uint32_t session_id)
 {
 	struct xio_session *s;
-	struct xio_key_int32  key;
-
-	spin_lock(&ss_lock);
-	key.id = session_id;
-	HT_LOOKUP(&sessions_cache, &key, s, sessions_htbl);
-	if (s == NULL) {
-		spin_unlock(&ss_lock);
-		return -1;
-	}
+	uint32_t shard = ss_shard(session_id);
 
-	HT_REMOVE(&sessions_cache, s, xio_session, sessions_htbl);
-	spin_unlock(&ss_lock);
+	spin_lock(&ss_lock[shard]);
+	s = (struct xio_session *)xio_sn_hash_remove(&sessions_cache[shard],
+						     session_id);
+	spin_unlock(&ss_lock[shard]);
 
-	return 0;
+	return s ? 0 : -1;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -100,12 +84,12 @@ int xio_sessions_cache_remove(uint32_t session_id)
 struct xio_session *xio_sessions_cache_lookup(uint32_t session_id)
 {
 	struct xio_session *s;
-	struct xio_key_int32  key;
+	uint32_t shard = ss_shard(session_id);
 
-	spin_lock(&ss_lock);
-	key.id = session_id;
-	HT_LOOKUP(&sessions_cache, &key, s, sessions_htbl);
-	spin_unlock(&ss_lock);
+	spin_lock(&ss_lock[shard]);
+	s = (struct xio_session *)xio_sn_hash_lookup(&sessions_cache[shard],
+						     session_id);
+	spin_unlock(&ss_lock[shard]);
 
 	return s;
 }
@@ -116,14 +100,20 @@ struct xio_session *xio_sessions_cache_lookup(uint32_t session_id)
 int xio_sessions_cache_add(struct xio_session *session,
 			   uint32_t *session_id)
 {
-	static uint32_t sid;  /* = 0 global session provider */
-	int retval;
+	uint32_t id = xio_sync_fetch_and_add32(&sid, 1);
+	uint32_t shard = ss_shard(id);
+	int retval = -1;
 
-	spin_lock(&ss_lock);
-	retval = sessions_cache_add(session, sid);
+	if (xio_sn_hash_reserve(&sessions_cache[shard], &ss_lock[shard]))
+		return -1;
+
+	spin_lock(&ss_lock[shard]);
+	if (!xio_sn_hash_lookup(&sessions_cache[shard], id))
+		retval = xio_sn_hash_insert_reserved(&sessions_cache[shard],
+						     id, session);
+	spin_unlock(&ss_lock[shard]);
 	if (retval == 0)
-		*session_id = sid++;
-	spin_unlock(&ss_lock);
+		*session_id = id;
 
 	return retval;
 }
@@ -133,12 +123,21 @@ int xio_sessions_cache_add(struct xio_session *session,
 /*---------------------------------------------------------------------------*/
 void sessions_cache_construct(void)
 {
-	HT_INIT(&sessions_cache, xio_int32_hash, xio_int32_cmp, xio_int32_cp);
-	spin_lock_init(&ss_lock);
+	int i;
+
+	for (i = 0; i < XIO_SESSIONS_CACHE_SHARDS; i++) {
+		xio_sn_hash_init(&sessions_cache[i]);
+		spin_lock_init(&ss_lock[i]);
+	}
 }
 
-/*
+/*---------------------------------------------------------------------------*/
+/* sessions_cache_destruct				                     */
+/*---------------------------------------------------------------------------*/
 void sessions_cache_destruct(void)
 {
+	int i;
+
+	for (i = 0; i < XIO_SESSIONS_CACHE_SHARDS; i++)
+		xio_sn_hash_destroy(&sessions_cache[i]);
 }
-*/
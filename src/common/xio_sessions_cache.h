@@ -49,6 +49,11 @@ struct xio_session;
 /*---------------------------------------------------------------------------*/
 void sessions_cache_construct(void);
 
+/*---------------------------------------------------------------------------*/
+/* sessions_cache_destruct				                     */
+/*---------------------------------------------------------------------------*/
+void sessions_cache_destruct(void);
+
 int xio_sessions_cache_add(struct xio_session *session, uint32_t *session_id);
 
 int xio_sessions_cache_remove(uint32_t session_id);
@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_hash.h"
+#include "xio_sn_hash.h"
+
+#define XIO_SN_HASH_INIT_SIZE	64
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_slot							     */
+/*---------------------------------------------------------------------------*/
+static inline uint32_t xio_sn_hash_slot(struct xio_sn_hash *hash,
+					uint64_t key)
+{
+	return int64_hash(key) & (hash->size - 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_find_slot						     */
+/*---------------------------------------------------------------------------*/
+static struct xio_sn_hash_entry *xio_sn_hash_find_slot(
+		struct xio_sn_hash *hash, uint64_t key)
+{
+	uint32_t mask = hash->size - 1;
+	uint32_t i = xio_sn_hash_slot(hash, key);
+
+	/* the table is never full so the probe always terminates */
+	while (hash->tbl[i].val) {
+		if (hash->tbl[i].key == key)
+			return &hash->tbl[i];
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_grow_size						     */
+/*---------------------------------------------------------------------------*/
+static inline uint32_t xio_sn_hash_grow_size(struct xio_sn_hash *hash)
+{
+	if (unlikely(!hash->tbl))
+		return XIO_SN_HASH_INIT_SIZE;
+
+	/* keep the load factor below 3/4 */
+	if (unlikely((hash->nr + 1) * 4 > hash->size * 3))
+		return hash->size * 2;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_rehash							     */
+/*---------------------------------------------------------------------------*/
+static struct xio_sn_hash_entry *xio_sn_hash_rehash(
+		struct xio_sn_hash *hash,
+		struct xio_sn_hash_entry *tbl, uint32_t size)
+{
+	struct xio_sn_hash_entry *old_tbl = hash->tbl;
+	uint32_t old_size = hash->size;
+	uint32_t i, j;
+
+	hash->tbl = tbl;
+	hash->size = size;
+
+	for (i = 0; i < old_size; i++) {
+		if (!old_tbl[i].val)
+			continue;
+		j = xio_sn_hash_slot(hash, old_tbl[i].key);
+		while (hash->tbl[j].val)
+			j = (j + 1) & (size - 1);
+		hash->tbl[j] = old_tbl[i];
+	}
+
+	return old_tbl;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_resize							     */
+/*---------------------------------------------------------------------------*/
+static int xio_sn_hash_resize(struct xio_sn_hash *hash, uint32_t size)
+{
+	struct xio_sn_hash_entry *tbl;
+
+	tbl = (struct xio_sn_hash_entry *)
+			kcalloc(size, sizeof(*tbl), GFP_KERNEL);
+	if (!tbl) {
+		xio_set_error(ENOMEM);
+		return -1;
+	}
+	kfree(xio_sn_hash_rehash(hash, tbl, size));
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_add							     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_sn_hash_add(struct xio_sn_hash *hash, uint64_t key,
+				   void *val)
+{
+	uint32_t i = xio_sn_hash_slot(hash, key);
+
+	while (hash->tbl[i].val)
+		i = (i + 1) & (hash->size - 1);
+
+	hash->tbl[i].key = key;
+	hash->tbl[i].val = val;
+	hash->nr++;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_insert							     */
+/*---------------------------------------------------------------------------*/
+int xio_sn_hash_insert(struct xio_sn_hash *hash, uint64_t key, void *val)
+{
+	struct xio_sn_hash_entry *entry;
+	uint32_t size;
+
+	if (likely(hash->tbl)) {
+		entry = xio_sn_hash_find_slot(hash, key);
+		if (entry) {
+			entry->val = val;
+			return 0;
+		}
+	}
+
+	size = xio_sn_hash_grow_size(hash);
+	if (unlikely(size) && xio_sn_hash_resize(hash, size) &&
+	    (!hash->tbl || hash->nr + 1 >= hash->size)) {
+		ERROR_LOG("sn hash is full. nr:%u\n", hash->nr);
+		return -1;
+	}
+	xio_sn_hash_add(hash, key, val);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_reserve							     */
+/*---------------------------------------------------------------------------*/
+int xio_sn_hash_reserve(struct xio_sn_hash *hash, spinlock_t *lock)
+{
+	struct xio_sn_hash_entry *tbl;
+	uint32_t size;
+
+	while (1) {
+		spin_lock(lock);
+		size = xio_sn_hash_grow_size(hash);
+		spin_unlock(lock);
+		if (likely(!size))
+			return 0;
+
+		/* allocate unlocked - the kernel allocation may sleep */
+		tbl = (struct xio_sn_hash_entry *)
+				kcalloc(size, sizeof(*tbl), GFP_KERNEL);
+		if (!tbl) {
+			xio_set_error(ENOMEM);
+			ERROR_LOG("sn hash grow failed. size:%u\n", size);
+			return -1;
+		}
+
+		/* install it unless another thread grew the table first */
+		spin_lock(lock);
+		if (xio_sn_hash_grow_size(hash) == size)
+			tbl = xio_sn_hash_rehash(hash, tbl, size);
+		spin_unlock(lock);
+		kfree(tbl);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_insert_reserved						     */
+/*---------------------------------------------------------------------------*/
+int xio_sn_hash_insert_reserved(struct xio_sn_hash *hash, uint64_t key,
+				void *val)
+{
+	struct xio_sn_hash_entry *entry;
+
+	if (unlikely(!hash->tbl)) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+	entry = xio_sn_hash_find_slot(hash, key);
+	if (entry) {
+		entry->val = val;
+		return 0;
+	}
+	/* concurrent inserts may have taken the room that was reserved.
+	 * the load factor may pass 3/4 but the table must never fill up
+	 */
+	if (unlikely(hash->nr + 1 >= hash->size)) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+	xio_sn_hash_add(hash, key, val);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_lookup							     */
+/*---------------------------------------------------------------------------*/
+void *xio_sn_hash_lookup(struct xio_sn_hash *hash, uint64_t key)
+{
+	struct xio_sn_hash_entry *entry;
+
+	if (!hash->nr)
+		return NULL;
+
+	entry = xio_sn_hash_find_slot(hash, key);
+
+	return entry ? entry->val : NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_remove							     */
+/*---------------------------------------------------------------------------*/
+void *xio_sn_hash_remove(struct xio_sn_hash *hash, uint64_t key)
+{
+	struct xio_sn_hash_entry *entry;
+	uint32_t mask = hash->size - 1;
+	uint32_t i, j, k;
+	void *val;
+
+	if (!hash->nr)
+		return NULL;
+
+	entry = xio_sn_hash_find_slot(hash, key);
+	if (!entry)
+		return NULL;
+
+	val = entry->val;
+	hash->nr--;
+
+	/* backward shift deletion - no tombstones are left behind */
+	i = entry - hash->tbl;
+	j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (!hash->tbl[j].val)
+			break;
+		k = xio_sn_hash_slot(hash, hash->tbl[j].key);
+		/* entry at j stays if its home slot is cyclically in (i, j] */
+		if ((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		hash->tbl[i] = hash->tbl[j];
+		i = j;
+	}
+	hash->tbl[i].val = NULL;
+
+	return val;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_destroy							     */
+/*---------------------------------------------------------------------------*/
+void xio_sn_hash_destroy(struct xio_sn_hash *hash)
+{
+	kfree(hash->tbl);
+	memset(hash, 0, sizeof(*hash));
+}
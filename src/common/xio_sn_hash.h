@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_SN_HASH_H
+#define XIO_SN_HASH_H
+
+/*---------------------------------------------------------------------------*/
+/* open addressing hash table keyed by 64 bit serial number		     */
+/*---------------------------------------------------------------------------*/
+struct xio_sn_hash_entry {
+	uint64_t		key;
+	void			*val;	/* NULL - free slot */
+};
+
+struct xio_sn_hash {
+	struct xio_sn_hash_entry	*tbl;	/* allocated on first insert */
+	uint32_t			size;	/* power of two */
+	uint32_t			nr;	/* used entries */
+};
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_init							     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_sn_hash_init(struct xio_sn_hash *hash)
+{
+	memset(hash, 0, sizeof(*hash));
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_destroy							     */
+/*---------------------------------------------------------------------------*/
+void xio_sn_hash_destroy(struct xio_sn_hash *hash);
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_insert							     */
+/*---------------------------------------------------------------------------*/
+int xio_sn_hash_insert(struct xio_sn_hash *hash, uint64_t key, void *val);
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_reserve							     */
+/*---------------------------------------------------------------------------*/
+/* make room for one more entry in a hash protected by lock. the lock is
+ * taken internally and dropped while allocating, so call it before taking
+ * the lock for xio_sn_hash_insert_reserved
+ */
+int xio_sn_hash_reserve(struct xio_sn_hash *hash, spinlock_t *lock);
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_insert_reserved						     */
+/*---------------------------------------------------------------------------*/
+/* insert under the lock without allocating. fails with EAGAIN if other
+ * inserts took the reserved room meanwhile
+ */
+int xio_sn_hash_insert_reserved(struct xio_sn_hash *hash, uint64_t key,
+				void *val);
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_lookup							     */
+/*---------------------------------------------------------------------------*/
+void *xio_sn_hash_lookup(struct xio_sn_hash *hash, uint64_t key);
+
+/*---------------------------------------------------------------------------*/
+/* xio_sn_hash_remove							     */
+/*---------------------------------------------------------------------------*/
+void *xio_sn_hash_remove(struct xio_sn_hash *hash, uint64_t key);
+
+#endif /* XIO_SN_HASH_H */
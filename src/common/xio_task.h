@@ -38,6 +38,8 @@
 #ifndef XIO_TASK_H
 #define XIO_TASK_H
 
+#include "xio_msg_trace.h"
+#include "xio_ev_trace.h"
 
 enum xio_task_state {
 	XIO_TASK_STATE_INIT,
@@ -76,7 +78,7 @@ struct xio_task {
 	uint16_t                ltid;           /* local task id        */
 	uint16_t                rtid;           /* remote task id       */
 	uint16_t                last_in_rxq;
-	uint16_t                pad;
+	uint16_t                traced;		/* see xio_msg_trace.h	*/
 	uint32_t                magic;
 	int32_t                 status;
 
@@ -84,6 +86,7 @@ struct xio_task {
 						/* receipt */
 	struct xio_msg		*omsg;		/* pointer from user */
 	struct xio_msg		imsg;		/* message to the user */
+	uint64_t		trace[XIO_TRACE_STAMPS];
 };
 
 struct xio_tasks_pool_hooks {
@@ -128,6 +131,8 @@ struct xio_tasks_pool_params {
 	int				pool_dd_data_sz;
 	int				slab_dd_data_sz;
 	int				task_dd_data_sz;
+	int				node_id; /* numa node, -1 any */
+	int				pad;
 };
 
 struct xio_tasks_slab {
@@ -153,6 +158,7 @@ struct xio_tasks_pool {
 	unsigned int			pad;
 	struct list_head		slabs_list;
 	void				*dd_data;
+	void				*ev_trace;	/* owner context's */
 };
 
 /*---------------------------------------------------------------------------*/
@@ -194,6 +200,8 @@ static inline void xio_task_release(struct kref *kref)
 
 	pool = (struct xio_tasks_pool *)task->pool;
 
+	xio_ev_trace(pool->ev_trace, XIO_EV_TASK_PUT, pool, task->ltid, 0, 0);
+
 	xio_task_reset(task);
 
 	if (pool->params.pool_hooks.task_pre_put)
@@ -253,6 +261,8 @@ static inline struct xio_task *xio_tasks_pool_get(struct xio_tasks_pool *q)
 		q->params.pool_hooks.task_post_get(
 				q->params.pool_hooks.context, t);
 
+	xio_ev_trace(q->ev_trace, XIO_EV_TASK_GET, q, t->ltid, 0, 0);
+
 	return t;
 }
 
@@ -264,6 +274,17 @@ static inline void xio_tasks_pool_put(struct xio_task *task)
 	kref_put(&task->kref, xio_task_release);
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tasks_pool_put_bulk						     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_tasks_pool_put_bulk(struct xio_task **tasks, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		kref_put(&tasks[i]->kref, xio_task_release);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tasks_pool_free_tasks						     */
 /*---------------------------------------------------------------------------*/
@@ -265,6 +265,15 @@ struct xio_transport {
 			 struct xio_transport_attr *attr,
 			 int attr_mask);
 
+	/* connection migration: detach runs on the current context and
+	 * fails with EAGAIN unless the handle is idle, attach runs on the
+	 * new one
+	 */
+	int	(*detach)(struct xio_transport_base *trans_hndl);
+
+	int	(*attach)(struct xio_transport_base *trans_hndl,
+			  struct xio_context *ctx);
+
 	struct list_head transports_list_entry;
 };
 
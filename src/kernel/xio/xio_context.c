@@ -55,7 +55,9 @@
 #include "xio_ev_loop.h"
 #include "xio_workqueue.h"
 #include "xio_context.h"
+#include "xio_ev_trace.h"
 #include "xio_mempool.h"
+#include "xio_context_priv.h"
 
 /*---------------------------------------------------------------------------*/
 /* xio_context_reg_observer						     */
@@ -174,6 +176,7 @@ struct xio_context *xio_context_create(unsigned int flags,
 		goto cleanup3;
 
 	ctx->stats.hertz = HZ;
+	ctx->stats.counter = ctx->stats.counter_priv;
 	/* Initialize default counters' name */
 	ctx->stats.name[XIO_STAT_TX_MSG]   = kstrdup("TX_MSG", GFP_KERNEL);
 	ctx->stats.name[XIO_STAT_RX_MSG]   = kstrdup("RX_MSG", GFP_KERNEL);
@@ -182,7 +185,7 @@ struct xio_context *xio_context_create(unsigned int flags,
 	ctx->stats.name[XIO_STAT_DELAY]    = kstrdup("DELAY", GFP_KERNEL);
 	ctx->stats.name[XIO_STAT_APPDELAY] = kstrdup("APPDELAY", GFP_KERNEL);
 
-	xio_idr_add_uobj(usr_idr, ctx, "xio_context");
+	xio_idr_add_uobj(usr_idr, &ctx->idr_entry, "xio_context");
 	return ctx;
 
 cleanup3:
@@ -248,12 +251,8 @@ EXPORT_SYMBOL(xio_query_context);
 void xio_context_destroy(struct xio_context *ctx)
 {
 	int i;
-	int found;
 
-	found = xio_idr_lookup_uobj(usr_idr, ctx);
-	if (found) {
-		xio_idr_remove_uobj(usr_idr, ctx);
-	} else {
+	if (xio_idr_remove_uobj(usr_idr, &ctx->idr_entry)) {
 		ERROR_LOG("context not found:%p\n", ctx);
 		xio_set_error(XIO_E_USER_OBJ_NOT_FOUND);
 		return;
@@ -429,6 +428,34 @@ int xio_ctx_del_work(struct xio_context *ctx,
 	return retval;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_init_event							     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_init_event(xio_ctx_event_t *evt,
+			void (*event_handler)(void *data),
+			void *data)
+{
+	memset(evt, 0, sizeof(*evt));
+	evt->handler = event_handler;
+	evt->data = data;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_add_event							     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_add_event(struct xio_context *ctx, xio_ctx_event_t *evt)
+{
+	xio_context_add_event(ctx, evt);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_remove_event							     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_remove_event(struct xio_context *ctx, xio_ctx_event_t *evt)
+{
+	xio_context_disable_event(evt);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_mempool_get							     */
 /*---------------------------------------------------------------------------*/
@@ -446,3 +473,45 @@ struct xio_mempool *xio_mempool_get(struct xio_context *ctx)
 	return ctx->mempool;
 }
 EXPORT_SYMBOL(xio_mempool_get);
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_attach - no statistics segment in the kernel	     */
+/*---------------------------------------------------------------------------*/
+struct xio_connection_counters *xio_ctx_stats_conn_attach(
+		struct xio_context *ctx, uint32_t session_id,
+		uint32_t conn_idx, const char *peer, void **slot)
+{
+	*slot = NULL;
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_detach						     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_stats_conn_detach(void *slot)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_move						     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_stats_conn_move(struct xio_context *ctx, void *slot)
+{
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_dump - the event tracer is user space only		     */
+/*---------------------------------------------------------------------------*/
+int xio_ev_trace_dump(const char *path)
+{
+	xio_set_error(XIO_E_NOT_SUPPORTED);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_record - no record files in the kernel			     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_record(struct xio_context *ctx, enum xio_ctx_rec_type type,
+		    const void *rec)
+{
+}
@@ -43,6 +43,7 @@
 #include "xio_sessions_cache.h"
 #include "xio_nexus_cache.h"
 #include "xio_idr.h"
+#include "xio_server.h"
 
 MODULE_AUTHOR("Eyal Solomon, Shlomo Pongratz");
 MODULE_DESCRIPTION("XIO generic part "	\
@@ -72,6 +73,7 @@ static int __init xio_init_module(void)
 
 	sessions_cache_construct();
 	nexus_cache_construct();
+	xio_servers_construct();
 	usr_idr = xio_idr_create();
 	if (!usr_idr) {
 		pr_err("usr_idr creation failed\n");
@@ -84,6 +86,8 @@ static int __init xio_init_module(void)
 static void __exit xio_cleanup_module(void)
 {
 	xio_idr_destroy(usr_idr);
+	nexus_cache_destruct();
+	sessions_cache_destruct();
 	debugfs_remove_recursive(xio_root);
 }
 
@@ -60,6 +60,9 @@
 #include <limits.h>
 #include <sched.h>
 #include <numa.h>
+#include <numaif.h>
+#include <ifaddrs.h>
+#include <net/if.h>
 #include <dlfcn.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -128,6 +131,16 @@ static inline void xio_numa_free(void *start, size_t size) {
 	numa_free(start, size);
 }
 
+/*---------------------------------------------------------------------------*/
+static inline int xio_numa_tonode(void *start, size_t size, int node)
+{
+	unsigned long nodemask = 1UL << node;
+
+	/* pages already touched move along */
+	return mbind(start, size, MPOL_PREFERRED, &nodemask,
+		     sizeof(nodemask) * 8, MPOL_MF_MOVE);
+}
+
 /*---------------------------------------------------------------------------*/
 /*------------------- CPU and Clock related things --------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -228,54 +241,6 @@ static inline int arch_cache_line_size(void)
 #define XIO_HZ_FILE  XIO_HZ_DIR "/hz"
 
 
-/*---------------------------------------------------------------------------*
- * xio_get_cpu_mhz							     *
- *									     *
- * since this operation may take time cache it on a cookie,		     *
- * and use the cookie if exist						     *
- *									     *
- *---------------------------------------------------------------------------*/
-static inline double xio_get_cpu_mhz(void)
-{
-	char	size[32]= { 0 };
-	double	hz = 0;
-	int	fd;
-	ssize_t ret;
-
-	fd = open(XIO_HZ_FILE, O_RDONLY);
-	if (fd < 0)
-		goto try_create;
-
-	ret = read(fd, size, sizeof(size));
-
-	close(fd);
-
-	if (ret > 0)
-		return atof(size);
-
-try_create:
-	hz = get_cpu_mhz(0);
-
-	ret = mkdir(XIO_HZ_DIR, 0777);
-	if (ret < 0)
-		goto exit;
-
-	fd = open(XIO_HZ_FILE, O_CREAT|O_TRUNC|O_WRONLY|O_SYNC, 0644);
-	if (fd < 0)
-		goto exit;
-
-	sprintf(size,"%f", hz);
-	ret = write(fd, size, sizeof(size));
-	if (ret < 0)
-		goto close_and_exit;
-
-close_and_exit:
-	close(fd);
-exit:
-	return hz;
-}
-
-
 /*---------------------------------------------------------------------------*/
 /*-------------------- Thread related things --------------------------------*/
 /*---------------------------------------------------------------------------*/
@@ -300,6 +265,7 @@ typedef pthread_once_t		thread_once_t;
 	__sync_fetch_and_add((ptr), (value))
 #define  xio_sync_fetch_and_add64(ptr, value) \
 	__sync_fetch_and_add((ptr), (value))
+#define xio_sync_synchronize()	__sync_synchronize()
 
 /*---------------------------------------------------------------------------*/
 #define LIBRARY_INITIALIZER(f) \
@@ -59,6 +59,7 @@
 	__sync_fetch_and_add((ptr), (value))
 #define  xio_sync_fetch_and_add64(ptr, value) \
 	__sync_fetch_and_add((ptr), (value))
+#define xio_sync_synchronize()	smp_mb()
 
 /*---------------------------------------------------------------------------*/
 /*-------------------- Socket related things --------------------------------*/
@@ -128,6 +128,12 @@ static inline void xio_numa_free(void *start, size_t size) {
 	assert(0 && "not yet supported");
 }
 
+/*---------------------------------------------------------------------------*/
+static inline int xio_numa_tonode(void *start, size_t size, int node)
+{
+	return 0;
+}
+
 
 /*---------------------------------------------------------------------------*/
 /*-------------------- Threads related things -------------------------------*/
@@ -149,6 +155,7 @@ static const INIT_ONCE INIT_ONCE_RESET_VALUE = INIT_ONCE_STATIC_INIT;
 		(InterlockedAddAcquire((volatile LONG *)(ptr), (value)) - (value))
 #define  xio_sync_fetch_and_add64(ptr, value) \
 		(InterlockedAddAcquire64((volatile LONG64 *)(ptr), (value)) - (value))
+#define xio_sync_synchronize()	MemoryBarrier()
 
 /* TODO: perhaps protect the type cast */
 #define xio_sync_bool_compare_and_swap(ptr, oldval, newval) \
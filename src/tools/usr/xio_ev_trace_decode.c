@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include "libxio.h"
+#include "xio_ev_trace.h"
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct event {
+	struct xio_ev_trace_rec	rec;
+	uint32_t		ctx_id;
+	uint32_t		track;		/* index in tracks[]	*/
+};
+
+/* one timeline - an object of a context */
+struct track {
+	uint64_t		obj;
+	uint32_t		ctx_id;
+	uint32_t		kind;		/* first event seen	*/
+	uint64_t		events_nr;
+};
+
+struct decode_config {
+	int			json;
+	uint32_t		ctx_id;		/* 0 all */
+	uint64_t		obj;		/* 0 all */
+};
+
+static struct decode_config config;
+
+static struct event	*events;
+static size_t		events_nr;
+static size_t		events_size;
+static struct track	*tracks;
+static size_t		tracks_nr;
+static uint64_t		hertz;
+static uint64_t		lost;
+
+static const char *event_name[XIO_EV_LAST] = {
+	[XIO_EV_CONN_SEND]	= "conn_send",
+	[XIO_EV_NEXUS_SEND]	= "nexus_send",
+	[XIO_EV_TCP_XMIT]	= "tcp_xmit",
+	[XIO_EV_TCP_RX]		= "tcp_rx",
+	[XIO_EV_RDMA_WC]	= "rdma_wc",
+	[XIO_EV_TASK_GET]	= "task_get",
+	[XIO_EV_TASK_PUT]	= "task_put",
+};
+
+static const char *event_arg[XIO_EV_LAST] = {
+	[XIO_EV_CONN_SEND]	= "sn",
+	[XIO_EV_NEXUS_SEND]	= "connection",
+	[XIO_EV_TCP_XMIT]	= "sn",
+	[XIO_EV_TCP_RX]		= "tlv",
+	[XIO_EV_RDMA_WC]	= "opcode",
+	[XIO_EV_TASK_GET]	= "",
+	[XIO_EV_TASK_PUT]	= "",
+};
+
+static const char *kind_name[XIO_EV_LAST] = {
+	[XIO_EV_CONN_SEND]	= "connection",
+	[XIO_EV_NEXUS_SEND]	= "nexus",
+	[XIO_EV_TCP_XMIT]	= "tcp",
+	[XIO_EV_TCP_RX]		= "tcp",
+	[XIO_EV_RDMA_WC]	= "rdma",
+	[XIO_EV_TASK_GET]	= "tasks pool",
+	[XIO_EV_TASK_PUT]	= "tasks pool",
+};
+
+/*---------------------------------------------------------------------------*/
+/* track_get								     */
+/*---------------------------------------------------------------------------*/
+static uint32_t track_get(uint32_t ctx_id, const struct xio_ev_trace_rec *rec)
+{
+	size_t i;
+
+	for (i = 0; i < tracks_nr; i++)
+		if (tracks[i].obj == rec->obj && tracks[i].ctx_id == ctx_id)
+			goto found;
+
+	tracks = (struct track *)realloc(tracks,
+					 (tracks_nr + 1) * sizeof(*tracks));
+	if (!tracks) {
+		fprintf(stderr, "realloc failed\n");
+		exit(1);
+	}
+	tracks[i].obj		= rec->obj;
+	tracks[i].ctx_id	= ctx_id;
+	tracks[i].kind		= rec->event;
+	tracks[i].events_nr	= 0;
+	tracks_nr++;
+found:
+	tracks[i].events_nr++;
+
+	return (uint32_t)i;
+}
+
+/*---------------------------------------------------------------------------*/
+/* event_add								     */
+/*---------------------------------------------------------------------------*/
+static void event_add(uint32_t ctx_id, const struct xio_ev_trace_rec *rec)
+{
+	/* never written, or torn by a concurrent dump */
+	if (!rec->cycles || !rec->event || rec->event >= XIO_EV_LAST)
+		return;
+	if (config.ctx_id && ctx_id != config.ctx_id)
+		return;
+	if (config.obj && rec->obj != config.obj)
+		return;
+
+	if (events_nr == events_size) {
+		events_size = events_size ? 2 * events_size : 65536;
+		events = (struct event *)realloc(events,
+						 events_size * sizeof(*events));
+		if (!events) {
+			fprintf(stderr, "realloc failed\n");
+			exit(1);
+		}
+	}
+	events[events_nr].rec	 = *rec;
+	events[events_nr].ctx_id = ctx_id;
+	events[events_nr].track	 = track_get(ctx_id, rec);
+	events_nr++;
+}
+
+/*---------------------------------------------------------------------------*/
+/* read_dump								     */
+/*---------------------------------------------------------------------------*/
+static int read_dump(const char *path)
+{
+	struct xio_ev_trace_file_hdr	hdr;
+	struct xio_ev_trace_ring_hdr	rhdr;
+	struct xio_ev_trace_rec		rec;
+	FILE				*fp;
+	uint64_t			j;
+	uint32_t			i;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "fopen %s failed. %m\n", path);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.magic != XIO_EV_TRACE_MAGIC ||
+	    hdr.version != XIO_EV_TRACE_VERSION ||
+	    hdr.rec_size != sizeof(rec) || !hdr.hertz) {
+		fprintf(stderr, "%s: not an event trace of this version\n",
+			path);
+		fclose(fp);
+		return -1;
+	}
+	hertz = hdr.hertz;
+	for (i = 0; i < hdr.rings_nr; i++) {
+		if (fread(&rhdr, sizeof(rhdr), 1, fp) != 1)
+			break;
+		lost += rhdr.lost;
+		for (j = 0; j < rhdr.recs_nr; j++) {
+			if (fread(&rec, sizeof(rec), 1, fp) != 1)
+				goto truncated;
+			event_add(rhdr.ctx_id, &rec);
+		}
+	}
+	fclose(fp);
+
+	return 0;
+
+truncated:
+	fprintf(stderr, "%s: truncated\n", path);
+	fclose(fp);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* cmp_time								     */
+/*---------------------------------------------------------------------------*/
+static int cmp_time(const void *a, const void *b)
+{
+	const struct event *x = (const struct event *)a;
+	const struct event *y = (const struct event *)b;
+
+	return (x->rec.cycles > y->rec.cycles) -
+	       (x->rec.cycles < y->rec.cycles);
+}
+
+/*---------------------------------------------------------------------------*/
+/* cmp_track								     */
+/*---------------------------------------------------------------------------*/
+static int cmp_track(const void *a, const void *b)
+{
+	const struct event *x = (const struct event *)a;
+	const struct event *y = (const struct event *)b;
+
+	if (x->track != y->track)
+		return (x->track > y->track) - (x->track < y->track);
+
+	return cmp_time(a, b);
+}
+
+/*---------------------------------------------------------------------------*/
+/* to_us - since the first event					     */
+/*---------------------------------------------------------------------------*/
+static double to_us(uint64_t cycles, uint64_t base)
+{
+	return (double)(cycles - base) * 1000000.0 / hertz;
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_timelines							     */
+/*---------------------------------------------------------------------------*/
+static void print_timelines(uint64_t base)
+{
+	const struct xio_ev_trace_rec	*rec;
+	const struct track		*t;
+	uint64_t			prev = 0;
+	size_t				i;
+
+	qsort(events, events_nr, sizeof(*events), cmp_track);
+
+	for (i = 0; i < events_nr; i++) {
+		rec = &events[i].rec;
+		if (!i || events[i].track != events[i - 1].track) {
+			t = &tracks[events[i].track];
+			printf("%sctx %u %s 0x%" PRIx64 " - %" PRIu64
+			       " events\n", i ? "\n" : "", t->ctx_id,
+			       kind_name[t->kind], t->obj, t->events_nr);
+			prev = rec->cycles;
+		}
+		printf("  %14.3f us %+10.3f  %-10s", to_us(rec->cycles, base),
+		       to_us(rec->cycles, prev), event_name[rec->event]);
+		if (rec->task != XIO_EV_TRACE_NO_TASK)
+			printf(" task %-5u", rec->task);
+		if (rec->size)
+			printf(" size %-7u", rec->size);
+		if (*event_arg[rec->event])
+			printf(" %s 0x%" PRIx64, event_arg[rec->event],
+			       rec->arg);
+		printf("\n");
+		prev = rec->cycles;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_json - chrome://tracing and Perfetto				     */
+/*---------------------------------------------------------------------------*/
+static void print_json(uint64_t base)
+{
+	const struct xio_ev_trace_rec	*rec;
+	const struct track		*t;
+	const char			*sep = "";
+	size_t				i;
+
+	qsort(events, events_nr, sizeof(*events), cmp_time);
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	/* a process per context, a thread per object */
+	for (i = 0; i < tracks_nr; i++) {
+		t = &tracks[i];
+		printf("%s{\"ph\":\"M\",\"name\":\"process_name\","
+		       "\"pid\":%u,\"args\":{\"name\":\"context %u\"}},\n",
+		       sep, t->ctx_id, t->ctx_id);
+		printf("{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,"
+		       "\"tid\":%zu,\"args\":{\"name\":\"%s 0x%" PRIx64
+		       "\"}}", t->ctx_id, i, kind_name[t->kind], t->obj);
+		sep = ",\n";
+	}
+	for (i = 0; i < events_nr; i++) {
+		rec = &events[i].rec;
+		printf("%s{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\","
+		       "\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"args\":{",
+		       sep, event_name[rec->event], events[i].ctx_id,
+		       events[i].track, to_us(rec->cycles, base));
+		printf("\"task\":%u,\"size\":%u", rec->task, rec->size);
+		if (*event_arg[rec->event])
+			printf(",\"%s\":\"0x%" PRIx64 "\"",
+			       event_arg[rec->event], rec->arg);
+		printf("}}");
+		sep = ",\n";
+
+		/* a task's life from get to put, as an async slice */
+		if (rec->event != XIO_EV_TASK_GET &&
+		    rec->event != XIO_EV_TASK_PUT)
+			continue;
+		printf(",\n{\"ph\":\"%s\",\"cat\":\"task\",\"name\":\"task\","
+		       "\"id\":\"0x%" PRIx64 ":%u\",\"pid\":%u,\"tid\":%u,"
+		       "\"ts\":%.3f}",
+		       rec->event == XIO_EV_TASK_GET ? "b" : "e",
+		       rec->obj, rec->task, events[i].ctx_id,
+		       events[i].track, to_us(rec->cycles, base));
+	}
+	printf("\n]}\n");
+}
+
+/*---------------------------------------------------------------------------*/
+/* usage								     */
+/*---------------------------------------------------------------------------*/
+static void usage(const char *argv0, int status)
+{
+	printf("Usage:\n");
+	printf("  %s [OPTIONS] <dump file>...\n", argv0);
+	printf("\tdecode event trace rings written by " \
+	       "XIO_OPTNAME_EV_TRACE_DUMP or on a crash\n\n");
+	printf("options:\n");
+	printf("\t-j, --json ");
+	printf("\t\t\tChrome trace JSON instead of timelines\n");
+	printf("\t-c, --ctx=<id> ");
+	printf("\t\t\tOnly events of context <id>\n");
+	printf("\t-o, --obj=<addr> ");
+	printf("\t\tOnly events of object <addr>\n");
+	printf("\t-h, --help ");
+	printf("\t\t\tDisplay this help and exit\n");
+
+	exit(status);
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_cmdline							     */
+/*---------------------------------------------------------------------------*/
+static void parse_cmdline(int argc, char **argv)
+{
+	static struct option const long_options[] = {
+			{ .name = "json",	.has_arg = 0, .val = 'j'},
+			{ .name = "ctx",	.has_arg = 1, .val = 'c'},
+			{ .name = "obj",	.has_arg = 1, .val = 'o'},
+			{ .name = "help",	.has_arg = 0, .val = 'h'},
+			{0, 0, 0, 0},
+		};
+	static char *short_options = "jc:o:h";
+	int c;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options,
+				long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'j':
+			config.json = 1;
+			break;
+		case 'c':
+			config.ctx_id = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			config.obj = strtoull(optarg, NULL, 16);
+			break;
+		case 'h':
+			usage(argv[0], 0);
+			break;
+		default:
+			usage(argv[0], -1);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0], -1);
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	uint64_t	base;
+	size_t		i;
+	int		n;
+
+	parse_cmdline(argc, argv);
+
+	for (n = optind; n < argc; n++)
+		read_dump(argv[n]);
+	if (!events_nr) {
+		fprintf(stderr, "no events\n");
+		return 1;
+	}
+
+	base = events[0].rec.cycles;
+	for (i = 1; i < events_nr; i++)
+		if (events[i].rec.cycles < base)
+			base = events[i].rec.cycles;
+
+	if (config.json) {
+		print_json(base);
+	} else {
+		printf("%zu events on %zu objects, %" PRIu64
+		       " overwritten\n\n", events_nr, tracks_nr, lost);
+		print_timelines(base);
+	}
+
+	free(events);
+	free(tracks);
+
+	return 0;
+}
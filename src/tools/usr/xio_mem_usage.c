@@ -52,6 +52,7 @@
 #include "xio_workqueue.h"
 #include "xio_context.h"
 #include "xio_nexus.h"
+#include "xio_sn_hash.h"
 #include "xio_connection.h"
 #include "xio_session.h"
 
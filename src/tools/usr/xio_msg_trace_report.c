@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include "libxio.h"
+#include "xio_msg_trace.h"
+
+#define HIST_BUCKETS		33	/* log2 of uint32_t ns, and zero */
+#define BAR_WIDTH		50
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct stage_samples {
+	uint32_t		*ns;
+	size_t			nr;
+	size_t			size;
+	uint64_t		sum;
+};
+
+struct report_config {
+	int			histograms;
+	int			conn_idx;	/* -1 all */
+	int			session_id;	/* -1 all */
+	int			pad;
+};
+
+static struct report_config config = {
+	.histograms	= 0,
+	.conn_idx	= -1,
+	.session_id	= -1,
+};
+
+static const char *stage_name[XIO_TRACE_STAGES] = {
+	[XIO_TRACE_STAGE_QUEUE]		= "queue",
+	[XIO_TRACE_STAGE_SEND]		= "send",
+	[XIO_TRACE_STAGE_TRANSPORT]	= "transport",
+	[XIO_TRACE_STAGE_NETWORK]	= "network",
+	[XIO_TRACE_STAGE_REMOTE_QUEUE]	= "remote_queue",
+	[XIO_TRACE_STAGE_REMOTE_APP]	= "remote_app",
+	[XIO_TRACE_STAGE_REMOTE_REPLY]	= "remote_reply",
+	[XIO_TRACE_STAGE_DELIVER]	= "deliver",
+	[XIO_TRACE_STAGE_TOTAL]		= "total",
+};
+
+static struct stage_samples samples[XIO_TRACE_STAGES];
+
+/*---------------------------------------------------------------------------*/
+/* samples_add								     */
+/*---------------------------------------------------------------------------*/
+static void samples_add(struct stage_samples *s, uint32_t ns)
+{
+	if (s->nr == s->size) {
+		s->size = s->size ? 2 * s->size : 4096;
+		s->ns = (uint32_t *)realloc(s->ns, s->size * sizeof(*s->ns));
+		if (!s->ns) {
+			fprintf(stderr, "realloc failed\n");
+			exit(1);
+		}
+	}
+	s->ns[s->nr++] = ns;
+	s->sum += ns;
+}
+
+/*---------------------------------------------------------------------------*/
+/* read_trace								     */
+/*---------------------------------------------------------------------------*/
+static int read_trace(const char *path, size_t *recs)
+{
+	struct xio_msg_trace_file_hdr	hdr;
+	struct xio_msg_trace_rec	rec;
+	FILE				*fp;
+	int				i;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		fprintf(stderr, "fopen %s failed. %m\n", path);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    hdr.magic != XIO_MSG_TRACE_MAGIC ||
+	    hdr.version != XIO_MSG_TRACE_VERSION ||
+	    hdr.rec_size != sizeof(rec)) {
+		fprintf(stderr, "%s: not a message trace of this version\n",
+			path);
+		fclose(fp);
+		return -1;
+	}
+	while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+		if (config.conn_idx != -1 &&
+		    rec.conn_idx != (uint32_t)config.conn_idx)
+			continue;
+		if (config.session_id != -1 &&
+		    rec.session_id != (uint32_t)config.session_id)
+			continue;
+		for (i = 0; i < XIO_TRACE_STAGES; i++)
+			samples_add(&samples[i], rec.stage_ns[i]);
+		(*recs)++;
+	}
+	fclose(fp);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* cmp_u32								     */
+/*---------------------------------------------------------------------------*/
+static int cmp_u32(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*---------------------------------------------------------------------------*/
+/* percentile - of sorted samples					     */
+/*---------------------------------------------------------------------------*/
+static uint32_t percentile(const struct stage_samples *s, double p)
+{
+	size_t idx = (size_t)(p / 100.0 * (double)s->nr);
+
+	if (idx >= s->nr)
+		idx = s->nr - 1;
+	return s->ns[idx];
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_histogram							     */
+/*---------------------------------------------------------------------------*/
+static void print_histogram(const struct stage_samples *s, const char *name)
+{
+	size_t		bucket[HIST_BUCKETS];
+	size_t		i, peak = 0;
+	int		b, first = HIST_BUCKETS, last = -1;
+
+	memset(bucket, 0, sizeof(bucket));
+	for (i = 0; i < s->nr; i++) {
+		/* bucket b holds [2^(b-1), 2^b) ns, bucket 0 holds 0 */
+		b = s->ns[i] ? 32 - __builtin_clz(s->ns[i]) : 0;
+		bucket[b]++;
+	}
+	for (b = 0; b < HIST_BUCKETS; b++) {
+		if (!bucket[b])
+			continue;
+		if (b < first)
+			first = b;
+		last = b;
+		if (bucket[b] > peak)
+			peak = bucket[b];
+	}
+
+	printf("\n%s (ns)\n", name);
+	for (b = first; b <= last; b++) {
+		uint64_t lo = b ? (1ULL << (b - 1)) : 0;
+		uint64_t hi = b ? (1ULL << b) : 1;
+		int	 len = (int)(bucket[b] * BAR_WIDTH / peak);
+
+		printf("  %10" PRIu64 " - %-10" PRIu64 " %10zu %6.2f%% |%.*s\n",
+		       lo, hi, bucket[b], 100.0 * bucket[b] / s->nr, len,
+		       "##################################################");
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* usage								     */
+/*---------------------------------------------------------------------------*/
+static void usage(const char *argv0, int status)
+{
+	printf("Usage:\n");
+	printf("  %s [OPTIONS] <trace file>...\n", argv0);
+	printf("\tbreak down request latency recorded by processes run " \
+	       "with XIO_MSG_TRACE=<file>\n\n");
+	printf("options:\n");
+	printf("\t-H, --histograms ");
+	printf("\t\tPrint a histogram of every stage\n");
+	printf("\t-c, --conn=<idx> ");
+	printf("\t\tOnly requests of connection <idx>\n");
+	printf("\t-s, --session=<id> ");
+	printf("\t\tOnly requests of session <id>\n");
+	printf("\t-h, --help ");
+	printf("\t\t\tDisplay this help and exit\n");
+
+	exit(status);
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_cmdline							     */
+/*---------------------------------------------------------------------------*/
+static void parse_cmdline(int argc, char **argv)
+{
+	static struct option const long_options[] = {
+			{ .name = "histograms",	.has_arg = 0, .val = 'H'},
+			{ .name = "conn",	.has_arg = 1, .val = 'c'},
+			{ .name = "session",	.has_arg = 1, .val = 's'},
+			{ .name = "help",	.has_arg = 0, .val = 'h'},
+			{0, 0, 0, 0},
+		};
+	static char *short_options = "Hc:s:h";
+	int c;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options,
+				long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'H':
+			config.histograms = 1;
+			break;
+		case 'c':
+			config.conn_idx = strtol(optarg, NULL, 0);
+			break;
+		case 's':
+			config.session_id = strtol(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage(argv[0], 0);
+			break;
+		default:
+			usage(argv[0], -1);
+		}
+	}
+	if (optind >= argc)
+		usage(argv[0], -1);
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct stage_samples	*s;
+	size_t			recs = 0;
+	double			total_mean;
+	int			i;
+
+	parse_cmdline(argc, argv);
+
+	for (i = optind; i < argc; i++)
+		read_trace(argv[i], &recs);
+	if (!recs) {
+		fprintf(stderr, "no traced requests\n");
+		return 1;
+	}
+
+	for (i = 0; i < XIO_TRACE_STAGES; i++)
+		qsort(samples[i].ns, samples[i].nr, sizeof(uint32_t),
+		      cmp_u32);
+
+	total_mean = (double)samples[XIO_TRACE_STAGE_TOTAL].sum / recs;
+
+	printf("%zu requests, ns\n", recs);
+	printf("%-14s %10s %10s %10s %10s %10s %10s %7s\n",
+	       "stage", "mean", "p50", "p90", "p99", "p99.9", "max",
+	       "share");
+	for (i = 0; i < XIO_TRACE_STAGES; i++) {
+		double mean;
+
+		s = &samples[i];
+		mean = (double)s->sum / s->nr;
+		printf("%-14s %10.0f %10u %10u %10u %10u %10u %6.1f%%\n",
+		       stage_name[i], mean,
+		       percentile(s, 50), percentile(s, 90),
+		       percentile(s, 99), percentile(s, 99.9),
+		       s->ns[s->nr - 1],
+		       total_mean ? 100.0 * mean / total_mean : 0);
+	}
+
+	if (config.histograms)
+		for (i = 0; i < XIO_TRACE_STAGES; i++)
+			print_histogram(&samples[i], stage_name[i]);
+
+	for (i = 0; i < XIO_TRACE_STAGES; i++)
+		free(samples[i].ns);
+
+	return 0;
+}
@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "libxio.h"
+#include "xio_stats_shm.h"
+
+#define SHM_DIR			"/dev/shm"
+#define MAX_SEGMENTS		64
+
+#define rmb()			__sync_synchronize()
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct segment {
+	struct xio_stats_shm_hdr	*hdr;
+	size_t				size;
+	/* previous snapshot, for the rates */
+	struct xio_stats_shm_ctx	*ctx_prev;
+	struct xio_stats_shm_conn	*conn_prev;
+	char				name[NAME_MAX + 9];	/* 8 aligned */
+};
+
+struct stats_config {
+	int				pid;
+	int				interval;
+	int				count;
+	int				show_conns;
+	int				show_pools;
+	int				keep_stale;
+};
+
+static struct stats_config config = {
+	.pid		= 0,
+	.interval	= 1,
+	.count		= 0,
+	.show_conns	= 1,
+	.show_pools	= 1,
+	.keep_stale	= 0,
+};
+
+/*---------------------------------------------------------------------------*/
+/* slot_copy - consistent copy of a slot, 0 when it is free		     */
+/*---------------------------------------------------------------------------*/
+static int slot_copy(void *dst, const void *src, size_t len)
+{
+	const volatile uint32_t	*seq = (const volatile uint32_t *)src;
+	uint32_t		s;
+	int			spins = 0;
+
+	do {
+		s = *seq;
+		if (s & 1) {
+			if (++spins > 1000000)
+				return 0;
+			continue;
+		}
+		rmb();
+		memcpy(dst, src, len);
+		rmb();
+	} while (*seq != s);
+
+	/* in_use follows seq in every slot */
+	return ((const uint32_t *)dst)[1] != 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* segment_map								     */
+/*---------------------------------------------------------------------------*/
+static int segment_map(struct segment *seg, const char *name)
+{
+	struct xio_stats_shm_hdr	*hdr;
+	struct stat			st;
+	int				fd;
+
+	snprintf(seg->name, sizeof(seg->name), "/%s", name);
+	fd = shm_open(seg->name, O_RDONLY, 0);
+	if (fd < 0)
+		return -1;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return -1;
+	}
+	hdr = (struct xio_stats_shm_hdr *)mmap(NULL, st.st_size, PROT_READ,
+					       MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED)
+		return -1;
+
+	if (hdr->magic != XIO_STATS_SHM_MAGIC ||
+	    hdr->version != XIO_STATS_SHM_VERSION ||
+	    hdr->size > (uint64_t)st.st_size) {
+		fprintf(stderr, "%s: not initialized or unknown version\n",
+			seg->name);
+		munmap(hdr, st.st_size);
+		return -1;
+	}
+	seg->hdr	= hdr;
+	seg->size	= st.st_size;
+	seg->ctx_prev	= (struct xio_stats_shm_ctx *)
+				calloc(hdr->ctxs_nr, sizeof(*seg->ctx_prev));
+	seg->conn_prev	= (struct xio_stats_shm_conn *)
+				calloc(hdr->conns_nr, sizeof(*seg->conn_prev));
+	if (!seg->ctx_prev || !seg->conn_prev) {
+		fprintf(stderr, "calloc failed\n");
+		exit(1);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* segment_unmap							     */
+/*---------------------------------------------------------------------------*/
+static void segment_unmap(struct segment *seg)
+{
+	munmap(seg->hdr, seg->size);
+	free(seg->ctx_prev);
+	free(seg->conn_prev);
+	memset(seg, 0, sizeof(*seg));
+}
+
+/*---------------------------------------------------------------------------*/
+/* segments_open - the segment of config.pid or of every live process   */
+/*---------------------------------------------------------------------------*/
+static int segments_open(struct segment *segs)
+{
+	struct dirent	*ent;
+	DIR		*dir;
+	char		name[NAME_MAX + 2];
+	int		prefix_len = strlen(XIO_STATS_SHM_PREFIX) - 1;
+	int		nr = 0, pid;
+
+	if (config.pid) {
+		snprintf(name, sizeof(name), "%s%d",
+			 XIO_STATS_SHM_PREFIX + 1, config.pid);
+		if (segment_map(&segs[0], name)) {
+			fprintf(stderr, "no statistics for pid %d. " \
+				"was it started with XIO_STATS_SHM=1?\n",
+				config.pid);
+			return -1;
+		}
+		return 1;
+	}
+
+	dir = opendir(SHM_DIR);
+	if (!dir) {
+		fprintf(stderr, "opendir %s failed. %m\n", SHM_DIR);
+		return -1;
+	}
+	while ((ent = readdir(dir)) != NULL && nr < MAX_SEGMENTS) {
+		if (strncmp(ent->d_name, XIO_STATS_SHM_PREFIX + 1, prefix_len))
+			continue;
+		pid = atoi(ent->d_name + prefix_len);
+		if (pid <= 0)
+			continue;
+		/* left behind by a process that did not exit cleanly */
+		if (kill(pid, 0) && errno == ESRCH) {
+			if (config.keep_stale)
+				continue;
+			snprintf(name, sizeof(name), "/%s", ent->d_name);
+			if (!shm_unlink(name))
+				fprintf(stderr, "removed stale segment %s\n",
+					name);
+			continue;
+		}
+		if (!segment_map(&segs[nr], ent->d_name))
+			nr++;
+	}
+	closedir(dir);
+
+	return nr;
+}
+
+/*---------------------------------------------------------------------------*/
+/* rate									     */
+/*---------------------------------------------------------------------------*/
+static inline double rate(uint64_t now, uint64_t prev, int fresh)
+{
+	if (fresh || now < prev)
+		return 0;
+	return (double)(now - prev) / config.interval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_unpublished - objects the full slot arrays could not take	     */
+/*---------------------------------------------------------------------------*/
+static void print_unpublished(struct segment *seg)
+{
+	struct xio_stats_shm_hdr	*hdr = seg->hdr;
+
+	if (!hdr->ctxs_unpublished && !hdr->conns_unpublished &&
+	    !hdr->pools_unpublished)
+		return;
+
+	printf("  unpublished: contexts %" PRIu64 " connections %" PRIu64
+	       " pools %" PRIu64 "\n", hdr->ctxs_unpublished,
+	       hdr->conns_unpublished, hdr->pools_unpublished);
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_contexts							     */
+/*---------------------------------------------------------------------------*/
+static void print_contexts(struct segment *seg)
+{
+	struct xio_stats_shm_hdr	*hdr = seg->hdr;
+	struct xio_stats_shm_ctx	*slots, cur, *prev;
+	uint32_t			i;
+	int				j, fresh;
+
+	slots = (struct xio_stats_shm_ctx *)((char *)hdr + hdr->ctxs_off);
+	for (i = 0; i < hdr->ctxs_nr; i++) {
+		prev = &seg->ctx_prev[i];
+		if (!slot_copy(&cur, &slots[i], sizeof(cur))) {
+			prev->in_use = 0;
+			continue;
+		}
+		fresh = !prev->in_use || prev->id != cur.id;
+		printf("  ctx %-6" PRIu64 " cpu %-3d node %-2d\n",
+		       cur.id, cur.cpu, cur.nodeid);
+		for (j = 0; j < XIO_STATS_SHM_COUNTERS; j++) {
+			if (!cur.name[j][0])
+				continue;
+			cur.name[j][XIO_STATS_SHM_NAME_LEN - 1] = 0;
+			printf("    %-16s %20" PRIu64 " %14.0f/s\n",
+			       cur.name[j], cur.counter[j],
+			       rate(cur.counter[j], prev->counter[j], fresh));
+		}
+		*prev = cur;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_connections							     */
+/*---------------------------------------------------------------------------*/
+static void print_connections(struct segment *seg)
+{
+	struct xio_stats_shm_hdr	*hdr = seg->hdr;
+	struct xio_stats_shm_conn	*slots, cur, *prev;
+	uint32_t			i;
+	int				fresh, title = 0;
+
+	slots = (struct xio_stats_shm_conn *)((char *)hdr + hdr->conns_off);
+	for (i = 0; i < hdr->conns_nr; i++) {
+		prev = &seg->conn_prev[i];
+		if (!slot_copy(&cur, &slots[i], sizeof(cur))) {
+			prev->in_use = 0;
+			continue;
+		}
+		if (!title) {
+			printf("  %-6s %-6s %-10s %-4s %12s %12s %10s %10s " \
+			       "%6s %6s %8s %8s %s\n",
+			       "conn", "ctx", "session", "idx",
+			       "tx_msg/s", "rx_msg/s", "tx_MB/s", "rx_MB/s",
+			       "outst", "pend", "stalls", "eagain",
+			       "peer");
+			title = 1;
+		}
+		fresh = !prev->in_use || prev->id != cur.id;
+		cur.peer[sizeof(cur.peer) - 1] = 0;
+		printf("  %-6" PRIu64 " %-6" PRIu64 " %-10" PRIu64 " %-4u " \
+		       "%12.0f %12.0f %10.2f %10.2f %6u %6u %8" PRIu64 \
+		       " %8" PRIu64 " %s\n",
+		       cur.id, cur.ctx_id, cur.session_id, cur.conn_idx,
+		       rate(cur.counters.tx_msgs, prev->counters.tx_msgs,
+			    fresh),
+		       rate(cur.counters.rx_msgs, prev->counters.rx_msgs,
+			    fresh),
+		       rate(cur.counters.tx_bytes, prev->counters.tx_bytes,
+			    fresh) / 1e6,
+		       rate(cur.counters.rx_bytes, prev->counters.rx_bytes,
+			    fresh) / 1e6,
+		       cur.counters.reqs_outstanding,
+		       cur.counters.reqs_pending,
+		       cur.counters.credit_stalls, cur.counters.eagains,
+		       cur.peer);
+		*prev = cur;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* print_pools								     */
+/*---------------------------------------------------------------------------*/
+static void print_pools(struct segment *seg)
+{
+	struct xio_stats_shm_hdr	*hdr = seg->hdr;
+	struct xio_stats_shm_pool	*slots, cur;
+	uint32_t			i, j;
+
+	slots = (struct xio_stats_shm_pool *)((char *)hdr + hdr->pools_off);
+	for (i = 0; i < hdr->pools_nr; i++) {
+		if (!slot_copy(&cur, &slots[i], sizeof(cur)))
+			continue;
+		printf("  pool %-6" PRIu64 " node %-2d\n", cur.id, cur.nodeid);
+		for (j = 0; j < cur.slabs_nr && j < XIO_STATS_SHM_SLABS; j++)
+			printf("    slab %-10" PRIu64 " used %8d alloced %8d " \
+			       "max %8d\n",
+			       cur.slab[j].mb_size, cur.slab[j].used_mb_nr,
+			       cur.slab[j].curr_mb_nr, cur.slab[j].max_mb_nr);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* usage								     */
+/*---------------------------------------------------------------------------*/
+static void usage(const char *argv0, int status)
+{
+	printf("Usage:\n");
+	printf("  %s [OPTIONS]\n", argv0);
+	printf("\tsample the statistics segments of processes started " \
+	       "with XIO_STATS_SHM=1\n\n");
+	printf("options:\n");
+	printf("\t-p, --pid=<pid> ");
+	printf("\t\tOnly the process <pid> (default all)\n");
+	printf("\t-i, --interval=<sec> ");
+	printf("\t\tSeconds between samples (default %d)\n", config.interval);
+	printf("\t-c, --count=<number> ");
+	printf("\t\tStop after <number> samples (default endless)\n");
+	printf("\t-C, --no-conns ");
+	printf("\t\t\tDo not show connections\n");
+	printf("\t-P, --no-pools ");
+	printf("\t\t\tDo not show memory pools\n");
+	printf("\t-k, --keep-stale ");
+	printf("\t\tDo not remove segments of dead processes\n");
+	printf("\t-h, --help ");
+	printf("\t\t\tDisplay this help and exit\n");
+
+	exit(status);
+}
+
+/*---------------------------------------------------------------------------*/
+/* parse_cmdline							     */
+/*---------------------------------------------------------------------------*/
+static void parse_cmdline(int argc, char **argv)
+{
+	static struct option const long_options[] = {
+			{ .name = "pid",	.has_arg = 1, .val = 'p'},
+			{ .name = "interval",	.has_arg = 1, .val = 'i'},
+			{ .name = "count",	.has_arg = 1, .val = 'c'},
+			{ .name = "no-conns",	.has_arg = 0, .val = 'C'},
+			{ .name = "no-pools",	.has_arg = 0, .val = 'P'},
+			{ .name = "keep-stale",	.has_arg = 0, .val = 'k'},
+			{ .name = "help",	.has_arg = 0, .val = 'h'},
+			{0, 0, 0, 0},
+		};
+	static char *short_options = "p:i:c:CPkh";
+	int c;
+
+	while (1) {
+		c = getopt_long(argc, argv, short_options,
+				long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'p':
+			config.pid = strtol(optarg, NULL, 0);
+			break;
+		case 'i':
+			config.interval = strtol(optarg, NULL, 0);
+			if (config.interval < 1)
+				config.interval = 1;
+			break;
+		case 'c':
+			config.count = strtol(optarg, NULL, 0);
+			break;
+		case 'C':
+			config.show_conns = 0;
+			break;
+		case 'P':
+			config.show_pools = 0;
+			break;
+		case 'k':
+			config.keep_stale = 1;
+			break;
+		case 'h':
+			usage(argv[0], 0);
+			break;
+		default:
+			usage(argv[0], -1);
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* main									     */
+/*---------------------------------------------------------------------------*/
+int main(int argc, char *argv[])
+{
+	struct segment	segs[MAX_SEGMENTS];
+	int		nr, i, sample;
+
+	parse_cmdline(argc, argv);
+
+	memset(segs, 0, sizeof(segs));
+	nr = segments_open(segs);
+	if (nr <= 0) {
+		if (nr == 0)
+			fprintf(stderr, "no statistics segments found\n");
+		return nr ? -1 : 1;
+	}
+
+	for (sample = 0; !config.count || sample < config.count; sample++) {
+		if (sample)
+			sleep(config.interval);
+		for (i = 0; i < nr; i++) {
+			if (!segs[i].hdr)
+				continue;
+			if (kill(segs[i].hdr->pid, 0) && errno == ESRCH) {
+				printf("pid %d exited\n", segs[i].hdr->pid);
+				segment_unmap(&segs[i]);
+				continue;
+			}
+			printf("pid %d generation %" PRIu64 "\n",
+			       segs[i].hdr->pid, segs[i].hdr->generation);
+			print_unpublished(&segs[i]);
+			print_contexts(&segs[i]);
+			if (config.show_conns)
+				print_connections(&segs[i]);
+			if (config.show_pools)
+				print_pools(&segs[i]);
+		}
+		printf("\n");
+		fflush(stdout);
+	}
+
+	for (i = 0; i < nr; i++)
+		if (segs[i].hdr)
+			segment_unmap(&segs[i]);
+
+	return 0;
+}
@@ -333,6 +333,7 @@ static int xio_rdma_xmit(struct xio_rdma_transport *rdma_hndl)
 			rdma_hndl->rsps_in_flight_nr++;
 		list_move_tail(&task->tasks_list_entry,
 			       &rdma_hndl->in_flight_list);
+		xio_msg_trace_stamp(task, XIO_TRACE_WIRE);
 	}
 	if (req_nr) {
 		first_wr = container_of(rdma_hndl->dummy_wr.send_wr.next,
@@ -941,6 +942,8 @@ static inline void xio_handle_wc(struct ibv_wc *wc, int last_in_rxq)
 	TRACE_LOG("received opcode :%s [%x]\n",
 		  ibv_wc_opcode_str(wc->opcode), wc->opcode);
 	*/
+	xio_ev_trace(rdma_hndl->base.ctx->ev_trace, XIO_EV_RDMA_WC, rdma_hndl,
+		     task->ltid, wc->byte_len, wc->opcode);
 
 	switch (wc->opcode) {
 	case IBV_WC_RECV:
@@ -978,6 +981,7 @@ static int xio_poll_cq(struct xio_cq *tcq, int max_wc, int timeout_us)
 	int		polled = 0, last_in_rxq = -1;
 	cycles_t	timeout;
 	cycles_t	start_time = 0;
+	cycles_t	rx_stamp;
 	struct ibv_wc	*wc;
 	struct xio_task *task;
 
@@ -1035,8 +1039,16 @@ static int xio_poll_cq(struct xio_cq *tcq, int max_wc, int timeout_us)
 			}
 			wc--;
 		}
+		rx_stamp = get_cycles();
 		wc = &tcq->wc_array[0];
 		for (i = 0; i < err; i++) {
+			/* one stamp per poll - see xio_msg_trace.h */
+			if (wc->status == IBV_WC_SUCCESS &&
+			    wc->opcode == IBV_WC_RECV) {
+				task = (struct xio_task *)
+					ptr_from_int64(wc->wr_id);
+				task->trace[XIO_TRACE_RX] = rx_stamp;
+			}
 			if (likely(wc->status == IBV_WC_SUCCESS))
 				xio_handle_wc(wc, (i == last_in_rxq));
 			else
@@ -1470,6 +1470,7 @@ static int xio_rdma_phantom_pool_create(struct xio_rdma_transport *rdma_hndl)
 	params.slab_dd_data_sz		   = sizeof(struct xio_rdma_tasks_slab);
 	params.task_dd_data_sz		   = sizeof(struct xio_rdma_task) +
 				rdma_hndl->max_sge*sizeof(struct ibv_sge);
+	params.node_id			   = rdma_hndl->base.ctx->nodeid;
 
 	params.pool_hooks.context	   = rdma_hndl;
 	params.pool_hooks.slab_init_task   =
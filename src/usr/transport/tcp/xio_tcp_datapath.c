@@ -49,6 +49,7 @@
 #include "xio_ev_data.h"
 #include "xio_workqueue.h"
 #include "xio_context.h"
+#include "xio_sn_hash.h"
 #include "xio_tcp_transport.h"
 #include "xio_mem.h"
 
@@ -603,6 +604,78 @@ cleanup:
 	return -1;
 }
 
+/* fan out payload copied once to the pool and sent by all the clones */
+struct xio_tcp_shared_payload {
+	struct xio_mempool_obj	*sge;
+	uint32_t		nents;
+	uint32_t		pad;
+};
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shared_payload_free						     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shared_payload_free(void *shared)
+{
+	struct xio_tcp_shared_payload *payload =
+				(struct xio_tcp_shared_payload *)shared;
+	uint32_t i;
+
+	for (i = 0; i < payload->nents; i++)
+		xio_mempool_free(&payload->sge[i]);
+
+	ufree(payload);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shared_payload_get						     */
+/*---------------------------------------------------------------------------*/
+static struct xio_tcp_shared_payload *xio_tcp_shared_payload_get(
+		struct xio_tcp_transport *tcp_hndl,
+		struct xio_task *task)
+{
+	struct xio_msg_multi		*multi = (struct xio_msg_multi *)
+						task->omsg->user_context;
+	struct xio_tcp_shared_payload	*payload;
+	struct xio_sg_table_ops		*sgtbl_ops;
+	void				*sgtbl;
+	void				*sg;
+	unsigned int			i;
+
+	payload = (struct xio_tcp_shared_payload *)multi->shared;
+	if (payload)
+		return payload;
+
+	sgtbl		= xio_sg_table_get(&task->omsg->out);
+	sgtbl_ops	= (struct xio_sg_table_ops *)
+				xio_sg_table_ops_get(task->omsg->out.sgl_type);
+
+	payload = (struct xio_tcp_shared_payload *)
+		ucalloc(1, sizeof(*payload) +
+			tbl_nents(sgtbl_ops, sgtbl) * sizeof(*payload->sge));
+	if (!payload)
+		return NULL;
+	payload->sge = (struct xio_mempool_obj *)(payload + 1);
+
+	for_each_sge(sgtbl, sgtbl_ops, sg, i) {
+		if (xio_mempool_alloc(tcp_hndl->tcp_mempool,
+				      sge_length(sgtbl_ops, sg),
+				      &payload->sge[i])) {
+			xio_tcp_shared_payload_free(payload);
+			return NULL;
+		}
+		payload->nents++;
+		payload->sge[i].length = sge_length(sgtbl_ops, sg);
+		memcpy(payload->sge[i].addr, sge_addr(sgtbl_ops, sg),
+		       sge_length(sgtbl_ops, sg));
+	}
+
+	/* all the clones are on this context - see xio_send_msg_multi */
+	multi->shared_free = xio_tcp_shared_payload_free;
+	multi->shared	   = payload;
+
+	return payload;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_prep_req_out_data						     */
 /*---------------------------------------------------------------------------*/
@@ -690,6 +763,22 @@ static int xio_tcp_prep_req_out_data(
 				tcp_task->write_sge[i].length =
 					sge_length(sgtbl_ops, sg);
 			}
+		} else if (task->omsg_flags & XIO_MSG_FLAG_EX_MULTI &&
+			   tcp_hndl->tcp_mempool) {
+			struct xio_tcp_shared_payload *payload;
+
+			/* fan out - one copy referenced by all clones */
+			payload = xio_tcp_shared_payload_get(tcp_hndl, task);
+			if (!payload) {
+				xio_set_error(ENOMEM);
+				ERROR_LOG("mempool is empty for fan out\n");
+				goto cleanup;
+			}
+			for (i = 0; i < payload->nents; i++) {
+				tcp_task->write_sge[i] = payload->sge[i];
+				/* released with the fan out, not the task */
+				tcp_task->write_sge[i].cache = NULL;
+			}
 		} else {
 			if (tcp_hndl->tcp_mempool == NULL) {
 				xio_set_error(XIO_E_NO_BUFS);
@@ -872,6 +961,31 @@ static void xio_tcp_tx_completion_handler(void *xio_task)
 	*/
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_flush_tx_completions						     */
+/*---------------------------------------------------------------------------*/
+void xio_tcp_flush_tx_completions(struct xio_tcp_transport *tcp_hndl)
+{
+	struct xio_task		*task;
+	struct xio_tcp_task	*tcp_task;
+
+	if (list_empty(&tcp_hndl->in_flight_list))
+		return;
+
+	/* sent tasks wait on in_flight_list until a batch is due, complete
+	 * them all now and drop the completion works already queued
+	 */
+	list_for_each_entry(task, &tcp_hndl->in_flight_list,
+			    tasks_list_entry) {
+		tcp_task = (struct xio_tcp_task *)task->dd_data;
+		xio_ctx_del_work(tcp_hndl->base.ctx, &tcp_task->comp_work);
+	}
+	task = list_last_entry(&tcp_hndl->in_flight_list, struct xio_task,
+			       tasks_list_entry);
+	tcp_hndl->tx_comp_cnt = 0;
+	xio_tcp_tx_completion_handler(task);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_write_sn							     */
 /*---------------------------------------------------------------------------*/
@@ -1089,6 +1203,12 @@ int xio_tcp_xmit(struct xio_tcp_transport *tcp_hndl)
 
 				list_move_tail(&task->tasks_list_entry,
 					       &tcp_hndl->in_flight_list);
+				xio_msg_trace_stamp(task, XIO_TRACE_WIRE);
+				xio_ev_trace(tcp_hndl->base.ctx->ev_trace,
+					     XIO_EV_TCP_XMIT, tcp_hndl,
+					     task->ltid,
+					     tcp_task->txd.tot_iov_byte_len,
+					     tcp_task->sn);
 
 				task_success = task;
 
@@ -1388,6 +1508,9 @@ static int xio_tcp_send_req(struct xio_tcp_transport *tcp_hndl,
 
 	tcp_task->tcp_op = XIO_TCP_SEND;
 
+	if (!task->is_control)
+		xio_tcp_req_idx_add(tcp_hndl, task);
+
 	list_move_tail(&task->tasks_list_entry, &tcp_hndl->tx_ready_list);
 
 	tcp_hndl->tx_ready_tasks_num++;
@@ -2702,6 +2825,92 @@ partial_msg:
 	return 0;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_req_idx_add							     */
+/*---------------------------------------------------------------------------*/
+void xio_tcp_req_idx_add(struct xio_tcp_transport *tcp_hndl,
+			 struct xio_task *task)
+{
+	XIO_TO_TCP_TASK(task, tcp_task);
+	struct xio_task *ptask;
+
+	if (!task->omsg || tcp_task->req_idx != XIO_TCP_REQ_IDX_NONE)
+		return;
+
+	tcp_task->req_sn = task->omsg->sn;
+
+	/* sessions sharing the transport may reuse the same sn. first
+	 * comer owns the slot, the rest are found by walking the lists
+	 */
+	ptask = (struct xio_task *)xio_sn_hash_lookup(&tcp_hndl->req_hash,
+						      tcp_task->req_sn);
+	if (ptask || xio_sn_hash_insert(&tcp_hndl->req_hash,
+					tcp_task->req_sn, task)) {
+		tcp_task->req_idx = XIO_TCP_REQ_IDX_OVERFLOW;
+		tcp_hndl->req_idx_overflow++;
+		return;
+	}
+	tcp_task->req_idx = XIO_TCP_REQ_IDX_HASHED;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_req_idx_del							     */
+/*---------------------------------------------------------------------------*/
+void xio_tcp_req_idx_del(struct xio_tcp_transport *tcp_hndl,
+			 struct xio_task *task)
+{
+	XIO_TO_TCP_TASK(task, tcp_task);
+
+	switch (tcp_task->req_idx) {
+	case XIO_TCP_REQ_IDX_HASHED:
+		xio_sn_hash_remove(&tcp_hndl->req_hash, tcp_task->req_sn);
+		break;
+	case XIO_TCP_REQ_IDX_OVERFLOW:
+		tcp_hndl->req_idx_overflow--;
+		break;
+	default:
+		break;
+	}
+	tcp_task->req_idx = XIO_TCP_REQ_IDX_NONE;
+
+	if (tcp_hndl->cancel_hash.nr &&
+	    xio_sn_hash_lookup(&tcp_hndl->cancel_hash, tcp_task->sn) == task)
+		xio_sn_hash_remove(&tcp_hndl->cancel_hash, tcp_task->sn);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_req_lookup							     */
+/*---------------------------------------------------------------------------*/
+static struct xio_task *xio_tcp_req_lookup(struct xio_tcp_transport *tcp_hndl,
+					   uint64_t sn, uint64_t stag)
+{
+	struct xio_task		*ptask;
+	struct list_head	*lists[3];
+	unsigned int		i;
+
+	ptask = (struct xio_task *)xio_sn_hash_lookup(&tcp_hndl->req_hash, sn);
+	if (ptask && ptask->stag == stag)
+		return ptask;
+
+	if (!tcp_hndl->req_idx_overflow)
+		return NULL;
+
+	lists[0] = &tcp_hndl->tx_ready_list;
+	lists[1] = &tcp_hndl->in_flight_list;
+	lists[2] = &tcp_hndl->tx_comp_list;
+
+	for (i = 0; i < ARRAY_SIZE(lists); i++) {
+		list_for_each_entry(ptask, lists[i], tasks_list_entry) {
+			if (ptask->omsg &&
+			    (ptask->omsg->sn == sn) &&
+			    (ptask->stag == stag))
+				return ptask;
+		}
+	}
+
+	return NULL;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_cancel_req_handler						     */
 /*---------------------------------------------------------------------------*/
@@ -2737,6 +2946,16 @@ static int xio_tcp_cancel_rsp_handler(struct xio_tcp_transport *tcp_hndl,
 
 	if ((cancel_hdr->result ==  XIO_E_MSG_CANCELED) ||
 	    (cancel_hdr->result ==  XIO_E_MSG_CANCEL_FAILED)) {
+		ptask = (struct xio_task *)xio_sn_hash_remove(
+				&tcp_hndl->cancel_hash, cancel_hdr->sn);
+		if (ptask) {
+			tcp_task = (struct xio_tcp_task *)ptask->dd_data;
+			if (tcp_task->sn == cancel_hdr->sn)
+				task_to_cancel = ptask;
+		}
+		if (task_to_cancel)
+			goto notify;
+
 		/* look in the in_flight */
 		list_for_each_entry_safe(ptask, next_ptask,
 					 &tcp_hndl->in_flight_list,
@@ -2778,6 +2997,7 @@ static int xio_tcp_cancel_rsp_handler(struct xio_tcp_transport *tcp_hndl,
 		}
 	}
 
+notify:
 	/* fill notification event */
 	event_data.cancel.ulp_msg	  = ulp_msg;
 	event_data.cancel.ulp_msg_sz	  = ulp_msg_sz;
@@ -2803,14 +3023,11 @@ static int xio_tcp_on_recv_cancel_rsp_data(struct xio_tcp_transport *tcp_hndl,
 	struct xio_tcp_cancel_hdr cancel_hdr;
 	struct xio_sg_table_ops	*sgtbl_ops;
 	void			*sgtbl;
-	void			*sg;
 
 	imsg		= &task->imsg;
 	sgtbl		= xio_sg_table_get(&task->imsg.in);
 	sgtbl_ops	= (struct xio_sg_table_ops *)
 				xio_sg_table_ops_get(task->imsg.in.sgl_type);
-	sg = sge_first(sgtbl_ops, sgtbl);
-	sge_set_addr(sgtbl_ops, sg, NULL);
 	tbl_set_nents(sgtbl_ops, sgtbl, 0);
 
 	buff = imsg->in.header.iov_base;
@@ -2855,6 +3072,7 @@ static int xio_tcp_on_recv_cancel_rsp_header(
 
 	/* read the sn */
 	tcp_task->sn = rsp_hdr.sn;
+	tcp_task->tcp_op = (enum xio_tcp_op_code)rsp_hdr.opcode;
 
 	imsg = &task->imsg;
 	ulp_hdr = xio_mbuf_get_curr_ptr(&task->mbuf);
@@ -2880,14 +3098,11 @@ static int xio_tcp_on_recv_cancel_req_data(struct xio_tcp_transport *tcp_hndl,
 	uint16_t		ulp_msg_sz;
 	struct xio_sg_table_ops	*sgtbl_ops;
 	void			*sgtbl;
-	void			*sg;
 
 	imsg		= &task->imsg;
 	sgtbl		= xio_sg_table_get(&task->imsg.in);
 	sgtbl_ops	= (struct xio_sg_table_ops *)
 				xio_sg_table_ops_get(task->imsg.in.sgl_type);
-	sg = sge_first(sgtbl_ops, sgtbl);
-	sge_set_addr(sgtbl_ops, sg, NULL);
 	tbl_set_nents(sgtbl_ops, sgtbl, 0);
 
 	buff = imsg->in.header.iov_base;
@@ -2931,6 +3146,7 @@ static int xio_tcp_on_recv_cancel_req_header(
 
 	/* read the sn */
 	tcp_task->sn = req_hdr.sn;
+	tcp_task->tcp_op = (enum xio_tcp_op_code)req_hdr.opcode;
 
 	imsg	= &task->imsg;
 	ulp_hdr = xio_mbuf_get_curr_ptr(&task->mbuf);
@@ -3207,6 +3423,9 @@ int xio_tcp_rx_data_handler(struct xio_tcp_transport *tcp_hndl, int batch_nr)
 		while (i--) {
 			++ret_count;
 			tcp_task = (struct xio_tcp_task *)task->dd_data;
+			xio_ev_trace(tcp_hndl->base.ctx->ev_trace,
+				     XIO_EV_TCP_RX, tcp_hndl, task->ltid, 0,
+				     task->tlv_type);
 			switch (task->tlv_type) {
 			case XIO_CANCEL_REQ:
 				xio_tcp_on_recv_cancel_req_data(tcp_hndl, task);
@@ -3281,6 +3500,7 @@ int xio_tcp_rx_data_handler(struct xio_tcp_transport *tcp_hndl, int batch_nr)
 /*---------------------------------------------------------------------------*/
 int xio_tcp_rx_ctl_handler(struct xio_tcp_transport *tcp_hndl, int batch_nr)
 {
+	cycles_t rx_stamp = 0;
 	int retval = 0;
 	struct xio_tcp_task *tcp_task;
 	struct xio_task *task, *task_next;
@@ -3339,6 +3559,10 @@ int xio_tcp_rx_ctl_handler(struct xio_tcp_transport *tcp_hndl, int batch_nr)
 				break;
 			}
 			retval = xio_mbuf_read_first_tlv(&task->mbuf);
+			/* one stamp per batch - see xio_msg_trace.h */
+			if (!rx_stamp)
+				rx_stamp = get_cycles();
+			task->trace[XIO_TRACE_RX] = rx_stamp;
 			tcp_task->rxd.msg.msg_iov[0].iov_base =
 					tcp_task->rxd.msg_iov[1].iov_base;
 			tcp_task->rxd.msg.msg_iov[0].iov_len =
@@ -3488,69 +3712,47 @@ int xio_tcp_cancel_req(struct xio_transport_base *transport,
 {
 	struct xio_tcp_transport *tcp_hndl =
 		(struct xio_tcp_transport *)transport;
-	struct xio_task			*ptask, *next_ptask;
+	struct xio_task			*ptask;
 	union xio_transport_event_data	event_data;
 	struct xio_tcp_task		*tcp_task;
 	struct xio_tcp_cancel_hdr	cancel_hdr = {};
 	cancel_hdr.hdr_len = sizeof(cancel_hdr);
 
-	/* look in the tx_ready */
-	list_for_each_entry_safe(ptask, next_ptask, &tcp_hndl->tx_ready_list,
-				 tasks_list_entry) {
-		if (ptask->omsg &&
-		    (ptask->omsg->sn == req->sn) &&
-		    (ptask->stag == stag)) {
-			TRACE_LOG("[%lu] - message found on tx_ready_list\n",
-				  req->sn);
+	ptask = xio_tcp_req_lookup(tcp_hndl, req->sn, stag);
+	if (!ptask)
+		goto not_found;
 
-			tcp_task = (struct xio_tcp_task *)ptask->dd_data;
+	tcp_task = (struct xio_tcp_task *)ptask->dd_data;
 
-			if (tcp_task->txd.stage != XIO_TCP_TX_BEFORE)
-				goto send_cancel;
+	/* not yet handed to the socket - still on tx_ready */
+	if (tcp_task->txd.stage == XIO_TCP_TX_BEFORE) {
+		TRACE_LOG("[%lu] - message found on tx_ready_list\n",
+			  req->sn);
 
-			/* return decrease ref count from task */
-			xio_tasks_pool_put(ptask);
-			tcp_hndl->tx_ready_tasks_num--;
-			list_move_tail(&ptask->tasks_list_entry,
-				       &tcp_hndl->tx_comp_list);
+		xio_tcp_req_idx_del(tcp_hndl, ptask);
 
-			/* fill notification event */
-			event_data.cancel.ulp_msg	=  ulp_msg;
-			event_data.cancel.ulp_msg_sz	=  ulp_msg_sz;
-			event_data.cancel.task		=  ptask;
-			event_data.cancel.result	=  XIO_E_MSG_CANCELED;
+		/* return decrease ref count from task */
+		xio_tasks_pool_put(ptask);
+		tcp_hndl->tx_ready_tasks_num--;
+		list_move_tail(&ptask->tasks_list_entry,
+			       &tcp_hndl->tx_comp_list);
 
-			xio_transport_notify_observer(
-					&tcp_hndl->base,
-					XIO_TRANSPORT_CANCEL_RESPONSE,
-					&event_data);
-			return 0;
-		}
-	}
-	/* look in the in_flight */
-	list_for_each_entry_safe(ptask, next_ptask, &tcp_hndl->in_flight_list,
-				 tasks_list_entry) {
-		if (ptask->omsg &&
-		    (ptask->omsg->sn == req->sn) &&
-		    (ptask->stag == stag) &&
-		    (ptask->state != XIO_TASK_STATE_RESPONSE_RECV)) {
-			TRACE_LOG("[%lu] - message found on in_flight_list\n",
-				  req->sn);
-			goto send_cancel;
-		}
-	}
-	/* look in the tx_comp */
-	list_for_each_entry_safe(ptask, next_ptask, &tcp_hndl->tx_comp_list,
-				 tasks_list_entry) {
-		if (ptask->omsg &&
-		    (ptask->omsg->sn == req->sn) &&
-		    (ptask->stag == stag) &&
-		    (ptask->state != XIO_TASK_STATE_RESPONSE_RECV)) {
-			TRACE_LOG("[%lu] - message found on tx_comp_list\n",
-				  req->sn);
-			goto send_cancel;
-		}
+		/* fill notification event */
+		event_data.cancel.ulp_msg	=  ulp_msg;
+		event_data.cancel.ulp_msg_sz	=  ulp_msg_sz;
+		event_data.cancel.task		=  ptask;
+		event_data.cancel.result	=  XIO_E_MSG_CANCELED;
+
+		xio_transport_notify_observer(
+				&tcp_hndl->base,
+				XIO_TRANSPORT_CANCEL_RESPONSE,
+				&event_data);
+		return 0;
 	}
+	if (ptask->state != XIO_TASK_STATE_RESPONSE_RECV)
+		goto send_cancel;
+
+not_found:
 	TRACE_LOG("[%lu] - message not found on tx path\n", req->sn);
 
 	/* fill notification event */
@@ -3569,9 +3771,11 @@ send_cancel:
 
 	TRACE_LOG("[%lu] - send cancel request\n", req->sn);
 
-	tcp_task	= (struct xio_tcp_task *)ptask->dd_data;
 	cancel_hdr.sn	= tcp_task->sn;
 
+	/* the response is matched back to ptask by its tcp sn */
+	xio_sn_hash_insert(&tcp_hndl->cancel_hash, tcp_task->sn, ptask);
+
 	xio_tcp_send_cancel(tcp_hndl, XIO_CANCEL_REQ, &cancel_hdr,
 			    ulp_msg, ulp_msg_sz);
 
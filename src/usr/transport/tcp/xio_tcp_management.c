@@ -53,6 +53,7 @@
 #include "xio_ev_data.h"
 #include "xio_workqueue.h"
 #include "xio_context.h"
+#include "xio_sn_hash.h"
 #include "xio_tcp_transport.h"
 #include "xio_mem.h"
 
@@ -67,12 +68,20 @@
 #define XIO_OPTVAL_DEF_TCP_SO_SNDBUF			4194304
 #define XIO_OPTVAL_DEF_TCP_SO_RCVBUF			4194304
 #define XIO_OPTVAL_DEF_TCP_DUAL_SOCK			1
+#define XIO_OPTVAL_DEF_TCP_REUSE_PORT			0
+#define XIO_OPTVAL_DEF_TCP_INCOMING_CPU			0
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU					49
+#endif
 
 
 /*---------------------------------------------------------------------------*/
 /* globals								     */
 /*---------------------------------------------------------------------------*/
 static spinlock_t			mngmt_lock;
+static spinlock_t			reuseport_lock;
+static LIST_HEAD(reuseport_groups);
 static thread_once_t			ctor_key_once = THREAD_ONCE_INIT;
 static thread_once_t			dtor_key_once = THREAD_ONCE_INIT;
 extern struct xio_transport		xio_tcp_transport;
@@ -92,6 +101,8 @@ struct xio_tcp_options			tcp_options = {
 	XIO_OPTVAL_DEF_TCP_SO_SNDBUF,		/*tcp_so_sndbuf*/
 	XIO_OPTVAL_DEF_TCP_SO_RCVBUF,		/*tcp_so_rcvbuf*/
 	XIO_OPTVAL_DEF_TCP_DUAL_SOCK,		/*tcp_dual_sock*/
+	XIO_OPTVAL_DEF_TCP_REUSE_PORT,		/*tcp_reuse_port*/
+	XIO_OPTVAL_DEF_TCP_INCOMING_CPU,	/*tcp_incoming_cpu*/
 	0					/*pad*/
 };
 
@@ -213,6 +224,152 @@ int xio_tcp_dual_sock_del_ev_handlers(struct xio_tcp_transport *tcp_hndl)
 	return retval1 | retval2;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_reuseport_group_get						     */
+/*---------------------------------------------------------------------------*/
+static struct xio_tcp_reuseport_group *xio_tcp_reuseport_group_get(
+		const char *portal_uri)
+{
+	struct xio_tcp_reuseport_group *group;
+
+	spin_lock(&reuseport_lock);
+	list_for_each_entry(group, &reuseport_groups, groups_list_entry) {
+		if (!strcmp(group->portal_uri, portal_uri)) {
+			group->listeners_nr++;
+			spin_unlock(&reuseport_lock);
+			return group;
+		}
+	}
+	group = (struct xio_tcp_reuseport_group *)ucalloc(1, sizeof(*group));
+	if (!group)
+		goto cleanup;
+	group->portal_uri = strdup(portal_uri);
+	if (!group->portal_uri) {
+		ufree(group);
+		goto cleanup;
+	}
+	INIT_LIST_HEAD(&group->pending_conns);
+	INIT_LIST_HEAD(&group->handoff_conns);
+	group->listeners_nr = 1;
+	list_add_tail(&group->groups_list_entry, &reuseport_groups);
+	spin_unlock(&reuseport_lock);
+
+	return group;
+
+cleanup:
+	spin_unlock(&reuseport_lock);
+	xio_set_error(ENOMEM);
+	ERROR_LOG("reuseport group allocation failed\n");
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_reuseport_group_put						     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_reuseport_group_put(struct xio_tcp_reuseport_group *group)
+{
+	struct xio_tcp_pending_conn *pconn, *next_pconn;
+
+	spin_lock(&reuseport_lock);
+	if (--group->listeners_nr) {
+		spin_unlock(&reuseport_lock);
+		return;
+	}
+	list_del(&group->groups_list_entry);
+	spin_unlock(&reuseport_lock);
+
+	/* listeners flush their own conns on close, nothing should be left */
+	list_for_each_entry_safe(pconn, next_pconn, &group->pending_conns,
+				 conns_list_entry) {
+		list_del(&pconn->conns_list_entry);
+		close(pconn->fd);
+		ufree(pconn);
+	}
+	ufree(group->portal_uri);
+	ufree(group);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_reuseport_group_flush					     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_reuseport_group_flush(struct xio_tcp_transport *tcp_hndl)
+{
+	struct xio_tcp_reuseport_group *group = tcp_hndl->reuseport_group;
+	struct xio_tcp_pending_conn *pconn, *next_pconn;
+
+	/* drop the half connections this listener parked and the pairs
+	 * handed to it, before its context goes away under them
+	 */
+	spin_lock(&reuseport_lock);
+	list_for_each_entry_safe(pconn, next_pconn, &group->pending_conns,
+				 conns_list_entry) {
+		if (pconn->listener != tcp_hndl)
+			continue;
+		list_del(&pconn->conns_list_entry);
+		close(pconn->fd);
+		ufree(pconn);
+	}
+	list_for_each_entry_safe(pconn, next_pconn, &group->handoff_conns,
+				 conns_list_entry) {
+		if (pconn->listener != tcp_hndl)
+			continue;
+		list_del(&pconn->conns_list_entry);
+		xio_ctx_del_work(tcp_hndl->base.ctx, &pconn->handoff_work);
+		close(pconn->fd);
+		close(pconn->peer_fd);
+		ufree(pconn);
+	}
+	spin_unlock(&reuseport_lock);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_find_matching_conn						     */
+/*---------------------------------------------------------------------------*/
+static struct xio_tcp_pending_conn *xio_tcp_find_matching_conn(
+		struct list_head *pending_conns,
+		struct xio_tcp_pending_conn *pending_conn)
+{
+	struct xio_tcp_pending_conn *pconn;
+
+	list_for_each_entry(pconn, pending_conns, conns_list_entry) {
+		if (pconn->waiting_for_bytes)
+			continue;
+
+		if (pconn->sa.sa.sa_family == AF_INET) {
+			if ((pconn->msg.second_port ==
+			    ntohs(pending_conn->sa.sa_in.sin_port)) &&
+			    (pconn->sa.sa_in.sin_addr.s_addr ==
+			    pending_conn->sa.sa_in.sin_addr.s_addr)) {
+				if (ntohs(pconn->sa.sa_in.sin_port) !=
+				    pending_conn->msg.second_port) {
+					ERROR_LOG("ports mismatch\n");
+					return NULL;
+				}
+				return pconn;
+			}
+		} else if (pconn->sa.sa.sa_family == AF_INET6) {
+			if ((pconn->msg.second_port ==
+			     ntohs(pending_conn->sa.sa_in6.sin6_port)) &&
+			     !memcmp(&pconn->sa.sa_in6.sin6_addr,
+				     &pending_conn->sa.sa_in6.sin6_addr,
+				     sizeof(pconn->sa.sa_in6.sin6_addr))) {
+				if (ntohs(pconn->sa.sa_in6.sin6_port)
+				    != pending_conn->msg.second_port) {
+					ERROR_LOG("ports mismatch\n");
+					return NULL;
+				}
+				return pconn;
+			}
+		} else {
+			ERROR_LOG("unknown family %d\n",
+				  pconn->sa.sa.sa_family);
+		}
+	}
+
+	return NULL;
+}
+
 /*---------------------------------------------------------------------------*/
 /* on_sock_disconnected							     */
 /*---------------------------------------------------------------------------*/
@@ -242,6 +399,9 @@ void on_sock_disconnected(struct xio_tcp_transport *tcp_hndl,
 		}
 		tcp_hndl->sock.ops->close(&tcp_hndl->sock);
 
+		if (tcp_hndl->reuseport_group)
+			xio_tcp_reuseport_group_flush(tcp_hndl);
+
 		list_for_each_entry_safe(pconn, next_pconn,
 					 &tcp_hndl->pending_conns,
 					 conns_list_entry) {
@@ -284,6 +444,12 @@ static void xio_tcp_post_close(struct xio_tcp_transport *tcp_hndl)
 
 	ufree(tcp_hndl->base.portal_uri);
 
+	if (tcp_hndl->reuseport_group)
+		xio_tcp_reuseport_group_put(tcp_hndl->reuseport_group);
+
+	xio_sn_hash_destroy(&tcp_hndl->req_hash);
+	xio_sn_hash_destroy(&tcp_hndl->cancel_hash);
+
 	XIO_OBSERVABLE_DESTROY(&tcp_hndl->base.observable);
 
 	ufree(tcp_hndl);
@@ -855,6 +1021,9 @@ struct xio_tcp_transport *xio_tcp_transport_create(
 
 	INIT_LIST_HEAD(&tcp_hndl->pending_conns);
 
+	xio_sn_hash_init(&tcp_hndl->req_hash);
+	xio_sn_hash_init(&tcp_hndl->cancel_hash);
+
 	memset(&tcp_hndl->flush_tx_event, 0, sizeof(xio_ctx_event_t));
 	xio_ctx_init_event(&tcp_hndl->flush_tx_event,
 			   xio_tcp_flush_tx_handler, tcp_hndl);
@@ -876,6 +1045,164 @@ cleanup:
 	return NULL;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_new_child							     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_new_child(struct xio_tcp_transport *parent_hndl,
+			      struct xio_tcp_pending_conn *ctl_conn,
+			      int cfd, int dfd)
+{
+	int retval;
+	socklen_t len = 0;
+	struct xio_tcp_transport *child_hndl = NULL;
+	union xio_transport_event_data ev_data;
+
+	child_hndl = xio_tcp_transport_create(parent_hndl->transport,
+					      parent_hndl->base.ctx,
+					      NULL,
+					      0);
+	if (!child_hndl) {
+		ERROR_LOG("failed to create tcp child\n");
+		xio_transport_notify_observer_error(&parent_hndl->base,
+						    xio_errno());
+		ufree(ctl_conn);
+		goto cleanup;
+	}
+
+	memcpy(&child_hndl->base.peer_addr,
+	       &ctl_conn->sa.sa_stor,
+	       sizeof(child_hndl->base.peer_addr));
+	ufree(ctl_conn);
+
+	if (cfd == dfd) {
+		child_hndl->sock.cfd = cfd;
+		child_hndl->sock.dfd = cfd;
+		child_hndl->sock.ops = &single_sock_ops;
+
+	} else {
+		child_hndl->sock.cfd = cfd;
+		child_hndl->sock.dfd = dfd;
+		child_hndl->sock.ops = &dual_sock_ops;
+
+		child_hndl->tmp_rx_buf = ucalloc(1, TMP_RX_BUF_SIZE);
+		if (!child_hndl->tmp_rx_buf) {
+			xio_set_error(ENOMEM);
+			ERROR_LOG("ucalloc failed. %m\n");
+			goto cleanup;
+		}
+		child_hndl->tmp_rx_buf_cur = child_hndl->tmp_rx_buf;
+	}
+
+
+	len = sizeof(child_hndl->base.local_addr);
+	retval = getsockname(child_hndl->sock.cfd,
+			     (struct sockaddr *)&child_hndl->base.local_addr,
+			     &len);
+	if (retval) {
+		xio_set_error(errno);
+		ERROR_LOG("tcp getsockname failed. (errno=%d %m)\n", errno);
+	}
+
+	ev_data.new_connection.child_trans_hndl =
+		(struct xio_transport_base *)child_hndl;
+	xio_transport_notify_observer((struct xio_transport_base *)parent_hndl,
+				      XIO_TRANSPORT_NEW_CONNECTION,
+				      &ev_data);
+
+	return;
+
+cleanup:
+	close(cfd);
+	if (dfd != cfd)
+		close(dfd);
+
+	if (child_hndl)
+		xio_tcp_post_close(child_hndl);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_reuseport_handoff_handler					     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_reuseport_handoff_handler(void *data)
+{
+	struct xio_tcp_pending_conn *ctl_conn =
+					(struct xio_tcp_pending_conn *)data;
+
+	spin_lock(&reuseport_lock);
+	list_del(&ctl_conn->conns_list_entry);
+	spin_unlock(&reuseport_lock);
+
+	xio_tcp_new_child(ctl_conn->listener, ctl_conn,
+			  ctl_conn->fd, ctl_conn->peer_fd);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_reuseport_pair						     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_reuseport_pair(struct xio_tcp_transport *parent_hndl,
+				   struct xio_tcp_pending_conn *pending_conn)
+{
+	struct xio_tcp_reuseport_group	*group = parent_hndl->reuseport_group;
+	struct xio_tcp_pending_conn	*matching_conn;
+	struct xio_tcp_pending_conn	*ctl_conn, *data_conn;
+	int				retval;
+
+	/* the peer socket may be accepted by any listener in the group,
+	 * so the halves are paired on the group list
+	 */
+	list_del(&pending_conn->conns_list_entry);
+	retval = xio_context_del_ev_handler(parent_hndl->base.ctx,
+					    pending_conn->fd);
+	if (retval) {
+		ERROR_LOG("removing connection handler failed.(errno=%d %m)\n",
+			  errno);
+	}
+	pending_conn->listener = parent_hndl;
+
+	spin_lock(&reuseport_lock);
+	matching_conn = xio_tcp_find_matching_conn(&group->pending_conns,
+						   pending_conn);
+	if (!matching_conn) {
+		list_add_tail(&pending_conn->conns_list_entry,
+			      &group->pending_conns);
+		spin_unlock(&reuseport_lock);
+		return;
+	}
+	list_del(&matching_conn->conns_list_entry);
+
+	if (pending_conn->msg.sock_type == XIO_TCP_CTL_SOCK) {
+		ctl_conn = pending_conn;
+		data_conn = matching_conn;
+	} else {
+		ctl_conn = matching_conn;
+		data_conn = pending_conn;
+	}
+	ctl_conn->peer_fd = data_conn->fd;
+	ufree(data_conn);
+
+	/* the connection lives where the kernel steered the control
+	 * socket. placing it on whichever listener happened to read the
+	 * second half would favor the busiest context.
+	 */
+	if (ctl_conn->listener != parent_hndl) {
+		list_add_tail(&ctl_conn->conns_list_entry,
+			      &group->handoff_conns);
+		retval = xio_ctx_add_work(ctl_conn->listener->base.ctx,
+					  ctl_conn,
+					  xio_tcp_reuseport_handoff_handler,
+					  &ctl_conn->handoff_work);
+		if (!retval) {
+			spin_unlock(&reuseport_lock);
+			return;
+		}
+		list_del(&ctl_conn->conns_list_entry);
+	}
+	spin_unlock(&reuseport_lock);
+
+	xio_tcp_new_child(parent_hndl, ctl_conn,
+			  ctl_conn->fd, ctl_conn->peer_fd);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_handle_pending_conn						     */
 /*---------------------------------------------------------------------------*/
@@ -888,10 +1215,7 @@ void xio_tcp_handle_pending_conn(int fd,
 	struct xio_tcp_pending_conn *pending_conn = NULL, *matching_conn = NULL;
 	struct xio_tcp_pending_conn *ctl_conn = NULL, *data_conn = NULL;
 	void *buf;
-	int cfd = 0, dfd = 0, is_single = 1;
-	socklen_t len = 0;
-	struct xio_tcp_transport *child_hndl = NULL;
-	union xio_transport_event_data ev_data;
+	int cfd = fd, dfd = fd;
 
 	list_for_each_entry_safe(pconn, next_pconn,
 				 &parent_hndl->pending_conns,
@@ -945,47 +1269,13 @@ void xio_tcp_handle_pending_conn(int fd,
 		goto single_sock;
 	}
 
-	is_single = 0;
-
-	list_for_each_entry_safe(pconn, next_pconn,
-				 &parent_hndl->pending_conns,
-				 conns_list_entry) {
-		if (pconn->waiting_for_bytes)
-			continue;
-
-		if (pconn->sa.sa.sa_family == AF_INET) {
-			if ((pconn->msg.second_port ==
-			    ntohs(pending_conn->sa.sa_in.sin_port)) &&
-			    (pconn->sa.sa_in.sin_addr.s_addr ==
-			    pending_conn->sa.sa_in.sin_addr.s_addr)) {
-				matching_conn = pconn;
-				if (ntohs(matching_conn->sa.sa_in.sin_port) !=
-				    pending_conn->msg.second_port) {
-					ERROR_LOG("ports mismatch\n");
-					return;
-				}
-				break;
-			}
-		} else if (pconn->sa.sa.sa_family == AF_INET6) {
-			if ((pconn->msg.second_port ==
-			     ntohs(pending_conn->sa.sa_in6.sin6_port)) &&
-			     !memcmp(&pconn->sa.sa_in6.sin6_addr,
-				     &pending_conn->sa.sa_in6.sin6_addr,
-				     sizeof(pconn->sa.sa_in6.sin6_addr))) {
-				matching_conn = pconn;
-				if (ntohs(matching_conn->sa.sa_in6.sin6_port)
-				    != pending_conn->msg.second_port) {
-					ERROR_LOG("ports mismatch\n");
-					return;
-				}
-				break;
-			}
-		} else {
-			ERROR_LOG("unknown family %d\n",
-				  pconn->sa.sa.sa_family);
-		}
+	if (parent_hndl->reuseport_group) {
+		xio_tcp_reuseport_pair(parent_hndl, pending_conn);
+		return;
 	}
 
+	matching_conn = xio_tcp_find_matching_conn(&parent_hndl->pending_conns,
+						   pending_conn);
 	if (!matching_conn)
 		return;
 
@@ -1018,57 +1308,7 @@ single_sock:
 			  errno);
 	}
 
-	child_hndl = xio_tcp_transport_create(parent_hndl->transport,
-					      parent_hndl->base.ctx,
-					      NULL,
-					      0);
-	if (!child_hndl) {
-		ERROR_LOG("failed to create tcp child\n");
-		xio_transport_notify_observer_error(&parent_hndl->base,
-						    xio_errno());
-		ufree(ctl_conn);
-		goto cleanup3;
-	}
-
-	memcpy(&child_hndl->base.peer_addr,
-	       &ctl_conn->sa.sa_stor,
-	       sizeof(child_hndl->base.peer_addr));
-	ufree(ctl_conn);
-
-	if (is_single) {
-		child_hndl->sock.cfd = fd;
-		child_hndl->sock.dfd = fd;
-		child_hndl->sock.ops = &single_sock_ops;
-
-	} else {
-		child_hndl->sock.cfd = cfd;
-		child_hndl->sock.dfd = dfd;
-		child_hndl->sock.ops = &dual_sock_ops;
-
-		child_hndl->tmp_rx_buf = ucalloc(1, TMP_RX_BUF_SIZE);
-		if (!child_hndl->tmp_rx_buf) {
-			xio_set_error(ENOMEM);
-			ERROR_LOG("ucalloc failed. %m\n");
-			goto cleanup3;
-		}
-		child_hndl->tmp_rx_buf_cur = child_hndl->tmp_rx_buf;
-	}
-
-
-	len = sizeof(child_hndl->base.local_addr);
-	retval = getsockname(child_hndl->sock.cfd,
-			     (struct sockaddr *)&child_hndl->base.local_addr,
-			     &len);
-	if (retval) {
-		xio_set_error(errno);
-		ERROR_LOG("tcp getsockname failed. (errno=%d %m)\n", errno);
-	}
-
-	ev_data.new_connection.child_trans_hndl =
-		(struct xio_transport_base *)child_hndl;
-	xio_transport_notify_observer((struct xio_transport_base *)parent_hndl,
-				      XIO_TRANSPORT_NEW_CONNECTION,
-				      &ev_data);
+	xio_tcp_new_child(parent_hndl, ctl_conn, cfd, dfd);
 
 	return;
 
@@ -1083,16 +1323,7 @@ cleanup2:
 		"removing connection handler failed.(errno=%d %m)\n",
 		errno);
 	}
-cleanup3:
-	if (is_single) {
-		close(fd);
-	} else {
-		close(cfd);
-		close(dfd);
-	}
-
-	if (child_hndl)
-		xio_tcp_post_close(child_hndl);
+	close(fd);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -1174,6 +1405,41 @@ void xio_tcp_listener_ev_handler(int fd, int events, void *user_context)
 	}
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_set_reuseport						     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_set_reuseport(struct xio_tcp_transport *tcp_hndl,
+				 const char *portal_uri)
+{
+	int optval = 1;
+	int retval;
+
+	retval = setsockopt(tcp_hndl->sock.cfd, SOL_SOCKET, SO_REUSEPORT,
+			    (char *)&optval, sizeof(optval));
+	if (retval) {
+		xio_set_error(errno);
+		ERROR_LOG("setsockopt failed. (errno=%d %m)\n", errno);
+		return -1;
+	}
+	/* let the kernel pick the group member running on the cpu that
+	 * took the connection's rx interrupt, best effort
+	 */
+	if (tcp_options.tcp_incoming_cpu && tcp_hndl->base.ctx->cpuid >= 0) {
+		optval = tcp_hndl->base.ctx->cpuid;
+		retval = setsockopt(tcp_hndl->sock.cfd, SOL_SOCKET,
+				    SO_INCOMING_CPU,
+				    (char *)&optval, sizeof(optval));
+		if (retval)
+			WARN_LOG("SO_INCOMING_CPU failed. (errno=%d %m)\n",
+				 errno);
+	}
+	tcp_hndl->reuseport_group = xio_tcp_reuseport_group_get(portal_uri);
+	if (!tcp_hndl->reuseport_group)
+		return -1;
+
+	return 0;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_listen							     */
 /*---------------------------------------------------------------------------*/
@@ -1197,6 +1463,11 @@ static int xio_tcp_listen(struct xio_transport_base *transport,
 	}
 	tcp_hndl->base.is_client = 0;
 
+	if (tcp_options.tcp_reuse_port) {
+		if (xio_tcp_set_reuseport(tcp_hndl, portal_uri))
+			goto exit;
+	}
+
 	/* bind */
 	retval = bind(tcp_hndl->sock.cfd,
 		      (struct sockaddr *)&sa.sa_stor,
@@ -1615,6 +1886,24 @@ static int xio_tcp_connect(struct xio_transport_base *transport,
 				  errno);
 			goto exit;
 		}
+		/* the passive side pairs the two streams by source address,
+		 * the data stream takes its own port
+		 */
+		if (tcp_hndl->sock.dfd != tcp_hndl->sock.cfd) {
+			if (if_sa.sa.sa_family == AF_INET)
+				if_sa.sa_in.sin_port = 0;
+			else
+				if_sa.sa_in6.sin6_port = 0;
+			retval = bind(tcp_hndl->sock.dfd,
+				      (struct sockaddr *)&if_sa.sa_stor,
+				      sa_len);
+			if (retval) {
+				xio_set_error(errno);
+				ERROR_LOG("tcp bind failed. (errno=%d %m)\n",
+					  errno);
+				goto exit;
+			}
+		}
 	}
 
 	/* connect */
@@ -1703,6 +1992,7 @@ static int xio_set_cpu_latency(int *fd)
 static void xio_tcp_init(void)
 {
 	spin_lock_init(&mngmt_lock);
+	spin_lock_init(&reuseport_lock);
 
 	/* set cpu latency until process is down */
 	xio_set_cpu_latency(&cdl_fd);
@@ -1859,7 +2149,7 @@ static int xio_tcp_initial_pool_slab_pre_create(
 	tcp_slab->buf_size = CONN_SETUP_BUF_SIZE;
 	pool_size = tcp_slab->buf_size * alloc_nr;
 
-	tcp_slab->data_pool = ucalloc(pool_size * alloc_nr, sizeof(uint8_t));
+	tcp_slab->data_pool = ucalloc(pool_size, sizeof(uint8_t));
 	if (tcp_slab->data_pool == NULL) {
 		xio_set_error(ENOMEM);
 		ERROR_LOG("ucalloc conn_setup_data_pool sz: %u failed\n",
@@ -2054,10 +2344,10 @@ static int xio_tcp_primary_pool_slab_pre_create(
 		}
 		tcp_slab->data_pool = tcp_slab->io_buf->addr;
 	} else {
-		/* maybe allocation of with unuma_alloc can provide better
-		 * performance?
-		 */
+		/* huge pages, placed on the node of the context */
 		tcp_slab->data_pool = umalloc_huge_pages(alloc_sz);
+		xio_mem_set_node(tcp_slab->data_pool, alloc_sz,
+				 tcp_hndl->base.ctx->nodeid);
 		if (!tcp_slab->data_pool) {
 			xio_set_error(ENOMEM);
 			ERROR_LOG("malloc tcp pool sz:%zu failed\n",
@@ -2184,6 +2474,8 @@ static int xio_tcp_task_pre_put(
 	unsigned int	i;
 	XIO_TO_TCP_TASK(task, tcp_task);
 
+	xio_tcp_req_idx_del(tcp_task->tcp_hndl, task);
+
 	/* recycle TCP  buffers back to pool */
 
 	/* put buffers back to pool */
@@ -2344,6 +2636,16 @@ static int xio_tcp_set_opt(void *xio_obj,
 		tcp_options.tcp_dual_sock = *((int *)optval);
 		return 0;
 		break;
+	case XIO_OPTNAME_TCP_REUSE_PORT:
+		VALIDATE_SZ(sizeof(int));
+		tcp_options.tcp_reuse_port = *((int *)optval);
+		return 0;
+		break;
+	case XIO_OPTNAME_TCP_INCOMING_CPU:
+		VALIDATE_SZ(sizeof(int));
+		tcp_options.tcp_incoming_cpu = *((int *)optval);
+		return 0;
+		break;
 	default:
 		break;
 	}
@@ -2403,6 +2705,16 @@ static int xio_tcp_get_opt(void  *xio_obj,
 		*optlen = sizeof(int);
 		return 0;
 		break;
+	case XIO_OPTNAME_TCP_REUSE_PORT:
+		*((int *)optval) = tcp_options.tcp_reuse_port;
+		*optlen = sizeof(int);
+		return 0;
+		break;
+	case XIO_OPTNAME_TCP_INCOMING_CPU:
+		*((int *)optval) = tcp_options.tcp_incoming_cpu;
+		*optlen = sizeof(int);
+		return 0;
+		break;
 	default:
 		break;
 	}
@@ -2511,6 +2823,100 @@ static int xio_tcp_is_valid_out_msg(struct xio_msg *msg)
 	return 1;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_pool_bufs_held						     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_pool_bufs_held(struct xio_tcp_transport *tcp_hndl)
+{
+	struct xio_tasks_pool	*pool = (struct xio_tasks_pool *)
+					tcp_hndl->primary_pool_cls.pool;
+	struct xio_task		*task;
+	struct xio_tcp_task	*tcp_task;
+	unsigned int		tid, i;
+
+	if (!tcp_options.enable_mem_pool || !pool)
+		return 0;
+
+	/* buffers return to the mempool they came from, on the thread
+	 * that puts the task - any still held pin the old context's pool
+	 */
+	for (tid = 0; tid < pool->curr_alloced; tid++) {
+		task = xio_tcp_primary_task_lookup(tcp_hndl, tid);
+		if (!task)
+			continue;
+		tcp_task = (struct xio_tcp_task *)task->dd_data;
+		for (i = 0; i < tcp_task->read_num_sge; i++)
+			if (tcp_task->read_sge[i].cache)
+				return 1;
+		for (i = 0; i < tcp_task->write_num_sge; i++)
+			if (tcp_task->write_sge[i].cache)
+				return 1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_detach							     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_detach(struct xio_transport_base *transport)
+{
+	struct xio_tcp_transport *tcp_hndl =
+			(struct xio_tcp_transport *)transport;
+
+	if (tcp_hndl->state == XIO_STATE_CONNECTED &&
+	    list_empty(&tcp_hndl->tx_ready_list))
+		xio_tcp_flush_tx_completions(tcp_hndl);
+
+	/* nothing may be queued on the context: no io in flight, no
+	 * partial control frame and no pending events
+	 */
+	if (tcp_hndl->state != XIO_STATE_CONNECTED ||
+	    !list_empty(&tcp_hndl->in_flight_list) ||
+	    !list_empty(&tcp_hndl->tx_ready_list) ||
+	    !list_empty(&tcp_hndl->tx_comp_list) ||
+	    !list_empty(&tcp_hndl->io_list) ||
+	    tcp_hndl->tx_comp_cnt || tcp_hndl->tmp_rx_buf_len ||
+	    tcp_hndl->flush_tx_event.scheduled ||
+	    tcp_hndl->ctl_rx_event.scheduled ||
+	    tcp_hndl->disconnect_event.scheduled ||
+	    xio_tcp_pool_bufs_held(tcp_hndl)) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+
+	/* the sockets stay open, only the old loop stops polling them */
+	if (tcp_hndl->sock.ops->del_ev_handlers(tcp_hndl)) {
+		xio_set_error(errno);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_attach							     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_attach(struct xio_transport_base *transport,
+			  struct xio_context *ctx)
+{
+	struct xio_tcp_transport *tcp_hndl =
+			(struct xio_tcp_transport *)transport;
+
+	tcp_hndl->base.ctx = ctx;
+	if (tcp_options.enable_mem_pool) {
+		tcp_hndl->tcp_mempool = xio_transport_mempool_get(ctx, 0);
+		if (!tcp_hndl->tcp_mempool) {
+			xio_set_error(ENOMEM);
+			ERROR_LOG("allocating tcp mempool failed. %m\n");
+			return -1;
+		}
+	}
+
+	/* data that arrived meanwhile is reported by the new loop */
+	return tcp_hndl->sock.ops->add_ev_handlers(tcp_hndl);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_tcp_dup2			                                             */
 /* makes new_trans_hndl be the copy of old_trans_hndl, closes new_trans_hndl */
@@ -2576,6 +2982,8 @@ static void init_xio_tcp_transport() {
 	xio_tcp_transport.reject = xio_tcp_reject;
 	xio_tcp_transport.close = xio_tcp_close;
 	xio_tcp_transport.dup2 = xio_tcp_dup2;
+	xio_tcp_transport.detach = xio_tcp_detach;
+	xio_tcp_transport.attach = xio_tcp_attach;
 	/*	.update_task		= xio_tcp_update_task;*/
 	xio_tcp_transport.send = xio_tcp_send;
 	xio_tcp_transport.poll = xio_tcp_poll;
@@ -0,0 +1,679 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <xio_predefs.h>
+#include <xio_env.h>
+#include <xio_os.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_observer.h"
+#include "xio_protocol.h"
+#include "xio_mbuf.h"
+#include "xio_task.h"
+#include "xio_sg_table.h"
+#include "xio_transport.h"
+#include "xio_mempool.h"
+#include "xio_usr_transport.h"
+#include "xio_ev_data.h"
+#include "xio_workqueue.h"
+#include "xio_context.h"
+#include "xio_sn_hash.h"
+#include "xio_tcp_transport.h"
+#include "xio_clock.h"
+
+/*
+ * shim+tcp - the tcp transport behind an impaired link, for benchmarking
+ * reconnect, flow control and tail latency without tc/netem. built and
+ * registered only with --enable-tcp-shim (XIO_TCP_SHIM).
+ *
+ * the transport shares every operation of "tcp" but send: the tasks a
+ * handle sends are held in order and handed to tcp once due - after the
+ * one way delay, a uniform +-jitter and the serialization time at the
+ * configured rate - by a delayed work of the handle's context. tcp keeps
+ * the order, so a task is never due before the one ahead of it. a handle
+ * may also be dropped - its sockets shut down under it - after a random
+ * time around the drop interval, which the peers see as a failed link.
+ *
+ * only sends are impaired: bind the server to shim+tcp too for both
+ * directions. the impairment is read from the environment at startup:
+ *
+ *	XIO_SHIM="delay=20ms,jitter=2ms,rate=100mbit,drop=30s,seed=7"
+ *
+ * times take ns, us, ms or s (default us), rates kbit, mbit or gbit
+ * (default bit) per second. the release work has the millisecond
+ * granularity of the context's timers.
+ */
+
+/* the tcp header and the session layer headers, for the rate */
+#define XIO_TCP_SHIM_MSG_OVERHEAD	64
+#define XIO_TCP_SHIM_DUE_MIN		64
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_tcp_shim_options {
+	uint64_t			delay_ns;
+	uint64_t			jitter_ns;
+	uint64_t			rate_bps;	/* bits per second */
+	uint64_t			drop_ns;	/* mean interval */
+	unsigned int			seed;
+	int				pad;
+};
+
+struct xio_tcp_shim_unit {
+	const char			*suffix;
+	double				mult;
+};
+
+/* per tcp handle, found through its observer on the handle */
+struct xio_tcp_shim_hndl {
+	struct xio_transport_base	*trans_hndl;
+	struct xio_context		*ctx;
+	struct xio_observer		observer;
+	struct list_head		held_list;
+	uint64_t			*due;		/* ring, per held task */
+	uint32_t			due_head;
+	uint32_t			due_nr;
+	uint32_t			due_max;
+	unsigned int			seed;
+	uint64_t			last_due_ns;
+	uint64_t			link_free_ns;
+	xio_ctx_delayed_work_t		release_work;
+	xio_ctx_delayed_work_t		drop_work;
+};
+
+/*---------------------------------------------------------------------------*/
+/* globals								     */
+/*---------------------------------------------------------------------------*/
+static const struct xio_tcp_shim_unit time_units[] = {
+	{ "ns", 1 }, { "us", 1e3 }, { "ms", 1e6 }, { "s", 1e9 }, { "", 1e3 },
+	{ NULL, 0 }
+};
+
+static const struct xio_tcp_shim_unit rate_units[] = {
+	{ "kbit", 1e3 }, { "mbit", 1e6 }, { "gbit", 1e9 }, { "bit", 1 },
+	{ "", 1 }, { NULL, 0 }
+};
+
+static struct xio_tcp_shim_options	shim_options;
+static struct xio_transport		*tcp_transport;
+struct xio_transport			xio_tcp_shim_transport;
+
+static int xio_tcp_shim_on_transport_event(void *observer_impl,
+					   void *sender, int event,
+					   void *event_data);
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_parse_val - number with a unit suffix			     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_parse_val(const char *val, int is_rate,
+				  uint64_t *result)
+{
+	const struct xio_tcp_shim_unit	*unit = is_rate ? rate_units :
+							  time_units;
+	char				*end;
+	double				num;
+
+	num = strtod(val, &end);
+	if (end == val || num < 0)
+		return -1;
+
+	for (; unit->suffix; unit++) {
+		if (!strcmp(end, unit->suffix)) {
+			*result = (uint64_t)(num * unit->mult);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_parse_options						     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_parse_options(const char *spec,
+				      struct xio_tcp_shim_options *opts)
+{
+	char		buf[256];
+	char		*key, *val, *saveptr = NULL;
+	uint64_t	num;
+
+	if (strlen(spec) >= sizeof(buf))
+		return -1;
+	strcpy(buf, spec);
+
+	for (key = strtok_r(buf, ",", &saveptr); key;
+	     key = strtok_r(NULL, ",", &saveptr)) {
+		val = strchr(key, '=');
+		if (!val)
+			return -1;
+		*val++ = 0;
+
+		if (!strcmp(key, "seed")) {
+			opts->seed = (unsigned int)strtoul(val, NULL, 0);
+			continue;
+		}
+		if (xio_tcp_shim_parse_val(val, !strcmp(key, "rate"), &num))
+			return -1;
+
+		if (!strcmp(key, "delay"))
+			opts->delay_ns = num;
+		else if (!strcmp(key, "jitter"))
+			opts->jitter_ns = num;
+		else if (!strcmp(key, "rate"))
+			opts->rate_bps = num;
+		else if (!strcmp(key, "drop"))
+			opts->drop_ns = num;
+		else
+			return -1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_rand - uniform in [0, 1)				     */
+/*---------------------------------------------------------------------------*/
+static inline double xio_tcp_shim_rand(struct xio_tcp_shim_hndl *shim)
+{
+	return rand_r(&shim->seed) / ((double)RAND_MAX + 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_msec - a delayed work duration, rounded up		     */
+/*---------------------------------------------------------------------------*/
+static inline int xio_tcp_shim_msec(uint64_t due_ns, uint64_t now_ns)
+{
+	uint64_t msec;
+
+	if (due_ns <= now_ns)
+		return 0;
+	msec = (due_ns - now_ns + 999999) / 1000000;
+
+	return (int)min(msec, (uint64_t)INT_MAX);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_find - the shim of a tcp handle, if any			     */
+/*---------------------------------------------------------------------------*/
+static struct xio_tcp_shim_hndl *xio_tcp_shim_find(
+				struct xio_transport_base *trans_hndl)
+{
+	struct xio_observer_node *observer_node;
+
+	list_for_each_entry(observer_node,
+			    &trans_hndl->observable.observers_list,
+			    observers_list_node) {
+		if (observer_node->observer->notify ==
+		    xio_tcp_shim_on_transport_event)
+			return (struct xio_tcp_shim_hndl *)
+				observer_node->observer->impl;
+	}
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_flush - return the held tasks to their pools		     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shim_flush(struct xio_tcp_shim_hndl *shim)
+{
+	xio_ctx_del_delayed_work(shim->ctx, &shim->release_work);
+	xio_transport_flush_task_list(&shim->held_list);
+	INIT_LIST_HEAD(&shim->held_list);
+	shim->due_head	= 0;
+	shim->due_nr	= 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_destroy							     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shim_destroy(struct xio_tcp_shim_hndl *shim)
+{
+	xio_tcp_shim_flush(shim);
+	xio_ctx_del_delayed_work(shim->ctx, &shim->drop_work);
+	xio_transport_unreg_observer(shim->trans_hndl, &shim->observer);
+	ufree(shim->due);
+	ufree(shim);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_drop - shut the sockets down under the handle		     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shim_drop(void *data)
+{
+	struct xio_tcp_shim_hndl	*shim = (struct xio_tcp_shim_hndl *)data;
+	struct xio_tcp_transport	*tcp_hndl =
+		(struct xio_tcp_transport *)shim->trans_hndl;
+
+	if (tcp_hndl->state != XIO_STATE_CONNECTED)
+		return;
+
+	WARN_LOG("shim+tcp: dropping handle:%p\n", tcp_hndl);
+
+	shutdown(tcp_hndl->sock.cfd, SHUT_RDWR);
+	if (tcp_hndl->sock.dfd >= 0 && tcp_hndl->sock.dfd != tcp_hndl->sock.cfd)
+		shutdown(tcp_hndl->sock.dfd, SHUT_RDWR);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_arm_drop - between half and one and a half intervals	     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shim_arm_drop(struct xio_tcp_shim_hndl *shim)
+{
+	uint64_t drop_ns;
+
+	if (!shim_options.drop_ns)
+		return;
+
+	drop_ns = (uint64_t)(shim_options.drop_ns *
+			     (0.5 + xio_tcp_shim_rand(shim)));
+	xio_ctx_add_delayed_work(shim->ctx, xio_tcp_shim_msec(drop_ns, 0),
+				 shim, xio_tcp_shim_drop, &shim->drop_work);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_create - on the first send of a handle			     */
+/*---------------------------------------------------------------------------*/
+static struct xio_tcp_shim_hndl *xio_tcp_shim_create(
+				struct xio_transport_base *trans_hndl)
+{
+	struct xio_tcp_shim_hndl *shim;
+
+	shim = (struct xio_tcp_shim_hndl *)ucalloc(1, sizeof(*shim));
+	if (!shim) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("ucalloc failed. %m\n");
+		return NULL;
+	}
+	shim->due = (uint64_t *)umalloc(XIO_TCP_SHIM_DUE_MIN *
+					sizeof(*shim->due));
+	if (!shim->due) {
+		ufree(shim);
+		xio_set_error(ENOMEM);
+		ERROR_LOG("umalloc failed. %m\n");
+		return NULL;
+	}
+	shim->due_max		= XIO_TCP_SHIM_DUE_MIN;
+	shim->trans_hndl	= trans_hndl;
+	shim->ctx		= trans_hndl->ctx;
+	shim->seed		= shim_options.seed ^
+				  (unsigned int)uint64_from_ptr(trans_hndl);
+	INIT_LIST_HEAD(&shim->held_list);
+
+	XIO_OBSERVER_INIT(&shim->observer, shim,
+			  xio_tcp_shim_on_transport_event);
+	xio_transport_reg_observer(trans_hndl, &shim->observer);
+
+	xio_tcp_shim_arm_drop(shim);
+
+	return shim;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_on_transport_event					     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_on_transport_event(void *observer_impl,
+					   void *sender, int event,
+					   void *event_data)
+{
+	struct xio_tcp_shim_hndl *shim =
+		(struct xio_tcp_shim_hndl *)observer_impl;
+
+	switch (event) {
+	case XIO_TRANSPORT_DISCONNECTED:
+	case XIO_TRANSPORT_ERROR:
+		/* as tcp flushes its own tx queues */
+		xio_tcp_shim_flush(shim);
+		xio_ctx_del_delayed_work(shim->ctx, &shim->drop_work);
+		break;
+	case XIO_TRANSPORT_CLOSED:
+		xio_tcp_shim_destroy(shim);
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_release - hand the due tasks to tcp			     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shim_release(void *data)
+{
+	struct xio_tcp_shim_hndl	*shim = (struct xio_tcp_shim_hndl *)data;
+	union xio_transport_event_data	event_data;
+	struct xio_task			*task;
+	uint64_t			now = xio_now_ns();
+	uint64_t			due;
+
+	while (shim->due_nr) {
+		due = shim->due[shim->due_head];
+		if (due > now) {
+			xio_ctx_add_delayed_work(shim->ctx,
+						 xio_tcp_shim_msec(due, now),
+						 shim, xio_tcp_shim_release,
+						 &shim->release_work);
+			return;
+		}
+		shim->due_head = (shim->due_head + 1) % shim->due_max;
+		shim->due_nr--;
+
+		task = list_first_entry(&shim->held_list,
+					struct xio_task, tasks_list_entry);
+		if (tcp_transport->send(shim->trans_hndl, task) == 0)
+			continue;
+
+		ERROR_LOG("tcp send failed. handle:%p, err:%d\n",
+			  shim->trans_hndl, xio_errno());
+		list_del_init(&task->tasks_list_entry);
+		memset(&event_data, 0, sizeof(event_data));
+		event_data.msg_error.task	= task;
+		event_data.msg_error.reason	= (enum xio_status)xio_errno();
+		event_data.msg_error.direction	= XIO_MSG_DIRECTION_OUT;
+		xio_transport_notify_observer(shim->trans_hndl,
+					      XIO_TRANSPORT_MESSAGE_ERROR,
+					      &event_data);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_due_push						     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_due_push(struct xio_tcp_shim_hndl *shim,
+				 uint64_t due)
+{
+	uint64_t	*ring;
+	uint32_t	i;
+
+	if (shim->due_nr == shim->due_max) {
+		ring = (uint64_t *)umalloc(2 * shim->due_max * sizeof(*ring));
+		if (!ring) {
+			xio_set_error(ENOMEM);
+			ERROR_LOG("umalloc failed. %m\n");
+			return -1;
+		}
+		for (i = 0; i < shim->due_nr; i++)
+			ring[i] = shim->due[(shim->due_head + i) %
+					    shim->due_max];
+		ufree(shim->due);
+		shim->due	= ring;
+		shim->due_head	= 0;
+		shim->due_max	*= 2;
+	}
+	shim->due[(shim->due_head + shim->due_nr) % shim->due_max] = due;
+	shim->due_nr++;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_task_bytes - what the task puts on the wire, roughly	     */
+/*---------------------------------------------------------------------------*/
+static size_t xio_tcp_shim_task_bytes(struct xio_task *task)
+{
+	struct xio_sg_table_ops	*sgtbl_ops;
+	struct xio_vmsg		*vmsg;
+	size_t			bytes = XIO_TCP_SHIM_MSG_OVERHEAD;
+
+	if (!task->omsg)
+		return bytes;
+
+	vmsg		= &task->omsg->out;
+	sgtbl_ops	= (struct xio_sg_table_ops *)
+				xio_sg_table_ops_get(vmsg->sgl_type);
+	bytes += vmsg->header.iov_len;
+	if (sgtbl_ops)
+		bytes += tbl_length(sgtbl_ops, xio_sg_table_get(vmsg));
+
+	return bytes;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_send							     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_send(struct xio_transport_base *trans_hndl,
+			     struct xio_task *task)
+{
+	struct xio_tcp_shim_hndl	*shim;
+	uint64_t			now, due;
+	int64_t				jitter = 0;
+
+	shim = xio_tcp_shim_find(trans_hndl);
+	if (!shim) {
+		shim = xio_tcp_shim_create(trans_hndl);
+		if (!shim)
+			return -1;
+	}
+	if (!shim_options.delay_ns && !shim_options.jitter_ns &&
+	    !shim_options.rate_bps)
+		return tcp_transport->send(trans_hndl, task);
+
+	now = xio_now_ns();
+	due = now;
+	if (shim_options.rate_bps) {
+		shim->link_free_ns = max(shim->link_free_ns, now) +
+				     xio_tcp_shim_task_bytes(task) * 8 *
+				     1000000000ULL / shim_options.rate_bps;
+		due = shim->link_free_ns;
+	}
+	if (shim_options.jitter_ns)
+		jitter = (int64_t)((2 * xio_tcp_shim_rand(shim) - 1) *
+				   shim_options.jitter_ns);
+	due += shim_options.delay_ns;
+	if (jitter < 0 && (uint64_t)-jitter > due - now)
+		due = now;
+	else
+		due += jitter;
+	/* tcp does not reorder */
+	due = max(due, shim->last_due_ns);
+	shim->last_due_ns = due;
+
+	if (xio_tcp_shim_due_push(shim, due))
+		return -1;
+
+	/* off the nexus tx queue, as tcp's send would */
+	list_move_tail(&task->tasks_list_entry, &shim->held_list);
+	if (shim->due_nr == 1)
+		xio_ctx_add_delayed_work(shim->ctx,
+					 xio_tcp_shim_msec(due, now),
+					 shim, xio_tcp_shim_release,
+					 &shim->release_work);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_close							     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shim_close(struct xio_transport_base *trans_hndl)
+{
+	struct xio_tcp_shim_hndl *shim;
+
+	/* the last reference goes, nothing more is sent */
+	if (atomic_read(&trans_hndl->kref.refcount) == 1) {
+		shim = xio_tcp_shim_find(trans_hndl);
+		if (shim)
+			xio_tcp_shim_destroy(shim);
+	}
+	tcp_transport->close(trans_hndl);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_dup2							     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_dup2(struct xio_transport_base *old_trans_hndl,
+			     struct xio_transport_base **new_trans_hndl)
+{
+	struct xio_tcp_shim_hndl *shim;
+
+	/* tcp closes the handle being replaced */
+	shim = xio_tcp_shim_find(*new_trans_hndl);
+	if (shim && atomic_read(&(*new_trans_hndl)->kref.refcount) == 1)
+		xio_tcp_shim_destroy(shim);
+
+	return tcp_transport->dup2(old_trans_hndl, new_trans_hndl);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_context_shutdown					     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_context_shutdown(struct xio_transport_base *trans_hndl,
+					 struct xio_context *ctx)
+{
+	struct xio_tcp_shim_hndl *shim = xio_tcp_shim_find(trans_hndl);
+
+	if (shim)
+		xio_tcp_shim_destroy(shim);
+
+	return tcp_transport->context_shutdown(trans_hndl, ctx);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_detach - not while tasks are held			     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_detach(struct xio_transport_base *trans_hndl)
+{
+	struct xio_tcp_shim_hndl *shim = xio_tcp_shim_find(trans_hndl);
+
+	if (shim && shim->due_nr) {
+		xio_set_error(EAGAIN);
+		return -1;
+	}
+	if (tcp_transport->detach(trans_hndl))
+		return -1;
+	if (shim)
+		xio_ctx_del_delayed_work(shim->ctx, &shim->drop_work);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_attach							     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_attach(struct xio_transport_base *trans_hndl,
+			       struct xio_context *ctx)
+{
+	struct xio_tcp_shim_hndl *shim;
+
+	if (tcp_transport->attach(trans_hndl, ctx))
+		return -1;
+
+	shim = xio_tcp_shim_find(trans_hndl);
+	if (shim) {
+		shim->ctx = ctx;
+		xio_tcp_shim_arm_drop(shim);
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_transport_init - borrow tcp's operations		     */
+/*---------------------------------------------------------------------------*/
+static int xio_tcp_shim_transport_init(struct xio_transport *transport)
+{
+	struct list_head transports_list_entry;
+
+	if (tcp_transport)
+		return 0;
+
+	tcp_transport = xio_get_transport("tcp");
+	if (!tcp_transport) {
+		xio_set_error(ENOPROTOOPT);
+		ERROR_LOG("tcp transport not found\n");
+		return -1;
+	}
+
+	transports_list_entry = transport->transports_list_entry;
+	*transport = *tcp_transport;
+	transport->transports_list_entry = transports_list_entry;
+
+	transport->name			= "shim+tcp";
+	transport->ctor			= NULL;
+	transport->dtor			= NULL;
+	transport->init			= xio_tcp_shim_transport_init;
+	transport->release		= NULL;
+	transport->context_shutdown	= xio_tcp_shim_context_shutdown;
+	transport->send			= xio_tcp_shim_send;
+	transport->close		= xio_tcp_shim_close;
+	transport->dup2			= xio_tcp_shim_dup2;
+	transport->detach		= xio_tcp_shim_detach;
+	transport->attach		= xio_tcp_shim_attach;
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_transport_constructor					     */
+/*---------------------------------------------------------------------------*/
+static void xio_tcp_shim_transport_constructor(void)
+{
+	const char *spec = getenv("XIO_SHIM");
+
+	memset(&shim_options, 0, sizeof(shim_options));
+	shim_options.seed = (unsigned int)getpid();
+	if (!spec || !*spec)
+		return;
+
+	if (xio_tcp_shim_parse_options(spec, &shim_options)) {
+		ERROR_LOG("invalid XIO_SHIM=\"%s\", no impairment\n", spec);
+		memset(&shim_options, 0, sizeof(shim_options));
+		return;
+	}
+	DEBUG_LOG("shim+tcp: delay:%lluns jitter:%lluns rate:%llubps " \
+		  "drop:%lluns\n",
+		  (unsigned long long)shim_options.delay_ns,
+		  (unsigned long long)shim_options.jitter_ns,
+		  (unsigned long long)shim_options.rate_bps,
+		  (unsigned long long)shim_options.drop_ns);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_tcp_shim_get_transport_func_list					     */
+/*---------------------------------------------------------------------------*/
+struct xio_transport *xio_tcp_shim_get_transport_func_list(void)
+{
+	xio_tcp_shim_transport.name = "shim+tcp";
+	xio_tcp_shim_transport.ctor = xio_tcp_shim_transport_constructor;
+	xio_tcp_shim_transport.init = xio_tcp_shim_transport_init;
+
+	return &xio_tcp_shim_transport;
+}
@@ -90,6 +90,12 @@ enum xio_tcp_op_code {
 	XIO_TCP_READ
 };
 
+enum xio_tcp_req_idx {
+	XIO_TCP_REQ_IDX_NONE,
+	XIO_TCP_REQ_IDX_HASHED,		/* reachable via req_hash */
+	XIO_TCP_REQ_IDX_OVERFLOW	/* sn collision - lists only */
+};
+
 enum xio_tcp_rx_stage {
 	XIO_TCP_RX_START,
 	XIO_TCP_RX_TLV,
@@ -122,6 +128,8 @@ struct xio_tcp_options {
 	int			tcp_so_sndbuf;
 	int			tcp_so_rcvbuf;
 	int			tcp_dual_sock;
+	int			tcp_reuse_port;
+	int			tcp_incoming_cpu;
 	int			pad;
 };
 
@@ -212,7 +220,9 @@ struct xio_tcp_task {
 	uint32_t			req_recv_num_sge;
 
 	uint16_t			sn;
-	uint16_t			pad[3];
+	uint16_t			req_idx;   /* enum xio_tcp_req_idx */
+	uint16_t			pad[2];
+	uint64_t			req_sn;	   /* ulp sn - req_hash key */
 
 	struct xio_tcp_work_req		txd;
 	struct xio_tcp_work_req		rxd;
@@ -251,6 +261,26 @@ struct xio_tcp_pending_conn {
 	struct xio_tcp_connect_msg	msg;
 	union xio_sockaddr		sa;
 	struct list_head		conns_list_entry;
+	/* reuseport: accepting listener and the paired data socket */
+	struct xio_tcp_transport	*listener;
+	xio_work_handle_t		handoff_work;
+	int				peer_fd;
+	int				pad;
+};
+
+/*
+ * listeners that share one portal with SO_REUSEPORT. the two sockets of a
+ * dual stream connection may be accepted by different listeners, so the
+ * first half to arrive waits here for its peer. a pair completed on a
+ * foreign listener is handed to the control socket's listener.
+ */
+struct xio_tcp_reuseport_group {
+	struct list_head		groups_list_entry;
+	struct list_head		pending_conns;
+	struct list_head		handoff_conns;
+	char				*portal_uri;
+	int				listeners_nr;
+	int				pad;
 };
 
 struct xio_tcp_socket {
@@ -327,11 +357,16 @@ struct xio_tcp_transport {
 	};
 
 	struct list_head		pending_conns;
+	struct xio_tcp_reuseport_group	*reuseport_group;
+
+	/* cancel lookup: tx requests by ulp sn, canceled tasks by tcp sn */
+	struct xio_sn_hash		req_hash;
+	struct xio_sn_hash		cancel_hash;
 
 	void				*tmp_rx_buf;
 	void				*tmp_rx_buf_cur;
 	uint32_t			tmp_rx_buf_len;
-	uint32_t			pad;
+	uint32_t			req_idx_overflow;
 
 	uint32_t			trans_attr_mask;
 	struct xio_transport_attr	trans_attr;
@@ -363,6 +398,12 @@ struct xio_task *xio_tcp_primary_task_alloc(
 void on_sock_disconnected(struct xio_tcp_transport *tcp_hndl,
 			  int notify_observer);
 
+void xio_tcp_req_idx_add(struct xio_tcp_transport *tcp_hndl,
+			 struct xio_task *task);
+
+void xio_tcp_req_idx_del(struct xio_tcp_transport *tcp_hndl,
+			 struct xio_task *task);
+
 int xio_tcp_cancel_req(struct xio_transport_base *transport,
 		       struct xio_msg *req, uint64_t stag,
 		       void *ulp_msg, size_t ulp_msg_sz);
@@ -390,4 +431,6 @@ void xio_tcp_disconnect_helper(void *xio_tcp_hndl);
 
 int xio_tcp_xmit(struct xio_tcp_transport *tcp_hndl);
 
+void xio_tcp_flush_tx_completions(struct xio_tcp_transport *tcp_hndl);
+
 #endif /* XIO_TCP_TRANSPORT_H_ */
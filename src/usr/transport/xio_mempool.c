@@ -41,6 +41,7 @@
 #include "xio_common.h"
 #include "xio_mem.h"
 #include "xio_usr_utils.h"
+#include "xio_stats_shm.h"
 
 
 /* Accelio's default mempool profile (don't expose it) */
@@ -120,6 +121,8 @@ struct xio_mem_slab {
 	int				alloc_quantum_nr; /* number of items
 							   per allocation */
 	int				used_mb_nr;
+	/* mirror in the statistics segment, if published */
+	struct xio_stats_shm_slab	*shm;
 };
 
 struct xio_mempool {
@@ -128,6 +131,7 @@ struct xio_mempool {
 	int				nodeid;
 	int				safe_mt;
 	struct xio_mem_slab		*slab;
+	struct xio_stats_shm_pool	*shm;
 };
 
 /* Lock free algorithm based on: Maged M. Michael & Michael L. Scott's
@@ -356,6 +360,8 @@ static struct xio_mem_block *xio_mem_slab_resize(struct xio_mem_slab *slab,
 	/* allocate the buffers and register them */
 	if (slab->pool->flags & XIO_MEMPOOL_FLAG_HUGE_PAGES_ALLOC) {
 		region->buf = umalloc_huge_pages(data_alloc_sz);
+		xio_mem_set_node(region->buf, data_alloc_sz,
+				 slab->pool->nodeid);
 	} else if (slab->pool->flags & XIO_MEMPOOL_FLAG_NUMA_ALLOC) {
 		region->buf = unuma_alloc(data_alloc_sz, slab->pool->nodeid);
 	} else if (slab->pool->flags & XIO_MEMPOOL_FLAG_REGULAR_PAGES_ALLOC) {
@@ -424,12 +430,40 @@ static struct xio_mem_block *xio_mem_slab_resize(struct xio_mem_slab *slab,
 	}
 
 	slab->curr_mb_nr += nr_blocks;
+	if (slab->shm)
+		slab->shm->curr_mb_nr = slab->curr_mb_nr;
 
 	list_add(&region->mem_region_entry, &slab->mem_regions_list);
 
 	return block;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_mempool_shm_sync - slabs were added or moved, rebind their mirrors  */
+/*---------------------------------------------------------------------------*/
+static void xio_mempool_shm_sync(struct xio_mempool *p)
+{
+	struct xio_mem_slab	*s;
+	unsigned int		i;
+
+	if (!p->shm)
+		return;
+
+	for (i = 0; i < p->slabs_nr; i++) {
+		s = &p->slab[i];
+		if (i >= XIO_STATS_SHM_SLABS) {
+			s->shm = NULL;
+			continue;
+		}
+		s->shm			= &p->shm->slab[i];
+		s->shm->mb_size		= s->mb_size;
+		s->shm->max_mb_nr	= s->max_mb_nr;
+		s->shm->curr_mb_nr	= s->curr_mb_nr;
+		s->shm->used_mb_nr	= s->used_mb_nr;
+	}
+	p->shm->slabs_nr = min(p->slabs_nr, (uint32_t)XIO_STATS_SHM_SLABS);
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_mempool_destroy							     */
 /*---------------------------------------------------------------------------*/
@@ -443,6 +477,7 @@ void xio_mempool_destroy(struct xio_mempool *p)
 	for (i = 0; i < p->slabs_nr; i++)
 		xio_mem_slab_free(&p->slab[i]);
 
+	xio_stats_shm_pool_release(p->shm);
 	ufree(p->slab);
 	ufree(p);
 }
@@ -512,6 +547,7 @@ struct xio_mempool *xio_mempool_create(int nodeid, uint32_t flags)
 	p->slabs_nr = 0;
 	p->safe_mt = 1;
 	p->slab = NULL;
+	p->shm = xio_stats_shm_pool_claim(nodeid);
 
 	return p;
 }
@@ -639,6 +675,8 @@ retry:
 #else
 	slab->used_mb_nr++;
 #endif
+	if (slab->shm)
+		slab->shm->used_mb_nr = slab->used_mb_nr;
 
 cleanup:
 
@@ -669,6 +707,9 @@ void xio_mempool_free(struct xio_mempool_obj *mp_obj)
 #else
 	block->parent_slab->used_mb_nr--;
 #endif
+	if (block->parent_slab->shm)
+		block->parent_slab->shm->used_mb_nr =
+					block->parent_slab->used_mb_nr;
 
 	if (block->parent_slab->pool->safe_mt)
 		safe_release(block->parent_slab, block);
@@ -749,6 +790,8 @@ int xio_mempool_add_slab(struct xio_mempool *p,
 	/* adjust length */
 	(p->slabs_nr)++;
 
+	xio_mempool_shm_sync(p);
+
 	return 0;
 }
 
@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include <signal.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_clock.h"
+
+#define XIO_CLOCK_QUICK_NS	2000000ULL	/* startup estimate	*/
+#define XIO_CLOCK_REFINE_NS	250000000ULL	/* background refinement	*/
+#define XIO_CLOCK_SHIFT		32
+
+enum xio_clock_slot {
+	XIO_CLOCK_BOOT,
+	XIO_CLOCK_ESTIMATE,
+	XIO_CLOCK_FINAL,
+	XIO_CLOCK_SLOTS
+};
+
+/*---------------------------------------------------------------------------*/
+/* globals								     */
+/*---------------------------------------------------------------------------*/
+/* installed scales are never reused, so readers need no lock */
+static struct xio_clock		xio_clocks[XIO_CLOCK_SLOTS];
+struct xio_clock * volatile	g_xio_clock = &xio_clocks[XIO_CLOCK_BOOT];
+
+static pthread_t		refine_thread;
+static pthread_mutex_t		refine_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		refine_cond;
+static int			refine_running;
+static int			refine_stop;
+static uint64_t			refine_cycles;
+static uint64_t			refine_ns;
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_tsc_invariant						     */
+/*---------------------------------------------------------------------------*/
+static int xio_clock_tsc_invariant(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) ||
+	    eax < 0x80000007)
+		return 0;
+
+	__cpuid(0x80000007, eax, ebx, ecx, edx);
+
+	return !!(edx & (1 << 8));
+#else
+	/* time base registers run at a fixed rate */
+	return 1;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cpuid_hz							     */
+/*---------------------------------------------------------------------------*/
+static uint64_t xio_clock_cpuid_hz(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+	unsigned int max_leaf = __get_cpuid_max(0, NULL);
+
+	if (max_leaf >= 0x15) {
+		/* tsc/crystal ratio and the crystal frequency */
+		__cpuid(0x15, eax, ebx, ecx, edx);
+		if (eax && ebx && ecx)
+			return (uint64_t)ecx * ebx / eax;
+	}
+	if (max_leaf >= 0x16) {
+		/* processor base frequency in MHz */
+		__cpuid(0x16, eax, ebx, ecx, edx);
+		if (eax & 0xffff)
+			return (uint64_t)(eax & 0xffff) * 1000000ULL;
+	}
+
+	/* hypervisor timing leaf reports the tsc frequency in kHz */
+	__cpuid(1, eax, ebx, ecx, edx);
+	if (!(ecx & (1U << 31)))
+		return 0;
+
+	__cpuid(0x40000000, eax, ebx, ecx, edx);
+	if (eax < 0x40000010)
+		return 0;
+
+	__cpuid(0x40000010, eax, ebx, ecx, edx);
+
+	return (uint64_t)eax * 1000ULL;
+#else
+	return 0;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_read_file							     */
+/*---------------------------------------------------------------------------*/
+static double xio_clock_read_file(const char *path)
+{
+	char	buf[32] = { 0 };
+	ssize_t ret;
+	int	fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	ret = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (ret <= 0)
+		return 0;
+
+	return strtod(buf, NULL);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_sysfs_hz							     */
+/*---------------------------------------------------------------------------*/
+static uint64_t xio_clock_sysfs_hz(void)
+{
+	double khz;
+
+	khz = xio_clock_read_file(
+			"/sys/devices/system/cpu/cpu0/tsc_freq_khz");
+	if (khz <= 0)
+		return 0;
+
+	return (uint64_t)(khz * 1000.0);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cache_hz							     */
+/*---------------------------------------------------------------------------*/
+static uint64_t xio_clock_cache_hz(void)
+{
+	double mhz = xio_clock_read_file(XIO_HZ_FILE);
+
+	if (mhz <= 0)
+		return 0;
+
+	return (uint64_t)(mhz * 1000000.0 + 0.5);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cache_write						     */
+/*---------------------------------------------------------------------------*/
+static void xio_clock_cache_write(uint64_t hz)
+{
+	char	path[sizeof(XIO_HZ_FILE) + 16];
+	char	buf[32];
+	int	fd, len;
+
+	if (mkdir(XIO_HZ_DIR, 0777) < 0 && errno != EEXIST)
+		return;
+
+	/* write aside and rename so readers never see a partial value */
+	sprintf(path, "%s.%d", XIO_HZ_FILE, getpid());
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+	if (fd < 0)
+		return;
+
+	len = sprintf(buf, "%f", hz / 1000000.0);
+	if (write(fd, buf, len) != len) {
+		close(fd);
+		unlink(path);
+		return;
+	}
+	close(fd);
+
+	if (rename(path, XIO_HZ_FILE) < 0)
+		unlink(path);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_sample							     */
+/*---------------------------------------------------------------------------*/
+static void xio_clock_sample(uint64_t *cycles, uint64_t *ns)
+{
+	struct timespec ts;
+	uint64_t	c0, c1, best = ~0ULL;
+	int		i;
+
+	/* keep the read that was least disturbed */
+	for (i = 0; i < 5; i++) {
+		c0 = get_cycles();
+		clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+		c1 = get_cycles();
+		if (c1 - c0 < best) {
+			best = c1 - c0;
+			*cycles = c0 + best / 2;
+			*ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_measure							     */
+/*---------------------------------------------------------------------------*/
+static uint64_t xio_clock_measure(uint64_t start_cycles, uint64_t start_ns)
+{
+	uint64_t cycles, ns;
+
+	xio_clock_sample(&cycles, &ns);
+	if (ns <= start_ns || cycles <= start_cycles)
+		return 0;
+
+	return (uint64_t)((double)(cycles - start_cycles) * 1000000000.0 /
+			  (ns - start_ns) + 0.5);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_install							     */
+/*---------------------------------------------------------------------------*/
+static void xio_clock_install(enum xio_clock_slot slot, uint64_t hz, int tsc)
+{
+	struct xio_clock *clk = &xio_clocks[slot];
+
+	clk->hz		= hz;
+	clk->tsc	= tsc;
+	clk->shift	= XIO_CLOCK_SHIFT;
+	clk->mult	= (1000000000ULL << XIO_CLOCK_SHIFT) / hz;
+	/* continue from the current reading */
+	clk->base_ns	= xio_now_ns();
+	clk->base_cycles = get_cycles();
+
+	__sync_synchronize();
+	g_xio_clock = clk;
+	g_mhz = hz / 1000000.0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_refine_worker						     */
+/*---------------------------------------------------------------------------*/
+static void *xio_clock_refine_worker(void *data)
+{
+	struct timespec deadline;
+	uint64_t	hz, ns;
+	int		stop = 0;
+
+	ns = xio_clock_monotonic_ns() + XIO_CLOCK_REFINE_NS;
+	deadline.tv_sec = ns / 1000000000ULL;
+	deadline.tv_nsec = ns % 1000000000ULL;
+
+	pthread_mutex_lock(&refine_mutex);
+	while (!refine_stop && !stop)
+		stop = pthread_cond_timedwait(&refine_cond, &refine_mutex,
+					      &deadline) == ETIMEDOUT;
+	stop = refine_stop;
+	pthread_mutex_unlock(&refine_mutex);
+	if (stop)
+		return NULL;
+
+	hz = xio_clock_measure(refine_cycles, refine_ns);
+	if (!hz)
+		return NULL;
+
+	xio_clock_install(XIO_CLOCK_FINAL, hz, g_xio_clock->tsc);
+	xio_clock_cache_write(hz);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_refine_start						     */
+/*---------------------------------------------------------------------------*/
+static void xio_clock_refine_start(void)
+{
+	pthread_condattr_t	attr;
+	sigset_t		set, old;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&refine_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	refine_stop = 0;
+
+	/* the worker must not take the application's signals */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	refine_running = !pthread_create(&refine_thread, NULL,
+					 xio_clock_refine_worker, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (!refine_running) {
+		pthread_cond_destroy(&refine_cond);
+		WARN_LOG("clock refinement thread failed to start\n");
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_init							     */
+/*---------------------------------------------------------------------------*/
+void xio_clock_init(void)
+{
+	uint64_t	hz;
+	int		tsc;
+
+	if (g_xio_clock == &xio_clocks[XIO_CLOCK_FINAL])
+		return;
+
+	tsc = xio_clock_tsc_invariant();
+
+	if (g_xio_clock == &xio_clocks[XIO_CLOCK_BOOT]) {
+		hz = xio_clock_cpuid_hz();
+		if (!hz)
+			hz = xio_clock_sysfs_hz();
+		if (hz) {
+			xio_clock_install(XIO_CLOCK_FINAL, hz, tsc);
+			return;
+		}
+		hz = xio_clock_cache_hz();
+		if (hz) {
+			xio_clock_install(XIO_CLOCK_FINAL, hz, tsc);
+			return;
+		}
+	}
+
+	/* nothing reliable - estimate now, refine in the background */
+	xio_clock_sample(&refine_cycles, &refine_ns);
+	if (g_xio_clock == &xio_clocks[XIO_CLOCK_BOOT]) {
+		while (xio_clock_monotonic_ns() < refine_ns +
+		       XIO_CLOCK_QUICK_NS)
+			;
+		hz = xio_clock_measure(refine_cycles, refine_ns);
+		if (!hz) {
+			/* no usable counter; keep the timers monotonic */
+			hz = 1000000000ULL;
+			tsc = 0;
+		}
+		xio_clock_install(XIO_CLOCK_ESTIMATE, hz, tsc);
+	}
+	xio_clock_refine_start();
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_destruct							     */
+/*---------------------------------------------------------------------------*/
+void xio_clock_destruct(void)
+{
+	if (!refine_running)
+		return;
+
+	pthread_mutex_lock(&refine_mutex);
+	refine_stop = 1;
+	pthread_cond_signal(&refine_cond);
+	pthread_mutex_unlock(&refine_mutex);
+
+	pthread_join(refine_thread, NULL);
+	pthread_cond_destroy(&refine_cond);
+	refine_running = 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_CLOCK_H
+#define XIO_CLOCK_H
+
+/*
+ * process wide time source
+ *
+ * the cycle counter frequency is taken, in that order, from cpuid (leaf
+ * 0x15/0x16 or the hypervisor timing leaf), from the kernel's tsc_freq_khz,
+ * or from the calibration cached in XIO_HZ_FILE. when none is available a
+ * few milliseconds estimate is used at startup and refined by a background
+ * thread, which also refreshes the cache for the next process.
+ *
+ * xio_now_ns() converts the counter with a fixed point multiply. when the
+ * counter is not invariant it falls back to CLOCK_MONOTONIC. every
+ * conversion is anchored at the time the current scale was installed, so
+ * replacing the estimate never moves the clock backwards.
+ *
+ * an event loop keeps a struct xio_clock_cache: "now" is read once per
+ * iteration and shared by everything the iteration runs (workqueue,
+ * timers). the cache is realigned to CLOCK_MONOTONIC every
+ * XIO_CLOCK_RESYNC_NS, since the timers are armed on timerfds of that
+ * clock. outside of an iteration - the loop is blocked or not running -
+ * readers of the cache fall back to a precise read.
+ */
+
+#define XIO_CLOCK_RESYNC_NS	1000000000ULL
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_clock {
+	uint64_t		base_cycles;
+	uint64_t		base_ns;
+	uint64_t		mult;
+	uint64_t		hz;
+	uint32_t		shift;
+	uint32_t		tsc;		/* counter is usable */
+};
+
+struct xio_clock_cache {
+	uint64_t		now_ns;		/* of this iteration	  */
+	int64_t			offset_ns;	/* to CLOCK_MONOTONIC	  */
+	uint64_t		resync_ns;	/* next realignment	  */
+	volatile int		valid;		/* loop is iterating	  */
+	int			pad;
+};
+
+extern struct xio_clock * volatile	g_xio_clock;
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_monotonic_ns						     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_clock_monotonic_ns(void)
+{
+	struct timespec ts;
+
+	xio_clock_gettime(&ts);
+
+	return (ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cycles_to_ns						     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_clock_cycles_to_ns(const struct xio_clock *clk,
+					      uint64_t delta)
+{
+#ifdef __SIZEOF_INT128__
+	return (uint64_t)(((__uint128_t)delta * clk->mult) >> clk->shift);
+#else
+	return (uint64_t)((double)delta * 1000000000.0 / clk->hz);
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_cycles_to_ns							     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_cycles_to_ns(uint64_t cycles)
+{
+	const struct xio_clock *clk = g_xio_clock;
+
+	if (unlikely(!clk->hz))
+		return 0;
+
+	return xio_clock_cycles_to_ns(clk, cycles);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_now_ns								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_now_ns(void)
+{
+	const struct xio_clock	*clk = g_xio_clock;
+	uint64_t		cycles;
+
+	if (unlikely(!clk->tsc))
+		return xio_clock_monotonic_ns();
+
+	cycles = get_cycles();
+	if (unlikely(cycles < clk->base_cycles))
+		return clk->base_ns;
+
+	return clk->base_ns + xio_clock_cycles_to_ns(clk,
+						     cycles - clk->base_cycles);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_hz								     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_clock_hz(void)
+{
+	return g_xio_clock->hz;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cache_init							     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_clock_cache_init(struct xio_clock_cache *cache)
+{
+	memset(cache, 0, sizeof(*cache));
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cache_refresh - take the iteration's "now"			     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_clock_cache_refresh(struct xio_clock_cache *cache)
+{
+	uint64_t now = xio_now_ns() + cache->offset_ns;
+	uint64_t monotonic;
+
+	if (unlikely(now >= cache->resync_ns)) {
+		monotonic = xio_clock_monotonic_ns();
+		cache->offset_ns += (int64_t)(monotonic - now);
+		cache->resync_ns = monotonic + XIO_CLOCK_RESYNC_NS;
+		now = monotonic;
+	}
+	/* a realignment may step back, hold the clock until it catches up */
+	if (likely(now > cache->now_ns))
+		cache->now_ns = now;
+	cache->valid = 1;
+
+	return cache->now_ns;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cache_invalidate - the loop is about to block		     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_clock_cache_invalidate(struct xio_clock_cache *cache)
+{
+	cache->valid = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_clock_cache_read - the iteration's "now", or a precise reading in   */
+/* the same time base when no iteration is running			     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_clock_cache_read(struct xio_clock_cache *cache)
+{
+	uint64_t now;
+
+	if (likely(cache->valid))
+		return cache->now_ns;
+
+	now = xio_now_ns() + cache->offset_ns;
+
+	return now > cache->now_ns ? now : cache->now_ns;
+}
+
+void xio_clock_init(void);
+
+void xio_clock_destruct(void);
+
+#endif /* XIO_CLOCK_H */
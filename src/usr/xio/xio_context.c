@@ -41,6 +41,7 @@
 #include "xio_common.h"
 #include "xio_observer.h"
 #include "get_clock.h"
+#include "xio_clock.h"
 #include "xio_ev_data.h"
 #include "xio_ev_loop.h"
 #include "xio_idr.h"
@@ -49,6 +50,10 @@
 #include "xio_timers_list.h"
 #include "xio_context.h"
 #include "xio_usr_utils.h"
+#include "xio_stats_shm.h"
+#include "xio_usr_rec_sink.h"
+#include "xio_ev_trace.h"
+#include "xio_usr_ev_trace.h"
 
 /*---------------------------------------------------------------------------*/
 /* xio_context_reg_observer						     */
@@ -107,7 +112,7 @@ static void xio_stats_handler(int fd, int events, void *data)
 	switch (nlh->nlmsg_type - NLMSG_MIN_TYPE) {
 	case 0: /* Format */
 		/* counting will start now */
-		memset(&ctx->stats.counter, 0,
+		memset(ctx->stats.counter, 0,
 		       XIO_STAT_LAST * sizeof(uint64_t));
 		/* First the cycles' hertz (assumed to be fixed) */
 		memcpy(ptr, &ctx->stats.hertz, sizeof(ctx->stats.hertz));
@@ -168,13 +173,16 @@ static int xio_pin_to_cpu(int cpu)
 	int		ret;
 	cpu_set_t	cs;
 
-	if (ncpus > CPU_SETSIZE)
+	if (ncpus > CPU_SETSIZE || cpu < 0 || cpu >= CPU_SETSIZE)
 		return -1;
 
+	/* already there */
+	if (!sched_getaffinity(0, sizeof(cs), &cs) &&
+	    CPU_COUNT(&cs) == 1 && CPU_ISSET(cpu, &cs))
+		return 0;
+
 	CPU_ZERO(&cs);
 	CPU_SET(cpu, &cs);
-	if (CPU_COUNT(&cs) == 1)
-		return 0;
 
 	ret = sched_setaffinity(0, sizeof(cs), &cs);
 	if (ret) {
@@ -205,6 +213,44 @@ static int xio_pin_to_node(int cpu)
 	return -1;
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_name - name a counter here and in the statistics segment  */
+/*---------------------------------------------------------------------------*/
+static int xio_ctx_stats_name(struct xio_context *ctx, int counter,
+			      const char *name)
+{
+	free(ctx->stats.name[counter]);
+	ctx->stats.name[counter] = NULL;
+	if (name) {
+		ctx->stats.name[counter] = strdup(name);
+		if (!ctx->stats.name[counter]) {
+			ERROR_LOG("strdup failed. %m");
+			return -1;
+		}
+	}
+	xio_stats_shm_ctx_name(
+			(struct xio_stats_shm_ctx *)ctx->stats.shm,
+			counter, name);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_release						     */
+/*---------------------------------------------------------------------------*/
+static void xio_ctx_stats_release(struct xio_context *ctx)
+{
+	int i;
+
+	for (i = 0; i < XIO_STAT_LAST; i++) {
+		free(ctx->stats.name[i]);
+		ctx->stats.name[i] = NULL;
+	}
+	xio_stats_shm_ctx_release((struct xio_stats_shm_ctx *)ctx->stats.shm);
+	ctx->stats.shm = NULL;
+	ctx->stats.counter = ctx->stats.counter_priv;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_context_create                                                        */
 /*---------------------------------------------------------------------------*/
@@ -227,9 +273,9 @@ struct xio_context *xio_context_create(struct xio_context_attr *ctx_attr,
 		}
 	} else {
 		cpu = cpu_hint;
+		/* pin the thread to the requested cpu */
+		xio_pin_to_cpu(cpu);
 	}
-	/*pin the process to cpu */
-	xio_pin_to_cpu(cpu);
 	/* pin to the numa node of the cpu */
 	if (0)
 		xio_pin_to_node(cpu);
@@ -256,6 +302,8 @@ struct xio_context *xio_context_create(struct xio_context_attr *ctx_attr,
 	XIO_OBSERVABLE_INIT(&ctx->observable, ctx);
 	INIT_LIST_HEAD(&ctx->ctx_list);
 
+	ctx->ev_trace = xio_ev_trace_ring_create(cpu);
+
 	ctx->workqueue = xio_workqueue_create(ctx);
 	if (!ctx->workqueue) {
 		xio_set_error(errno);
@@ -263,7 +311,27 @@ struct xio_context *xio_context_create(struct xio_context_attr *ctx_attr,
 		goto cleanup1;
 	}
 
-	/* only root can bind netlink socket */
+	ctx->stats.hertz = xio_clock_hz();
+	/* the segment's slot layout follows enum xio_stat */
+	if (XIO_STATS_SHM_COUNTERS == XIO_STAT_LAST)
+		ctx->stats.shm = xio_stats_shm_ctx_claim(cpu, ctx->nodeid);
+	if (ctx->stats.shm)
+		ctx->stats.counter =
+			((struct xio_stats_shm_ctx *)ctx->stats.shm)->counter;
+	else
+		ctx->stats.counter = ctx->stats.counter_priv;
+
+	/* Init default counters' name */
+	xio_ctx_stats_name(ctx, XIO_STAT_TX_MSG, "TX_MSG");
+	xio_ctx_stats_name(ctx, XIO_STAT_RX_MSG, "RX_MSG");
+	xio_ctx_stats_name(ctx, XIO_STAT_TX_BYTES, "TX_BYTES");
+	xio_ctx_stats_name(ctx, XIO_STAT_RX_BYTES, "RX_BYTES");
+	xio_ctx_stats_name(ctx, XIO_STAT_DELAY, "DELAY");
+	xio_ctx_stats_name(ctx, XIO_STAT_APPDELAY, "APPDELAY");
+
+	/* only root can bind netlink socket. the statistics segment
+	 * (XIO_STATS_SHM) serves everybody else
+	 */
 	if (geteuid() != 0) {
 		DEBUG_LOG("statistics monitoring disabled. " \
 			  "not privileged user\n");
@@ -322,24 +390,16 @@ struct xio_context *xio_context_create(struct xio_context_attr *ctx_attr,
 	xio_ev_loop_add(ctx->ev_loop, fd, XIO_POLLIN,
 			xio_stats_handler, ctx);
 
-	ctx->stats.hertz = g_mhz * 1000000.0 + 0.5;
-	/* Init default counters' name */
-	ctx->stats.name[XIO_STAT_TX_MSG] = strdup("TX_MSG");
-	ctx->stats.name[XIO_STAT_RX_MSG] = strdup("RX_MSG");
-	ctx->stats.name[XIO_STAT_TX_BYTES] = strdup("TX_BYTES");
-	ctx->stats.name[XIO_STAT_RX_BYTES] = strdup("RX_BYTES");
-	ctx->stats.name[XIO_STAT_DELAY] = strdup("DELAY");
-	ctx->stats.name[XIO_STAT_APPDELAY] = strdup("APPDELAY");
-
 	ctx->netlink_sock = (void *)(unsigned long) fd;
 
 exit:
-	xio_idr_add_uobj(usr_idr, ctx, "xio_context");
+	xio_idr_add_uobj(usr_idr, &ctx->idr_entry, "xio_context");
 	return ctx;
 
 cleanup2:
 	close(fd);
 cleanup1:
+	xio_ctx_stats_release(ctx);
 	ufree(ctx);
 	return NULL;
 }
@@ -360,16 +420,12 @@ static inline void xio_context_reset_stop(struct xio_context *ctx)
 void xio_context_destroy(struct xio_context *ctx)
 {
 	int i;
-	int found;
 
 	if (ctx == NULL)
 		return;
 
 
-	found = xio_idr_lookup_uobj(usr_idr, ctx);
-	if (found) {
-		xio_idr_remove_uobj(usr_idr, ctx);
-	} else {
+	if (xio_idr_remove_uobj(usr_idr, &ctx->idr_entry)) {
 		ERROR_LOG("context not found:%p\n", ctx);
 		xio_set_error(XIO_E_USER_OBJ_NOT_FOUND);
 		return;
@@ -402,9 +458,13 @@ void xio_context_destroy(struct xio_context *ctx)
 		close(fd);
 		ctx->netlink_sock = NULL;
 	}
-	for (i = 0; i < XIO_STAT_LAST; i++)
-		if (ctx->stats.name[i])
-			free(ctx->stats.name[i]);
+	xio_ctx_stats_release(ctx);
+	for (i = 0; i < XIO_CTX_REC_TYPES; i++) {
+		xio_rec_buf_destroy((struct xio_rec_buf *)ctx->recs[i]);
+		ctx->recs[i] = NULL;
+	}
+	xio_ev_trace_ring_destroy((struct xio_ev_trace_ring *)ctx->ev_trace);
+	ctx->ev_trace = NULL;
 
 	xio_workqueue_destroy(ctx->workqueue);
 
@@ -475,11 +535,8 @@ int xio_add_counter(struct xio_context *ctx, char *name)
 
 	for (i = XIO_STAT_USER_FIRST; i < XIO_STAT_LAST; i++) {
 		if (!ctx->stats.name[i]) {
-			ctx->stats.name[i] = strdup(name);
-			if (!ctx->stats.name[i]) {
-				ERROR_LOG("stddup failed. %m");
+			if (xio_ctx_stats_name(ctx, i, name))
 				return -1;
-			}
 			ctx->stats.counter[i] = 0;
 			return i;
 		}
@@ -499,8 +556,7 @@ int xio_del_counter(struct xio_context *ctx, int counter)
 	}
 
 	/* free the name and mark as free for reuse */
-	free(ctx->stats.name[counter]);
-	ctx->stats.name[counter] = NULL;
+	xio_ctx_stats_name(ctx, counter, NULL);
 
 	return 0;
 }
@@ -585,11 +641,79 @@ int xio_context_del_ev_handler(struct xio_context *ctx,
 	return xio_ev_loop_del(ctx->ev_loop, fd);
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_context_create_set						     */
+/*---------------------------------------------------------------------------*/
+int xio_context_create_set(struct xio_context_set_attr *attr,
+			   struct xio_context **ctxs)
+{
+	int	*cpus;
+	int	cpus_nr, node, i;
+
+	if (!attr || !ctxs || attr->ctxs_nr <= 0) {
+		xio_set_error(EINVAL);
+		ERROR_LOG("invalid context set attributes\n");
+		return -1;
+	}
+
+	node = attr->numa_node;
+	if (node == -1 && attr->uri)
+		node = xio_uri_numa_node(attr->uri);
+
+	cpus = (int *)ucalloc(CPU_SETSIZE, sizeof(*cpus));
+	if (!cpus) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("calloc failed. %m\n");
+		return -1;
+	}
+	cpus_nr = xio_numa_node_cpus(node, cpus, CPU_SETSIZE);
+	if (!cpus_nr && node != -1)
+		cpus_nr = xio_numa_node_cpus(-1, cpus, CPU_SETSIZE);
+	if (!cpus_nr) {
+		xio_set_error(ENODEV);
+		ERROR_LOG("no cpu available for numa node %d\n", node);
+		goto cleanup;
+	}
+
+	for (i = 0; i < attr->ctxs_nr; i++) {
+		ctxs[i] = xio_context_create(attr->ctx_attr,
+					     attr->polling_timeout_us, -1);
+		if (!ctxs[i])
+			goto cleanup1;
+		/* spread over the local cores, the thread that runs the
+		 * loop moves there. pools follow nodeid
+		 */
+		ctxs[i]->cpuid	= cpus[i % cpus_nr];
+		ctxs[i]->nodeid	= numa_node_of_cpu(ctxs[i]->cpuid);
+		ctxs[i]->worker	= 0;
+		ctxs[i]->placed	= 1;
+	}
+	DEBUG_LOG("%d contexts placed on node %d (%d cpus)\n",
+		  attr->ctxs_nr, node, cpus_nr);
+	ufree(cpus);
+
+	return 0;
+
+cleanup1:
+	while (--i >= 0)
+		xio_context_destroy(ctxs[i]);
+cleanup:
+	ufree(cpus);
+
+	return -1;
+}
+EXPORT_SYMBOL(xio_context_create_set);
+
 /*---------------------------------------------------------------------------*/
 /* xio_context_run_loop							     */
 /*---------------------------------------------------------------------------*/
 int xio_context_run_loop(struct xio_context *ctx, int timeout_ms)
 {
+	/* a placed context pins whichever thread runs it */
+	if (ctx->placed && ctx->worker != (uint64_t)pthread_self()) {
+		ctx->worker = (uint64_t)pthread_self();
+		xio_pin_to_cpu(ctx->cpuid);
+	}
 	if (timeout_ms == -1)
 		return	xio_ev_loop_run(ctx->ev_loop);
 	else
@@ -687,3 +811,55 @@ void xio_ctx_remove_event(struct xio_context *ctx, xio_ctx_event_t *evt)
 	xio_ev_loop_remove_event(ctx->ev_loop, evt);
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_attach						     */
+/*---------------------------------------------------------------------------*/
+struct xio_connection_counters *xio_ctx_stats_conn_attach(
+		struct xio_context *ctx, uint32_t session_id,
+		uint32_t conn_idx, const char *peer, void **slot)
+{
+	struct xio_stats_shm_conn *conn_slot;
+
+	*slot = NULL;
+	if (!ctx->stats.shm)
+		return NULL;
+
+	conn_slot = xio_stats_shm_conn_claim(
+			((struct xio_stats_shm_ctx *)ctx->stats.shm)->id,
+			session_id, conn_idx, peer);
+	if (!conn_slot)
+		return NULL;
+
+	*slot = conn_slot;
+
+	return &conn_slot->counters;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_detach						     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_stats_conn_detach(void *slot)
+{
+	xio_stats_shm_conn_release((struct xio_stats_shm_conn *)slot);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_stats_conn_move						     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_stats_conn_move(struct xio_context *ctx, void *slot)
+{
+	if (!slot)
+		return;
+
+	((struct xio_stats_shm_conn *)slot)->ctx_id = ctx->stats.shm ?
+		((struct xio_stats_shm_ctx *)ctx->stats.shm)->id : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ctx_record							     */
+/*---------------------------------------------------------------------------*/
+void xio_ctx_record(struct xio_context *ctx, enum xio_ctx_rec_type type,
+		    const void *rec)
+{
+	xio_rec_sink_add(type, (struct xio_rec_buf **)&ctx->recs[type], rec);
+}
@@ -43,6 +43,7 @@
 #include "xio_log.h"
 #include "xio_common.h"
 #include "get_clock.h"
+#include "xio_clock.h"
 #include "xio_ev_data.h"
 #include "xio_ev_loop.h"
 
@@ -61,6 +62,7 @@ struct xio_ev_loop {
 	struct xio_ev_data		*deleted_events[MAX_DELETED_EVENTS];
 	struct list_head		poll_events_list;
 	struct list_head		events_list;
+	struct xio_clock_cache		clock;
 };
 
 /*---------------------------------------------------------------------------*/
@@ -256,6 +258,7 @@ void *xio_ev_loop_create()
 
 	INIT_LIST_HEAD(&loop->poll_events_list);
 	INIT_LIST_HEAD(&loop->events_list);
+	xio_clock_cache_init(&loop->clock);
 
 	loop->stop_loop		= 0;
 	loop->wakeup_armed	= 0;
@@ -369,10 +372,9 @@ static inline int xio_ev_loop_run_helper(void *loop_hndl, int timeout)
 	int			tmout;
 	int			wait_time = timeout;
 	uint32_t		out_events;
-	cycles_t		start_cycle  = 0;
+	uint64_t		start_ns;
 
-	if (timeout != -1)
-		start_cycle = get_cycles();
+	start_ns = xio_clock_cache_refresh(&loop->clock);
 
 retry:
 	work_remains = xio_ev_loop_exec_scheduled(loop);
@@ -383,11 +385,14 @@ retry:
 		while (loop->deleted_events_nr)
 			ufree(loop->deleted_events[--loop->deleted_events_nr]);
 
+	xio_clock_cache_invalidate(&loop->clock);
 	nevent = epoll_wait(loop->efd, events, ARRAY_SIZE(events), tmout);
+	xio_clock_cache_refresh(&loop->clock);
 	if (unlikely(nevent < 0)) {
 		if (errno != EINTR) {
 			xio_set_error(errno);
 			ERROR_LOG("epoll_wait failed. %m\n");
+			xio_clock_cache_invalidate(&loop->clock);
 			return -1;
 		} else {
 			goto retry;
@@ -441,10 +446,13 @@ retry:
 		 * duration of each loop
 		 * */
 	}
+	/* the next iteration starts here */
+	xio_clock_cache_refresh(&loop->clock);
+
 	/* calculate the remaining timeout */
 	if (timeout != -1 && !loop->stop_loop) {
-		int time_passed = (int)((get_cycles() -
-				start_cycle)/(1000*g_mhz) + 0.5);
+		int time_passed = (int)((loop->clock.now_ns - start_ns +
+					 500000) / 1000000);
 		if (time_passed >= wait_time)
 			loop->stop_loop = 1;
 		else
@@ -465,6 +473,7 @@ retry:
 
 	loop->stop_loop = 0;
 	loop->wakeup_armed = 0;
+	xio_clock_cache_invalidate(&loop->clock);
 
 	return 0;
 }
@@ -485,6 +494,16 @@ int xio_ev_loop_run(void *loop_hndl)
 	return xio_ev_loop_run_helper(loop_hndl, -1 /* block indefinitely */);
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_ev_loop_clock							     */
+/*---------------------------------------------------------------------------*/
+struct xio_clock_cache *xio_ev_loop_clock(void *loop_hndl)
+{
+	struct xio_ev_loop *loop = (struct xio_ev_loop *)loop_hndl;
+
+	return &loop->clock;
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_ev_loop_stop							     */
 /*---------------------------------------------------------------------------*/
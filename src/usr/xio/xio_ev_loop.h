@@ -102,6 +102,15 @@ int xio_ev_loop_is_stopping(void *loop_hndl);
  */
 void xio_ev_loop_destroy(void **loop);
 
+/**
+ * the loop's cached clock - "now" of the running iteration
+ *
+ * @param[in] loop		Pointer to event loop
+ *
+ * @returns the clock cache, valid for the lifetime of the loop
+ */
+struct xio_clock_cache *xio_ev_loop_clock(void *loop);
+
 /**
  * add event handlers on dispatcher
  *
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include <signal.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_mem.h"
+#include "xio_clock.h"
+#include "xio_ev_trace.h"
+#include "xio_usr_ev_trace.h"
+
+#ifdef XIO_EV_TRACE
+
+#define XIO_EV_TRACE_RECS	16384	/* per context, power of two */
+
+/*---------------------------------------------------------------------------*/
+/* globals								     */
+/*---------------------------------------------------------------------------*/
+static LIST_HEAD(g_rings);
+static uint32_t			g_rings_nr;
+static uint32_t			g_ring_id;
+static uint64_t			g_recs = XIO_EV_TRACE_RECS;
+static char			g_path[256];
+static DEFINE_MUTEX(ev_trace_mutex);
+
+static const int		g_crash_signals[] = {
+	SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT
+};
+#define CRASH_SIGNALS_NR	ARRAY_SIZE(g_crash_signals)
+static struct sigaction		g_crash_old[CRASH_SIGNALS_NR];
+static int			g_crash_armed;
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_write_all - async signal safe, the caller keeps the list   */
+/*---------------------------------------------------------------------------*/
+static int xio_ev_trace_write_all(int fd)
+{
+	struct xio_ev_trace_file_hdr	hdr;
+	struct xio_ev_trace_ring_hdr	rhdr;
+	struct xio_ev_trace_ring	*ring;
+	uint64_t			head, start, size;
+	size_t				len;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic	= XIO_EV_TRACE_MAGIC;
+	hdr.version	= XIO_EV_TRACE_VERSION;
+	hdr.pid		= getpid();
+	hdr.rec_size	= sizeof(struct xio_ev_trace_rec);
+	hdr.hertz	= xio_clock_hz();
+	hdr.rings_nr	= g_rings_nr;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr))
+		return -1;
+
+	list_for_each_entry(ring, &g_rings, rings_list_entry) {
+		/* the owner keeps writing; a record may be torn, never lost */
+		head		= ring->head;
+		size		= ring->mask + 1;
+		rhdr.ctx_id	= ring->ctx_id;
+		rhdr.cpu	= ring->cpu;
+		rhdr.recs_nr	= head < size ? head : size;
+		rhdr.lost	= head - rhdr.recs_nr;
+		if (write(fd, &rhdr, sizeof(rhdr)) != sizeof(rhdr))
+			return -1;
+
+		start = (head - rhdr.recs_nr) & ring->mask;
+		len = (start + rhdr.recs_nr > size ? size - start :
+						     rhdr.recs_nr) *
+		      sizeof(ring->rec[0]);
+		if (write(fd, &ring->rec[start], len) != (ssize_t)len)
+			return -1;
+		if (start + rhdr.recs_nr <= size)
+			continue;
+		len = (start + rhdr.recs_nr - size) * sizeof(ring->rec[0]);
+		if (write(fd, ring->rec, len) != (ssize_t)len)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_path							     */
+/*---------------------------------------------------------------------------*/
+static const char *xio_ev_trace_path(const char *path)
+{
+	if (path && *path)
+		return path;
+	if (!g_path[0])
+		snprintf(g_path, sizeof(g_path), "/tmp/xio_ev_trace.%d",
+			 getpid());
+
+	return g_path;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_dump							     */
+/*---------------------------------------------------------------------------*/
+int xio_ev_trace_dump(const char *path)
+{
+	int	fd, retval;
+
+	path = xio_ev_trace_path(path);
+	fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		xio_set_error(errno);
+		ERROR_LOG("open %s failed. %m\n", path);
+		return -1;
+	}
+	mutex_lock(&ev_trace_mutex);
+	retval = xio_ev_trace_write_all(fd);
+	mutex_unlock(&ev_trace_mutex);
+	if (retval) {
+		xio_set_error(errno);
+		ERROR_LOG("write %s failed. %m\n", path);
+	}
+	close(fd);
+
+	return retval;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_crash_handler						     */
+/*---------------------------------------------------------------------------*/
+static void xio_ev_trace_crash_handler(int sig)
+{
+	size_t	i;
+	int	fd;
+
+	/* write once, then let the previous disposition run */
+	for (i = 0; i < CRASH_SIGNALS_NR; i++)
+		sigaction(g_crash_signals[i], &g_crash_old[i], NULL);
+
+	fd = open(g_path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0644);
+	if (fd >= 0) {
+		xio_ev_trace_write_all(fd);
+		close(fd);
+	}
+	raise(sig);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_construct						     */
+/*---------------------------------------------------------------------------*/
+void xio_ev_trace_construct(void)
+{
+	struct sigaction	sa;
+	char			*val;
+	uint64_t		recs;
+	size_t			i;
+
+	val = getenv("XIO_EV_TRACE");
+	if (val && *val)
+		snprintf(g_path, sizeof(g_path), "%s", val);
+	xio_ev_trace_path(NULL);
+
+	val = getenv("XIO_EV_TRACE_RECS");
+	if (val) {
+		recs = strtoull(val, NULL, 0);
+		g_recs = 1;
+		while (g_recs < recs)
+			g_recs <<= 1;
+		if (!recs)
+			g_recs = 0;	/* disabled */
+	}
+
+	val = getenv("XIO_EV_TRACE_CRASH");
+	if (!val || !atoi(val) || g_crash_armed)
+		return;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = xio_ev_trace_crash_handler;
+	sigemptyset(&sa.sa_mask);
+	for (i = 0; i < CRASH_SIGNALS_NR; i++)
+		sigaction(g_crash_signals[i], &sa, &g_crash_old[i]);
+	g_crash_armed = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_destruct						     */
+/*---------------------------------------------------------------------------*/
+void xio_ev_trace_destruct(void)
+{
+	size_t i;
+
+	if (!g_crash_armed)
+		return;
+
+	for (i = 0; i < CRASH_SIGNALS_NR; i++)
+		sigaction(g_crash_signals[i], &g_crash_old[i], NULL);
+	g_crash_armed = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_ring_create						     */
+/*---------------------------------------------------------------------------*/
+struct xio_ev_trace_ring *xio_ev_trace_ring_create(int cpu)
+{
+	struct xio_ev_trace_ring *ring;
+
+	if (!g_recs)
+		return NULL;
+
+	ring = (struct xio_ev_trace_ring *)ucalloc(1, sizeof(*ring));
+	if (!ring)
+		goto cleanup;
+	ring->rec = (struct xio_ev_trace_rec *)ucalloc(g_recs,
+						      sizeof(ring->rec[0]));
+	if (!ring->rec)
+		goto cleanup;
+	ring->mask = g_recs - 1;
+	ring->cpu = cpu;
+
+	mutex_lock(&ev_trace_mutex);
+	ring->ctx_id = ++g_ring_id;
+	list_add_tail(&ring->rings_list_entry, &g_rings);
+	g_rings_nr++;
+	mutex_unlock(&ev_trace_mutex);
+
+	return ring;
+
+cleanup:
+	if (ring)
+		ufree(ring);
+	xio_set_error(ENOMEM);
+	ERROR_LOG("event trace ring allocation failed\n");
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_ev_trace_ring_destroy						     */
+/*---------------------------------------------------------------------------*/
+void xio_ev_trace_ring_destroy(struct xio_ev_trace_ring *ring)
+{
+	if (!ring)
+		return;
+
+	mutex_lock(&ev_trace_mutex);
+	list_del(&ring->rings_list_entry);
+	g_rings_nr--;
+	mutex_unlock(&ev_trace_mutex);
+
+	ufree(ring->rec);
+	ufree(ring);
+}
+
+#else /* !XIO_EV_TRACE */
+
+/*---------------------------------------------------------------------------*/
+/* built without the tracer						     */
+/*---------------------------------------------------------------------------*/
+int xio_ev_trace_dump(const char *path)
+{
+	xio_set_error(XIO_E_NOT_SUPPORTED);
+	return -1;
+}
+
+void xio_ev_trace_construct(void)
+{
+}
+
+void xio_ev_trace_destruct(void)
+{
+}
+
+struct xio_ev_trace_ring *xio_ev_trace_ring_create(int cpu)
+{
+	return NULL;
+}
+
+void xio_ev_trace_ring_destroy(struct xio_ev_trace_ring *ring)
+{
+}
+
+#endif /* XIO_EV_TRACE */
@@ -46,6 +46,12 @@
 #include "xio_observer.h"
 #include "xio_transport.h"
 #include "xio_idr.h"
+#include "xio_server.h"
+#include "xio_clock.h"
+#include "xio_stats_shm.h"
+#include "xio_usr_rec_sink.h"
+#include "xio_ev_trace.h"
+#include "xio_usr_ev_trace.h"
 
 int		page_size;
 double		g_mhz;
@@ -57,6 +63,9 @@ extern struct xio_transport xio_rdma_transport;
 
 struct xio_transport * xio_rdma_get_transport_func_list();
 struct xio_transport *  xio_tcp_get_transport_func_list();
+#ifdef XIO_TCP_SHIM
+struct xio_transport *xio_tcp_shim_get_transport_func_list(void);
+#endif
 
 
 typedef struct xio_transport * (*get_transport_func_list_t)();
@@ -65,7 +74,10 @@ static get_transport_func_list_t  transport_func_list_tbl[] = {
 #ifdef HAVE_INFINIBAND_VERBS_H
 	xio_rdma_get_transport_func_list,
 #endif
-	xio_tcp_get_transport_func_list
+	xio_tcp_get_transport_func_list,
+#ifdef XIO_TCP_SHIM
+	xio_tcp_shim_get_transport_func_list
+#endif
 };
 
 #define  transport_tbl_sz (sizeof(transport_func_list_tbl) \
@@ -78,8 +90,6 @@ static struct xio_transport  *transport_tbl[transport_tbl_sz];
 static volatile int32_t	ini_refcnt; /*= 0 */
 static DEFINE_MUTEX(ini_mutex);
 
-extern double xio_get_cpu_mhz(void);
-
 /*---------------------------------------------------------------------------*/
 /* xio_dtor								     */
 /*---------------------------------------------------------------------------*/
@@ -96,8 +106,15 @@ static void xio_dtor(void)
 
 		xio_unreg_transport(transport_tbl[i]);
 	}
+	xio_stats_shm_destruct();
+	xio_rec_sinks_destruct();
+	xio_ev_trace_destruct();
+	xio_clock_destruct();
 	xio_idr_destroy(usr_idr);
+	nexus_cache_destruct();
+	sessions_cache_destruct();
 	xio_thread_data_destruct();
+	xio_log_destruct();
 	xio_env_cleanup();
 }
 
@@ -108,6 +125,7 @@ static void xio_ctor(void)
 {
 	size_t i;
 	xio_env_startup();
+	xio_log_construct();
 	for (i = 0; i < transport_tbl_sz; i++)
 		if (!transport_tbl[i])
 			transport_tbl[i] = transport_func_list_tbl[i]();
@@ -115,13 +133,17 @@ static void xio_ctor(void)
 	page_size = xio_get_page_size();
 	if (page_size < 0)
 		page_size = 4096;
-	g_mhz = xio_get_cpu_mhz();
+	xio_clock_init();
+	xio_stats_shm_construct();
+	xio_rec_sinks_construct();
+	xio_ev_trace_construct();
 	xio_thread_data_construct();
 	usr_idr = xio_idr_create();
 	if (!usr_idr)
 		ERROR_LOG("usr_idr creation failed");
 	sessions_cache_construct();
 	nexus_cache_construct();
+	xio_servers_construct();
 
 	for (i = 0; i < transport_tbl_sz; i++) {
 		xio_reg_transport(transport_tbl[i]);
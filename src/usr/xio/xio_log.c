@@ -36,8 +36,10 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 #include <xio_os.h>
+#include <signal.h>
 #include "libxio.h"
 #include "xio_log.h"
+#include "xio_mem.h"
 
 
 void xio_vlog(const char *file, unsigned line, const char *function,
@@ -50,30 +52,71 @@ xio_log_fn		xio_vlog_fn = xio_vlog;
 
 #define LOG_TIME_FMT "%04d/%02d/%02d-%02d:%02d:%02d.%05ld"
 
+/*
+ * asynchronous backend
+ *
+ * every logging thread owns a byte ring it alone writes to; records carry
+ * the wall time and the already formatted text. a drain thread merges the
+ * rings in time order and does the stderr I/O, so a burst of errors costs
+ * the loop threads a vsnprintf each. a record that does not fit is
+ * dropped and counted, the drain thread reports the count. FATAL messages
+ * bypass the rings.
+ */
+#define XIO_LOG_RING_SIZE	(64 * 1024)
+#define XIO_LOG_TEXT_MAX	1024
+#define XIO_LOG_DRAIN_MS	10
+#define XIO_LOG_SKIP		0xffffffff
+
+struct xio_log_rec {
+	uint32_t		len;	/* whole record, 8 aligned */
+	uint32_t		level;
+	uint32_t		line;
+	uint32_t		pad;
+	const char		*file;
+	struct timeval		tv;
+	char			text[0];
+};
+
+struct xio_log_ring {
+	struct list_head	ring_list_entry;
+	uint64_t		head;		/* written by the owner	*/
+	uint64_t		tail;		/* by the drain thread	*/
+	uint64_t		dropped;
+	uint64_t		reported;
+	int			orphan;		/* owner exited		*/
+	int			pad;
+	char			buf[XIO_LOG_RING_SIZE];
+};
+
+static volatile int		log_async;
+static int			log_gen;
+static unsigned int		log_burst;	/* 0 - no rate limiting	*/
+static uint64_t			log_suppressed;
+static uint64_t			log_dropped;
+static pthread_key_t		log_key;
+static pthread_t		log_thread;
+static pthread_mutex_t		log_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t		log_cond;
+static int			log_stop;
+static LIST_HEAD(log_rings);
+
+static xio_tls struct xio_log_ring	*log_ring;
+static xio_tls int			log_ring_gen;
+
 /*---------------------------------------------------------------------------*/
-/* xio_vlog								     */
+/* xio_log_print							     */
 /*---------------------------------------------------------------------------*/
-void xio_vlog(const char *file, unsigned line, const char *function,
-	      unsigned level, const char *fmt, ...)
+static void xio_log_print(const struct timeval *tv, const char *file,
+			  unsigned line, unsigned level, const char *text)
 {
-	va_list			args;
 	const char		*short_file;
-	struct timeval		tv;
 	struct tm		t;
-	char			buf[2048];
 	char			buf2[48];
-	int			length = 0;
 	static const char * const level_str[] = {
 		"FATAL", "ERROR", "WARN", "INFO", "DEBUG", "TRACE"
 	};
 
-	va_start(args, fmt);
-	length = vsnprintf(buf, sizeof(buf), fmt, args);
-	va_end(args);
-	buf[length] = 0;
-
-	gettimeofday(&tv, NULL);
-	localtime_r(&tv.tv_sec, &t);
+	localtime_r(&tv->tv_sec, &t);
 
 	short_file = strrchr(file, '/');
 	short_file = (short_file == NULL) ? file : short_file + 1;
@@ -87,14 +130,375 @@ void xio_vlog(const char *file, unsigned line, const char *function,
 	fprintf(stderr,
 		"["LOG_TIME_FMT"] %-28s [%-5s] - %s",
 		t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-		t.tm_hour, t.tm_min, t.tm_sec, tv.tv_usec,
+		t.tm_hour, t.tm_min, t.tm_sec, tv->tv_usec,
 		buf2,
-		level_str[level], buf);
+		level_str[level], text);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_ring_key_release - the owner thread exits			     */
+/*---------------------------------------------------------------------------*/
+static void xio_log_ring_key_release(void *data)
+{
+	struct xio_log_ring *ring = (struct xio_log_ring *)data;
+
+	__atomic_store_n(&ring->orphan, 1, __ATOMIC_RELEASE);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_ring_get							     */
+/*---------------------------------------------------------------------------*/
+static struct xio_log_ring *xio_log_ring_get(void)
+{
+	struct xio_log_ring *ring;
 
+	if (likely(log_ring && log_ring_gen == log_gen))
+		return log_ring;
+
+	ring = (struct xio_log_ring *)ucalloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	pthread_mutex_lock(&log_mutex);
+	if (!log_async) {
+		pthread_mutex_unlock(&log_mutex);
+		ufree(ring);
+		return NULL;
+	}
+	list_add_tail(&ring->ring_list_entry, &log_rings);
+	log_ring_gen = log_gen;
+	pthread_mutex_unlock(&log_mutex);
+
+	pthread_setspecific(log_key, ring);
+	log_ring = ring;
+
+	return ring;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_ring_write							     */
+/*---------------------------------------------------------------------------*/
+static int xio_log_ring_write(const char *file, unsigned line,
+			      unsigned level, const char *text, int length)
+{
+	struct xio_log_ring	*ring = xio_log_ring_get();
+	struct xio_log_rec	*rec;
+	uint64_t		head, used;
+	uint32_t		pos, contig, len, skip = 0;
+
+	if (unlikely(!ring))
+		return -1;
+
+	if (length > XIO_LOG_TEXT_MAX)
+		length = XIO_LOG_TEXT_MAX;
+	len = (sizeof(*rec) + length + 1 + 7) & ~7;
+
+	head	= ring->head;
+	pos	= head % XIO_LOG_RING_SIZE;
+	contig	= XIO_LOG_RING_SIZE - pos;
+	if (contig < len)
+		skip = contig;
+
+	used = head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (XIO_LOG_RING_SIZE - used < skip + len) {
+		__atomic_store_n(&ring->dropped, ring->dropped + 1,
+				 __ATOMIC_RELAXED);
+		pthread_cond_signal(&log_cond);
+		return 0;
+	}
+	if (skip) {
+		/* a tail too short for a header is skipped implicitly */
+		if (skip >= sizeof(*rec)) {
+			rec = (struct xio_log_rec *)&ring->buf[pos];
+			rec->len	= skip;
+			rec->level	= XIO_LOG_SKIP;
+		}
+		pos = 0;
+	}
+
+	rec = (struct xio_log_rec *)&ring->buf[pos];
+	rec->len	= len;
+	rec->level	= level;
+	rec->line	= line;
+	rec->file	= file;
+	gettimeofday(&rec->tv, NULL);
+	memcpy(rec->text, text, length);
+	rec->text[length] = 0;
+
+	__atomic_store_n(&ring->head, head + skip + len, __ATOMIC_RELEASE);
+
+	/* the drain thread polls, wake it early only when filling up */
+	if (used + skip + len > XIO_LOG_RING_SIZE / 2)
+		pthread_cond_signal(&log_cond);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_ring_peek - next record of a ring or NULL			     */
+/*---------------------------------------------------------------------------*/
+static struct xio_log_rec *xio_log_ring_peek(struct xio_log_ring *ring)
+{
+	struct xio_log_rec	*rec;
+	uint32_t		pos;
+
+	while (ring->tail != __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+		pos = ring->tail % XIO_LOG_RING_SIZE;
+		if (XIO_LOG_RING_SIZE - pos < sizeof(*rec)) {
+			__atomic_store_n(&ring->tail,
+					 ring->tail + XIO_LOG_RING_SIZE - pos,
+					 __ATOMIC_RELEASE);
+			continue;
+		}
+		rec = (struct xio_log_rec *)&ring->buf[pos];
+		if (rec->level != XIO_LOG_SKIP)
+			return rec;
+		__atomic_store_n(&ring->tail, ring->tail + rec->len,
+				 __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_drain - print pending records, oldest first			     */
+/*---------------------------------------------------------------------------*/
+static void xio_log_drain(void)
+{
+	struct xio_log_ring	*ring, *tmp, *oldest;
+	struct xio_log_rec	*rec, *first;
+	struct timeval		tv;
+	uint64_t		dropped;
+	int			printed = 0;
+	char			buf[64];
+
+	pthread_mutex_lock(&log_mutex);
+	while (1) {
+		oldest = NULL;
+		first = NULL;
+		list_for_each_entry(ring, &log_rings, ring_list_entry) {
+			rec = xio_log_ring_peek(ring);
+			if (rec && (!first || timercmp(&rec->tv, &first->tv, <))) {
+				first = rec;
+				oldest = ring;
+			}
+		}
+		if (!oldest)
+			break;
+		xio_log_print(&first->tv, first->file, first->line,
+			      first->level, first->text);
+		__atomic_store_n(&oldest->tail, oldest->tail + first->len,
+				 __ATOMIC_RELEASE);
+		printed++;
+	}
+	list_for_each_entry_safe(ring, tmp, &log_rings, ring_list_entry) {
+		dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+		if (dropped != ring->reported) {
+			gettimeofday(&tv, NULL);
+			snprintf(buf, sizeof(buf),
+				 "%llu log records dropped, ring full\n",
+				 (unsigned long long)(dropped - ring->reported));
+			xio_log_print(&tv, __FILE__, __LINE__,
+				      XIO_LOG_LEVEL_WARN, buf);
+			log_dropped += dropped - ring->reported;
+			ring->reported = dropped;
+			printed++;
+		}
+		/* an exited owner's last records are printed first */
+		if (__atomic_load_n(&ring->orphan, __ATOMIC_ACQUIRE) &&
+		    !xio_log_ring_peek(ring)) {
+			list_del(&ring->ring_list_entry);
+			ufree(ring);
+		}
+	}
+	pthread_mutex_unlock(&log_mutex);
+
+	if (printed)
+		fflush(stderr);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_drain_worker							     */
+/*---------------------------------------------------------------------------*/
+static void *xio_log_drain_worker(void *data)
+{
+	struct timespec deadline;
+	int		stop = 0;
+
+	while (!stop) {
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += XIO_LOG_DRAIN_MS * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+		pthread_mutex_lock(&log_mutex);
+		if (!log_stop)
+			pthread_cond_timedwait(&log_cond, &log_mutex,
+					       &deadline);
+		stop = log_stop;
+		pthread_mutex_unlock(&log_mutex);
+
+		xio_log_drain();
+	}
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_vlog								     */
+/*---------------------------------------------------------------------------*/
+void xio_vlog(const char *file, unsigned line, const char *function,
+	      unsigned level, const char *fmt, ...)
+{
+	va_list			args;
+	struct timeval		tv;
+	char			buf[2048];
+	int			length = 0;
+
+	va_start(args, fmt);
+	length = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	if (length < 0)
+		return;
+	if (length >= (int)sizeof(buf))
+		length = sizeof(buf) - 1;
+	buf[length] = 0;
+
+	if (log_async && level != XIO_LOG_LEVEL_FATAL &&
+	    !xio_log_ring_write(file, line, level, buf, length))
+		return;
+
+	gettimeofday(&tv, NULL);
+	xio_log_print(&tv, file, line, level, buf);
 
 	fflush(stderr);
 }
 
+/*---------------------------------------------------------------------------*/
+/* xio_log_ratelimit - pass at most log_burst messages of a call site per   */
+/* second; the suppressed ones are reported by the thread that opens the    */
+/* next second								     */
+/*---------------------------------------------------------------------------*/
+int xio_log_ratelimit(struct xio_log_site *site, unsigned level,
+		      const char *file, unsigned line, const char *function)
+{
+	struct timespec ts;
+	uint64_t	state, next, sec;
+	uint32_t	suppressed;
+
+	if (likely(!log_burst) || level == XIO_LOG_LEVEL_FATAL ||
+	    level > XIO_LOG_LEVEL_INFO)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	sec = (uint32_t)ts.tv_sec;
+	do {
+		state = site->state;
+		if ((state >> 32) != sec) {
+			next = (sec << 32) | 1;
+		} else if ((uint32_t)state < log_burst) {
+			next = state + 1;
+		} else {
+			__sync_fetch_and_add(&site->suppressed, 1);
+			__sync_fetch_and_add(&log_suppressed, 1);
+			return 0;
+		}
+	} while (!__sync_bool_compare_and_swap(&site->state, state, next));
+
+	if ((state >> 32) != sec) {
+		suppressed = __sync_lock_test_and_set(&site->suppressed, 0);
+		if (suppressed)
+			xio_vlog_fn(file, line, function, level,
+				    "%u similar messages suppressed\n",
+				    suppressed);
+	}
+
+	return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_construct							     */
+/*---------------------------------------------------------------------------*/
+void xio_log_construct(void)
+{
+	pthread_condattr_t	attr;
+	sigset_t		set, old;
+	char			*val;
+	int			retval;
+
+	/* opt in, like the asynchronous backend */
+	val = getenv("XIO_LOG_RATELIMIT");
+	if (val && atoi(val) > 0)
+		log_burst = atoi(val);
+
+	val = getenv("XIO_LOG_ASYNC");
+	if (!val || !atoi(val) || log_async)
+		return;
+
+	if (pthread_key_create(&log_key, xio_log_ring_key_release))
+		return;
+
+	/* kept across destruct, a late writer may still signal it */
+	if (!log_gen) {
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&log_cond, &attr);
+		pthread_condattr_destroy(&attr);
+	}
+
+	log_stop = 0;
+	log_gen++;
+	/* the worker must not take the application's signals */
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+	retval = pthread_create(&log_thread, NULL, xio_log_drain_worker, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	if (retval) {
+		pthread_key_delete(log_key);
+		return;
+	}
+	log_async = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_log_destruct							     */
+/*---------------------------------------------------------------------------*/
+void xio_log_destruct(void)
+{
+	struct timeval		tv;
+	char			buf[96];
+
+	if (!log_async)
+		return;
+
+	pthread_mutex_lock(&log_mutex);
+	log_async = 0;
+	log_stop = 1;
+	pthread_cond_signal(&log_cond);
+	pthread_mutex_unlock(&log_mutex);
+
+	/* the worker drains once more before it exits */
+	pthread_join(log_thread, NULL);
+	pthread_key_delete(log_key);
+
+	/* the rings are not freed - a thread that saw log_async set may
+	 * still be writing to its cached ring. they stay on log_rings and
+	 * a later construct drains them and frees the orphaned ones
+	 */
+
+	if (log_dropped || log_suppressed) {
+		gettimeofday(&tv, NULL);
+		snprintf(buf, sizeof(buf),
+			 "log records dropped %llu, suppressed %llu\n",
+			 (unsigned long long)log_dropped,
+			 (unsigned long long)log_suppressed);
+		xio_log_print(&tv, __FILE__, __LINE__, XIO_LOG_LEVEL_INFO,
+			      buf);
+		fflush(stderr);
+	}
+}
+
 /*---------------------------------------------------------------------------*/
 /* xio_read_logging_level						     */
 /*---------------------------------------------------------------------------*/
@@ -48,6 +48,18 @@
 #define XIO_F_PRINTF(fmtarg, varg) \
 	__attribute__((__format__(printf, fmtarg, varg)))
 
+/*---------------------------------------------------------------------------*/
+/* structs								     */
+/*---------------------------------------------------------------------------*/
+/* per call site rate limiting state, see xio_log_ratelimit. shared by
+ * every thread that logs from the site, so it changes only atomically
+ */
+struct xio_log_site {
+	volatile uint64_t	state;		/* second << 32 | count	*/
+	volatile uint32_t	suppressed;	/* not yet reported	*/
+	uint32_t		pad;
+};
+
 /*---------------------------------------------------------------------------*/
 /* enum									     */
 /*---------------------------------------------------------------------------*/
@@ -57,10 +69,16 @@ extern xio_log_fn		xio_vlog_fn;
 extern void xio_vlog(const char *file, unsigned line, const char *function,
 		     unsigned level, const char *fmt, ...);
 
+int xio_log_ratelimit(struct xio_log_site *site, unsigned level,
+		      const char *file, unsigned line, const char *function);
+
 #define xio_log(level, fmt, ...) \
 	do { \
+		static struct xio_log_site log_site; \
 		if (unlikely(((level) < XIO_LOG_LEVEL_LAST) &&  \
-					(level) <= xio_logging_level)) { \
+					(level) <= xio_logging_level) && \
+		    xio_log_ratelimit(&log_site, (level), __FILE__, \
+				      __LINE__, __func__)) { \
 			xio_vlog_fn(__FILE__, __LINE__, __func__, (level), \
 				    fmt, ## __VA_ARGS__); \
 		} \
@@ -81,6 +99,13 @@ extern void xio_vlog(const char *file, unsigned line, const char *function,
 
 void xio_read_logging_level(void);
 
+/* asynchronous backend of xio_vlog - XIO_LOG_ASYNC=1, and per call site
+ * rate limiting - XIO_LOG_RATELIMIT=<messages per second>
+ */
+void xio_log_construct(void);
+
+void xio_log_destruct(void);
+
 static inline int xio_set_log_level(enum xio_log_level level)
 {
 	xio_logging_level = level;
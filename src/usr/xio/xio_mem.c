@@ -101,7 +101,11 @@ void *malloc_huge_pages(size_t size)
 				  real_size, strerror(retval));
 			return NULL;
 		}
-		memset(ptr, 0, real_size);
+		/* only the first word of the metadata page is used - leave
+		 * the rest untouched so it never becomes resident
+		 */
+		memset(sum_to_ptr(ptr, HUGE_PAGE_SZ), 0,
+		       real_size - HUGE_PAGE_SZ);
 		real_size = 0;
 	} else {
 		DEBUG_LOG("Allocated huge page sz:%zu\n", real_size);
@@ -190,3 +194,21 @@ void xio_numa_free_ptr(void *ptr)
 		   */
 		xio_numa_free(real_ptr, real_size);
 }
+
+/*---------------------------------------------------------------------------*/
+/* xio_mem_set_node - place the pages of a buffer on a numa node	     */
+/*---------------------------------------------------------------------------*/
+void xio_mem_set_node(void *ptr, size_t size, int node)
+{
+	uintptr_t start, end;
+
+	/* memory of a user allocator is left where the user put it */
+	if (!ptr || node < 0 || node >= (int)(sizeof(long) * 8) ||
+	    allocator_assigned || numa_available() < 0)
+		return;
+
+	start = (uintptr_t)ptr & ~((uintptr_t)page_size - 1);
+	end = ALIGN((uintptr_t)ptr + size, page_size);
+	if (xio_numa_tonode((void *)start, end - start, node))
+		DEBUG_LOG("mbind to node %d failed sz:%zu. %m\n", node, size);
+}
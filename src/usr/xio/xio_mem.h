@@ -49,6 +49,7 @@ extern void *malloc_huge_pages(size_t size);
 extern void free_huge_pages(void *ptr);
 extern void *xio_numa_alloc(size_t bytes, int node);
 extern void xio_numa_free_ptr(void *ptr);
+extern void xio_mem_set_node(void *ptr, size_t size, int node);
 
 
 static inline void xio_disable_huge_pages(int disable)
@@ -47,6 +47,7 @@ static inline void	*xio_mmap(size_t length);
 static inline int	xio_munmap(void *addr, size_t length);
 static inline void	*xio_numa_alloc_onnode(size_t size, int node);
 static inline void	xio_numa_free(void *start, size_t size);
+static inline int	xio_numa_tonode(void *start, size_t size, int node);
 
 #include <xio_env.h>
 #include "get_clock.h"
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/hashtable.h>
+#include <xio_os.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_observer.h"
+#include "xio_hash.h"
+#include "xio_transport.h"
+#include "xio_protocol.h"
+#include "xio_mbuf.h"
+#include "xio_task.h"
+#include "xio_idr.h"
+#include "xio_msg_list.h"
+#include "xio_ev_data.h"
+#include "xio_workqueue.h"
+#include "xio_context.h"
+#include "xio_session.h"
+#include "xio_nexus.h"
+#include "xio_sn_hash.h"
+#include "xio_connection.h"
+
+#define XIO_REBALANCER_INTERVAL_MS	1000
+#define XIO_REBALANCER_THRESHOLD	25	/* percent */
+#define XIO_REBALANCER_MIN_LOAD		64	/* messages per interval */
+#define XIO_REBALANCER_RETRIES		200	/* one per msec */
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_rebalancer_ctx {
+	struct xio_context		*ctx;
+	uint64_t			last_rx;
+	uint64_t			load;
+	uint64_t			mark_ns;	/* connections sampled */
+};
+
+struct xio_rebalancer {
+	struct xio_rebalancer_ctx	*ctxs;
+	int				ctxs_nr;
+	int				interval_ms;
+	int				threshold;
+	volatile int32_t		stop;
+	/* one migration at a time, owned by the source context */
+	volatile int32_t		busy;
+	int				retries;
+	struct xio_rebalancer_ctx	*src;
+	struct xio_context		*dst;
+	uint64_t			target;
+	xio_work_handle_t		work;
+	xio_delayed_work_handle_t	retry_work;
+	pthread_t			thread;
+	pthread_mutex_t			mutex;
+	pthread_cond_t			cond;
+};
+
+/*---------------------------------------------------------------------------*/
+/* xio_rebalancer_now_ns						     */
+/*---------------------------------------------------------------------------*/
+static inline uint64_t xio_rebalancer_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rebalancer_pick							     */
+/*---------------------------------------------------------------------------*/
+static struct xio_connection *xio_rebalancer_pick(struct xio_rebalancer *rb,
+						  int remark)
+{
+	struct xio_context	*ctx = rb->src->ctx;
+	struct xio_connection	*connection, *best = NULL;
+	uint64_t		now = xio_rebalancer_now_ns();
+	uint64_t		elapsed, load, dist, best_dist = 0;
+
+	/* retries measure from the same mark as the first pick */
+	elapsed = rb->src->mark_ns ? now - rb->src->mark_ns : 0;
+	if (remark)
+		rb->src->mark_ns = now;
+
+	/* moving load d narrows the gap only while d < 2 * target, the
+	 * best candidate carries about target
+	 */
+	list_for_each_entry(connection, &ctx->ctx_list, ctx_list_entry) {
+		load = connection->counters->rx_msgs -
+		       connection->rx_msgs_mark;
+		if (remark)
+			connection->rx_msgs_mark =
+				connection->counters->rx_msgs;
+		if (elapsed)
+			load = load * (rb->interval_ms * 1000000ULL) / elapsed;
+		if (!load || load >= 2 * rb->target)
+			continue;
+		dist = load > rb->target ? load - rb->target :
+					   rb->target - load;
+		if (!best || dist < best_dist) {
+			best = connection;
+			best_dist = dist;
+		}
+	}
+
+	return best;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rebalancer_migrate_handler					     */
+/*---------------------------------------------------------------------------*/
+static void xio_rebalancer_migrate_handler(void *data)
+{
+	struct xio_rebalancer	*rb = (struct xio_rebalancer *)data;
+	struct xio_context	*ctx = rb->src->ctx;
+	struct xio_connection	*candidate;
+	int			first = !rb->retries;
+
+	/* runs on the source context. the candidate is picked again on
+	 * every retry, not kept across them: a connection closed meanwhile
+	 * may have left its memory to a new one
+	 */
+	if (first)
+		rb->retries = XIO_REBALANCER_RETRIES;
+	candidate = xio_rebalancer_pick(rb, first);
+	if (!candidate)
+		goto done;
+
+	if (!xio_connection_migrate(candidate, rb->dst)) {
+		DEBUG_LOG("rebalancer: connection:%p moved from ctx:%p " \
+			  "to ctx:%p\n", candidate, ctx, rb->dst);
+		goto done;
+	}
+	/* a busy connection is idle only between messages, poll for it */
+	if (xio_errno() == EAGAIN && --rb->retries > 0 && !rb->stop &&
+	    !xio_ctx_add_delayed_work(ctx, 1, rb,
+				      xio_rebalancer_migrate_handler,
+				      &rb->retry_work))
+		return;
+done:
+	rb->retries = 0;
+	xio_sync_synchronize();
+	rb->busy = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rebalancer_sample						     */
+/*---------------------------------------------------------------------------*/
+static void xio_rebalancer_sample(struct xio_rebalancer *rb)
+{
+	struct xio_rebalancer_ctx	*c, *max = NULL, *min = NULL;
+	uint64_t			rx;
+	int				i;
+
+	/* per context load: messages received during the last interval */
+	for (i = 0; i < rb->ctxs_nr; i++) {
+		c = &rb->ctxs[i];
+		rx = c->ctx->stats.counter[XIO_STAT_RX_MSG];
+		c->load = rx - c->last_rx;
+		c->last_rx = rx;
+		if (!max || c->load > max->load)
+			max = c;
+		if (!min || c->load < min->load)
+			min = c;
+	}
+	if (rb->busy || max == min || max->load < XIO_REBALANCER_MIN_LOAD ||
+	    (max->load - min->load) * 100 <= rb->threshold * max->load)
+		return;
+
+	rb->src	   = max;
+	rb->dst	   = min->ctx;
+	rb->target = (max->load - min->load) / 2;
+	rb->busy   = 1;
+	xio_sync_synchronize();
+	if (xio_ctx_add_work(max->ctx, rb, xio_rebalancer_migrate_handler,
+			     &rb->work))
+		rb->busy = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rebalancer_thread						     */
+/*---------------------------------------------------------------------------*/
+static void *xio_rebalancer_thread(void *data)
+{
+	struct xio_rebalancer	*rb = (struct xio_rebalancer *)data;
+	struct timespec		ts;
+
+	pthread_mutex_lock(&rb->mutex);
+	while (!rb->stop) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec  += rb->interval_ms / 1000;
+		ts.tv_nsec += (rb->interval_ms % 1000) * 1000000L;
+		if (ts.tv_nsec >= 1000000000L) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000L;
+		}
+		pthread_cond_timedwait(&rb->cond, &rb->mutex, &ts);
+		if (!rb->stop)
+			xio_rebalancer_sample(rb);
+	}
+	pthread_mutex_unlock(&rb->mutex);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rebalancer_create						     */
+/*---------------------------------------------------------------------------*/
+struct xio_rebalancer *xio_rebalancer_create(struct xio_rebalancer_attr *attr)
+{
+	struct xio_rebalancer	*rb;
+	int			i;
+
+	if (!attr || !attr->ctxs || attr->ctxs_nr < 2 ||
+	    attr->interval_ms < 0 || attr->threshold < 0 ||
+	    attr->threshold > 100) {
+		xio_set_error(EINVAL);
+		ERROR_LOG("invalid rebalancer attributes\n");
+		return NULL;
+	}
+
+	rb = (struct xio_rebalancer *)ucalloc(1, sizeof(*rb));
+	if (!rb) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("rebalancer allocation failed\n");
+		return NULL;
+	}
+	rb->ctxs = (struct xio_rebalancer_ctx *)ucalloc(attr->ctxs_nr,
+							sizeof(*rb->ctxs));
+	if (!rb->ctxs) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("rebalancer allocation failed\n");
+		goto cleanup;
+	}
+	rb->ctxs_nr	= attr->ctxs_nr;
+	rb->interval_ms	= attr->interval_ms ? attr->interval_ms :
+			  XIO_REBALANCER_INTERVAL_MS;
+	rb->threshold	= attr->threshold ? attr->threshold :
+			  XIO_REBALANCER_THRESHOLD;
+	for (i = 0; i < rb->ctxs_nr; i++) {
+		rb->ctxs[i].ctx = attr->ctxs[i];
+		rb->ctxs[i].last_rx =
+			attr->ctxs[i]->stats.counter[XIO_STAT_RX_MSG];
+	}
+
+	pthread_mutex_init(&rb->mutex, NULL);
+	pthread_cond_init(&rb->cond, NULL);
+	if (pthread_create(&rb->thread, NULL, xio_rebalancer_thread, rb)) {
+		xio_set_error(errno);
+		ERROR_LOG("pthread_create failed. %m\n");
+		pthread_cond_destroy(&rb->cond);
+		pthread_mutex_destroy(&rb->mutex);
+		goto cleanup;
+	}
+
+	return rb;
+
+cleanup:
+	ufree(rb->ctxs);
+	ufree(rb);
+
+	return NULL;
+}
+EXPORT_SYMBOL(xio_rebalancer_create);
+
+/*---------------------------------------------------------------------------*/
+/* xio_rebalancer_destroy						     */
+/*---------------------------------------------------------------------------*/
+int xio_rebalancer_destroy(struct xio_rebalancer *rb)
+{
+	if (!rb) {
+		xio_set_error(EINVAL);
+		return -1;
+	}
+
+	pthread_mutex_lock(&rb->mutex);
+	rb->stop = 1;
+	pthread_cond_signal(&rb->cond);
+	pthread_mutex_unlock(&rb->mutex);
+	pthread_join(rb->thread, NULL);
+
+	/* the loops are not running - drop a migration that is still
+	 * queued or waiting for its connection to go idle
+	 */
+	if (rb->busy) {
+		xio_ctx_del_work(rb->src->ctx, &rb->work);
+		xio_ctx_del_delayed_work(rb->src->ctx, &rb->retry_work);
+	}
+
+	pthread_cond_destroy(&rb->cond);
+	pthread_mutex_destroy(&rb->mutex);
+	ufree(rb->ctxs);
+	ufree(rb);
+
+	return 0;
+}
+EXPORT_SYMBOL(xio_rebalancer_destroy);
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_mem.h"
+#include "xio_observer.h"
+#include "xio_ev_data.h"
+#include "xio_ev_loop.h"
+#include "xio_workqueue.h"
+#include "xio_context.h"
+#include "xio_msg_trace.h"
+#include "xio_capture.h"
+#include "xio_usr_rec_sink.h"
+
+#define XIO_REC_BATCH		512	/* records buffered per context */
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_rec_sink {
+	const char		*env;		/* names the file	      */
+	const char		*name;		/* else /tmp/<name>.<pid>     */
+	int			*option;	/* set when env names a file  */
+	uint32_t		magic;
+	uint32_t		version;
+	uint32_t		rec_size;
+	int			fd;
+	int			failed;
+	int			pad;
+	char			path[256];
+	struct mutex		lock;
+};
+
+struct xio_rec_buf {
+	uint32_t		nr;
+	uint32_t		type;		/* enum xio_ctx_rec_type      */
+	char			rec[0];
+};
+
+/*---------------------------------------------------------------------------*/
+/* globals								     */
+/*---------------------------------------------------------------------------*/
+static struct xio_rec_sink rec_sinks[XIO_CTX_REC_TYPES] = {
+	[XIO_CTX_REC_MSG_TRACE] = {
+		.env		= "XIO_MSG_TRACE",
+		.name		= "xio_msg_trace",
+		.option		= &g_options.msg_trace,
+		.magic		= XIO_MSG_TRACE_MAGIC,
+		.version	= XIO_MSG_TRACE_VERSION,
+		.rec_size	= sizeof(struct xio_msg_trace_rec),
+		.fd		= -1,
+		.lock		= __MUTEX_INITIALIZER(lock),
+	},
+	[XIO_CTX_REC_CAPTURE] = {
+		.env		= "XIO_CAPTURE",
+		.name		= "xio_capture",
+		.option		= &g_options.capture,
+		.magic		= XIO_CAPTURE_MAGIC,
+		.version	= XIO_CAPTURE_VERSION,
+		.rec_size	= sizeof(struct xio_capture_rec),
+		.fd		= -1,
+		.lock		= __MUTEX_INITIALIZER(lock),
+	},
+};
+
+/*---------------------------------------------------------------------------*/
+/* xio_rec_sinks_construct						     */
+/*---------------------------------------------------------------------------*/
+void xio_rec_sinks_construct(void)
+{
+	struct xio_rec_sink	*sink;
+	char			*val;
+	int			i;
+
+	for (i = 0; i < XIO_CTX_REC_TYPES; i++) {
+		sink = &rec_sinks[i];
+		val = getenv(sink->env);
+		if (!val || !*val)
+			continue;
+
+		snprintf(sink->path, sizeof(sink->path), "%s", val);
+		*sink->option = 1;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rec_sink_open - first record of the process			     */
+/*---------------------------------------------------------------------------*/
+static int xio_rec_sink_open(struct xio_rec_sink *sink)
+{
+	struct xio_rec_file_hdr	hdr;
+	int			fd;
+
+	if (!sink->path[0])
+		snprintf(sink->path, sizeof(sink->path),
+			 "/tmp/%s.%d", sink->name, getpid());
+
+	fd = open(sink->path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC,
+		  0644);
+	if (fd < 0) {
+		xio_set_error(errno);
+		ERROR_LOG("open %s failed. %m\n", sink->path);
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic	= sink->magic;
+	hdr.version	= sink->version;
+	hdr.pid		= getpid();
+	hdr.rec_size	= sink->rec_size;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+		xio_set_error(errno);
+		ERROR_LOG("write %s failed. %m\n", sink->path);
+		close(fd);
+		return -1;
+	}
+	sink->fd = fd;
+	DEBUG_LOG("%s records written to %s\n", sink->name, sink->path);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rec_sink_flush							     */
+/*---------------------------------------------------------------------------*/
+void xio_rec_sink_flush(struct xio_rec_buf *buf)
+{
+	struct xio_rec_sink	*sink;
+	size_t			len;
+
+	if (!buf || !buf->nr)
+		return;
+
+	sink	= &rec_sinks[buf->type];
+	len	= buf->nr * sink->rec_size;
+	buf->nr = 0;
+
+	/* whole batches under the lock keep records of the contexts apart */
+	mutex_lock(&sink->lock);
+	if (sink->fd < 0 && !sink->failed && xio_rec_sink_open(sink))
+		sink->failed = 1;
+	if (sink->fd >= 0 && write(sink->fd, buf->rec, len) != (ssize_t)len)
+		ERROR_LOG("write %s failed. %m\n", sink->path);
+	mutex_unlock(&sink->lock);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rec_sink_add							     */
+/*---------------------------------------------------------------------------*/
+int xio_rec_sink_add(int type, struct xio_rec_buf **pbuf, const void *rec)
+{
+	struct xio_rec_sink	*sink = &rec_sinks[type];
+	struct xio_rec_buf	*buf = *pbuf;
+
+	if (unlikely(!buf)) {
+		buf = (struct xio_rec_buf *)ucalloc(1, sizeof(*buf) +
+				XIO_REC_BATCH * sink->rec_size);
+		if (!buf) {
+			xio_set_error(ENOMEM);
+			ERROR_LOG("calloc failed. %m\n");
+			return -1;
+		}
+		buf->type = type;
+		*pbuf = buf;
+	}
+	memcpy(buf->rec + buf->nr * sink->rec_size, rec, sink->rec_size);
+	if (++buf->nr == XIO_REC_BATCH)
+		xio_rec_sink_flush(buf);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rec_buf_destroy							     */
+/*---------------------------------------------------------------------------*/
+void xio_rec_buf_destroy(struct xio_rec_buf *buf)
+{
+	if (!buf)
+		return;
+
+	xio_rec_sink_flush(buf);
+	ufree(buf);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_rec_sinks_destruct						     */
+/*---------------------------------------------------------------------------*/
+void xio_rec_sinks_destruct(void)
+{
+	struct xio_rec_sink	*sink;
+	int			i;
+
+	for (i = 0; i < XIO_CTX_REC_TYPES; i++) {
+		sink = &rec_sinks[i];
+		mutex_lock(&sink->lock);
+		if (sink->fd >= 0) {
+			close(sink->fd);
+			sink->fd = -1;
+		}
+		sink->failed = 0;
+		mutex_unlock(&sink->lock);
+	}
+}
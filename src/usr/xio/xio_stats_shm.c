@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <xio_os.h>
+#include <sys/mman.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_clock.h"
+#include "xio_stats_shm.h"
+
+/*---------------------------------------------------------------------------*/
+/* globals								     */
+/*---------------------------------------------------------------------------*/
+static struct xio_stats_shm_hdr	*g_shm;		/* open for claims */
+static struct xio_stats_shm_hdr	*g_shm_map;	/* until last release */
+static uint32_t			g_shm_slots;	/* claimed	      */
+static char			g_shm_name[64];
+static uint64_t			g_shm_next_id = 1;
+static DEFINE_MUTEX(shm_mutex);
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_slots							     */
+/*---------------------------------------------------------------------------*/
+static inline void *xio_stats_shm_slots(uint64_t off)
+{
+	return (char *)g_shm + off;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_unpublished - no free slot, count it and say so once      */
+/*---------------------------------------------------------------------------*/
+static void xio_stats_shm_unpublished(volatile uint64_t *counter,
+				      const char *what)
+{
+	if (!(*counter)++)
+		WARN_LOG("statistics segment: no free %s slot, " \
+			 "further ones are only counted\n", what);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_begin - open a slot for identity changes		     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_stats_shm_begin(volatile uint32_t *seq)
+{
+	(*seq)++;
+	__sync_synchronize();
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_end							     */
+/*---------------------------------------------------------------------------*/
+static inline void xio_stats_shm_end(volatile uint32_t *seq)
+{
+	__sync_synchronize();
+	(*seq)++;
+	g_shm_map->generation++;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_construct						     */
+/*---------------------------------------------------------------------------*/
+int xio_stats_shm_construct(void)
+{
+	struct xio_stats_shm_hdr	*hdr;
+	char				*val = getenv("XIO_STATS_SHM");
+	size_t				size;
+	int				fd;
+
+	if (!val || !atoi(val))
+		return 0;
+
+	size = sizeof(*hdr) +
+	       XIO_STATS_SHM_CTXS * sizeof(struct xio_stats_shm_ctx) +
+	       XIO_STATS_SHM_CONNS * sizeof(struct xio_stats_shm_conn) +
+	       XIO_STATS_SHM_POOLS * sizeof(struct xio_stats_shm_pool);
+
+	snprintf(g_shm_name, sizeof(g_shm_name), "%s%d",
+		 XIO_STATS_SHM_PREFIX, getpid());
+	fd = shm_open(g_shm_name, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC,
+		      0644);
+	if (fd < 0) {
+		xio_set_error(errno);
+		ERROR_LOG("shm_open %s failed. %m\n", g_shm_name);
+		return -1;
+	}
+	if (ftruncate(fd, size)) {
+		xio_set_error(errno);
+		ERROR_LOG("ftruncate failed. %m\n");
+		goto cleanup;
+	}
+	hdr = (struct xio_stats_shm_hdr *)mmap(NULL, size,
+					       PROT_READ | PROT_WRITE,
+					       MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED) {
+		xio_set_error(errno);
+		ERROR_LOG("mmap failed. %m\n");
+		goto cleanup;
+	}
+	close(fd);
+
+	/* fresh pages are zeroed - all slots free */
+	hdr->size	= size;
+	hdr->hertz	= xio_clock_hz();
+	hdr->pid	= getpid();
+	hdr->ctxs_nr	= XIO_STATS_SHM_CTXS;
+	hdr->conns_nr	= XIO_STATS_SHM_CONNS;
+	hdr->pools_nr	= XIO_STATS_SHM_POOLS;
+	hdr->ctxs_off	= sizeof(*hdr);
+	hdr->conns_off	= hdr->ctxs_off +
+			  XIO_STATS_SHM_CTXS * sizeof(struct xio_stats_shm_ctx);
+	hdr->pools_off	= hdr->conns_off +
+			  XIO_STATS_SHM_CONNS *
+			  sizeof(struct xio_stats_shm_conn);
+	hdr->version	= XIO_STATS_SHM_VERSION;
+	__sync_synchronize();
+	/* readers check the magic last */
+	hdr->magic	= XIO_STATS_SHM_MAGIC;
+
+	g_shm = hdr;
+	g_shm_map = hdr;
+	DEBUG_LOG("statistics published in %s\n", g_shm_name);
+
+	return 0;
+
+cleanup:
+	close(fd);
+	shm_unlink(g_shm_name);
+	return -1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_destruct						     */
+/*---------------------------------------------------------------------------*/
+void xio_stats_shm_destruct(void)
+{
+	mutex_lock(&shm_mutex);
+	if (!g_shm) {
+		mutex_unlock(&shm_mutex);
+		return;
+	}
+	shm_unlink(g_shm_name);
+	g_shm = NULL;
+	/* else the last slot release unmaps it */
+	if (!g_shm_slots) {
+		munmap(g_shm_map, g_shm_map->size);
+		g_shm_map = NULL;
+	}
+	mutex_unlock(&shm_mutex);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_put - a slot was released, under shm_mutex		     */
+/*---------------------------------------------------------------------------*/
+static void xio_stats_shm_put(void)
+{
+	if (--g_shm_slots || g_shm)
+		return;
+
+	munmap(g_shm_map, g_shm_map->size);
+	g_shm_map = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_ctx_claim						     */
+/*---------------------------------------------------------------------------*/
+struct xio_stats_shm_ctx *xio_stats_shm_ctx_claim(int cpu, int nodeid)
+{
+	struct xio_stats_shm_ctx	*slot;
+	uint32_t			i;
+
+	mutex_lock(&shm_mutex);
+	if (!g_shm) {
+		mutex_unlock(&shm_mutex);
+		return NULL;
+	}
+	slot = (struct xio_stats_shm_ctx *)
+			xio_stats_shm_slots(g_shm->ctxs_off);
+	for (i = 0; i < g_shm->ctxs_nr; i++, slot++) {
+		if (slot->in_use)
+			continue;
+		xio_stats_shm_begin(&slot->seq);
+		slot->id	= g_shm_next_id++;
+		slot->cpu	= cpu;
+		slot->nodeid	= nodeid;
+		memset(slot->name, 0, sizeof(slot->name));
+		memset(slot->counter, 0, sizeof(slot->counter));
+		slot->in_use	= 1;
+		xio_stats_shm_end(&slot->seq);
+		g_shm_slots++;
+		mutex_unlock(&shm_mutex);
+		return slot;
+	}
+	xio_stats_shm_unpublished(&g_shm->ctxs_unpublished, "context");
+	mutex_unlock(&shm_mutex);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_ctx_release						     */
+/*---------------------------------------------------------------------------*/
+void xio_stats_shm_ctx_release(struct xio_stats_shm_ctx *slot)
+{
+	if (!slot)
+		return;
+
+	mutex_lock(&shm_mutex);
+	xio_stats_shm_begin(&slot->seq);
+	slot->in_use = 0;
+	xio_stats_shm_end(&slot->seq);
+	xio_stats_shm_put();
+	mutex_unlock(&shm_mutex);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_ctx_name						     */
+/*---------------------------------------------------------------------------*/
+void xio_stats_shm_ctx_name(struct xio_stats_shm_ctx *slot, int counter,
+			    const char *name)
+{
+	if (!slot || counter < 0 || counter >= XIO_STATS_SHM_COUNTERS)
+		return;
+
+	mutex_lock(&shm_mutex);
+	xio_stats_shm_begin(&slot->seq);
+	memset(slot->name[counter], 0, XIO_STATS_SHM_NAME_LEN);
+	if (name)
+		strncpy(slot->name[counter], name,
+			XIO_STATS_SHM_NAME_LEN - 1);
+	xio_stats_shm_end(&slot->seq);
+	mutex_unlock(&shm_mutex);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_conn_claim						     */
+/*---------------------------------------------------------------------------*/
+struct xio_stats_shm_conn *xio_stats_shm_conn_claim(uint64_t ctx_id,
+						    uint64_t session_id,
+						    uint32_t conn_idx,
+						    const char *peer)
+{
+	struct xio_stats_shm_conn	*slot;
+	uint32_t			i;
+
+	mutex_lock(&shm_mutex);
+	if (!g_shm) {
+		mutex_unlock(&shm_mutex);
+		return NULL;
+	}
+	slot = (struct xio_stats_shm_conn *)
+			xio_stats_shm_slots(g_shm->conns_off);
+	for (i = 0; i < g_shm->conns_nr; i++, slot++) {
+		if (slot->in_use)
+			continue;
+		xio_stats_shm_begin(&slot->seq);
+		slot->id	 = g_shm_next_id++;
+		slot->ctx_id	 = ctx_id;
+		slot->session_id = session_id;
+		slot->conn_idx	 = conn_idx;
+		memset(slot->peer, 0, sizeof(slot->peer));
+		if (peer)
+			strncpy(slot->peer, peer, sizeof(slot->peer) - 1);
+		memset(&slot->counters, 0, sizeof(slot->counters));
+		slot->in_use	 = 1;
+		xio_stats_shm_end(&slot->seq);
+		g_shm_slots++;
+		mutex_unlock(&shm_mutex);
+		return slot;
+	}
+	xio_stats_shm_unpublished(&g_shm->conns_unpublished, "connection");
+	mutex_unlock(&shm_mutex);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_conn_release						     */
+/*---------------------------------------------------------------------------*/
+void xio_stats_shm_conn_release(struct xio_stats_shm_conn *slot)
+{
+	if (!slot)
+		return;
+
+	mutex_lock(&shm_mutex);
+	xio_stats_shm_begin(&slot->seq);
+	slot->in_use = 0;
+	xio_stats_shm_end(&slot->seq);
+	xio_stats_shm_put();
+	mutex_unlock(&shm_mutex);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_pool_claim						     */
+/*---------------------------------------------------------------------------*/
+struct xio_stats_shm_pool *xio_stats_shm_pool_claim(int nodeid)
+{
+	struct xio_stats_shm_pool	*slot;
+	uint32_t			i;
+
+	mutex_lock(&shm_mutex);
+	if (!g_shm) {
+		mutex_unlock(&shm_mutex);
+		return NULL;
+	}
+	slot = (struct xio_stats_shm_pool *)
+			xio_stats_shm_slots(g_shm->pools_off);
+	for (i = 0; i < g_shm->pools_nr; i++, slot++) {
+		if (slot->in_use)
+			continue;
+		xio_stats_shm_begin(&slot->seq);
+		slot->id	= g_shm_next_id++;
+		slot->nodeid	= nodeid;
+		slot->slabs_nr	= 0;
+		memset(slot->slab, 0, sizeof(slot->slab));
+		slot->in_use	= 1;
+		xio_stats_shm_end(&slot->seq);
+		g_shm_slots++;
+		mutex_unlock(&shm_mutex);
+		return slot;
+	}
+	xio_stats_shm_unpublished(&g_shm->pools_unpublished, "pool");
+	mutex_unlock(&shm_mutex);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_stats_shm_pool_release						     */
+/*---------------------------------------------------------------------------*/
+void xio_stats_shm_pool_release(struct xio_stats_shm_pool *slot)
+{
+	if (!slot)
+		return;
+
+	mutex_lock(&shm_mutex);
+	xio_stats_shm_begin(&slot->seq);
+	slot->in_use = 0;
+	xio_stats_shm_end(&slot->seq);
+	xio_stats_shm_put();
+	mutex_unlock(&shm_mutex);
+}
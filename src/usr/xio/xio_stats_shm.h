@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_STATS_SHM_H
+#define XIO_STATS_SHM_H
+
+/*
+ * per process statistics segment
+ *
+ * when XIO_STATS_SHM is set in the environment the library creates the
+ * POSIX shared memory object XIO_STATS_SHM_PREFIX<pid> and keeps the
+ * counters of every context, connection and memory pool directly in it,
+ * so an external reader (xio_stats) samples them with plain loads.
+ *
+ * the segment is a header followed by three fixed size slot arrays.
+ * counters are written in place by their owner thread without further
+ * synchronization. a slot's identity (claimed, released, renamed) is
+ * guarded by its seq - odd while the owner changes it - readers copy the
+ * slot and retry when seq was odd or moved meanwhile.
+ *
+ * the slot arrays do not grow - objects that find them full keep private
+ * counters and are only counted in the header's *_unpublished. the
+ * mapping outlives the library destructor until the last slot is
+ * released, the name is unlinked right away.
+ */
+
+#define XIO_STATS_SHM_PREFIX		"/xio_stats."
+#define XIO_STATS_SHM_MAGIC		0x53544958	/* "XITS" */
+#define XIO_STATS_SHM_VERSION		2
+
+#define XIO_STATS_SHM_COUNTERS		16	/* == XIO_STAT_LAST */
+#define XIO_STATS_SHM_NAME_LEN		32
+#define XIO_STATS_SHM_SLABS		8
+
+#define XIO_STATS_SHM_CTXS		256
+#define XIO_STATS_SHM_CONNS		4096
+#define XIO_STATS_SHM_POOLS		256
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_stats_shm_hdr {
+	uint32_t			magic;
+	uint32_t			version;
+	uint64_t			size;		/* whole segment */
+	uint64_t			hertz;		/* of timestamps  */
+	int32_t				pid;
+	uint32_t			ctxs_nr;	/* slots	  */
+	uint32_t			conns_nr;
+	uint32_t			pools_nr;
+	uint64_t			ctxs_off;	/* from the header */
+	uint64_t			conns_off;
+	uint64_t			pools_off;
+	/* bumped on every claim and release */
+	volatile uint64_t		generation;
+	/* claims that found no free slot */
+	volatile uint64_t		ctxs_unpublished;
+	volatile uint64_t		conns_unpublished;
+	volatile uint64_t		pools_unpublished;
+};
+
+struct xio_stats_shm_ctx {
+	volatile uint32_t		seq;
+	uint32_t			in_use;
+	uint64_t			id;	/* unique in the process */
+	int32_t				cpu;
+	int32_t				nodeid;
+	char				name[XIO_STATS_SHM_COUNTERS]
+					    [XIO_STATS_SHM_NAME_LEN];
+	uint64_t			counter[XIO_STATS_SHM_COUNTERS];
+};
+
+struct xio_stats_shm_conn {
+	volatile uint32_t		seq;
+	uint32_t			in_use;
+	uint64_t			id;
+	volatile uint64_t		ctx_id;	/* follows migrations */
+	uint64_t			session_id;
+	uint32_t			conn_idx;
+	uint32_t			pad;
+	char				peer[64];
+	struct xio_connection_counters	counters;
+};
+
+struct xio_stats_shm_slab {
+	uint64_t			mb_size;
+	int32_t				curr_mb_nr;
+	int32_t				max_mb_nr;
+	volatile int32_t		used_mb_nr;
+	int32_t				pad;
+};
+
+struct xio_stats_shm_pool {
+	volatile uint32_t		seq;
+	uint32_t			in_use;
+	uint64_t			id;
+	int32_t				nodeid;
+	uint32_t			slabs_nr;
+	struct xio_stats_shm_slab	slab[XIO_STATS_SHM_SLABS];
+};
+
+/*---------------------------------------------------------------------------*/
+/* library side - NULL when the segment is disabled or full, the caller  */
+/* then keeps its counters in private memory				     */
+/*---------------------------------------------------------------------------*/
+int xio_stats_shm_construct(void);
+void xio_stats_shm_destruct(void);
+
+struct xio_stats_shm_ctx *xio_stats_shm_ctx_claim(int cpu, int nodeid);
+void xio_stats_shm_ctx_release(struct xio_stats_shm_ctx *slot);
+void xio_stats_shm_ctx_name(struct xio_stats_shm_ctx *slot, int counter,
+			    const char *name);
+
+struct xio_stats_shm_conn *xio_stats_shm_conn_claim(uint64_t ctx_id,
+						    uint64_t session_id,
+						    uint32_t conn_idx,
+						    const char *peer);
+void xio_stats_shm_conn_release(struct xio_stats_shm_conn *slot);
+
+struct xio_stats_shm_pool *xio_stats_shm_pool_claim(int nodeid);
+void xio_stats_shm_pool_release(struct xio_stats_shm_pool *slot);
+
+#endif /* XIO_STATS_SHM_H */
@@ -90,6 +90,7 @@ int xio_tasks_pool_alloc_slab(struct xio_tasks_pool *q)
 
 	if (tot_sz > 1 << 20) {
 		buf = umalloc_huge_pages(tot_sz);
+		xio_mem_set_node(buf, tot_sz, q->params.node_id);
 		huge_alloc = 1;
 	} else {
 		buf = umemalign(64, tot_sz);
@@ -222,6 +223,7 @@ struct xio_tasks_pool *xio_tasks_pool_create(
 	INIT_LIST_HEAD(&q->slabs_list);
 
 	memcpy(&q->params, params, sizeof(*params));
+	q->node_id = params->node_id;
 
 	if (q->params.pool_hooks.pool_pre_create)
 		q->params.pool_hooks.pool_pre_create(
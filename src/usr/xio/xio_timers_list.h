@@ -38,6 +38,8 @@
 #ifndef XIO_TIMERS_LIST_H
 #define XIO_TIMERS_LIST_H
 
+#include "xio_clock.h"
+
 
 #define XIO_MS_IN_SEC   1000ULL
 #define XIO_US_IN_SEC   1000000ULL
@@ -52,6 +54,8 @@
 
 struct xio_timers_list {
 	struct list_head		timers_head;
+	/* owning loop's clock, NULL for precise reads */
+	struct xio_clock_cache		*clock;
 #ifdef SAFE_LIST
 	spinlock_t			lock;
 	int				pad;
@@ -83,24 +87,23 @@ static inline void xio_timers_list_unlock(struct xio_timers_list *timers_list)
 /*---------------------------------------------------------------------------*/
 /* xio_timers_list_ns_current_get					     */
 /*---------------------------------------------------------------------------*/
-static inline uint64_t xio_timers_list_ns_current_get(void)
+static inline uint64_t xio_timers_list_ns_current_get(
+			struct xio_timers_list *timers_list)
 {
-	uint64_t	ns_monotonic;
-	struct timespec ts;
-
-	xio_clock_gettime(&ts);
-
-	ns_monotonic = (ts.tv_sec*XIO_NS_IN_SEC) + (uint64_t)ts.tv_nsec;
+	if (unlikely(!timers_list->clock))
+		return xio_now_ns();
 
-	return ns_monotonic;
+	return xio_clock_cache_read(timers_list->clock);
 }
 
 /*---------------------------------------------------------------------------*/
 /* xio_timers_list_init							     */
 /*---------------------------------------------------------------------------*/
-static inline void xio_timers_list_init(struct xio_timers_list *timers_list)
+static inline void xio_timers_list_init(struct xio_timers_list *timers_list,
+					struct xio_clock_cache *clock)
 {
 	INIT_LIST_HEAD(&timers_list->timers_head);
+	timers_list->clock = clock;
 #ifdef SAFE_LIST
 	spin_lock_init(&timers_list->lock);
 #endif
@@ -150,7 +153,7 @@ static inline enum timers_list_rc xio_timers_list_add_duration(
 			struct xio_timers_list_entry *tentry)
 {
 	tentry->expires			=
-		(xio_timers_list_ns_current_get() + ns_duration);
+		(xio_timers_list_ns_current_get(timers_list) + ns_duration);
 
 	return xio_timers_list_add(timers_list, tentry);
 }
@@ -250,7 +253,7 @@ static inline int64_t xio_timerlist_ns_duration_to_expire(
 			&timers_list->timers_head,
 			struct xio_timers_list_entry, entry);
 
-	current_time = xio_timers_list_ns_current_get();
+	current_time = xio_timers_list_ns_current_get(timers_list);
 
 	/*
 	 * timer at head of list is expired, zero ns required
@@ -281,7 +284,7 @@ static inline void xio_timers_list_expire(struct xio_timers_list *timers_list)
 		tentry = list_first_entry(&timers_list->timers_head,
 					  struct xio_timers_list_entry, entry);
 
-		current_time = xio_timers_list_ns_current_get();
+		current_time = xio_timers_list_ns_current_get(timers_list);
 
 		if (time_before_eq64(tentry->expires, current_time)) {
 			xio_timers_list_pre_dispatch(timers_list,
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef XIO_USR_REC_SINK_H
+#define XIO_USR_REC_SINK_H
+
+/*
+ * user space sink of the records a context collects (see enum
+ * xio_ctx_rec_type). every type has its own process file - named by its
+ * environment variable (XIO_MSG_TRACE, XIO_CAPTURE), else
+ * /tmp/<name>.<pid> - that starts with a xio_rec_file_hdr. every context
+ * buffers its records of a type and appends them in whole batches.
+ */
+
+/* laid out as xio_msg_trace_file_hdr and xio_capture_file_hdr */
+struct xio_rec_file_hdr {
+	uint32_t		magic;
+	uint32_t		version;
+	int32_t			pid;
+	uint32_t		rec_size;
+};
+
+struct xio_rec_buf;
+
+void xio_rec_sinks_construct(void);
+void xio_rec_sinks_destruct(void);
+
+/* type is an enum xio_ctx_rec_type */
+int xio_rec_sink_add(int type, struct xio_rec_buf **pbuf, const void *rec);
+void xio_rec_sink_flush(struct xio_rec_buf *buf);
+void xio_rec_buf_destroy(struct xio_rec_buf *buf);
+
+#endif /* XIO_USR_REC_SINK_H */
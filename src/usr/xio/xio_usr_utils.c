@@ -270,6 +270,128 @@ int xio_uri_to_ss(const char *uri, struct sockaddr_storage *ss)
 }
 EXPORT_SYMBOL(xio_uri_to_ss);
 
+/*---------------------------------------------------------------------------*/
+/* xio_if_numa_node							     */
+/*---------------------------------------------------------------------------*/
+static int xio_if_numa_node(const char *if_name, int depth)
+{
+	char	path[256];
+	char	buf[256];
+	char	*p;
+	int	fd, len, node = -1;
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node",
+		 if_name);
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		/* virtual devices have no node, a bond takes its first
+		 * slave's
+		 */
+		if (depth)
+			return -1;
+		snprintf(path, sizeof(path),
+			 "/sys/class/net/%s/bonding/slaves", if_name);
+		fd = open(path, O_RDONLY);
+		if (fd == -1)
+			return -1;
+		len = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (len <= 0)
+			return -1;
+		buf[len] = 0;
+		p = strpbrk(buf, " \n");
+		if (p)
+			*p = 0;
+		return buf[0] ? xio_if_numa_node(buf, depth + 1) : -1;
+	}
+
+	len = read(fd, buf, sizeof(buf) - 1);
+	if (len > 0) {
+		buf[len] = 0;
+		node = strtol(buf, NULL, 0);
+	}
+	close(fd);
+
+	return node;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_uri_numa_node							     */
+/*---------------------------------------------------------------------------*/
+int xio_uri_numa_node(const char *uri)
+{
+	struct sockaddr_storage	ss;
+	struct ifaddrs		*ifaddr, *ifa;
+	struct sockaddr_in	*sa4 = (struct sockaddr_in *)&ss;
+	struct sockaddr_in6	*sa6 = (struct sockaddr_in6 *)&ss;
+	int			node = -1;
+
+	if (!uri || xio_uri_to_ss(uri, &ss) == -1)
+		return -1;
+
+	/* a wildcard address is served by any interface */
+	if ((ss.ss_family == AF_INET &&
+	     sa4->sin_addr.s_addr == htonl(INADDR_ANY)) ||
+	    (ss.ss_family == AF_INET6 &&
+	     IN6_IS_ADDR_UNSPECIFIED(&sa6->sin6_addr)))
+		return -1;
+
+	if (getifaddrs(&ifaddr) == -1) {
+		xio_set_error(errno);
+		ERROR_LOG("getifaddrs failed. %m\n");
+		return -1;
+	}
+	for (ifa = ifaddr; ifa; ifa = ifa->ifa_next) {
+		if (!ifa->ifa_addr || !(ifa->ifa_flags & IFF_UP) ||
+		    ifa->ifa_addr->sa_family != ss.ss_family)
+			continue;
+		if ((ss.ss_family == AF_INET &&
+		     ((struct sockaddr_in *)ifa->ifa_addr)->sin_addr.s_addr ==
+		     sa4->sin_addr.s_addr) ||
+		    (ss.ss_family == AF_INET6 &&
+		     !memcmp(&((struct sockaddr_in6 *)
+				ifa->ifa_addr)->sin6_addr,
+			     &sa6->sin6_addr, sizeof(sa6->sin6_addr)))) {
+			node = xio_if_numa_node(ifa->ifa_name, 0);
+			break;
+		}
+	}
+	freeifaddrs(ifaddr);
+
+	return node;
+}
+EXPORT_SYMBOL(xio_uri_numa_node);
+
+/*---------------------------------------------------------------------------*/
+/* xio_numa_node_cpus							     */
+/*---------------------------------------------------------------------------*/
+int xio_numa_node_cpus(int node, int *cpus, int cpus_nr)
+{
+	struct bitmask	*mask;
+	cpu_set_t	allowed;
+	unsigned int	i;
+	int		nr = 0;
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed))
+		CPU_ZERO(&allowed);
+
+	mask = numa_allocate_cpumask();
+	if (!mask)
+		return 0;
+	if (node < 0 || numa_available() < 0 ||
+	    numa_node_to_cpus(node, mask))
+		numa_bitmask_setall(mask);
+
+	/* cpus of the node this process may run on */
+	for (i = 0; i < mask->size && i < CPU_SETSIZE && nr < cpus_nr; i++) {
+		if (numa_bitmask_isbitset(mask, i) && CPU_ISSET(i, &allowed))
+			cpus[nr++] = i;
+	}
+	numa_free_cpumask(mask);
+
+	return nr;
+}
+
 
 /*---------------------------------------------------------------------------*/
 /* xio_msg_dump								     */
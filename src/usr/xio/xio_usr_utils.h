@@ -38,4 +38,9 @@
 #ifndef XIO_USR_UTILS_H
 #define XIO_USR_UTILS_H
 
+/*---------------------------------------------------------------------------*/
+/* xio_numa_node_cpus - allowed cpus on a node, all of them for node -1	     */
+/*---------------------------------------------------------------------------*/
+int xio_numa_node_cpus(int node, int *cpus, int cpus_nr);
+
 #endif /* XIO_USR_UTILS_H */
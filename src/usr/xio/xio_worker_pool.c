@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2013 Mellanox Technologies®. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two licenses.
+ * You may choose to be licensed under the terms of the GNU General Public
+ * License (GPL) Version 2, available from the file COPYING in the main
+ * directory of this source tree, or the Mellanox Technologies® BSD license
+ * below:
+ *
+ *      - Redistribution and use in source and binary forms, with or without
+ *        modification, are permitted provided that the following conditions
+ *        are met:
+ *
+ *      - Redistributions of source code must retain the above copyright
+ *        notice, this list of conditions and the following disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ *      - Neither the name of the Mellanox Technologies® nor the names of its
+ *        contributors may be used to endorse or promote products derived from
+ *        this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/hashtable.h>
+#include <xio_os.h>
+#include "libxio.h"
+#include "xio_log.h"
+#include "xio_common.h"
+#include "xio_observer.h"
+#include "xio_hash.h"
+#include "xio_transport.h"
+#include "xio_protocol.h"
+#include "xio_mbuf.h"
+#include "xio_task.h"
+#include "xio_idr.h"
+#include "xio_msg_list.h"
+#include "xio_ev_data.h"
+#include "xio_workqueue.h"
+#include "xio_context.h"
+#include "xio_session.h"
+#include "xio_nexus.h"
+#include "xio_sn_hash.h"
+#include "xio_connection.h"
+#include "xio_server.h"
+
+#define XIO_WORKER_POOL_QUEUE_DEPTH	256
+
+/*---------------------------------------------------------------------------*/
+/* structures								     */
+/*---------------------------------------------------------------------------*/
+struct xio_worker_item {
+	struct xio_connection		*connection;
+	struct xio_msg			*msg;
+	int				last_in_rxq;
+	int				pad;
+};
+
+struct xio_worker {
+	struct xio_worker_pool		*pool;
+	struct xio_worker_item		*items;
+	pthread_t			thread;
+	spinlock_t			lock;
+	int				id;
+	volatile uint32_t		head;
+	volatile uint32_t		tail;
+	volatile int32_t		sleeping;
+	int				pad;
+	pthread_mutex_t			mutex;
+	pthread_cond_t			cond;
+};
+
+struct xio_worker_pool {
+	struct xio_dispatcher		dispatcher;	/* must be first */
+	struct xio_worker		*workers;
+	int				threads_nr;
+	int				queue_depth;
+	int				ordered;
+	volatile int32_t		inflight;
+	volatile int32_t		stop;
+	volatile uint32_t		next;
+};
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_push							     */
+/*---------------------------------------------------------------------------*/
+static void xio_worker_push(struct xio_worker *worker,
+			    struct xio_worker_item *item)
+{
+	struct xio_worker_pool *pool = worker->pool;
+
+	/* never full: the pool admits at most queue_depth requests */
+	spin_lock(&worker->lock);
+	worker->items[worker->tail % pool->queue_depth] = *item;
+	worker->tail++;
+	spin_unlock(&worker->lock);
+
+	/* pairs with the barrier in xio_worker_wait: either the worker
+	 * sees the item or we see it sleeping
+	 */
+	xio_sync_synchronize();
+	if (worker->sleeping) {
+		pthread_mutex_lock(&worker->mutex);
+		pthread_cond_signal(&worker->cond);
+		pthread_mutex_unlock(&worker->mutex);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pop							     */
+/*---------------------------------------------------------------------------*/
+static int xio_worker_pop(struct xio_worker *worker,
+			  struct xio_worker_item *item)
+{
+	struct xio_worker_pool	*pool = worker->pool;
+	int			found = 0;
+
+	if (worker->head == worker->tail)
+		return 0;
+
+	spin_lock(&worker->lock);
+	if (worker->head != worker->tail) {
+		*item = worker->items[worker->head % pool->queue_depth];
+		worker->head++;
+		found = 1;
+	}
+	spin_unlock(&worker->lock);
+
+	return found;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_steal							     */
+/*---------------------------------------------------------------------------*/
+static int xio_worker_steal(struct xio_worker *worker,
+			    struct xio_worker_item *item)
+{
+	struct xio_worker_pool	*pool = worker->pool;
+	int			i;
+
+	for (i = 1; i < pool->threads_nr; i++) {
+		if (xio_worker_pop(&pool->workers[(worker->id + i) %
+						  pool->threads_nr], item))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_wait							     */
+/*---------------------------------------------------------------------------*/
+static void xio_worker_wait(struct xio_worker *worker)
+{
+	struct xio_worker_pool *pool = worker->pool;
+
+	pthread_mutex_lock(&worker->mutex);
+	worker->sleeping = 1;
+	xio_sync_synchronize();
+	while (worker->head == worker->tail && !pool->stop)
+		pthread_cond_wait(&worker->cond, &worker->mutex);
+	worker->sleeping = 0;
+	pthread_mutex_unlock(&worker->mutex);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_run							     */
+/*---------------------------------------------------------------------------*/
+static void xio_worker_run(struct xio_worker_pool *pool,
+			   struct xio_worker_item *item)
+{
+	struct xio_connection *connection = item->connection;
+
+	connection->ses_ops.on_msg(connection->session, item->msg,
+				   item->last_in_rxq,
+				   connection->cb_user_context);
+
+	/* the connection's context drops the reference taken at dispatch,
+	 * after the response posted by the handler, if any
+	 */
+	while (xio_connection_post(connection, XIO_POST_DISPATCH_DONE,
+				   item->msg)) {
+		sched_yield();
+		if (xio_errno() != EBUSY)
+			continue;
+		/* queued but the context was not woken up - ring again,
+		 * posting twice would drop the reference twice
+		 */
+		while (xio_connection_post_wake(connection))
+			sched_yield();
+		break;
+	}
+
+	xio_sync_fetch_and_add32(&pool->inflight, -1);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_thread							     */
+/*---------------------------------------------------------------------------*/
+static void *xio_worker_thread(void *data)
+{
+	struct xio_worker	*worker = (struct xio_worker *)data;
+	struct xio_worker_pool	*pool = worker->pool;
+	struct xio_worker_item	item;
+
+	while (1) {
+		if (xio_worker_pop(worker, &item) ||
+		    (!pool->ordered && xio_worker_steal(worker, &item))) {
+			xio_worker_run(pool, &item);
+			continue;
+		}
+		if (pool->stop)
+			break;
+		/* an idle worker only sleeps on its own queue, stealing
+		 * resumes on the next wakeup
+		 */
+		xio_worker_wait(worker);
+	}
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pool_admit						     */
+/*---------------------------------------------------------------------------*/
+static inline int xio_worker_pool_admit(struct xio_worker_pool *pool)
+{
+	int32_t inflight;
+
+	/* servers on several contexts may share the pool */
+	do {
+		inflight = pool->inflight;
+		if (inflight >= pool->queue_depth)
+			return 0;
+	} while (!xio_sync_bool_compare_and_swap(&pool->inflight,
+						 inflight, inflight + 1));
+
+	return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pool_queue - hand an admitted request to its worker	     */
+/*---------------------------------------------------------------------------*/
+static void xio_worker_pool_queue(struct xio_worker_pool *pool,
+				  struct xio_connection *connection,
+				  struct xio_msg *msg, int last_in_rxq)
+{
+	struct xio_worker	*worker;
+	struct xio_worker_item	item;
+
+	if (pool->ordered)
+		worker = &pool->workers[((uintptr_t)connection >> 6) %
+					pool->threads_nr];
+	else
+		worker = &pool->workers[
+			xio_sync_fetch_and_add32(&pool->next, 1) %
+			pool->threads_nr];
+
+	kref_get(&connection->kref);
+	connection->dispatched++;
+
+	item.connection  = connection;
+	item.msg	 = msg;
+	item.last_in_rxq = last_in_rxq;
+	item.pad	 = 0;
+	xio_worker_push(worker, &item);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pool_dispatch						     */
+/*---------------------------------------------------------------------------*/
+static int xio_worker_pool_dispatch(struct xio_dispatcher *dispatcher,
+				    struct xio_connection *connection,
+				    struct xio_msg *msg, int last_in_rxq)
+{
+	struct xio_worker_pool	*pool = (struct xio_worker_pool *)dispatcher;
+
+	/* the context's loop never waits for the pool. an ordered request
+	 * that finds it full waits on the connection behind the requests
+	 * the connection has on the pool - the completion of one of those
+	 * resumes it, see xio_worker_pool_done. with none there it runs
+	 * inline, which keeps the order as well. unordered handlers simply
+	 * run inline.
+	 */
+	if (!xio_msg_list_empty(&connection->dispatch_backlog) ||
+	    !xio_worker_pool_admit(pool)) {
+		if (!pool->ordered || !connection->dispatched)
+			return -1;
+		xio_msg_list_insert_tail(&connection->dispatch_backlog, msg,
+					 pdata);
+		return 0;
+	}
+	xio_worker_pool_queue(pool, connection, msg, last_in_rxq);
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pool_done - a request of the connection left the pool	     */
+/*---------------------------------------------------------------------------*/
+static void xio_worker_pool_done(struct xio_dispatcher *dispatcher,
+				 struct xio_connection *connection)
+{
+	struct xio_worker_pool	*pool = (struct xio_worker_pool *)dispatcher;
+	struct xio_msg		*msg;
+
+	connection->dispatched--;
+
+	/* the batch the waiting requests arrived in is long over */
+	while (!xio_msg_list_empty(&connection->dispatch_backlog)) {
+		msg = xio_msg_list_first(&connection->dispatch_backlog);
+		if (xio_worker_pool_admit(pool)) {
+			xio_msg_list_remove(&connection->dispatch_backlog,
+					    msg, pdata);
+			xio_worker_pool_queue(pool, connection, msg, 1);
+			continue;
+		}
+		if (connection->dispatched)
+			break;
+		xio_msg_list_remove(&connection->dispatch_backlog, msg, pdata);
+		msg->flags &= ~XIO_MSG_FLAG_EX_DISPATCHED;
+		connection->ses_ops.on_msg(connection->session, msg, 1,
+					   connection->cb_user_context);
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pool_stop							     */
+/*---------------------------------------------------------------------------*/
+static void xio_worker_pool_stop(struct xio_worker_pool *pool, int nr)
+{
+	struct xio_worker	*worker;
+	int			i;
+
+	pool->stop = 1;
+	xio_sync_synchronize();
+	for (i = 0; i < nr; i++) {
+		worker = &pool->workers[i];
+		pthread_mutex_lock(&worker->mutex);
+		pthread_cond_signal(&worker->cond);
+		pthread_mutex_unlock(&worker->mutex);
+	}
+	for (i = 0; i < nr; i++) {
+		worker = &pool->workers[i];
+		pthread_join(worker->thread, NULL);
+		pthread_cond_destroy(&worker->cond);
+		pthread_mutex_destroy(&worker->mutex);
+		ufree(worker->items);
+	}
+	ufree(pool->workers);
+	ufree(pool);
+}
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pool_create						     */
+/*---------------------------------------------------------------------------*/
+struct xio_worker_pool *xio_worker_pool_create(
+		struct xio_worker_pool_attr *attr)
+{
+	struct xio_worker_pool	*pool;
+	struct xio_worker	*worker;
+	int			i;
+
+	/* every admitted request may post a response and a completion on
+	 * the same connection, both must fit its post ring
+	 */
+	if (!attr || attr->threads_nr <= 0 || attr->queue_depth < 0 ||
+	    attr->queue_depth > XIO_POST_QUEUE_DEPTH / 2) {
+		xio_set_error(EINVAL);
+		ERROR_LOG("invalid worker pool attributes\n");
+		return NULL;
+	}
+
+	pool = (struct xio_worker_pool *)ucalloc(1, sizeof(*pool));
+	if (!pool) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("worker pool allocation failed\n");
+		return NULL;
+	}
+	pool->dispatcher.dispatch = xio_worker_pool_dispatch;
+	pool->dispatcher.done	  = xio_worker_pool_done;
+	pool->threads_nr	= attr->threads_nr;
+	pool->queue_depth	= attr->queue_depth ? attr->queue_depth :
+				  XIO_WORKER_POOL_QUEUE_DEPTH;
+	pool->ordered		= attr->ordered;
+
+	pool->workers = (struct xio_worker *)ucalloc(pool->threads_nr,
+						     sizeof(*pool->workers));
+	if (!pool->workers) {
+		xio_set_error(ENOMEM);
+		ERROR_LOG("worker pool allocation failed\n");
+		ufree(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < pool->threads_nr; i++) {
+		worker = &pool->workers[i];
+		worker->pool = pool;
+		worker->id = i;
+		spin_lock_init(&worker->lock);
+		pthread_mutex_init(&worker->mutex, NULL);
+		pthread_cond_init(&worker->cond, NULL);
+		worker->items = (struct xio_worker_item *)
+			ucalloc(pool->queue_depth, sizeof(*worker->items));
+		if (!worker->items) {
+			xio_set_error(ENOMEM);
+			ERROR_LOG("worker queue allocation failed\n");
+			goto cleanup;
+		}
+		if (pthread_create(&worker->thread, NULL,
+				   xio_worker_thread, worker)) {
+			xio_set_error(errno);
+			ERROR_LOG("pthread_create failed. %m\n");
+			ufree(worker->items);
+			goto cleanup;
+		}
+	}
+
+	return pool;
+
+cleanup:
+	pthread_cond_destroy(&worker->cond);
+	pthread_mutex_destroy(&worker->mutex);
+	xio_worker_pool_stop(pool, i);
+
+	return NULL;
+}
+EXPORT_SYMBOL(xio_worker_pool_create);
+
+/*---------------------------------------------------------------------------*/
+/* xio_worker_pool_destroy						     */
+/*---------------------------------------------------------------------------*/
+int xio_worker_pool_destroy(struct xio_worker_pool *pool)
+{
+	if (!pool) {
+		xio_set_error(EINVAL);
+		return -1;
+	}
+	if (pool->inflight) {
+		xio_set_error(EBUSY);
+		ERROR_LOG("worker pool has %d requests in flight\n",
+			  pool->inflight);
+		return -1;
+	}
+	xio_worker_pool_stop(pool, pool->threads_nr);
+
+	return 0;
+}
+EXPORT_SYMBOL(xio_worker_pool_destroy);
+
+/*---------------------------------------------------------------------------*/
+/* xio_bind_worker_pool							     */
+/*---------------------------------------------------------------------------*/
+int xio_bind_worker_pool(struct xio_server *server,
+			 struct xio_worker_pool *pool)
+{
+	if (!server) {
+		xio_set_error(EINVAL);
+		return -1;
+	}
+	server->dispatcher = pool ? &pool->dispatcher : NULL;
+
+	return 0;
+}
+EXPORT_SYMBOL(xio_bind_worker_pool);
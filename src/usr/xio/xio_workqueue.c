@@ -42,6 +42,7 @@
 #include "xio_observer.h"
 #include "xio_ev_data.h"
 #include "xio_workqueue.h"
+#include "xio_ev_loop.h"
 #include "xio_timers_list.h"
 #include "xio_context.h"
 
@@ -248,7 +249,9 @@ struct xio_workqueue *xio_workqueue_create(struct xio_context *ctx)
 		return NULL;
 	}
 
-	xio_timers_list_init(&work_queue->timers_list);
+	xio_timers_list_init(&work_queue->timers_list,
+			     ctx->ev_loop ? xio_ev_loop_clock(ctx->ev_loop) :
+					    NULL);
 	work_queue->ctx = ctx;
 
 	work_queue->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
@@ -428,6 +431,8 @@ int xio_workqueue_add_work(struct xio_workqueue *work_queue,
 
 	s = write(work_queue->pipe_fd[1], &exp, sizeof(exp));
 	if (s < 0) {
+		/* not queued - let the caller add it again */
+		work->flags &= ~XIO_WORK_PENDING;
 		ERROR_LOG("failed to write to pipe, %m\n");
 		return -1;
 	}